@@ -47,6 +47,7 @@
 #include <stdio.h>
 
 #include "anet.h"
+#include "config.h"
 
 static void anetSetError(char *err, const char *fmt, ...)
 {
@@ -69,6 +70,10 @@ int anetSetBlock(char *err, int fd, int non_block) {
         return ANET_ERR;
     }
 
+    /* Don't call fcntl() again if the socket is already in the requested
+     * mode, like sockets returned by anetTcpAccept() with accept4(). */
+    if (!!(flags & O_NONBLOCK) == !!non_block) return ANET_OK;
+
     if (non_block)
         flags |= O_NONBLOCK;
     else
@@ -179,6 +184,25 @@ int anetTcpKeepAlive(char *err, int fd)
     return ANET_OK;
 }
 
+/* Set the number of microseconds to busy poll the device queue on blocking
+ * reads and on readiness polling (SO_BUSY_POLL socket option), trading CPU
+ * for lower latency. Only available on Linux. */
+int anetBusyPoll(char *err, int fd, int usec)
+{
+#ifdef SO_BUSY_POLL
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1) {
+        anetSetError(err, "setsockopt SO_BUSY_POLL: %s", strerror(errno));
+        return ANET_ERR;
+    }
+    return ANET_OK;
+#else
+    ((void) fd);
+    ((void) usec);
+    anetSetError(err, "SO_BUSY_POLL is not supported on this system");
+    return ANET_ERR;
+#endif
+}
+
 /* Set the socket send timeout (SO_SNDTIMEO socket option) to the specified
  * number of milliseconds, or disable it if the 'ms' argument is zero. */
 int anetSendTimeout(char *err, int fd, long long ms) {
@@ -526,10 +550,17 @@ int anetUnixServer(char *err, char *path, mode_t perm, int backlog)
     return s;
 }
 
+/* Accept a connection on the listening socket 's'. Where accept4() is
+ * available the new socket is returned already in non blocking mode, saving
+ * the fcntl() calls that would follow for every client. */
 static int anetGenericAccept(char *err, int s, struct sockaddr *sa, socklen_t *len) {
     int fd;
     while(1) {
+#ifdef HAVE_ACCEPT4
+        fd = accept4(s,sa,len,SOCK_NONBLOCK|SOCK_CLOEXEC);
+#else
         fd = accept(s,sa,len);
+#endif
         if (fd == -1) {
             if (errno == EINTR)
                 continue;
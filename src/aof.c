@@ -588,9 +588,13 @@ struct client *createFakeClient(void) {
     c->fd = -1;
     c->name = NULL;
     c->querybuf = sdsempty();
+    c->qb_pos = 0;
     c->querybuf_peak = 0;
+    c->resp = 2;
     c->argc = 0;
     c->argv = NULL;
+    c->argv_len = 0;
+    c->argv_len_sum = 0;
     c->bufpos = 0;
     c->flags = 0;
     c->btype = BLOCKED_NONE;
@@ -602,7 +606,12 @@ struct client *createFakeClient(void) {
     c->obuf_soft_limit_reached_time = 0;
     c->watched_keys = listCreate();
     c->peerid = NULL;
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    c->client_tracking_redirection = 0;
+    c->client_tracking_prefixes = NULL;
+    c->last_memory_usage = 0;
+    c->mem_usage_bucket = NULL;
+    c->mem_usage_bucket_node = NULL;
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     initClientMultiState(c);
     return c;
@@ -785,6 +794,20 @@ fmterr: /* Format error. */
  * AOF rewrite
  * ------------------------------------------------------------------------- */
 
+/* Write a chunked string as a bulk string, a chunk at a time. */
+static int rioWriteBulkChunkedString(rio *r, chunkedString *cs) {
+    size_t j;
+
+    if (rioWriteBulkCount(r,'$',cs->len) == 0) return 0;
+    for (j = 0; j < cs->numchunks; j++) {
+        robj *chunk = cs->chunks[j];
+
+        if (rioWrite(r,chunk->ptr,sdslen(chunk->ptr)) == 0) return 0;
+    }
+    if (rioWrite(r,"\r\n",2) == 0) return 0;
+    return 1;
+}
+
 /* Delegate writing an object to writing a bulk string or bulk long long.
  * This is not placed in rio.c since that adds the server.h dependency. */
 int rioWriteBulkObject(rio *r, robj *obj) {
@@ -794,6 +817,8 @@ int rioWriteBulkObject(rio *r, robj *obj) {
         return rioWriteBulkLongLong(r,(long)obj->ptr);
     } else if (sdsEncodedObject(obj)) {
         return rioWriteBulkString(r,obj->ptr,sdslen(obj->ptr));
+    } else if (obj->encoding == OBJ_ENCODING_CHUNKED) {
+        return rioWriteBulkChunkedString(r,obj->ptr);
     } else {
         serverPanic("Unknown string encoding");
     }
@@ -1007,6 +1032,31 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
     return 1;
 }
 
+/* Emit an HPEXPIREAT command for every field of a hash with a TTL.
+ * The function returns 0 on error, 1 on success. */
+int rewriteHashFieldExpires(rio *r, robj *key, hashFieldExpires *hfe) {
+    dictIterator *di = dictGetIterator(hfe->fields);
+    dictEntry *de;
+
+    while((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+        char cmd[]="*6\r\n$10\r\nHPEXPIREAT\r\n";
+
+        if (rioWrite(r,cmd,sizeof(cmd)-1) == 0 ||
+            rioWriteBulkObject(r,key) == 0 ||
+            rioWriteBulkLongLong(r,dictGetSignedIntegerVal(de)) == 0 ||
+            rioWriteBulkString(r,"FIELDS",6) == 0 ||
+            rioWriteBulkLongLong(r,1) == 0 ||
+            rioWriteBulkString(r,field,sdslen(field)) == 0)
+        {
+            dictReleaseIterator(di);
+            return 0;
+        }
+    }
+    dictReleaseIterator(di);
+    return 1;
+}
+
 /* This function is called by the child rewriting the AOF file to read
  * the difference accumulated from the parent into a buffer, that is
  * concatenated at the end of the rewrite. */
@@ -1084,13 +1134,21 @@ int rewriteAppendOnlyFile(char *filename) {
             if (expiretime != -1 && expiretime < now) continue;
 
             /* Save the key and associated value */
-            if (o->type == OBJ_STRING) {
+            if (objectIsPacked(o) || o->type == OBJ_STRING) {
                 /* Emit a SET command */
                 char cmd[]="*3\r\n$3\r\nSET\r\n";
-                if (rioWrite(&aof,cmd,sizeof(cmd)-1) == 0) goto werr;
-                /* Key and value */
-                if (rioWriteBulkObject(&aof,&key) == 0) goto werr;
-                if (rioWriteBulkObject(&aof,o) == 0) goto werr;
+                robj *val = objectIsPacked(o) ? unpackObject(o) : o;
+                int retval;
+
+                if (rioWrite(&aof,cmd,sizeof(cmd)-1) == 0 ||
+                    rioWriteBulkObject(&aof,&key) == 0)
+                {
+                    retval = 0;
+                } else {
+                    retval = rioWriteBulkObject(&aof,val);
+                }
+                if (val != o) decrRefCount(val);
+                if (retval == 0) goto werr;
             } else if (o->type == OBJ_LIST) {
                 if (rewriteListObject(&aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_SET) {
@@ -1098,7 +1156,11 @@ int rewriteAppendOnlyFile(char *filename) {
             } else if (o->type == OBJ_ZSET) {
                 if (rewriteSortedSetObject(&aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_HASH) {
+                hashFieldExpires *hfe;
+
                 if (rewriteHashObject(&aof,&key,o) == 0) goto werr;
+                if ((hfe = hashGetFieldExpires(db,&key)) != NULL &&
+                    rewriteHashFieldExpires(&aof,&key,hfe) == 0) goto werr;
             } else {
                 serverPanic("Unknown object type");
             }
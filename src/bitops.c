@@ -470,15 +470,27 @@ int getBitfieldTypeFromArgument(client *c, robj *o, int *sign, int *bits) {
  * an error is sent to the client. */
 robj *lookupStringForBitCommand(client *c, size_t maxbit) {
     size_t byte = maxbit >> 3;
-    robj *o = lookupKeyWrite(c->db,c->argv[1]);
+    robj *o = lookupKeyWriteWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED);
 
     if (o == NULL) {
-        o = createObject(OBJ_STRING,sdsnewlen(NULL, byte+1));
+        if (stringNeedsChunking(byte+1)) {
+            o = createChunkedStringObject(NULL,0);
+            chunkedStringGrowZero(o->ptr,byte+1);
+        } else {
+            o = createObject(OBJ_STRING,sdsnewlen(NULL, byte+1));
+        }
         dbAdd(c->db,c->argv[1],o);
     } else {
         if (checkType(c,o,OBJ_STRING)) return NULL;
-        o = dbUnshareStringValue(c->db,c->argv[1],o);
-        o->ptr = sdsgrowzero(o->ptr,byte+1);
+        if (o->encoding == OBJ_ENCODING_CHUNKED ||
+            (byte >= stringObjectLen(o) && stringNeedsChunking(byte+1)))
+        {
+            o = dbChunkStringValue(c->db,c->argv[1],o);
+            chunkedStringGrowZero(o->ptr,byte+1);
+        } else {
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
+            o->ptr = sdsgrowzero(o->ptr,byte+1);
+        }
     }
     return o;
 }
@@ -539,14 +551,27 @@ void setbitCommand(client *c) {
 
     /* Get current values */
     byte = bitoffset >> 3;
-    byteval = ((uint8_t*)o->ptr)[byte];
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        uint8_t b;
+
+        chunkedStringRead(o->ptr,byte,&b,1);
+        byteval = b;
+    } else {
+        byteval = ((uint8_t*)o->ptr)[byte];
+    }
     bit = 7 - (bitoffset & 0x7);
     bitval = byteval & (1 << bit);
 
     /* Update byte with new bit value and return original value */
     byteval &= ~(1 << bit);
     byteval |= ((on & 0x1) << bit);
-    ((uint8_t*)o->ptr)[byte] = byteval;
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        uint8_t b = byteval;
+
+        chunkedStringWrite(o->ptr,byte,&b,1);
+    } else {
+        ((uint8_t*)o->ptr)[byte] = byteval;
+    }
     signalModifiedKey(c->db,c->argv[1]);
     notifyKeyspaceEvent(NOTIFY_STRING,"setbit",c->argv[1],c->db->id);
     server.dirty++;
@@ -564,12 +589,20 @@ void getbitCommand(client *c) {
     if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset,0,0) != C_OK)
         return;
 
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
-        checkType(c,o,OBJ_STRING)) return;
+    if ((o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED)) == NULL) {
+        addReply(c,shared.czero);
+        return;
+    }
+    if (checkType(c,o,OBJ_STRING)) return;
 
     byte = bitoffset >> 3;
     bit = 7 - (bitoffset & 0x7);
-    if (sdsEncodedObject(o)) {
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        uint8_t b;
+
+        if (chunkedStringRead(o->ptr,byte,&b,1))
+            bitval = b & (1 << bit);
+    } else if (sdsEncodedObject(o)) {
         if (byte < sdslen(o->ptr))
             bitval = ((uint8_t*)o->ptr)[byte] & (1 << bit);
     } else {
@@ -982,7 +1015,7 @@ void bitfieldCommand(client *c) {
     if (readonly) {
         /* Lookup for read is ok if key doesn't exit, but errors
          * if it's not a string. */
-        o = lookupKeyRead(c->db,c->argv[1]);
+        o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED);
         if (o != NULL && checkType(c,o,OBJ_STRING)) return;
     } else {
         /* Lookup by making room up to the farest bit reached by
@@ -1001,10 +1034,24 @@ void bitfieldCommand(client *c) {
         if (thisop->opcode == BITFIELDOP_SET ||
             thisop->opcode == BITFIELDOP_INCRBY)
         {
+            unsigned char buf[9], *p = o->ptr;
+            uint64_t offset = thisop->offset;
+            size_t byte = 0, buflen = 0;
+
             /* SET and INCRBY: We handle both with the same code path
              * for simplicity. SET return value is the previous value so
              * we need fetch & store as well. */
 
+            /* Chunked strings: like GET does below, operate on a copy of
+             * the bytes holding the field, then store them back. */
+            if (o->encoding == OBJ_ENCODING_CHUNKED) {
+                byte = thisop->offset >> 3;
+                memset(buf,0,sizeof(buf));
+                buflen = chunkedStringRead(o->ptr,byte,buf,sizeof(buf));
+                p = buf;
+                offset -= byte*8;
+            }
+
             /* We need two different but very similar code paths for signed
              * and unsigned operations, since the set of functions to get/set
              * the integers and the used variables types are different. */
@@ -1012,8 +1059,7 @@ void bitfieldCommand(client *c) {
                 int64_t oldval, newval, wrapped, retval;
                 int overflow;
 
-                oldval = getSignedBitfield(o->ptr,thisop->offset,
-                        thisop->bits);
+                oldval = getSignedBitfield(p,offset,thisop->bits);
 
                 if (thisop->opcode == BITFIELDOP_INCRBY) {
                     newval = oldval + thisop->i64;
@@ -1033,17 +1079,15 @@ void bitfieldCommand(client *c) {
                  * NULL to signal the condition. */
                 if (!(overflow && thisop->owtype == BFOVERFLOW_FAIL)) {
                     addReplyLongLong(c,retval);
-                    setSignedBitfield(o->ptr,thisop->offset,
-                                      thisop->bits,newval);
+                    setSignedBitfield(p,offset,thisop->bits,newval);
                 } else {
-                    addReply(c,shared.nullbulk);
+                    addReply(c,shared.null[c->resp]);
                 }
             } else {
                 uint64_t oldval, newval, wrapped, retval;
                 int overflow;
 
-                oldval = getUnsignedBitfield(o->ptr,thisop->offset,
-                        thisop->bits);
+                oldval = getUnsignedBitfield(p,offset,thisop->bits);
 
                 if (thisop->opcode == BITFIELDOP_INCRBY) {
                     newval = oldval + thisop->i64;
@@ -1062,12 +1106,12 @@ void bitfieldCommand(client *c) {
                  * NULL to signal the condition. */
                 if (!(overflow && thisop->owtype == BFOVERFLOW_FAIL)) {
                     addReplyLongLong(c,retval);
-                    setUnsignedBitfield(o->ptr,thisop->offset,
-                                        thisop->bits,newval);
+                    setUnsignedBitfield(p,offset,thisop->bits,newval);
                 } else {
-                    addReply(c,shared.nullbulk);
+                    addReply(c,shared.null[c->resp]);
                 }
             }
+            if (p == buf) chunkedStringWrite(o->ptr,byte,buf,buflen);
             changes++;
         } else {
             /* GET */
@@ -1076,7 +1120,7 @@ void bitfieldCommand(client *c) {
             unsigned char *src = NULL;
             char llbuf[LONG_STR_SIZE];
 
-            if (o != NULL)
+            if (o != NULL && o->encoding != OBJ_ENCODING_CHUNKED)
                 src = getObjectReadOnlyString(o,&strlen,llbuf);
 
             /* For GET we use a trick: before executing the operation
@@ -1086,6 +1130,8 @@ void bitfieldCommand(client *c) {
             memset(buf,0,9);
             int i;
             size_t byte = thisop->offset >> 3;
+            if (o != NULL && o->encoding == OBJ_ENCODING_CHUNKED)
+                chunkedStringRead(o->ptr,byte,buf,9);
             for (i = 0; i < 9; i++) {
                 if (src == NULL || i+byte >= (size_t)strlen) break;
                 buf[i] = src[i+byte];
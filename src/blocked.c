@@ -156,7 +156,7 @@ void unblockClient(client *c) {
  * send it a reply of some kind. */
 void replyToBlockedClientTimedOut(client *c) {
     if (c->btype == BLOCKED_LIST) {
-        addReply(c,shared.nullmultibulk);
+        addReply(c,shared.nullarray[c->resp]);
     } else if (c->btype == BLOCKED_WAIT) {
         addReplyLongLong(c,replicationCountAcksByOffset(c->bpop.reploffset));
     } else {
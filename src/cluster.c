@@ -4398,14 +4398,18 @@ void clusterCommand(client *c) {
  * -------------------------------------------------------------------------- */
 
 /* Generates a DUMP-format representation of the object 'o', adding it to the
- * io stream pointed by 'rio'. This function can't fail. */
-void createDumpPayload(rio *payload, robj *o) {
+ * io stream pointed by 'rio'. If 'hfe' is not NULL the expire times of the
+ * fields of the hash are serialized as well. This function can't fail. */
+void createDumpPayload(rio *payload, robj *o, hashFieldExpires *hfe) {
     unsigned char buf[2];
+    int rdbver = hfe ? RDB_VERSION : RDB_VERSION_NO_FIELD_EXPIRES;
     uint64_t crc;
 
     /* Serialize the object in a RDB-like format. It consist of an object type
-     * byte followed by the serialized object. This is understood by RESTORE. */
+     * byte followed by the serialized object, optionally preceded by the
+     * HASH_FIELD_EXPIRES opcode. This is understood by RESTORE. */
     rioInitWithBuffer(payload,sdsempty());
+    if (hfe) serverAssert(rdbSaveHashFieldExpires(payload,hfe));
     serverAssert(rdbSaveObjectType(payload,o));
     serverAssert(rdbSaveObject(payload,o));
 
@@ -4417,8 +4421,8 @@ void createDumpPayload(rio *payload, robj *o) {
      */
 
     /* RDB version */
-    buf[0] = RDB_VERSION & 0xff;
-    buf[1] = (RDB_VERSION >> 8) & 0xff;
+    buf[0] = rdbver & 0xff;
+    buf[1] = (rdbver >> 8) & 0xff;
     payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,buf,2);
 
     /* CRC64 */
@@ -4460,12 +4464,13 @@ void dumpCommand(client *c) {
 
     /* Check if the key is here. */
     if ((o = lookupKeyRead(c->db,c->argv[1])) == NULL) {
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
         return;
     }
 
     /* Create the DUMP encoded representation. */
-    createDumpPayload(&payload,o);
+    createDumpPayload(&payload,o,o->type == OBJ_HASH ?
+                      hashGetFieldExpires(c->db,c->argv[1]) : NULL);
 
     /* Transfer to the client */
     dumpobj = createObject(OBJ_STRING,payload.io.buffer.ptr);
@@ -4480,6 +4485,7 @@ void restoreCommand(client *c) {
     rio payload;
     int j, type, replace = 0;
     robj *obj;
+    dict *fieldexpires = NULL;
 
     /* Parse additional options */
     for (j = 4; j < c->argc; j++) {
@@ -4513,9 +4519,17 @@ void restoreCommand(client *c) {
     }
 
     rioInitWithBuffer(&payload,c->argv[3]->ptr);
-    if (((type = rdbLoadObjectType(&payload)) == -1) ||
+    if ((type = rdbLoadType(&payload)) == RDB_OPCODE_HASH_FIELD_EXPIRES) {
+        fieldexpires = dictCreate(&hashFieldTimesDictType,NULL);
+        if (rdbLoadHashFieldExpires(&payload,fieldexpires) == -1)
+            type = -1;
+        else
+            type = rdbLoadType(&payload);
+    }
+    if (type == -1 || !rdbIsObjectType(type) ||
         ((obj = rdbLoadObject(type,&payload)) == NULL))
     {
+        if (fieldexpires) dictRelease(fieldexpires);
         addReplyError(c,"Bad data format");
         return;
     }
@@ -4526,6 +4540,10 @@ void restoreCommand(client *c) {
     /* Create the key and set the TTL if any */
     dbAdd(c->db,c->argv[1],obj);
     if (ttl) setExpire(c->db,c->argv[1],mstime()+ttl);
+    if (fieldexpires) {
+        hashAddFieldExpires(c->db,c->argv[1],obj,fieldexpires);
+        dictRelease(fieldexpires);
+    }
     signalModifiedKey(c->db,c->argv[1]);
     addReply(c,shared.ok);
     server.dirty++;
@@ -4768,7 +4786,8 @@ try_again:
 
         /* Emit the payload argument, that is the serialized object using
          * the DUMP format. */
-        createDumpPayload(&payload,ov[j]);
+        createDumpPayload(&payload,ov[j],ov[j]->type == OBJ_HASH ?
+                          hashGetFieldExpires(c->db,kv[j]) : NULL);
         serverAssertWithInfo(c,NULL,
             rioWriteBulkString(&cmd,payload.io.buffer.ptr,
                                sdslen(payload.io.buffer.ptr)));
@@ -196,6 +196,11 @@ void loadServerConfigFromString(char *config) {
             if (server.tcpkeepalive < 0) {
                 err = "Invalid tcp-keepalive value"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"busy-poll-usec") && argc == 2) {
+            server.busy_poll_usec = atoi(argv[1]);
+            if (server.busy_poll_usec < 0) {
+                err = "Invalid busy-poll-usec value"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"protected-mode") && argc == 2) {
             if ((server.protected_mode = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -205,6 +210,11 @@ void loadServerConfigFromString(char *config) {
             if (server.port < 0 || server.port > 65535) {
                 err = "Invalid port"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"metrics-port") && argc == 2) {
+            server.metrics_port = atoi(argv[1]);
+            if (server.metrics_port < 0 || server.metrics_port > 65535) {
+                err = "Invalid port"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"tcp-backlog") && argc == 2) {
             server.tcp_backlog = atoi(argv[1]);
             if (server.tcp_backlog < 0) {
@@ -295,6 +305,8 @@ void loadServerConfigFromString(char *config) {
             }
         } else if (!strcasecmp(argv[0],"maxmemory") && argc == 2) {
             server.maxmemory = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"maxmemory-clients") && argc == 2) {
+            server.maxmemory_clients = memtoll(argv[1],NULL);
         } else if (!strcasecmp(argv[0],"maxmemory-policy") && argc == 2) {
             server.maxmemory_policy =
                 configEnumGetValue(maxmemory_policy_enum,argv[1]);
@@ -308,6 +320,10 @@ void loadServerConfigFromString(char *config) {
                 err = "maxmemory-samples must be 1 or greater";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"tracking-table-max-keys") &&
+                   argc == 2)
+        {
+            server.tracking_table_max_keys = strtoul(argv[1],NULL,10);
         } else if (!strcasecmp(argv[0],"slaveof") && argc == 3) {
             slaveof_linenum = linenum;
             server.masterhost = sdsnew(argv[1]);
@@ -371,6 +387,19 @@ void loadServerConfigFromString(char *config) {
             if ((server.rdb_checksum = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"active-rehashing-usec") &&
+                   argc == 2) {
+            server.active_rehashing_usec = strtoll(argv[1],NULL,10);
+            if (server.active_rehashing_usec <= 0) {
+                err = "active-rehashing-usec must be positive"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"hashtable-min-fill") && argc == 2) {
+            server.hashtable_min_fill = atoi(argv[1]);
+            if (server.hashtable_min_fill < 1 ||
+                server.hashtable_min_fill > HASHTABLE_MAX_MIN_FILL)
+            {
+                err = "Invalid hashtable-min-fill percentage"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"activerehashing") && argc == 2) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -459,6 +488,30 @@ void loadServerConfigFromString(char *config) {
             server.list_max_ziplist_size = atoi(argv[1]);
         } else if (!strcasecmp(argv[0],"list-compress-depth") && argc == 2) {
             server.list_compress_depth = atoi(argv[1]);
+        } else if (!strcasecmp(argv[0],"list-compress-cache-bytes") &&
+                   argc == 2) {
+            server.list_compress_cache_bytes = memtoll(argv[1],NULL);
+            quicklistSetCacheBytes(server.list_compress_cache_bytes);
+        } else if (!strcasecmp(argv[0],"string-chunk-threshold") &&
+                   argc == 2) {
+            server.string_chunk_threshold = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"string-intern-max-entries") &&
+                   argc == 2) {
+            server.string_intern_max_entries = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"string-intern-max-len") &&
+                   argc == 2) {
+            server.string_intern_max_len = memtoll(argv[1],NULL);
+            if (server.string_intern_max_len >
+                OBJ_ENCODING_EMBSTR_SIZE_LIMIT)
+            {
+                err = "string-intern-max-len can't be greater than 44";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"pack-values-idle") && argc == 2) {
+            server.pack_values_idle = atoi(argv[1]);
+            if (server.pack_values_idle < 0) {
+                err = "pack-values-idle can't be negative"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"set-max-intset-entries") && argc == 2) {
             server.set_max_intset_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-entries") && argc == 2) {
@@ -532,6 +585,10 @@ void loadServerConfigFromString(char *config) {
                    argc == 2)
         {
             server.slowlog_log_slower_than = strtoll(argv[1],NULL,10);
+        } else if (!strcasecmp(argv[0],"hotkeys-tracking") && argc == 2) {
+            if ((server.hotkeys_tracking = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"latency-monitor-threshold") &&
                    argc == 2)
         {
@@ -540,6 +597,16 @@ void loadServerConfigFromString(char *config) {
                 err = "The latency threshold can't be negative";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"loop-profiler") && argc == 2) {
+            if ((server.loop_profiler = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"loop-trace-threshold") && argc == 2) {
+            server.loop_trace_threshold = strtoll(argv[1],NULL,10);
+            if (server.loop_trace_threshold < 0) {
+                err = "The loop trace threshold can't be negative";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"slowlog-max-len") && argc == 2) {
             server.slowlog_max_len = strtoll(argv[1],NULL,10);
         } else if (!strcasecmp(argv[0],"client-output-buffer-limit") &&
@@ -893,6 +960,12 @@ void configSetCommand(client *c) {
       "slave-read-only",server.repl_slave_ro) {
     } config_set_bool_field(
       "activerehashing",server.activerehashing) {
+    } config_set_bool_field(
+      "hotkeys-tracking",server.hotkeys_tracking) {
+        if (server.hotkeys_tracking == 0) hotkeysReset();
+    } config_set_bool_field(
+      "loop-profiler",server.loop_profiler) {
+        if (server.loop_profiler) loopProfilerClearState();
     } config_set_bool_field(
       "protected-mode",server.protected_mode) {
     } config_set_bool_field(
@@ -904,8 +977,14 @@ void configSetCommand(client *c) {
      * config_set_numerical_field(name,var,min,max) */
     } config_set_numerical_field(
       "tcp-keepalive",server.tcpkeepalive,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "busy-poll-usec",server.busy_poll_usec,0,INT_MAX) {
     } config_set_numerical_field(
       "maxmemory-samples",server.maxmemory_samples,1,LLONG_MAX) {
+    } config_set_numerical_field(
+      "active-rehashing-usec",server.active_rehashing_usec,1,LLONG_MAX) {
+    } config_set_numerical_field(
+      "hashtable-min-fill",server.hashtable_min_fill,1,HASHTABLE_MAX_MIN_FILL) {
     } config_set_numerical_field(
       "timeout",server.maxidletime,0,LONG_MAX) {
     } config_set_numerical_field(
@@ -936,6 +1015,8 @@ void configSetCommand(client *c) {
         server.slowlog_max_len = (unsigned)ll;
     } config_set_numerical_field(
       "latency-monitor-threshold",server.latency_monitor_threshold,0,LLONG_MAX){
+    } config_set_numerical_field(
+      "loop-trace-threshold",server.loop_trace_threshold,0,LLONG_MAX){
     } config_set_numerical_field(
       "repl-ping-slave-period",server.repl_ping_slave_period,1,LLONG_MAX) {
     } config_set_numerical_field(
@@ -966,6 +1047,8 @@ void configSetCommand(client *c) {
          * but cap them to reasonable values. */
         if (server.hz < CONFIG_MIN_HZ) server.hz = CONFIG_MIN_HZ;
         if (server.hz > CONFIG_MAX_HZ) server.hz = CONFIG_MAX_HZ;
+    } config_set_numerical_field(
+      "tracking-table-max-keys",server.tracking_table_max_keys,0,LLONG_MAX) {
     } config_set_numerical_field(
       "watchdog-period",ll,0,LLONG_MAX) {
         if (ll)
@@ -982,6 +1065,20 @@ void configSetCommand(client *c) {
             }
             freeMemoryIfNeeded();
         }
+    } config_set_memory_field("maxmemory-clients",server.maxmemory_clients) {
+        evictClients();
+    } config_set_memory_field(
+      "list-compress-cache-bytes",server.list_compress_cache_bytes) {
+        quicklistSetCacheBytes(server.list_compress_cache_bytes);
+    } config_set_memory_field(
+      "string-chunk-threshold",server.string_chunk_threshold) {
+    } config_set_numerical_field(
+      "string-intern-max-entries",server.string_intern_max_entries,0,LLONG_MAX) {
+        if (server.string_intern_max_entries == 0) internTableEmpty();
+    } config_set_numerical_field(
+      "string-intern-max-len",server.string_intern_max_len,0,OBJ_ENCODING_EMBSTR_SIZE_LIMIT) {
+    } config_set_numerical_field(
+      "pack-values-idle",server.pack_values_idle,0,INT_MAX) {
     } config_set_memory_field("repl-backlog-size",ll) {
         resizeReplicationBacklog(ll);
     } config_set_memory_field("auto-aof-rewrite-min-size",ll) {
@@ -1069,6 +1166,7 @@ void configGetCommand(client *c) {
 
     /* Numerical values */
     config_get_numerical_field("maxmemory",server.maxmemory);
+    config_get_numerical_field("maxmemory-clients",server.maxmemory_clients);
     config_get_numerical_field("maxmemory-samples",server.maxmemory_samples);
     config_get_numerical_field("timeout",server.maxidletime);
     config_get_numerical_field("auto-aof-rewrite-percentage",
@@ -1083,6 +1181,15 @@ void configGetCommand(client *c) {
             server.list_max_ziplist_size);
     config_get_numerical_field("list-compress-depth",
             server.list_compress_depth);
+    config_get_numerical_field("list-compress-cache-bytes",
+            server.list_compress_cache_bytes);
+    config_get_numerical_field("string-chunk-threshold",
+            server.string_chunk_threshold);
+    config_get_numerical_field("string-intern-max-entries",
+            server.string_intern_max_entries);
+    config_get_numerical_field("string-intern-max-len",
+            server.string_intern_max_len);
+    config_get_numerical_field("pack-values-idle",server.pack_values_idle);
     config_get_numerical_field("set-max-intset-entries",
             server.set_max_intset_entries);
     config_get_numerical_field("zset-max-ziplist-entries",
@@ -1096,9 +1203,12 @@ void configGetCommand(client *c) {
             server.slowlog_log_slower_than);
     config_get_numerical_field("latency-monitor-threshold",
             server.latency_monitor_threshold);
+    config_get_numerical_field("loop-trace-threshold",
+            server.loop_trace_threshold);
     config_get_numerical_field("slowlog-max-len",
             server.slowlog_max_len);
     config_get_numerical_field("port",server.port);
+    config_get_numerical_field("metrics-port",server.metrics_port);
     config_get_numerical_field("tcp-backlog",server.tcp_backlog);
     config_get_numerical_field("databases",server.dbnum);
     config_get_numerical_field("repl-ping-slave-period",server.repl_ping_slave_period);
@@ -1112,11 +1222,13 @@ void configGetCommand(client *c) {
     config_get_numerical_field("min-slaves-to-write",server.repl_min_slaves_to_write);
     config_get_numerical_field("min-slaves-max-lag",server.repl_min_slaves_max_lag);
     config_get_numerical_field("hz",server.hz);
+    config_get_numerical_field("tracking-table-max-keys",server.tracking_table_max_keys);
     config_get_numerical_field("cluster-node-timeout",server.cluster_node_timeout);
     config_get_numerical_field("cluster-migration-barrier",server.cluster_migration_barrier);
     config_get_numerical_field("cluster-slave-validity-factor",server.cluster_slave_validity_factor);
     config_get_numerical_field("repl-diskless-sync-delay",server.repl_diskless_sync_delay);
     config_get_numerical_field("tcp-keepalive",server.tcpkeepalive);
+    config_get_numerical_field("busy-poll-usec",server.busy_poll_usec);
 
     /* Bool (yes/no) values */
     config_get_bool_field("cluster-require-full-coverage",
@@ -1133,6 +1245,12 @@ void configGetCommand(client *c) {
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("hotkeys-tracking", server.hotkeys_tracking);
+    config_get_bool_field("loop-profiler", server.loop_profiler);
+    config_get_numerical_field("active-rehashing-usec",
+            server.active_rehashing_usec);
+    config_get_numerical_field("hashtable-min-fill",
+            server.hashtable_min_fill);
     config_get_bool_field("protected-mode", server.protected_mode);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
@@ -1242,7 +1360,7 @@ void configGetCommand(client *c) {
         sdsfree(aux);
         matches++;
     }
-    setDeferredMultiBulkLength(c,replylen,matches*2);
+    setDeferredMapLen(c,replylen,matches);
 }
 
 /*-----------------------------------------------------------------------------
@@ -1269,7 +1387,8 @@ dictType optionToLineDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictListDestructor          /* val destructor */
+    dictListDestructor,         /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 dictType optionSetDictType = {
@@ -1278,7 +1397,8 @@ dictType optionSetDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* The config rewrite state. */
@@ -1783,12 +1903,14 @@ int rewriteConfig(char *path) {
     rewriteConfigYesNoOption(state,"daemonize",server.daemonize,0);
     rewriteConfigStringOption(state,"pidfile",server.pidfile,CONFIG_DEFAULT_PID_FILE);
     rewriteConfigNumericalOption(state,"port",server.port,CONFIG_DEFAULT_SERVER_PORT);
+    rewriteConfigNumericalOption(state,"metrics-port",server.metrics_port,CONFIG_DEFAULT_METRICS_PORT);
     rewriteConfigNumericalOption(state,"tcp-backlog",server.tcp_backlog,CONFIG_DEFAULT_TCP_BACKLOG);
     rewriteConfigBindOption(state);
     rewriteConfigStringOption(state,"unixsocket",server.unixsocket,NULL);
     rewriteConfigOctalOption(state,"unixsocketperm",server.unixsocketperm,CONFIG_DEFAULT_UNIX_SOCKET_PERM);
     rewriteConfigNumericalOption(state,"timeout",server.maxidletime,CONFIG_DEFAULT_CLIENT_TIMEOUT);
     rewriteConfigNumericalOption(state,"tcp-keepalive",server.tcpkeepalive,CONFIG_DEFAULT_TCP_KEEPALIVE);
+    rewriteConfigNumericalOption(state,"busy-poll-usec",server.busy_poll_usec,CONFIG_DEFAULT_BUSY_POLL_USEC);
     rewriteConfigNumericalOption(state,"slave-announce-port",server.slave_announce_port,CONFIG_DEFAULT_SLAVE_ANNOUNCE_PORT);
     rewriteConfigEnumOption(state,"loglevel",server.verbosity,loglevel_enum,CONFIG_DEFAULT_VERBOSITY);
     rewriteConfigStringOption(state,"logfile",server.logfile,CONFIG_DEFAULT_LOGFILE);
@@ -1822,6 +1944,7 @@ int rewriteConfig(char *path) {
     rewriteConfigBytesOption(state,"maxmemory",server.maxmemory,CONFIG_DEFAULT_MAXMEMORY);
     rewriteConfigEnumOption(state,"maxmemory-policy",server.maxmemory_policy,maxmemory_policy_enum,CONFIG_DEFAULT_MAXMEMORY_POLICY);
     rewriteConfigNumericalOption(state,"maxmemory-samples",server.maxmemory_samples,CONFIG_DEFAULT_MAXMEMORY_SAMPLES);
+    rewriteConfigBytesOption(state,"maxmemory-clients",server.maxmemory_clients,CONFIG_DEFAULT_MAXMEMORY_CLIENTS);
     rewriteConfigYesNoOption(state,"appendonly",server.aof_state != AOF_OFF,0);
     rewriteConfigStringOption(state,"appendfilename",server.aof_filename,CONFIG_DEFAULT_AOF_FILENAME);
     rewriteConfigEnumOption(state,"appendfsync",server.aof_fsync,aof_fsync_enum,CONFIG_DEFAULT_AOF_FSYNC);
@@ -1837,20 +1960,31 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"cluster-slave-validity-factor",server.cluster_slave_validity_factor,CLUSTER_DEFAULT_SLAVE_VALIDITY);
     rewriteConfigNumericalOption(state,"slowlog-log-slower-than",server.slowlog_log_slower_than,CONFIG_DEFAULT_SLOWLOG_LOG_SLOWER_THAN);
     rewriteConfigNumericalOption(state,"latency-monitor-threshold",server.latency_monitor_threshold,CONFIG_DEFAULT_LATENCY_MONITOR_THRESHOLD);
+    rewriteConfigYesNoOption(state,"hotkeys-tracking",server.hotkeys_tracking,CONFIG_DEFAULT_HOTKEYS_TRACKING);
+    rewriteConfigYesNoOption(state,"loop-profiler",server.loop_profiler,CONFIG_DEFAULT_LOOP_PROFILER);
+    rewriteConfigNumericalOption(state,"loop-trace-threshold",server.loop_trace_threshold,CONFIG_DEFAULT_LOOP_TRACE_THRESHOLD);
     rewriteConfigNumericalOption(state,"slowlog-max-len",server.slowlog_max_len,CONFIG_DEFAULT_SLOWLOG_MAX_LEN);
     rewriteConfigNotifykeyspaceeventsOption(state);
     rewriteConfigNumericalOption(state,"hash-max-ziplist-entries",server.hash_max_ziplist_entries,OBJ_HASH_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"hash-max-ziplist-value",server.hash_max_ziplist_value,OBJ_HASH_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"list-max-ziplist-size",server.list_max_ziplist_size,OBJ_LIST_MAX_ZIPLIST_SIZE);
     rewriteConfigNumericalOption(state,"list-compress-depth",server.list_compress_depth,OBJ_LIST_COMPRESS_DEPTH);
+    rewriteConfigBytesOption(state,"list-compress-cache-bytes",server.list_compress_cache_bytes,OBJ_LIST_COMPRESS_CACHE_BYTES);
+    rewriteConfigBytesOption(state,"string-chunk-threshold",server.string_chunk_threshold,OBJ_STRING_CHUNK_THRESHOLD);
+    rewriteConfigNumericalOption(state,"string-intern-max-entries",server.string_intern_max_entries,OBJ_STRING_INTERN_MAX_ENTRIES);
+    rewriteConfigNumericalOption(state,"string-intern-max-len",server.string_intern_max_len,OBJ_STRING_INTERN_MAX_LEN);
+    rewriteConfigNumericalOption(state,"pack-values-idle",server.pack_values_idle,OBJ_PACK_VALUES_IDLE);
     rewriteConfigNumericalOption(state,"set-max-intset-entries",server.set_max_intset_entries,OBJ_SET_MAX_INTSET_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-entries",server.zset_max_ziplist_entries,OBJ_ZSET_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,OBJ_ZSET_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,CONFIG_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigNumericalOption(state,"active-rehashing-usec",server.active_rehashing_usec,CONFIG_DEFAULT_ACTIVE_REHASHING_USEC);
+    rewriteConfigNumericalOption(state,"hashtable-min-fill",server.hashtable_min_fill,HASHTABLE_MIN_FILL);
     rewriteConfigYesNoOption(state,"protected-mode",server.protected_mode,CONFIG_DEFAULT_PROTECTED_MODE);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,CONFIG_DEFAULT_HZ);
+    rewriteConfigNumericalOption(state,"tracking-table-max-keys",server.tracking_table_max_keys,CONFIG_DEFAULT_TRACKING_TABLE_MAX_KEYS);
     rewriteConfigYesNoOption(state,"aof-rewrite-incremental-fsync",server.aof_rewrite_incremental_fsync,CONFIG_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC);
     rewriteConfigYesNoOption(state,"aof-load-truncated",server.aof_load_truncated,CONFIG_DEFAULT_AOF_LOAD_TRUNCATED);
     rewriteConfigEnumOption(state,"supervised",server.supervised_mode,supervised_mode_enum,SUPERVISED_NONE);
@@ -48,8 +48,14 @@ void slotToKeyFlush(void);
  * lookupKeyWrite() and lookupKeyReadWithFlags(). */
 robj *lookupKey(redisDb *db, robj *key, int flags) {
     dictEntry *de = dictFind(db->dict,key->ptr);
+
+    /* Count the access for HOTKEYS, unless it's just an inspection of the
+     * key, like OBJECT does. Missing keys are counted as well: a key that
+     * is requested over and over is hot even if it does not exist. */
+    if (!(flags & LOOKUP_NOTOUCH)) hotkeysTrack(db,key);
+
     if (de) {
-        robj *val = dictGetVal(de);
+        robj *val = dbUnpackValue(db,de);
 
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
@@ -60,6 +66,15 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
         {
             val->lru = LRU_CLOCK();
         }
+
+        /* Chunked strings are only returned to the callers that know how
+         * to handle them, for everything else they become plain strings
+         * again. */
+        if (val->encoding == OBJ_ENCODING_CHUNKED &&
+            !(flags & LOOKUP_CHUNKED))
+        {
+            flattenChunkedStringObject(val);
+        }
         return val;
     } else {
         return NULL;
@@ -81,6 +96,8 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
  *
  *  LOOKUP_NONE (or zero): no special flags are passed.
  *  LOOKUP_NOTOUCH: don't alter the last access time of the key.
+ *  LOOKUP_CHUNKED: the caller handles OBJ_ENCODING_CHUNKED strings, that
+ *                  are otherwise converted to raw strings.
  *
  * Note: this function also returns NULL is the key is logically expired
  * but still existing, in case this is a slave, since this API is called only
@@ -116,6 +133,7 @@ robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags) {
             return NULL;
         }
     }
+    if (dictSize(db->hexpires)) hashExpireFieldsIfNeeded(db,key);
     val = lookupKey(db,key,flags);
     if (val == NULL)
         server.stat_keyspace_misses++;
@@ -135,9 +153,15 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  *
  * Returns the linked value object if the key exists or NULL if the key
  * does not exist in the specified DB. */
-robj *lookupKeyWrite(redisDb *db, robj *key) {
+robj *lookupKeyWriteWithFlags(redisDb *db, robj *key, int flags) {
     expireIfNeeded(db,key);
-    return lookupKey(db,key,LOOKUP_NONE);
+    if (dictSize(db->hexpires)) hashExpireFieldsIfNeeded(db,key);
+    return lookupKey(db,key,flags);
+}
+
+/* Like lookupKeyWriteWithFlags(), but does not use any flag. */
+robj *lookupKeyWrite(redisDb *db, robj *key) {
+    return lookupKeyWriteWithFlags(db,key,LOOKUP_NONE);
 }
 
 robj *lookupKeyReadOrReply(client *c, robj *key, robj *reply) {
@@ -152,6 +176,19 @@ robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply) {
     return o;
 }
 
+/* Return the value of the db->dict entry 'de', turning it back into an
+ * object first if it was packed by packValuesCron(). */
+robj *dbUnpackValue(redisDb *db, dictEntry *de) {
+    robj *val = dictGetVal(de);
+
+    if (objectIsPacked(val)) {
+        val = unpackObject(val);
+        dictSetVal(db->dict,de,val);
+        server.packed_values--;
+    }
+    return val;
+}
+
 /* Add the key to the DB. It's up to the caller to increment the reference
  * counter of the value if needed.
  *
@@ -167,13 +204,15 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
 
 /* Overwrite an existing key with a new value. Incrementing the reference
  * count of the new value is up to the caller.
- * This function does not modify the expire time of the existing key.
+ * This function does not modify the expire time of the existing key, while
+ * the expire times of the fields of an overwritten hash are dropped.
  *
  * The program is aborted if the key was not already present. */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict,key->ptr);
 
     serverAssertWithInfo(NULL,key,de != NULL);
+    if (dictSize(db->hexpires) > 0) dictDelete(db->hexpires,key->ptr);
     dictReplace(db->dict, key->ptr, val);
 }
 
@@ -184,7 +223,7 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
  * 2) clients WATCHing for the destination key notified.
  * 3) The expire time of the key is reset (the key is made persistent). */
 void setKey(redisDb *db, robj *key, robj *val) {
-    if (lookupKeyWrite(db,key) == NULL) {
+    if (lookupKeyWriteWithFlags(db,key,LOOKUP_CHUNKED) == NULL) {
         dbAdd(db,key,val);
     } else {
         dbOverwrite(db,key,val);
@@ -229,6 +268,7 @@ int dbDelete(redisDb *db, robj *key) {
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+    if (dictSize(db->hexpires) > 0) dictDelete(db->hexpires,key->ptr);
     if (dictDelete(db->dict,key->ptr) == DICT_OK) {
         if (server.cluster_enabled) slotToKeyDel(key);
         return 1;
@@ -275,6 +315,26 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     return o;
 }
 
+/* Like dbUnshareStringValue(), but makes sure the string is chunked: this is
+ * used by the commands modifying big strings in place, see the
+ * chunkedString type. The returned object can be modified by the caller
+ * with the chunkedString API. */
+robj *dbChunkStringValue(redisDb *db, robj *key, robj *o) {
+    serverAssert(o->type == OBJ_STRING);
+    if (o->refcount != 1 || o->encoding != OBJ_ENCODING_CHUNKED) {
+        if (o->encoding == OBJ_ENCODING_CHUNKED) {
+            o = createObject(OBJ_STRING,chunkedStringDup(o->ptr));
+            o->encoding = OBJ_ENCODING_CHUNKED;
+        } else {
+            robj *decoded = getDecodedObject(o);
+            o = createChunkedStringObject(decoded->ptr,sdslen(decoded->ptr));
+            decrRefCount(decoded);
+        }
+        dbOverwrite(db,key,o);
+    }
+    return o;
+}
+
 long long emptyDb(void(callback)(void*)) {
     int j;
     long long removed = 0;
@@ -283,6 +343,7 @@ long long emptyDb(void(callback)(void*)) {
         removed += dictSize(server.db[j].dict);
         dictEmpty(server.db[j].dict,callback);
         dictEmpty(server.db[j].expires,callback);
+        dictEmpty(server.db[j].hexpires,callback);
     }
     if (server.cluster_enabled) slotToKeyFlush();
     return removed;
@@ -306,10 +367,13 @@ int selectDb(client *c, int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db,key);
+    trackingInvalidateKey(key);
 }
 
 void signalFlushedDb(int dbid) {
     touchWatchedKeysOnFlush(dbid);
+    trackingInvalidateKeysOnFlush(dbid);
+    hotkeysFlushDb(dbid);
 }
 
 /*-----------------------------------------------------------------------------
@@ -321,6 +385,7 @@ void flushdbCommand(client *c) {
     signalFlushedDb(c->db->id);
     dictEmpty(c->db->dict,NULL);
     dictEmpty(c->db->expires,NULL);
+    dictEmpty(c->db->hexpires,NULL);
     if (server.cluster_enabled) slotToKeyFlush();
     addReply(c,shared.ok);
 }
@@ -367,6 +432,8 @@ void existsCommand(client *c) {
 
     for (j = 1; j < c->argc; j++) {
         expireIfNeeded(c->db,c->argv[j]);
+        if (dictSize(c->db->hexpires))
+            hashExpireFieldsIfNeeded(c->db,c->argv[j]);
         if (dbExists(c->db,c->argv[j])) count++;
     }
     addReplyLongLong(c,count);
@@ -394,7 +461,7 @@ void randomkeyCommand(client *c) {
     robj *key;
 
     if ((key = dbRandomKey(c->db)) == NULL) {
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
         return;
     }
 
@@ -553,6 +620,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     } else if (o->type == OBJ_SET && o->encoding == OBJ_ENCODING_HT) {
         ht = o->ptr;
     } else if (o->type == OBJ_HASH && o->encoding == OBJ_ENCODING_HT) {
+        hashTypeConvertFinish(o);
         ht = o->ptr;
         count *= 2; /* We return key / value for this type. */
     } else if (o->type == OBJ_ZSET && o->encoding == OBJ_ENCODING_SKIPLIST) {
@@ -686,7 +754,7 @@ void typeCommand(client *c) {
     robj *o;
     char *type;
 
-    o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_NOTOUCH);
+    o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_NOTOUCH|LOOKUP_CHUNKED);
     if (o == NULL) {
         type = "none";
     } else {
@@ -739,8 +807,11 @@ void renameGenericCommand(client *c, int nx) {
      * if the key exists, however we still return an error on unexisting key. */
     if (sdscmp(c->argv[1]->ptr,c->argv[2]->ptr) == 0) samekey = 1;
 
-    if ((o = lookupKeyWriteOrReply(c,c->argv[1],shared.nokeyerr)) == NULL)
+    o = lookupKeyWriteWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED);
+    if (o == NULL) {
+        addReply(c,shared.nokeyerr);
         return;
+    }
 
     if (samekey) {
         addReply(c,nx ? shared.czero : shared.ok);
@@ -749,7 +820,7 @@ void renameGenericCommand(client *c, int nx) {
 
     incrRefCount(o);
     expire = getExpire(c->db,c->argv[1]);
-    if (lookupKeyWrite(c->db,c->argv[2]) != NULL) {
+    if (lookupKeyWriteWithFlags(c->db,c->argv[2],LOOKUP_CHUNKED) != NULL) {
         if (nx) {
             decrRefCount(o);
             addReply(c,shared.czero);
@@ -761,6 +832,7 @@ void renameGenericCommand(client *c, int nx) {
     }
     dbAdd(c->db,c->argv[2],o);
     if (expire != -1) setExpire(c->db,c->argv[2],expire);
+    hashMoveFieldExpires(c->db,c->argv[1],c->db,c->argv[2]);
     dbDelete(c->db,c->argv[1]);
     signalModifiedKey(c->db,c->argv[1]);
     signalModifiedKey(c->db,c->argv[2]);
@@ -813,7 +885,7 @@ void moveCommand(client *c) {
     }
 
     /* Check if the element exists and get a reference */
-    o = lookupKeyWrite(c->db,c->argv[1]);
+    o = lookupKeyWriteWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED);
     if (!o) {
         addReply(c,shared.czero);
         return;
@@ -821,12 +893,13 @@ void moveCommand(client *c) {
     expire = getExpire(c->db,c->argv[1]);
 
     /* Return zero if the key already exists in the target DB */
-    if (lookupKeyWrite(dst,c->argv[1]) != NULL) {
+    if (lookupKeyWriteWithFlags(dst,c->argv[1],LOOKUP_CHUNKED) != NULL) {
         addReply(c,shared.czero);
         return;
     }
     dbAdd(dst,c->argv[1],o);
     if (expire != -1) setExpire(dst,c->argv[1],expire);
+    hashMoveFieldExpires(src,c->argv[1],dst,c->argv[1]);
     incrRefCount(o);
 
     /* OK! key moved, free the entry in the source DB */
@@ -928,6 +1001,7 @@ int expireIfNeeded(redisDb *db, robj *key) {
     propagateExpire(db,key);
     notifyKeyspaceEvent(NOTIFY_EXPIRED,
         "expired",key,db->id);
+    trackingInvalidateKey(key);
     return dbDelete(db,key);
 }
 
@@ -953,7 +1027,7 @@ void expireGenericCommand(client *c, long long basetime, int unit) {
     when += basetime;
 
     /* No key, return zero. */
-    if (lookupKeyWrite(c->db,key) == NULL) {
+    if (lookupKeyWriteWithFlags(c->db,key,LOOKUP_CHUNKED) == NULL) {
         addReply(c,shared.czero);
         return;
     }
@@ -1008,7 +1082,9 @@ void ttlGenericCommand(client *c, int output_ms) {
     long long expire, ttl = -1;
 
     /* If the key does not exist at all, return -2 */
-    if (lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_NOTOUCH) == NULL) {
+    if (lookupKeyReadWithFlags(c->db,c->argv[1],
+                               LOOKUP_NOTOUCH|LOOKUP_CHUNKED) == NULL)
+    {
         addReplyLongLong(c,-2);
         return;
     }
@@ -1035,7 +1111,7 @@ void pttlCommand(client *c) {
 }
 
 void persistCommand(client *c) {
-    if (lookupKeyWrite(c->db,c->argv[1])) {
+    if (lookupKeyWriteWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED)) {
         if (removeExpire(c->db,c->argv[1])) {
             addReply(c,shared.cone);
             server.dirty++;
@@ -1051,7 +1127,8 @@ void persistCommand(client *c) {
 void touchCommand(client *c) {
     int touched = 0;
     for (int j = 1; j < c->argc; j++)
-        if (lookupKeyRead(c->db,c->argv[j]) != NULL) touched++;
+        if (lookupKeyReadWithFlags(c->db,c->argv[j],LOOKUP_CHUNKED) != NULL)
+            touched++;
     addReplyLongLong(c,touched);
 }
 
@@ -1157,6 +1234,29 @@ int *evalGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys)
     return keys;
 }
 
+/* Helper function to extract keys from the LMPOP command:
+ * LMPOP <num-keys> <key> <key> ... <key> LEFT|RIGHT [COUNT <count>] */
+int *lmpopGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys) {
+    int i, num, *keys;
+    UNUSED(cmd);
+
+    num = atoi(argv[1]->ptr);
+    /* Sanity check. Don't return any key if the command is going to
+     * reply with syntax error. */
+    if (num <= 0 || num > (argc-3)) {
+        *numkeys = 0;
+        return NULL;
+    }
+
+    keys = zmalloc(sizeof(int)*num);
+    *numkeys = num;
+
+    /* Add all key positions for argv[2...n] to keys[] */
+    for (i = 0; i < num; i++) keys[i] = 2+i;
+
+    return keys;
+}
+
 /* Helper function to extract keys from the SORT command.
  *
  * SORT <sort-key> ... STORE <store-key> ...
@@ -136,7 +136,7 @@ void computeDatasetDigest(unsigned char *final) {
         /* Iterate this DB writing every entry */
         while((de = dictNext(di)) != NULL) {
             sds key;
-            robj *keyobj, *o;
+            robj *keyobj, *o, *unpacked = NULL;
             long long expiretime;
 
             memset(digest,0,20); /* This key-val digest */
@@ -146,6 +146,7 @@ void computeDatasetDigest(unsigned char *final) {
             mixDigest(digest,key,sdslen(key));
 
             o = dictGetVal(de);
+            if (objectIsPacked(o)) o = unpacked = unpackObject(o);
 
             aux = htonl(o->type);
             mixDigest(digest,&aux,sizeof(aux));
@@ -241,6 +242,26 @@ void computeDatasetDigest(unsigned char *final) {
                     xorDigest(digest,eledigest,20);
                 }
                 hashTypeReleaseIterator(hi);
+
+                /* Mix the expire times of the fields, if any. */
+                hashFieldExpires *hfe = hashGetFieldExpires(db,keyobj);
+                if (hfe) {
+                    dictIterator *di = dictGetIterator(hfe->fields);
+                    dictEntry *de;
+
+                    while((de = dictNext(di)) != NULL) {
+                        unsigned char eledigest[20];
+                        sds field = dictGetKey(de);
+
+                        memset(eledigest,0,20);
+                        mixDigest(eledigest,field,sdslen(field));
+                        snprintf(buf,sizeof(buf),"!!hexpire!!%lld",
+                                 (long long)dictGetSignedIntegerVal(de));
+                        mixDigest(eledigest,buf,strlen(buf));
+                        xorDigest(digest,eledigest,20);
+                    }
+                    dictReleaseIterator(di);
+                }
             } else {
                 serverPanic("Unknown object type");
             }
@@ -249,6 +270,7 @@ void computeDatasetDigest(unsigned char *final) {
             /* We can finally xor the key-val digest to the final digest */
             xorDigest(final,digest,20);
             decrRefCount(keyobj);
+            if (unpacked) decrRefCount(unpacked);
         }
         dictReleaseIterator(di);
     }
@@ -309,6 +331,12 @@ void debugCommand(client *c) {
         "jemalloc info  -- Show internal jemalloc statistics.");
         blen++; addReplyStatus(c,
         "jemalloc purge -- Force jemalloc to release unused memory.");
+        blen++; addReplyStatus(c,
+        "list-compress-stats [reset] -- Show (or reset) list nodes compression and decompressed nodes cache statistics.");
+        blen++; addReplyStatus(c,
+        "looptrace [live] -- Show the event loop trace leading to the latest iteration slower than loop-trace-threshold, or the current trace with 'live'. Requires loop-profiler.");
+        blen++; addReplyStatus(c,
+        "protocol <type> -- Reply with a test value of the specified type. <type> can be: string, integer, double, bignum, null, array, set, map, push, true, false.");
         setDeferredMultiBulkLength(c,blenp,blen);
     } else if (!strcasecmp(c->argv[1]->ptr,"segfault")) {
         *((char*)-1) = 'x';
@@ -357,18 +385,22 @@ void debugCommand(client *c) {
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"object") && c->argc == 3) {
         dictEntry *de;
-        robj *val;
+        robj *val, *unpacked = NULL;
         char *strenc;
 
         if ((de = dictFind(c->db->dict,c->argv[2]->ptr)) == NULL) {
             addReply(c,shared.nokeyerr);
             return;
         }
+        /* Packed values are reported without unpacking them in the db. */
         val = dictGetVal(de);
+        if (objectIsPacked(val)) val = unpacked = unpackObject(val);
         strenc = strEncoding(val->encoding);
 
-        char extra[128] = {0};
-        if (val->encoding == OBJ_ENCODING_QUICKLIST) {
+        char extra[256] = {0};
+        if (unpacked) {
+            snprintf(extra, sizeof(extra), " packed:1");
+        } else if (val->encoding == OBJ_ENCODING_QUICKLIST) {
             char *nextra = extra;
             int remaining = sizeof(extra);
             quicklist *ql = val->ptr;
@@ -390,14 +422,33 @@ void debugCommand(client *c) {
             used = snprintf(nextra, remaining, " ql_compressed:%d", compressed);
             nextra += used;
             remaining -= used;
-            /* Add total uncompressed size */
-            unsigned long sz = 0;
+            /* Add total uncompressed size, and the sizes of the compressed
+             * nodes before and after compression. */
+            unsigned long sz = 0, zsz = 0, lzfsz = 0;
             for (quicklistNode *node = ql->head; node; node = node->next) {
                 sz += node->sz;
+                if (quicklistNodeIsCompressed(node)) {
+                    void *data;
+                    zsz += node->sz;
+                    lzfsz += quicklistGetLzf(node, &data);
+                }
             }
             used = snprintf(nextra, remaining, " ql_uncompressed_size:%lu", sz);
             nextra += used;
             remaining -= used;
+            /* Add compression ratio of the compressed nodes */
+            double ratio = lzfsz ? (double)zsz/lzfsz : 0;
+            used = snprintf(nextra, remaining, " ql_compress_ratio:%.2f", ratio);
+            nextra += used;
+            remaining -= used;
+            /* Add nodes kept decompressed by the nodes cache */
+            used = snprintf(nextra, remaining, " ql_cached_nodes:%d",
+                            ql->cache ? ql->cache->len : 0);
+            nextra += used;
+            remaining -= used;
+        } else if (val->encoding == OBJ_ENCODING_CHUNKED) {
+            chunkedString *cs = val->ptr;
+            snprintf(extra, sizeof(extra), " chunks:%zu", cs->numchunks);
         }
 
         addReplyStatusFormat(c,
@@ -407,6 +458,7 @@ void debugCommand(client *c) {
             (void*)val, val->refcount,
             strenc, rdbSavedObjectLen(val),
             val->lru, estimateObjectIdleTime(val)/1000, extra);
+        if (unpacked) decrRefCount(unpacked);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
         robj *val;
@@ -416,7 +468,7 @@ void debugCommand(client *c) {
             addReply(c,shared.nokeyerr);
             return;
         }
-        val = dictGetVal(de);
+        val = dbUnpackValue(c->db,de);
         key = dictGetKey(de);
 
         if (val->type != OBJ_STRING || !sdsEncodedObject(val)) {
@@ -490,6 +542,95 @@ void debugCommand(client *c) {
         errstr = sdsmapchars(errstr,"\n\r","  ",2); /* no newlines in errors. */
         errstr = sdscatlen(errstr,"\r\n",2);
         addReplySds(c,errstr);
+    } else if (!strcasecmp(c->argv[1]->ptr,"protocol") && c->argc == 3) {
+        /* DEBUG PROTOCOL [string|integer|double|bignum|null|array|set|map|
+         *                 push|true|false] */
+        char *name = c->argv[2]->ptr;
+        int j;
+
+        if (!strcasecmp(name,"string")) {
+            addReplyBulkCString(c,"Hello World");
+        } else if (!strcasecmp(name,"integer")) {
+            addReplyLongLong(c,12345);
+        } else if (!strcasecmp(name,"double")) {
+            addReplyDouble(c,3.14159265359);
+        } else if (!strcasecmp(name,"bignum")) {
+            addReplyBigNum(c,"1234567999999999999999999999999999999",37);
+        } else if (!strcasecmp(name,"null")) {
+            addReplyNull(c);
+        } else if (!strcasecmp(name,"array")) {
+            addReplyMultiBulkLen(c,3);
+            for (j = 0; j < 3; j++) addReplyLongLong(c,j);
+        } else if (!strcasecmp(name,"set")) {
+            addReplySetLen(c,3);
+            for (j = 0; j < 3; j++) addReplyLongLong(c,j);
+        } else if (!strcasecmp(name,"map")) {
+            addReplyMapLen(c,3);
+            for (j = 0; j < 3; j++) {
+                addReplyLongLong(c,j);
+                addReplyBool(c, j == 1);
+            }
+        } else if (!strcasecmp(name,"push")) {
+            if (c->resp < 3) {
+                addReplyError(c,"RESP2 is not supported by this command");
+                return;
+            }
+            addReplyPushLen(c,2);
+            addReplyBulkCString(c,"server-cpu-usage");
+            addReplyLongLong(c,42);
+            /* Push replies are not synchronous replies, so we emit also a
+             * normal reply in order for blocking clients just discarding the
+             * push reply, to actually consume the reply and continue. */
+            addReplyBulkCString(c,"Some real reply following the push reply");
+        } else if (!strcasecmp(name,"true")) {
+            addReplyBool(c,1);
+        } else if (!strcasecmp(name,"false")) {
+            addReplyBool(c,0);
+        } else {
+            addReplyError(c,"Wrong protocol type name. Please use one of the following: string|integer|double|bignum|null|array|set|map|push|true|false");
+        }
+    } else if (!strcasecmp(c->argv[1]->ptr,"list-compress-stats") &&
+               (c->argc == 2 || c->argc == 3))
+    {
+        quicklistStats st;
+
+        if (c->argc == 3) {
+            if (strcasecmp(c->argv[2]->ptr,"reset")) {
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+            quicklistResetStats();
+            addReply(c,shared.ok);
+            return;
+        }
+        quicklistGetStats(&st);
+        addReplyBulkSds(c,sdscatprintf(sdsempty(),
+            "compressed_nodes:%llu\r\n"
+            "compress_failed:%llu\r\n"
+            "compress_ratio:%.2f\r\n"
+            "compress_usec:%llu\r\n"
+            "compress_usec_per_node:%.2f\r\n"
+            "decompressed_nodes:%llu\r\n"
+            "decompress_usec:%llu\r\n"
+            "decompress_usec_per_node:%.2f\r\n"
+            "cache_hits:%llu\r\n"
+            "cache_evictions:%llu\r\n",
+            st.compressed, st.compress_failed,
+            st.compress_out ? (double)st.compress_in/st.compress_out : 0,
+            st.compress_us,
+            (st.compressed+st.compress_failed) ?
+                (double)st.compress_us/(st.compressed+st.compress_failed) : 0,
+            st.decompressed, st.decompress_us,
+            st.decompressed ? (double)st.decompress_us/st.decompressed : 0,
+            st.cache_hits, st.cache_evictions));
+    } else if (!strcasecmp(c->argv[1]->ptr,"looptrace") &&
+               (c->argc == 2 || c->argc == 3))
+    {
+        if (c->argc == 3 && strcasecmp(c->argv[2]->ptr,"live")) {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        loopTraceReply(c,c->argc == 3);
     } else if (!strcasecmp(c->argv[1]->ptr,"structsize") && c->argc == 2) {
         sds sizes = sdsempty();
         sizes = sdscatprintf(sizes,"bits:%d ",(sizeof(void*) == 8)?64:32);
@@ -900,7 +1041,9 @@ void logCurrentClient(void) {
 
         key = getDecodedObject(cc->argv[1]);
         de = dictFind(cc->db->dict, key->ptr);
-        if (de) {
+        if (de && objectIsPacked(dictGetVal(de))) {
+            serverLog(LL_WARNING,"key '%s' found in DB containing a packed value", (char*)key->ptr);
+        } else if (de) {
             val = dictGetVal(de);
             serverLog(LL_WARNING,"key '%s' found in DB containing the following object:", (char*)key->ptr);
             serverLogObjectDebugInfo(val);
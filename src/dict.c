@@ -328,6 +328,27 @@ int dictRehashMilliseconds(dict *d, int ms) {
     return rehashes;
 }
 
+/* 当前微秒数 */
+static long long timeInMicroseconds(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Like dictRehashMilliseconds() but with a microseconds resolution, so that
+ * the caller can spread a tight time budget among different tables. */
+int dictRehashMicroseconds(dict *d, long long us) {
+    long long start = timeInMicroseconds();
+    int rehashes = 0;
+
+    while(dictRehash(d,100)) {
+        rehashes += 100;
+        if (timeInMicroseconds()-start > us) break;
+    }
+    return rehashes;
+}
+
 /* This function performs just a step of rehashing, and only if there are
  * no safe iterators bound to our hash table. When we have iterators in the
  * middle of a rehashing we can't mess with the two hash tables otherwise
@@ -960,6 +981,16 @@ unsigned long dictScan(dict *d,
 
 /* ------------------------- private functions ------------------------------ */
 
+/* Return true if the dict type allows to expand the table, passing to the
+ * type callback the memory the new buckets array would take, and the current
+ * elements/buckets ratio. */
+static int dictTypeExpandAllowed(dict *d) {
+    if (d->type->expandAllowed == NULL) return 1;
+    return d->type->expandAllowed(
+                    _dictNextPower(d->ht[0].used*2)*sizeof(dictEntry*),
+                    (double)d->ht[0].used/d->ht[0].size);
+}
+
 /* Expand the hash table if needed */
 static int _dictExpandIfNeeded(dict *d)
 {
@@ -975,7 +1006,8 @@ static int _dictExpandIfNeeded(dict *d)
      * the number of buckets. */
     if (d->ht[0].used >= d->ht[0].size &&
         (dict_can_resize ||
-         d->ht[0].used/d->ht[0].size > dict_force_resize_ratio))
+         d->ht[0].used/d->ht[0].size > dict_force_resize_ratio) &&
+        dictTypeExpandAllowed(d))
     {
         return dictExpand(d, d->ht[0].used*2);
     }
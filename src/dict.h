@@ -86,6 +86,9 @@ typedef struct dictType {
 
     // 销毁键值的函数
     void (*valDestructor)(void *privdata, void *obj);
+
+    // 是否允许扩展哈希表，NULL表示总是允许 Return 0 to prevent the table from growing
+    int (*expandAllowed)(size_t moreMem, double usedRatio);
 } dictType;
 
 /* 定义底层哈希表结构 This is our hash table structure. Every dictionary has two of this as we
@@ -216,6 +219,7 @@ void dictEnableResize(void);  // 全局：设置能重调哈希表大小的全
 void dictDisableResize(void);  // 全局：设置不能重调哈希表大小全局变量
 int dictRehash(dict *d, int n);  // 重新哈希调整指定字典
 int dictRehashMilliseconds(dict *d, int ms);  // 在指定毫秒内，不断的批量迁移数据，每批100个
+int dictRehashMicroseconds(dict *d, long long us);  // 同上，时间单位为微秒
 void dictSetHashFunctionSeed(unsigned int initval);  // 设置哈希函数的随机数种子，默认是5381，server.c里设置
 unsigned int dictGetHashFunctionSeed(void);  // 获取哈希函数随机种子
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, void *privdata);  // 按指定扫描函数和参数，迭代一遍指定的字典
@@ -716,7 +716,7 @@ void geohashCommand(client *c) {
     for (j = 2; j < c->argc; j++) {
         double score;
         if (zsetScore(zobj, c->argv[j], &score) == C_ERR) {
-            addReply(c,shared.nullbulk);
+            addReply(c,shared.null[c->resp]);
         } else {
             /* The internal format we use for geocoding is a bit different
              * than the standard, since we use as initial latitude range
@@ -727,7 +727,7 @@ void geohashCommand(client *c) {
             /* Decode... */
             double xy[2];
             if (!decodeGeohash(score,xy)) {
-                addReply(c,shared.nullbulk);
+                addReply(c,shared.null[c->resp]);
                 continue;
             }
 
@@ -770,12 +770,12 @@ void geoposCommand(client *c) {
     for (j = 2; j < c->argc; j++) {
         double score;
         if (zsetScore(zobj, c->argv[j], &score) == C_ERR) {
-            addReply(c,shared.nullmultibulk);
+            addReply(c,shared.nullarray[c->resp]);
         } else {
             /* Decode... */
             double xy[2];
             if (!decodeGeohash(score,xy)) {
-                addReply(c,shared.nullmultibulk);
+                addReply(c,shared.nullarray[c->resp]);
                 continue;
             }
             addReplyMultiBulkLen(c,2);
@@ -812,13 +812,13 @@ void geodistCommand(client *c) {
     if (zsetScore(zobj, c->argv[2], &score1) == C_ERR ||
         zsetScore(zobj, c->argv[3], &score2) == C_ERR)
     {
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
         return;
     }
 
     /* Decode & compute the distance. */
     if (!decodeGeohash(score1,xyxy) || !decodeGeohash(score2,xyxy+2))
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
     else
         addReplyDoubleDistance(c,
             geohashGetDistance(xyxy[0],xyxy[1],xyxy[2],xyxy[3]) / to_meter);
@@ -0,0 +1,329 @@
+/* hotkeys.c - Always on detection of the most accessed keys.
+ *
+ * Copyright (c) 2026, Redis contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+#include "cluster.h"
+
+#include <math.h>
+
+/* Every key looked up is counted in a HeavyKeeper sketch: HOTKEYS_ROWS rows
+ * of HOTKEYS_WIDTH buckets, every bucket holding the fingerprint of a key and
+ * a counter. A key maps to one bucket per row: if the bucket is empty or
+ * holds the same fingerprint the counter is incremented, otherwise the
+ * counter of the other key is decremented with a probability that becomes
+ * exponentially smaller as the counter grows (HOTKEYS_DECAY_BASE^-count).
+ * This way the buckets are quickly taken by the frequently accessed keys and
+ * rarely accessed keys can't steal them, so the counter of a hot key is an
+ * accurate estimation of the number of accesses.
+ *
+ * The keys with the greatest estimated counters are remembered by name in a
+ * small table of HOTKEYS_TOPK entries, together with their database. The
+ * memory used is constant: the sketch itself plus the names of at most
+ * HOTKEYS_TOPK keys.
+ *
+ * In order to report the keys that are hot now, and not the keys that were
+ * hot a day ago, all the counters are halved every HOTKEYS_HALVE_PERIOD
+ * milliseconds by hotkeysCron(). */
+
+#define HOTKEYS_ROWS 4
+#define HOTKEYS_WIDTH 1024
+#define HOTKEYS_TOPK 64
+#define HOTKEYS_DECAY_BASE 1.08
+#define HOTKEYS_DECAY_TABLE 256     /* Beyond this the probability is ~0. */
+#define HOTKEYS_HALVE_PERIOD 10000
+
+typedef struct hotkeysBucket {
+    uint32_t fp;        /* Fingerprint of the key owning the bucket. */
+    uint32_t count;     /* Estimated accesses of the key. */
+} hotkeysBucket;
+
+typedef struct hotkeysEntry {
+    sds key;            /* Key name, NULL if the entry is free. */
+    int dbid;           /* Database of the key. */
+    uint32_t fp;        /* Fingerprint, to avoid comparing names. */
+    uint32_t count;     /* Estimated accesses of the key. */
+} hotkeysEntry;
+
+static hotkeysBucket (*HotkeysSketch)[HOTKEYS_WIDTH] = NULL;
+static hotkeysEntry HotkeysTop[HOTKEYS_TOPK];
+static uint32_t HotkeysTopMin = 0;   /* Min count of a full top table. */
+static int HotkeysTopUsed = 0;       /* Number of used top table entries. */
+static uint32_t HotkeysDecay[HOTKEYS_DECAY_TABLE]; /* Decay thresholds. */
+static uint32_t HotkeysRandState = 0x9e3779b9;
+static mstime_t HotkeysLastHalve = 0;
+
+uint64_t MurmurHash64A(const void *key, int len, unsigned int seed);
+
+/* Small and fast PRNG, we don't need anything better to decide whether a
+ * counter should be decremented or not. */
+static inline uint32_t hotkeysRandom(void) {
+    uint32_t x = HotkeysRandState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return HotkeysRandState = x;
+}
+
+/* Allocate the sketch and populate the table of the decay probabilities,
+ * expressed as thresholds for hotkeysRandom(), so that no floating point
+ * math is needed in the fast path. */
+static void hotkeysInit(void) {
+    int j;
+
+    HotkeysSketch = zcalloc(sizeof(hotkeysBucket)*HOTKEYS_ROWS*HOTKEYS_WIDTH);
+    for (j = 0; j < HOTKEYS_DECAY_TABLE; j++)
+        HotkeysDecay[j] = (uint32_t)(pow(HOTKEYS_DECAY_BASE,-j)*UINT32_MAX);
+    HotkeysLastHalve = mstime();
+}
+
+/* Update the minimum count of the top table, used in the fast path to avoid
+ * scanning the table when the key can't enter it anyway. */
+static void hotkeysUpdateTopMin(void) {
+    int j;
+
+    HotkeysTopMin = UINT32_MAX;
+    for (j = 0; j < HOTKEYS_TOPK; j++) {
+        if (HotkeysTop[j].key == NULL) {
+            HotkeysTopMin = 0;
+            return;
+        }
+        if (HotkeysTop[j].count < HotkeysTopMin)
+            HotkeysTopMin = HotkeysTop[j].count;
+    }
+}
+
+/* Count an access to the specified key. Called by lookupKey(). */
+void hotkeysTrack(redisDb *db, robj *key) {
+    sds name = key->ptr;
+    size_t len = sdslen(name);
+    uint64_t hash;
+    uint32_t fp, h1, h2, est = 0;
+    int j, min = -1, freeslot = -1;
+
+    if (!server.hotkeys_tracking) return;
+    if (HotkeysSketch == NULL) hotkeysInit();
+
+    /* The database is used as seed, so that the same key in different
+     * databases is counted as a different key. The two halves of the hash
+     * are combined to obtain the bucket of every row. */
+    hash = MurmurHash64A(name,len,db->id);
+    h1 = (uint32_t)hash;
+    h2 = (uint32_t)(hash >> 32);
+    fp = h2 | 1; /* Zero means empty bucket. */
+
+    for (j = 0; j < HOTKEYS_ROWS; j++) {
+        hotkeysBucket *b = &HotkeysSketch[j][(h1+j*h2) % HOTKEYS_WIDTH];
+
+        if (b->count == 0) {
+            b->fp = fp;
+            b->count = 1;
+        } else if (b->fp == fp) {
+            if (b->count != UINT32_MAX) b->count++;
+        } else {
+            if (b->count < HOTKEYS_DECAY_TABLE &&
+                hotkeysRandom() < HotkeysDecay[b->count])
+            {
+                if (--b->count == 0) {
+                    b->fp = fp;
+                    b->count = 1;
+                }
+            }
+            continue;
+        }
+        if (b->count > est) est = b->count;
+    }
+
+    /* Most keys are not hot: don't even look at the top table unless the
+     * estimation is good enough to enter it. */
+    if (est <= HotkeysTopMin) return;
+
+    for (j = 0; j < HOTKEYS_TOPK; j++) {
+        hotkeysEntry *e = &HotkeysTop[j];
+
+        if (e->key == NULL) {
+            if (freeslot == -1) freeslot = j;
+            continue;
+        }
+        if (e->fp == fp && e->dbid == db->id && sdslen(e->key) == len &&
+            memcmp(e->key,name,len) == 0)
+        {
+            uint32_t old = e->count;
+
+            e->count = est;
+            if (old == HotkeysTopMin) hotkeysUpdateTopMin();
+            return;
+        }
+        if (min == -1 || e->count < HotkeysTop[min].count) min = j;
+    }
+
+    /* Not in the table: use a free entry or replace the least accessed. */
+    if (freeslot != -1) {
+        min = freeslot;
+        HotkeysTopUsed++;
+    } else {
+        sdsfree(HotkeysTop[min].key);
+    }
+    HotkeysTop[min].key = sdsnewlen(name,len);
+    HotkeysTop[min].dbid = db->id;
+    HotkeysTop[min].fp = fp;
+    HotkeysTop[min].count = est;
+    hotkeysUpdateTopMin();
+}
+
+/* Remove the top table entry at the specified index. */
+static void hotkeysRemoveEntry(int j) {
+    sdsfree(HotkeysTop[j].key);
+    HotkeysTop[j].key = NULL;
+    HotkeysTop[j].count = 0;
+    HotkeysTopUsed--;
+}
+
+/* Forget the keys of the specified database, or of all the databases if
+ * dbid is -1. Called when databases are flushed. The sketch is left as it
+ * is: the counters of keys no longer accessed will fade away anyway. */
+void hotkeysFlushDb(int dbid) {
+    int j;
+
+    for (j = 0; j < HOTKEYS_TOPK; j++) {
+        if (HotkeysTop[j].key == NULL) continue;
+        if (dbid == -1 || HotkeysTop[j].dbid == dbid) hotkeysRemoveEntry(j);
+    }
+    hotkeysUpdateTopMin();
+}
+
+/* Clear the sketch and the top table. */
+void hotkeysReset(void) {
+    hotkeysFlushDb(-1);
+    if (HotkeysSketch)
+        memset(HotkeysSketch,0,
+               sizeof(hotkeysBucket)*HOTKEYS_ROWS*HOTKEYS_WIDTH);
+}
+
+/* Halve all the counters every HOTKEYS_HALVE_PERIOD milliseconds, so that
+ * keys that are no longer accessed leave the top table. */
+void hotkeysCron(void) {
+    int i, j;
+
+    if (HotkeysSketch == NULL ||
+        mstime()-HotkeysLastHalve < HOTKEYS_HALVE_PERIOD) return;
+    HotkeysLastHalve = mstime();
+
+    for (i = 0; i < HOTKEYS_ROWS; i++)
+        for (j = 0; j < HOTKEYS_WIDTH; j++)
+            HotkeysSketch[i][j].count >>= 1;
+    for (j = 0; j < HOTKEYS_TOPK; j++) {
+        if (HotkeysTop[j].key == NULL) continue;
+        HotkeysTop[j].count >>= 1;
+        if (HotkeysTop[j].count == 0) hotkeysRemoveEntry(j);
+    }
+    hotkeysUpdateTopMin();
+}
+
+/* Sort entries by count, descending. */
+static int hotkeysCompareEntries(const void *a, const void *b) {
+    const hotkeysEntry *ea = *(hotkeysEntry**)a, *eb = *(hotkeysEntry**)b;
+
+    if (ea->count == eb->count) return 0;
+    return ea->count > eb->count ? -1 : 1;
+}
+
+/* HOTKEYS [COUNT <count>] [DB <dbid>] [SLOT <slot>]
+ * HOTKEYS RESET
+ *
+ * Reply with the most accessed keys, optionally only the ones of a given
+ * database or hash slot, from the most to the least accessed. Every key is
+ * reported as an array of key name, database, hash slot and estimated
+ * number of accesses. */
+void hotkeysCommand(client *c) {
+    hotkeysEntry *sorted[HOTKEYS_TOPK];
+    long long count = 10, dbid = -1, slot = -1;
+    int j, found = 0;
+
+    if (c->argc == 2 && !strcasecmp(c->argv[1]->ptr,"reset")) {
+        hotkeysReset();
+        addReply(c,shared.ok);
+        return;
+    }
+
+    for (j = 1; j < c->argc; j++) {
+        int moreargs = (c->argc-1) - j;
+        char *opt = c->argv[j]->ptr;
+        long long *val;
+
+        if (!strcasecmp(opt,"count") && moreargs) {
+            val = &count;
+        } else if (!strcasecmp(opt,"db") && moreargs) {
+            val = &dbid;
+        } else if (!strcasecmp(opt,"slot") && moreargs) {
+            val = &slot;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        if (getLongLongFromObjectOrReply(c,c->argv[++j],val,NULL) != C_OK)
+            return;
+    }
+    if (count < 1) {
+        addReplyError(c,"COUNT must be > 0");
+        return;
+    }
+    if (slot < -1 || slot >= CLUSTER_SLOTS) {
+        addReplyError(c,"Invalid or out of range slot");
+        return;
+    }
+
+    for (j = 0; j < HOTKEYS_TOPK; j++) {
+        hotkeysEntry *e = &HotkeysTop[j];
+
+        if (e->key == NULL) continue;
+        if (dbid != -1 && e->dbid != dbid) continue;
+        if (slot != -1 && keyHashSlot(e->key,sdslen(e->key)) != slot)
+            continue;
+        sorted[found++] = e;
+    }
+    qsort(sorted,found,sizeof(hotkeysEntry*),hotkeysCompareEntries);
+    if (count > found) count = found;
+
+    addReplyMultiBulkLen(c,count);
+    for (j = 0; j < count; j++) {
+        hotkeysEntry *e = sorted[j];
+
+        addReplyMultiBulkLen(c,4);
+        addReplyBulkCBuffer(c,e->key,sdslen(e->key));
+        addReplyLongLong(c,e->dbid);
+        addReplyLongLong(c,keyHashSlot(e->key,sdslen(e->key)));
+        addReplyLongLong(c,e->count);
+    }
+}
+
+/* Number of keys in the top table, for INFO. */
+unsigned long hotkeysGetTrackedCount(void) {
+    return HotkeysTopUsed;
+}
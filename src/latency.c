@@ -53,7 +53,8 @@ dictType latencyTimeSeriesDictType = {
     NULL,                       /* val dup */
     dictStringKeyCompare,       /* key compare */
     dictVanillaFree,            /* key destructor */
-    dictVanillaFree             /* val destructor */
+    dictVanillaFree,            /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* ------------------------- Utility functions ------------------------------ */
@@ -115,6 +116,7 @@ void latencyAddSample(char *event, mstime_t latency) {
     if (ts->samples[prev].time == now) {
         if (latency > ts->samples[prev].latency)
             ts->samples[prev].latency = latency;
+        loopTraceAddEvent(event,latency*1000);
         return;
     }
 
@@ -124,6 +126,7 @@ void latencyAddSample(char *event, mstime_t latency) {
 
     ts->idx++;
     if (ts->idx == LATENCY_TS_LEN) ts->idx = 0;
+    loopTraceAddEvent(event,latency*1000);
 }
 
 /* Reset data for the specified event, or all the events data if 'event' is
@@ -470,6 +473,206 @@ sds createLatencyReport(void) {
     return report;
 }
 
+/* ------------------------- Event loop profiler ---------------------------- */
+
+/* When loop-profiler is enabled the time spent in every phase of the event
+ * loop iterations is measured, so that it is possible to tell if latency
+ * comes from beforeSleep(), from the events processing or from the cron,
+ * or if the server is just waiting for events. The time of an iteration
+ * does not include the poll, so that it is the time the server was busy,
+ * that is the lag clients may observe. Besides the statistics of
+ * every phase, a trace of the latest iterations and latency monitor events
+ * is kept in a circular buffer, that is copied when an iteration takes more
+ * than loop-trace-threshold milliseconds, and can be inspected with the
+ * DEBUG LOOPTRACE command. */
+
+char *loopPhaseNames[LOOP_PHASE_NUM] = {
+    "iteration",
+    "before-sleep",
+    "expire-cycle",
+    "aof-flush",
+    "pending-writes",
+    "poll",
+    "events",
+    "cron"
+};
+
+/* Account 'usec' microseconds to the statistics of the specified phase. */
+static void loopProfilerAccount(int phase, long long usec) {
+    struct loopPhaseStats *ps = &server.loop.phases[phase];
+    int bucket = 0;
+
+    if (usec < 0) usec = 0; /* Clock skew. */
+    if (usec) bucket = 64-__builtin_clzll(usec);
+    if (bucket >= LOOP_HIST_BUCKETS) bucket = LOOP_HIST_BUCKETS-1;
+    ps->calls++;
+    ps->usec += usec;
+    if (usec > ps->max_usec) ps->max_usec = usec;
+    ps->hist[bucket]++;
+}
+
+/* Return the next entry of the trace, overwriting the oldest one. */
+static struct loopTraceEntry *loopTraceNext(void) {
+    struct loopTraceEntry *e;
+
+    if (server.loop.trace == NULL)
+        server.loop.trace = zcalloc(sizeof(*e)*LOOPTRACE_LEN);
+    e = server.loop.trace+server.loop.trace_idx;
+    server.loop.trace_idx = (server.loop.trace_idx+1) % LOOPTRACE_LEN;
+    return e;
+}
+
+/* Add a latency monitor event to the trace, called by latencyAddSample().
+ * The duration is in microseconds. */
+void loopTraceAddEvent(char *event, long long duration) {
+    struct loopTraceEntry *e;
+
+    if (!server.loop_profiler) return;
+    e = loopTraceNext();
+    e->start = ustime()-duration;
+    e->duration = duration;
+    memset(e->phases,0,sizeof(e->phases));
+    strncpy(e->event,event,LOOPTRACE_EVENT_LEN-1);
+    e->event[LOOPTRACE_EVENT_LEN-1] = '\0';
+}
+
+/* Called by loopPhaseEnd(): account the time elapsed since the phase
+ * started to the current iteration. */
+void loopProfilerAddPhase(int phase) {
+    struct loopProfiler *l = &server.loop;
+
+    if (l->phase_start[phase] == 0) return; /* Profiler just enabled. */
+    l->cur[phase] += ustime()-l->phase_start[phase];
+    l->phase_start[phase] = 0;
+    l->ran |= 1<<phase;
+}
+
+/* Called at the start of beforeSleep(): the previous iteration is complete,
+ * so its phases are accounted and traced, and a new iteration starts. */
+void loopProfilerBeforeSleep(void) {
+    struct loopProfiler *l = &server.loop;
+    long long now = ustime();
+    int j;
+
+    if (l->phase_start[LOOP_PHASE_ITERATION]) {
+        struct loopTraceEntry *e;
+
+        if (l->phase_start[LOOP_PHASE_EVENTS]) {
+            l->cur[LOOP_PHASE_EVENTS] = now-l->phase_start[LOOP_PHASE_EVENTS]-
+                                        l->cur[LOOP_PHASE_CRON];
+            l->ran |= 1<<LOOP_PHASE_EVENTS;
+        }
+        l->cur[LOOP_PHASE_ITERATION] = now-l->phase_start[LOOP_PHASE_ITERATION]-
+                                       l->cur[LOOP_PHASE_POLL];
+        l->ran |= 1<<LOOP_PHASE_ITERATION;
+        for (j = 0; j < LOOP_PHASE_NUM; j++)
+            if (l->ran & (1<<j)) loopProfilerAccount(j,l->cur[j]);
+
+        e = loopTraceNext();
+        e->start = l->phase_start[LOOP_PHASE_ITERATION];
+        e->duration = l->cur[LOOP_PHASE_ITERATION];
+        for (j = 0; j < LOOP_PHASE_NUM; j++)
+            e->phases[j] = l->cur[j] > 0 ? l->cur[j] : 0;
+        e->event[0] = '\0';
+
+        latencyAddSampleIfNeeded("event-loop",e->duration/1000);
+
+        /* Keep the trace leading to this iteration if it was slow. */
+        if (server.loop_trace_threshold &&
+            e->duration >= server.loop_trace_threshold*1000)
+        {
+            int first = server.loop.trace_idx;
+
+            if (l->slowtrace == NULL)
+                l->slowtrace = zmalloc(sizeof(*e)*LOOPTRACE_LEN);
+            memcpy(l->slowtrace,l->trace+first,
+                sizeof(*e)*(LOOPTRACE_LEN-first));
+            memcpy(l->slowtrace+(LOOPTRACE_LEN-first),l->trace,
+                sizeof(*e)*first);
+            l->slow_iterations++;
+        }
+    }
+    loopProfilerClearState();
+    l->phase_start[LOOP_PHASE_ITERATION] = now;
+    l->phase_start[LOOP_PHASE_BEFORE_SLEEP] = now;
+}
+
+/* Forget the current iteration. Called when the profiler is enabled, since
+ * the iteration in progress was not profiled. */
+void loopProfilerClearState(void) {
+    memset(server.loop.phase_start,0,sizeof(server.loop.phase_start));
+    memset(server.loop.cur,0,sizeof(server.loop.cur));
+    server.loop.ran = 0;
+}
+
+/* Reset the statistics and the trace of the latest slow iteration. */
+void loopProfilerReset(void) {
+    memset(server.loop.phases,0,sizeof(server.loop.phases));
+    server.loop.slow_iterations = 0;
+    zfree(server.loop.slowtrace);
+    server.loop.slowtrace = NULL;
+}
+
+/* DEBUG LOOPTRACE [LIVE]: reply with the trace of the latest slow event
+ * loop iteration, or with the current trace if 'live' is true. Every entry
+ * is the start time and duration in microseconds of either an iteration,
+ * followed by its phases, or of a latency monitor event. */
+void loopTraceReply(client *c, int live) {
+    struct loopTraceEntry *trace;
+    void *replylen = addDeferredMultiBulkLength(c);
+    int j, k, first, entries = 0;
+
+    if (live) {
+        trace = server.loop.trace;
+        first = server.loop.trace_idx;
+    } else {
+        trace = server.loop.slowtrace;
+        first = 0;
+    }
+    for (j = 0; trace && j < LOOPTRACE_LEN; j++) {
+        struct loopTraceEntry *e = trace+(first+j)%LOOPTRACE_LEN;
+        int phases = 0;
+
+        if (e->start == 0) continue;
+        if (e->event[0] == '\0') {
+            for (k = LOOP_PHASE_BEFORE_SLEEP; k < LOOP_PHASE_NUM; k++)
+                if (e->phases[k]) phases++;
+        }
+        addReplyMultiBulkLen(c,3+phases*2);
+        addReplyLongLong(c,e->start);
+        addReplyBulkCString(c,e->event[0] ? e->event : "iteration");
+        addReplyLongLong(c,e->duration);
+        for (k = LOOP_PHASE_BEFORE_SLEEP; phases && k < LOOP_PHASE_NUM; k++) {
+            if (e->phases[k] == 0) continue;
+            addReplyBulkCString(c,loopPhaseNames[k]);
+            addReplyLongLong(c,e->phases[k]);
+        }
+        entries++;
+    }
+    setDeferredMultiBulkLength(c,replylen,entries);
+}
+
+/* Add the event loop phases statistics to the INFO output. */
+sds genLoopstatsInfoString(sds info) {
+    int j;
+
+    info = sdscatprintf(info,
+        "loop_profiler:%d\r\n"
+        "loop_slow_iterations:%lld\r\n",
+        server.loop_profiler, server.loop.slow_iterations);
+    for (j = 0; j < LOOP_PHASE_NUM; j++) {
+        struct loopPhaseStats *ps = &server.loop.phases[j];
+
+        if (!ps->calls) continue;
+        info = sdscatprintf(info,
+            "loopstat_%s:calls=%lld,usec=%lld,usec_per_call=%.2f,"
+            "max_usec=%lld\r\n",
+            loopPhaseNames[j], ps->calls, ps->usec,
+            (float)ps->usec/ps->calls, ps->max_usec);
+    }
+    return info;
+}
+
 /* ---------------------- Latency command implementation -------------------- */
 
 /* latencyCommand() helper to produce a time-delay reply for all the samples
@@ -513,6 +716,36 @@ void latencyCommandReplyWithLatestEvents(client *c) {
 }
 
 #define LATENCY_GRAPH_COLS 80
+/* latencyCommand() helper to produce, for every event loop phase profiled,
+ * the name, number of calls, total and max time in microseconds, and the
+ * histogram of the durations as pairs of upper bound (exclusive) and count,
+ * for the non empty buckets only. */
+void latencyCommandReplyWithLoopStats(client *c) {
+    void *replylen = addDeferredMultiBulkLength(c);
+    int j, b, phases = 0;
+
+    for (j = 0; j < LOOP_PHASE_NUM; j++) {
+        struct loopPhaseStats *ps = &server.loop.phases[j];
+        int buckets = 0;
+
+        if (!ps->calls) continue;
+        for (b = 0; b < LOOP_HIST_BUCKETS; b++) if (ps->hist[b]) buckets++;
+        addReplyMultiBulkLen(c,5);
+        addReplyBulkCString(c,loopPhaseNames[j]);
+        addReplyLongLong(c,ps->calls);
+        addReplyLongLong(c,ps->usec);
+        addReplyLongLong(c,ps->max_usec);
+        addReplyMultiBulkLen(c,buckets*2);
+        for (b = 0; b < LOOP_HIST_BUCKETS; b++) {
+            if (!ps->hist[b]) continue;
+            addReplyLongLong(c,1LL<<b);
+            addReplyLongLong(c,ps->hist[b]);
+        }
+        phases++;
+    }
+    setDeferredMultiBulkLength(c,replylen,phases);
+}
+
 sds latencyCommandGenSparkeline(char *event, struct latencyTimeSeries *ts) {
     int j;
     struct sequence *seq = createSparklineSequence();
@@ -563,6 +796,7 @@ sds latencyCommandGenSparkeline(char *event, struct latencyTimeSeries *ts) {
  * LATENCY LATEST: return the latest latency for all the events classes.
  * LATENCY DOCTOR: returns an human readable analysis of instance latency.
  * LATENCY GRAPH: provide an ASCII graph of the latency of the specified event.
+ * LATENCY LOOP: return the statistics of the event loop phases.
  */
 void latencyCommand(client *c) {
     struct latencyTimeSeries *ts;
@@ -598,6 +832,14 @@ void latencyCommand(client *c) {
 
         addReplyBulkCBuffer(c,report,sdslen(report));
         sdsfree(report);
+    } else if (!strcasecmp(c->argv[1]->ptr,"loop") && c->argc == 2) {
+        /* LATENCY LOOP */
+        latencyCommandReplyWithLoopStats(c);
+    } else if (!strcasecmp(c->argv[1]->ptr,"loop") && c->argc == 3 &&
+               !strcasecmp(c->argv[2]->ptr,"reset")) {
+        /* LATENCY LOOP RESET */
+        loopProfilerReset();
+        addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"reset") && c->argc >= 2) {
         /* LATENCY RESET */
         if (c->argc == 2) {
@@ -61,9 +61,63 @@ struct latencyStats {
     time_t period;          /* Number of seconds since first event and now. */
 };
 
+/* Event loop profiler: phases of every event loop iteration. The phases
+ * from LOOP_PHASE_EXPIRE to LOOP_PHASE_WRITES are part of beforeSleep(), and
+ * the cron is part of the events processing. */
+#define LOOP_PHASE_ITERATION 0      /* Whole iteration but the poll. */
+#define LOOP_PHASE_BEFORE_SLEEP 1   /* beforeSleep(). */
+#define LOOP_PHASE_EXPIRE 2         /* Fast active expire cycle. */
+#define LOOP_PHASE_AOF 3            /* AOF buffer flush. */
+#define LOOP_PHASE_WRITES 4         /* Clients with pending writes. */
+#define LOOP_PHASE_POLL 5           /* Waiting for events. */
+#define LOOP_PHASE_EVENTS 6         /* File and time events processing. */
+#define LOOP_PHASE_CRON 7           /* serverCron(). */
+#define LOOP_PHASE_NUM 8
+
+#define LOOP_HIST_BUCKETS 25 /* Power of two buckets, in microseconds. */
+#define LOOPTRACE_LEN 256    /* Entries of the event loop trace. */
+#define LOOPTRACE_EVENT_LEN 32
+
+/* Timing statistics of an event loop phase. */
+struct loopPhaseStats {
+    long long calls;
+    long long usec;
+    long long max_usec;
+    long long hist[LOOP_HIST_BUCKETS]; /* hist[i]: durations < 2^i usec. */
+};
+
+/* An entry of the event loop trace: either an event loop iteration with
+ * the time spent in every phase, or a latency monitor event. */
+struct loopTraceEntry {
+    long long start;            /* Unix time in microseconds. */
+    long long duration;         /* Microseconds. */
+    uint32_t phases[LOOP_PHASE_NUM]; /* Iterations only. */
+    char event[LOOPTRACE_EVENT_LEN]; /* Latency event name, or "". */
+};
+
+/* Event loop profiler state. */
+struct loopProfiler {
+    long long phase_start[LOOP_PHASE_NUM]; /* Current phases start time. */
+    long long cur[LOOP_PHASE_NUM];         /* Current iteration phases. */
+    int ran;                    /* Bitmap of the phases that ran. */
+    struct loopPhaseStats phases[LOOP_PHASE_NUM];
+    long long slow_iterations;  /* Iterations over loop-trace-threshold. */
+    struct loopTraceEntry *trace;       /* Circular buffer. */
+    int trace_idx;                      /* Index of the next entry. */
+    struct loopTraceEntry *slowtrace;   /* Trace of the latest slow iteration,
+                                           oldest entry first. */
+};
+
+extern char *loopPhaseNames[];
+
 void latencyMonitorInit(void);
 void latencyAddSample(char *event, mstime_t latency);
 int THPIsEnabled(void);
+void loopProfilerAddPhase(int phase);
+void loopProfilerBeforeSleep(void);
+void loopProfilerClearState(void);
+void loopProfilerReset(void);
+void loopTraceAddEvent(char *event, long long duration);
 
 /* Latency monitoring macros. */
 
@@ -90,4 +144,14 @@ int THPIsEnabled(void);
 #define latencyRemoveNestedEvent(event_var,nested_var) \
     event_var += nested_var;
 
+/* Event loop profiler macros: the time spent between the two calls is
+ * accounted to the specified phase of the current event loop iteration. */
+#define loopPhaseStart(phase) if (server.loop_profiler) { \
+    server.loop.phase_start[phase] = ustime(); \
+}
+
+#define loopPhaseEnd(phase) if (server.loop_profiler) { \
+    loopProfilerAddPhase(phase); \
+}
+
 #endif /* __LATENCY_H */
@@ -0,0 +1,434 @@
+/* metrics.c - OpenMetrics exporter served over HTTP.
+ *
+ * Copyright (c) 2026, Redis contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+
+#include <sys/resource.h>
+
+/* When metrics-port is not zero, Redis listens on that port (and on the same
+ * addresses of the normal clients port) for HTTP requests of monitoring
+ * systems such as Prometheus, and replies to "GET /metrics" with the server
+ * metrics in the OpenMetrics text format.
+ *
+ * The connections are served by the event loop like the normal clients, but
+ * they are not Redis clients: they are not in the clients list, they don't
+ * use the maxclients slots, and are closed after the reply is sent.
+ *
+ * The reply is generated from the counters the server already maintains
+ * while it runs, so a scrape costs O(number of metrics): unlike INFO it
+ * never scans the keyspace or the list of clients (so the client buffer
+ * sizes INFO reports are not exported). */
+
+#define METRICS_MAX_CLIENTS 16      /* Concurrent HTTP connections. */
+#define METRICS_MAX_REQUEST 8192    /* Max size of the HTTP request. */
+#define METRICS_CLIENT_TIMEOUT 10   /* Seconds to send request and get reply. */
+#define METRICS_CONTENT_TYPE \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef struct metricsClient {
+    int fd;
+    sds buf;                /* The request, then the response. */
+    size_t sentlen;         /* Bytes of the response already sent. */
+    time_t ctime;           /* Connection time. */
+} metricsClient;
+
+/* ============================ Metrics generation ========================== */
+
+/* Add the TYPE and HELP lines of a metric family. */
+static sds metricsAddFamily(sds s, char *name, char *type, char *help) {
+    return sdscatprintf(s,"# TYPE redis_%s %s\n# HELP redis_%s %s\n",
+        name, type, name, help);
+}
+
+/* Add a family with a single integer sample. Counters get the _total
+ * suffix, as required by OpenMetrics. */
+static sds metricsAddGauge(sds s, char *name, char *help, long long value) {
+    s = metricsAddFamily(s,name,"gauge",help);
+    return sdscatprintf(s,"redis_%s %lld\n", name, value);
+}
+
+static sds metricsAddCounter(sds s, char *name, char *help, long long value) {
+    s = metricsAddFamily(s,name,"counter",help);
+    return sdscatprintf(s,"redis_%s_total %lld\n", name, value);
+}
+
+/* Return the metrics in the OpenMetrics text format. */
+sds metricsGenerate(void) {
+    sds s = sdsempty();
+    struct rusage self_ru;
+    dictIterator *di;
+    dictEntry *de;
+    int j;
+
+    /* Server */
+    s = metricsAddGauge(s,"uptime_seconds",
+        "Seconds since the server started.",
+        server.unixtime-server.stat_starttime);
+    getrusage(RUSAGE_SELF,&self_ru);
+    s = metricsAddFamily(s,"cpu_sys_seconds","counter",
+        "System CPU consumed by the server.");
+    s = sdscatprintf(s,"redis_cpu_sys_seconds_total %ld.%06ld\n",
+        (long)self_ru.ru_stime.tv_sec, (long)self_ru.ru_stime.tv_usec);
+    s = metricsAddFamily(s,"cpu_user_seconds","counter",
+        "User CPU consumed by the server.");
+    s = sdscatprintf(s,"redis_cpu_user_seconds_total %ld.%06ld\n",
+        (long)self_ru.ru_utime.tv_sec, (long)self_ru.ru_utime.tv_usec);
+
+    /* Clients */
+    s = metricsAddGauge(s,"connected_clients",
+        "Number of client connections, excluding slaves.",
+        listLength(server.clients)-listLength(server.slaves));
+    s = metricsAddGauge(s,"blocked_clients",
+        "Clients blocked in a blocking call.",
+        server.bpop_blocked_clients);
+    s = metricsAddCounter(s,"connections_received",
+        "Connections accepted by the server.",server.stat_numconnections);
+    s = metricsAddCounter(s,"rejected_connections",
+        "Connections rejected because of maxclients.",
+        server.stat_rejected_conn);
+    s = metricsAddCounter(s,"evicted_clients",
+        "Clients evicted because of maxmemory-clients.",
+        server.stat_evictedclients);
+
+    /* Memory */
+    s = metricsAddGauge(s,"memory_used_bytes",
+        "Memory allocated by the server.",zmalloc_used_memory());
+    s = metricsAddGauge(s,"memory_peak_bytes",
+        "Peak memory allocated by the server.",server.stat_peak_memory);
+    s = metricsAddGauge(s,"memory_rss_bytes",
+        "Resident set size, sampled by the server cron.",
+        server.resident_set_size);
+    s = metricsAddGauge(s,"memory_max_bytes",
+        "The maxmemory setting, 0 if unlimited.",server.maxmemory);
+
+    /* Persistence */
+    s = metricsAddGauge(s,"rdb_changes_since_last_save",
+        "Changes to the dataset since the last save.",server.dirty);
+    s = metricsAddGauge(s,"rdb_last_save_timestamp_seconds",
+        "Unix time of the last successful save.",server.lastsave);
+    s = metricsAddGauge(s,"rdb_bgsave_in_progress",
+        "1 if a RDB save is in progress.",server.rdb_child_pid != -1);
+    s = metricsAddGauge(s,"aof_rewrite_in_progress",
+        "1 if an AOF rewrite is in progress.",server.aof_child_pid != -1);
+
+    /* Stats */
+    s = metricsAddCounter(s,"commands_processed",
+        "Commands processed by the server.",server.stat_numcommands);
+    s = metricsAddCounter(s,"net_input_bytes",
+        "Bytes read from the network.",server.stat_net_input_bytes);
+    s = metricsAddCounter(s,"net_output_bytes",
+        "Bytes written to the network.",server.stat_net_output_bytes);
+    s = metricsAddCounter(s,"expired_keys",
+        "Keys removed because expired.",server.stat_expiredkeys);
+    s = metricsAddCounter(s,"evicted_keys",
+        "Keys evicted because of maxmemory.",server.stat_evictedkeys);
+    s = metricsAddCounter(s,"keyspace_hits",
+        "Successful lookups of keys.",server.stat_keyspace_hits);
+    s = metricsAddCounter(s,"keyspace_misses",
+        "Failed lookups of keys.",server.stat_keyspace_misses);
+    s = metricsAddCounter(s,"metrics_scrapes",
+        "Metrics requests served.",server.stat_metrics_scrapes);
+
+    /* Replication */
+    s = metricsAddGauge(s,"connected_slaves",
+        "Number of connected slaves.",listLength(server.slaves));
+    s = metricsAddGauge(s,"master_repl_offset",
+        "Replication offset of the server.",server.master_repl_offset);
+    s = metricsAddCounter(s,"sync_full",
+        "Full resynchronizations with slaves.",server.stat_sync_full);
+    s = metricsAddCounter(s,"sync_partial_ok",
+        "Accepted partial resynchronization requests.",
+        server.stat_sync_partial_ok);
+    s = metricsAddCounter(s,"sync_partial_err",
+        "Refused partial resynchronization requests.",
+        server.stat_sync_partial_err);
+
+    /* Keyspace: the size of the dictionaries is known without scanning. */
+    s = metricsAddFamily(s,"db_keys","gauge","Keys in the database.");
+    for (j = 0; j < server.dbnum; j++) {
+        long long keys = dictSize(server.db[j].dict);
+
+        if (keys) s = sdscatprintf(s,"redis_db_keys{db=\"%d\"} %lld\n",
+                                   j, keys);
+    }
+    s = metricsAddFamily(s,"db_keys_expiring","gauge",
+        "Keys with an expire in the database.");
+    for (j = 0; j < server.dbnum; j++) {
+        long long keys = dictSize(server.db[j].expires);
+
+        if (keys) s = sdscatprintf(s,
+            "redis_db_keys_expiring{db=\"%d\"} %lld\n", j, keys);
+    }
+
+    /* Commands */
+    s = metricsAddFamily(s,"commands","counter","Calls of the command.");
+    di = dictGetIterator(server.commands);
+    while((de = dictNext(di)) != NULL) {
+        struct redisCommand *c = dictGetVal(de);
+
+        if (!c->calls) continue;
+        s = sdscatprintf(s,"redis_commands_total{cmd=\"%s\"} %lld\n",
+            c->name, c->calls);
+    }
+    dictReleaseIterator(di);
+    s = metricsAddFamily(s,"commands_duration_seconds","counter",
+        "Time spent executing the command.");
+    di = dictGetIterator(server.commands);
+    while((de = dictNext(di)) != NULL) {
+        struct redisCommand *c = dictGetVal(de);
+
+        if (!c->calls) continue;
+        s = sdscatprintf(s,
+            "redis_commands_duration_seconds_total{cmd=\"%s\"} %lld.%06lld\n",
+            c->name, c->microseconds/1000000, c->microseconds%1000000);
+    }
+    dictReleaseIterator(di);
+
+    /* Event loop phases, if the profiler is enabled. */
+    if (server.loop_profiler) {
+        s = metricsAddFamily(s,"event_loop_phase_seconds","counter",
+            "Time spent in the event loop phase.");
+        for (j = 0; j < LOOP_PHASE_NUM; j++) {
+            long long usec = server.loop.phases[j].usec;
+
+            if (!server.loop.phases[j].calls) continue;
+            s = sdscatprintf(s,
+                "redis_event_loop_phase_seconds_total{phase=\"%s\"} "
+                "%lld.%06lld\n", loopPhaseNames[j], usec/1000000,
+                usec%1000000);
+        }
+    }
+    return sdscat(s,"# EOF\n");
+}
+
+/* ============================== HTTP server =============================== */
+
+static void metricsFreeClient(metricsClient *mc) {
+    listNode *ln = listSearchKey(server.metrics_clients,mc);
+
+    if (ln) listDelNode(server.metrics_clients,ln);
+    aeDeleteFileEvent(server.el,mc->fd,AE_READABLE|AE_WRITABLE);
+    close(mc->fd);
+    sdsfree(mc->buf);
+    zfree(mc);
+}
+
+static void metricsWriteHandler(aeEventLoop *el, int fd, void *privdata,
+                                int mask)
+{
+    metricsClient *mc = privdata;
+    ssize_t nwritten;
+    UNUSED(el);
+    UNUSED(mask);
+
+    nwritten = write(fd,mc->buf+mc->sentlen,sdslen(mc->buf)-mc->sentlen);
+    if (nwritten == -1) {
+        if (errno == EAGAIN) return;
+        metricsFreeClient(mc);
+        return;
+    }
+    mc->sentlen += nwritten;
+    if (mc->sentlen == sdslen(mc->buf)) metricsFreeClient(mc);
+}
+
+/* Replace the request with the HTTP response, and start sending it. The
+ * connection is closed once the response is sent. */
+static void metricsReply(metricsClient *mc, int code, char *status,
+                         char *ctype, sds body, int head)
+{
+    sdsfree(mc->buf);
+    mc->buf = sdscatprintf(sdsempty(),
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n"
+        "\r\n", code, status, ctype, sdslen(body));
+    if (!head) mc->buf = sdscatsds(mc->buf,body);
+    sdsfree(body);
+    mc->sentlen = 0;
+    aeDeleteFileEvent(server.el,mc->fd,AE_READABLE);
+    if (aeCreateFileEvent(server.el,mc->fd,AE_WRITABLE,
+        metricsWriteHandler,mc) == AE_ERR)
+    {
+        metricsFreeClient(mc);
+    }
+}
+
+/* Serve the request, once the headers were read. Only the request line is
+ * checked: the headers are ignored. */
+static void metricsProcessRequest(metricsClient *mc) {
+    char *method = mc->buf, *path, *p;
+    int head;
+
+    if ((path = strchr(method,' ')) == NULL) goto badreq;
+    *path++ = '\0';
+    if ((p = strpbrk(path," ?\r\n")) == NULL) goto badreq;
+    *p = '\0';
+
+    head = !strcmp(method,"HEAD");
+    if (strcmp(method,"GET") && !head) {
+        metricsReply(mc,405,"Method Not Allowed","text/plain",
+            sdsnew("Method not allowed\n"),0);
+    } else if (strcmp(path,"/metrics") && strcmp(path,"/")) {
+        metricsReply(mc,404,"Not Found","text/plain",
+            sdsnew("Not found, try /metrics\n"),head);
+    } else {
+        server.stat_metrics_scrapes++;
+        metricsReply(mc,200,"OK",METRICS_CONTENT_TYPE,metricsGenerate(),head);
+    }
+    return;
+
+badreq:
+    metricsReply(mc,400,"Bad Request","text/plain",
+        sdsnew("Bad request\n"),0);
+}
+
+static void metricsReadHandler(aeEventLoop *el, int fd, void *privdata,
+                               int mask)
+{
+    metricsClient *mc = privdata;
+    char buf[PROTO_IOBUF_LEN];
+    ssize_t nread;
+    UNUSED(el);
+    UNUSED(mask);
+
+    nread = read(fd,buf,sizeof(buf));
+    if (nread == -1 && errno == EAGAIN) return;
+    if (nread <= 0) {
+        metricsFreeClient(mc);
+        return;
+    }
+    mc->buf = sdscatlen(mc->buf,buf,nread);
+
+    /* Wait for the empty line terminating the headers. */
+    if (strstr(mc->buf,"\r\n\r\n") || strstr(mc->buf,"\n\n")) {
+        metricsProcessRequest(mc);
+    } else if (sdslen(mc->buf) > METRICS_MAX_REQUEST) {
+        metricsReply(mc,431,"Request Header Fields Too Large","text/plain",
+            sdsnew("Request too large\n"),0);
+    }
+}
+
+/* Create a metricsClient for the accepted connection. In protected mode, if
+ * no bind address is specified, only connections from the loopback interface
+ * are served. Unlike for the normal clients a password does not lift the
+ * restriction: the metrics requests are never authenticated. */
+static void metricsCreateClient(int fd, char *ip) {
+    metricsClient *mc;
+
+    if (listLength(server.metrics_clients) >= METRICS_MAX_CLIENTS) {
+        close(fd);
+        return;
+    }
+    anetNonBlock(NULL,fd);
+    anetEnableTcpNoDelay(NULL,fd);
+    mc = zmalloc(sizeof(*mc));
+    mc->fd = fd;
+    mc->buf = sdsempty();
+    mc->sentlen = 0;
+    mc->ctime = server.unixtime;
+    listAddNodeTail(server.metrics_clients,mc);
+
+    if (server.protected_mode &&
+        server.bindaddr_count == 0 &&
+        strcmp(ip,"127.0.0.1") && strcmp(ip,"::1"))
+    {
+        metricsReply(mc,403,"Forbidden","text/plain",
+            sdsnew("Redis is running in protected mode: metrics are only "
+                   "served to the loopback interface.\n"),0);
+        return;
+    }
+    if (aeCreateFileEvent(server.el,fd,AE_READABLE,
+        metricsReadHandler,mc) == AE_ERR)
+    {
+        metricsFreeClient(mc);
+    }
+}
+
+static void metricsAcceptHandler(aeEventLoop *el, int fd, void *privdata,
+                                 int mask)
+{
+    int cport, cfd, max = METRICS_MAX_CLIENTS;
+    char cip[NET_IP_STR_LEN];
+    UNUSED(el);
+    UNUSED(mask);
+    UNUSED(privdata);
+
+    while(max--) {
+        cfd = anetTcpAccept(server.neterr, fd, cip, sizeof(cip), &cport);
+        if (cfd == ANET_ERR) {
+            if (errno != EWOULDBLOCK)
+                serverLog(LL_WARNING,
+                    "Accepting metrics connection: %s", server.neterr);
+            return;
+        }
+        serverLog(LL_DEBUG,"Accepted metrics connection %s:%d", cip, cport);
+        metricsCreateClient(cfd,cip);
+    }
+}
+
+/* ============================ Public API ================================== */
+
+/* Listen on metrics-port if configured. Called by initServer(). */
+void metricsInit(void) {
+    int j;
+
+    server.metrics_fd_count = 0;
+    server.metrics_clients = listCreate();
+    if (server.metrics_port == 0) return;
+
+    if (listenToPort(server.metrics_port,server.metrics_fd,
+        &server.metrics_fd_count) == C_ERR)
+    {
+        exit(1);
+    }
+    for (j = 0; j < server.metrics_fd_count; j++) {
+        if (aeCreateFileEvent(server.el, server.metrics_fd[j], AE_READABLE,
+            metricsAcceptHandler, NULL) == AE_ERR)
+                serverPanic("Unrecoverable error creating the metrics "
+                            "file event.");
+    }
+    serverLog(LL_NOTICE,"Serving metrics on port %d", server.metrics_port);
+}
+
+/* Close the connections that did not complete the request (or did not read
+ * the response) in METRICS_CLIENT_TIMEOUT seconds. Called by serverCron(). */
+void metricsCron(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.metrics_clients,&li);
+    while((ln = listNext(&li)) != NULL) {
+        metricsClient *mc = listNodeValue(ln);
+
+        if (server.unixtime-mc->ctime > METRICS_CLIENT_TIMEOUT)
+            metricsFreeClient(mc);
+    }
+}
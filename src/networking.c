@@ -31,7 +31,13 @@
 #include <sys/uio.h>
 #include <math.h>
 
-static void setProtocolError(client *c, int pos);
+static void setProtocolError(client *c);
+
+/* Clients with no partial command pending don't own a query buffer: reads
+ * go into this shared scratch buffer, and only what is left after processing
+ * the commands (an incomplete command) is moved into a private c->querybuf.
+ * This way idle clients don't hold a PROTO_IOBUF_LEN buffer each. */
+static sds thread_shared_qb = NULL;
 
 /* Return the size consumed from the allocator, for the specified SDS string,
  * including internal fragmentation. This function is used in order to compute
@@ -61,7 +67,23 @@ int listMatchObjects(void *a, void *b) {
     return equalStringObjects(a,b);
 }
 
-client *createClient(int fd) {
+/* Flags for setupClientSocket(), describing the kind of connection. */
+#define CLIENT_SOCK_UNIX (1<<0)     /* Unix domain socket. */
+
+/* Set the socket options of a new client connection. Unix sockets don't
+ * need the TCP options at all: this saves a few syscalls per connection
+ * during reconnection storms. */
+static void setupClientSocket(int fd, int sockflags) {
+    anetNonBlock(NULL,fd);
+    if (sockflags & CLIENT_SOCK_UNIX) return;
+    anetEnableTcpNoDelay(NULL,fd);
+    if (server.tcpkeepalive)
+        anetKeepAlive(NULL,fd,server.tcpkeepalive);
+    if (server.busy_poll_usec)
+        anetBusyPoll(NULL,fd,server.busy_poll_usec);
+}
+
+static client *createClientWithSocketFlags(int fd, int sockflags) {
     client *c = zmalloc(sizeof(client));
 
     /* passing -1 as fd it is possible to create a non connected client.
@@ -69,10 +91,7 @@ client *createClient(int fd) {
      * in the context of a client. When commands are executed in other
      * contexts (for instance a Lua script) we need a non connected client. */
     if (fd != -1) {
-        anetNonBlock(NULL,fd);
-        anetEnableTcpNoDelay(NULL,fd);
-        if (server.tcpkeepalive)
-            anetKeepAlive(NULL,fd,server.tcpkeepalive);
+        setupClientSocket(fd,sockflags);
         if (aeCreateFileEvent(server.el,fd,AE_READABLE,
             readQueryFromClient, c) == AE_ERR)
         {
@@ -87,11 +106,15 @@ client *createClient(int fd) {
     c->fd = fd;
     c->name = NULL;
     c->bufpos = 0;
-    c->querybuf = sdsempty();
+    c->querybuf = NULL;
+    c->qb_pos = 0;
     c->querybuf_peak = 0;
     c->reqtype = 0;
+    c->resp = 2;
     c->argc = 0;
     c->argv = NULL;
+    c->argv_len = 0;
+    c->argv_len_sum = 0;
     c->cmd = c->lastcmd = NULL;
     c->multibulklen = 0;
     c->bulklen = -1;
@@ -110,7 +133,7 @@ client *createClient(int fd) {
     c->reply = listCreate();
     c->reply_bytes = 0;
     c->obuf_soft_limit_reached_time = 0;
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     c->btype = BLOCKED_NONE;
     c->bpop.timeout = 0;
@@ -123,13 +146,25 @@ client *createClient(int fd) {
     c->pubsub_channels = dictCreate(&setDictType,NULL);
     c->pubsub_patterns = listCreate();
     c->peerid = NULL;
+    c->client_tracking_redirection = 0;
+    c->client_tracking_prefixes = NULL;
+    c->last_memory_usage = 0;
+    c->mem_usage_bucket = NULL;
+    c->mem_usage_bucket_node = NULL;
     listSetFreeMethod(c->pubsub_patterns,decrRefCountVoid);
     listSetMatchMethod(c->pubsub_patterns,listMatchObjects);
-    if (fd != -1) listAddNodeTail(server.clients,c);
+    if (fd != -1) {
+        listAddNodeTail(server.clients,c);
+        dictAdd(server.clients_index,&c->id,c);
+    }
     initClientMultiState(c);
     return c;
 }
 
+client *createClient(int fd) {
+    return createClientWithSocketFlags(fd,0);
+}
+
 /* This function is called every time we are going to transmit new data
  * to the client. The behavior is the following:
  *
@@ -190,20 +225,50 @@ int prepareClientToWrite(client *c) {
     return C_OK;
 }
 
-/* Create a duplicate of the last object in the reply list when
- * it is not exclusively owned by the reply list. */
-robj *dupLastObjectIfNeeded(list *reply) {
-    robj *new, *cur;
-    listNode *ln;
-    serverAssert(listLength(reply) > 0);
-    ln = listLast(reply);
-    cur = listNodeValue(ln);
-    if (cur->refcount > 1) {
-        new = dupStringObject(cur);
-        decrRefCount(cur);
-        listNodeValue(ln) = new;
+/* Reply list blocks.
+ *
+ * Data copied into the reply list is stored in blocks of fixed size: string
+ * objects owning an sds preallocated to PROTO_REPLY_CHUNK_BYTES, that are
+ * filled by appending and never reallocated. This way the reply_bytes
+ * accounting of a block never changes while it is filled, and the blocks
+ * released after being sent are kept in a small pool, to be reused by the
+ * next replies without going through the allocator. */
+#define REPLY_BLOCK_POOL_SIZE 64
+static robj *reply_block_pool[REPLY_BLOCK_POOL_SIZE];
+static int reply_block_pool_len = 0;
+
+/* Return an empty reply block, from the pool if possible. */
+static robj *createReplyBlock(void) {
+    sds s;
+
+    if (reply_block_pool_len) return reply_block_pool[--reply_block_pool_len];
+    s = sdsnewlen(NULL,PROTO_REPLY_CHUNK_BYTES);
+    sdsclear(s);
+    return createObject(OBJ_STRING,s);
+}
+
+/* Return true if 'o' is a reply block exclusively owned by the reply list,
+ * so that more data can be appended to it. Values linked by reference in
+ * the list (see PROTO_REPLY_NOCOPY_BYTES) and deferred lengths are never
+ * appended to. */
+static int isReplyBlock(robj *o) {
+    return o->refcount == 1 &&
+           o->encoding == OBJ_ENCODING_RAW &&
+           o->ptr != NULL &&
+           sdsalloc(o->ptr) == PROTO_REPLY_CHUNK_BYTES;
+}
+
+/* Free method of the reply list: blocks go back to the pool if there is
+ * room, everything else is just released. */
+void freeClientReplyValue(void *o) {
+    robj *obj = o;
+
+    if (reply_block_pool_len < REPLY_BLOCK_POOL_SIZE && isReplyBlock(obj)) {
+        sdsclear(obj->ptr);
+        reply_block_pool[reply_block_pool_len++] = obj;
+    } else {
+        decrRefCount(obj);
     }
-    return listNodeValue(ln);
 }
 
 /* -----------------------------------------------------------------------------
@@ -227,32 +292,41 @@ int _addReplyToBuffer(client *c, const char *s, size_t len) {
     return C_OK;
 }
 
-void _addReplyObjectToList(client *c, robj *o) {
-    robj *tail;
+/* Copy 'len' bytes at the tail of the reply list, filling the last block
+ * and adding new blocks as needed. */
+static void _addReplyProtoToList(client *c, const char *s, size_t len) {
+    listNode *ln = listLast(c->reply);
+    robj *block = ln ? listNodeValue(ln) : NULL;
+    size_t copy;
 
+    if (block && isReplyBlock(block)) {
+        copy = sdsavail(block->ptr) < len ? sdsavail(block->ptr) : len;
+        block->ptr = sdscatlen(block->ptr,s,copy); /* Never reallocates. */
+        s += copy;
+        len -= copy;
+    }
+    while(len) {
+        block = createReplyBlock();
+        copy = len < PROTO_REPLY_CHUNK_BYTES ? len : PROTO_REPLY_CHUNK_BYTES;
+        block->ptr = sdscatlen(block->ptr,s,copy);
+        listAddNodeTail(c->reply,block);
+        c->reply_bytes += sdsZmallocSize(block->ptr);
+        s += copy;
+        len -= copy;
+    }
+}
+
+void _addReplyObjectToList(client *c, robj *o) {
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
+    /* Big values are always linked by reference (zero copy), the writev()
+     * in writeToClient() will send them straight from the object. */
+    if (sdslen(o->ptr) >= PROTO_REPLY_NOCOPY_BYTES) {
         incrRefCount(o);
         listAddNodeTail(c->reply,o);
         c->reply_bytes += getStringObjectSdsUsedMemory(o);
     } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
-            tail->encoding == OBJ_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(o->ptr) <= PROTO_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= sdsZmallocSize(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
-            c->reply_bytes += sdsZmallocSize(tail->ptr);
-        } else {
-            incrRefCount(o);
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += getStringObjectSdsUsedMemory(o);
-        }
+        _addReplyProtoToList(c,o->ptr,sdslen(o->ptr));
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
@@ -260,64 +334,25 @@ void _addReplyObjectToList(client *c, robj *o) {
 /* This method takes responsibility over the sds. When it is no longer
  * needed it will be free'd, otherwise it ends up in a robj. */
 void _addReplySdsToList(client *c, sds s) {
-    robj *tail;
-
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) {
         sdsfree(s);
         return;
     }
 
-    if (listLength(c->reply) == 0) {
+    if (sdslen(s) >= PROTO_REPLY_NOCOPY_BYTES) {
         listAddNodeTail(c->reply,createObject(OBJ_STRING,s));
         c->reply_bytes += sdsZmallocSize(s);
     } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == OBJ_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(s) <= PROTO_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= sdsZmallocSize(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
-            c->reply_bytes += sdsZmallocSize(tail->ptr);
-            sdsfree(s);
-        } else {
-            listAddNodeTail(c->reply,createObject(OBJ_STRING,s));
-            c->reply_bytes += sdsZmallocSize(s);
-        }
+        _addReplyProtoToList(c,s,sdslen(s));
+        sdsfree(s);
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
 void _addReplyStringToList(client *c, const char *s, size_t len) {
-    robj *tail;
-
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
-        robj *o = createStringObject(s,len);
-
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += getStringObjectSdsUsedMemory(o);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == OBJ_ENCODING_RAW &&
-            sdslen(tail->ptr)+len <= PROTO_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= sdsZmallocSize(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,len);
-            c->reply_bytes += sdsZmallocSize(tail->ptr);
-        } else {
-            robj *o = createStringObject(s,len);
-
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += getStringObjectSdsUsedMemory(o);
-        }
-    }
+    _addReplyProtoToList(c,s,len);
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
@@ -337,7 +372,10 @@ void addReply(client *c, robj *obj) {
      * we'll be able to send the object to the client without
      * messing with its page. */
     if (sdsEncodedObject(obj)) {
-        if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != C_OK)
+        /* Big values skip the static buffer: they are referenced by the
+         * reply list instead of being copied. */
+        if (sdslen(obj->ptr) >= PROTO_REPLY_NOCOPY_BYTES ||
+            _addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != C_OK)
             _addReplyObjectToList(c,obj);
     } else if (obj->encoding == OBJ_ENCODING_INT) {
         /* Optimization: if there is room in the static buffer for 32 bytes
@@ -438,57 +476,121 @@ void *addDeferredMultiBulkLength(client *c) {
     return listLast(c->reply);
 }
 
-/* Populate the length object and try gluing it to the next chunk. */
-void setDeferredMultiBulkLength(client *c, void *node, long length) {
+/* Populate the length object and try gluing it to the next chunk.
+ * 'prefix' is the aggregate type: '*' array, '%' map, '~' set. */
+static void setDeferredAggregateLen(client *c, void *node, long length,
+                                    char prefix)
+{
     listNode *ln = (listNode*)node;
     robj *len, *next;
+    char lenstr[128];
+    size_t lenlen;
 
     /* Abort when *node is NULL (see addDeferredMultiBulkLength). */
     if (node == NULL) return;
 
-    len = listNodeValue(ln);
-    len->ptr = sdscatprintf(sdsempty(),"*%ld\r\n",length);
-    len->encoding = OBJ_ENCODING_RAW; /* in case it was an EMBSTR. */
-    c->reply_bytes += sdsZmallocSize(len->ptr);
+    lenlen = snprintf(lenstr,sizeof(lenstr),"%c%ld\r\n",prefix,length);
+
+    /* Prepend the length to the next block if it has room for it, so that
+     * the placeholder node can be removed. */
     if (ln->next != NULL) {
         next = listNodeValue(ln->next);
-
-        /* Only glue when the next node is non-NULL (an sds in this case) */
-        if (next->ptr != NULL) {
-            c->reply_bytes -= sdsZmallocSize(len->ptr);
-            c->reply_bytes -= getStringObjectSdsUsedMemory(next);
-            len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
-            c->reply_bytes += sdsZmallocSize(len->ptr);
-            listDelNode(c->reply,ln->next);
+        if (isReplyBlock(next) && sdsavail(next->ptr) >= lenlen) {
+            memmove((char*)next->ptr+lenlen,next->ptr,sdslen(next->ptr));
+            memcpy(next->ptr,lenstr,lenlen);
+            sdsIncrLen(next->ptr,lenlen);
+            listDelNode(c->reply,ln);
+            return;
         }
     }
+
+    /* Otherwise store the length in the placeholder itself. */
+    len = listNodeValue(ln);
+    len->ptr = sdsnewlen(lenstr,lenlen);
+    len->encoding = OBJ_ENCODING_RAW; /* in case it was an EMBSTR. */
+    c->reply_bytes += sdsZmallocSize(len->ptr);
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
-/* Add a double as a bulk reply */
+void setDeferredMultiBulkLength(client *c, void *node, long length) {
+    setDeferredAggregateLen(c,node,length,'*');
+}
+
+/* Like setDeferredMultiBulkLength() but for a map of 'length' field-value
+ * pairs. RESP2 clients get a flat array of twice the length. */
+void setDeferredMapLen(client *c, void *node, long length) {
+    if (c->resp == 2)
+        setDeferredAggregateLen(c,node,length*2,'*');
+    else
+        setDeferredAggregateLen(c,node,length,'%');
+}
+
+void setDeferredSetLen(client *c, void *node, long length) {
+    setDeferredAggregateLen(c,node,length,c->resp == 2 ? '*' : '~');
+}
+
+/* Add a double as a bulk reply, or as a RESP3 double type. */
 void addReplyDouble(client *c, double d) {
     char dbuf[128], sbuf[128];
     int dlen, slen;
     if (isinf(d)) {
         /* Libc in odd systems (Hi Solaris!) will format infinite in a
          * different way, so better to handle it in an explicit way. */
-        addReplyBulkCString(c, d > 0 ? "inf" : "-inf");
+        if (c->resp == 2)
+            addReplyBulkCString(c, d > 0 ? "inf" : "-inf");
+        else
+            addReplyString(c, d > 0 ? ",inf\r\n" : ",-inf\r\n",
+                              d > 0 ? 6 : 7);
     } else {
         dlen = snprintf(dbuf,sizeof(dbuf),"%.17g",d);
-        slen = snprintf(sbuf,sizeof(sbuf),"$%d\r\n%s\r\n",dlen,dbuf);
+        if (c->resp == 2)
+            slen = snprintf(sbuf,sizeof(sbuf),"$%d\r\n%s\r\n",dlen,dbuf);
+        else
+            slen = snprintf(sbuf,sizeof(sbuf),",%s\r\n",dbuf);
         addReplyString(c,sbuf,slen);
     }
 }
 
 /* Add a long double as a bulk reply, but uses a human readable formatting
  * of the double instead of exposing the crude behavior of doubles to the
- * dear user. */
+ * dear user. RESP3 clients get it as a double type. */
 void addReplyHumanLongDouble(client *c, long double d) {
     robj *o = createStringObjectFromLongDouble(d,1);
-    addReplyBulk(c,o);
+    if (c->resp == 2) {
+        addReplyBulk(c,o);
+    } else {
+        addReplyString(c,",",1);
+        addReplyString(c,o->ptr,sdslen(o->ptr));
+        addReply(c,shared.crlf);
+    }
     decrRefCount(o);
 }
 
+/* Add a boolean reply: an integer reply 1 or 0 for RESP2 clients. */
+void addReplyBool(client *c, int b) {
+    if (c->resp == 2)
+        addReply(c, b ? shared.cone : shared.czero);
+    else
+        addReplyString(c, b ? "#t\r\n" : "#f\r\n",4);
+}
+
+/* Add a number too big for a 64 bit integer, in decimal form. RESP2
+ * clients get it as a bulk string. */
+void addReplyBigNum(client *c, const char *num, size_t len) {
+    if (c->resp == 2) {
+        addReplyBulkCBuffer(c,num,len);
+    } else {
+        addReplyString(c,"(",1);
+        addReplyString(c,num,len);
+        addReply(c,shared.crlf);
+    }
+}
+
+/* Add a null reply: a null bulk for RESP2 clients. */
+void addReplyNull(client *c) {
+    addReply(c,shared.null[c->resp]);
+}
+
 /* Add a long long as integer reply or bulk len / multi bulk count.
  * Basically this is used to output <prefix><long long><crlf>. */
 void addReplyLongLongWithPrefix(client *c, long long ll, char prefix) {
@@ -498,11 +600,36 @@ void addReplyLongLongWithPrefix(client *c, long long ll, char prefix) {
     /* Things like $3\r\n or *2\r\n are emitted very often by the protocol
      * so we have a few shared objects to use if the integer is small
      * like it is most of the times. */
-    if (prefix == '*' && ll < OBJ_SHARED_BULKHDR_LEN && ll >= 0) {
-        addReply(c,shared.mbulkhdr[ll]);
-        return;
-    } else if (prefix == '$' && ll < OBJ_SHARED_BULKHDR_LEN && ll >= 0) {
-        addReply(c,shared.bulkhdr[ll]);
+    if (ll >= 0 && ll < OBJ_SHARED_BULKHDR_LEN) {
+        robj *hdr = NULL;
+
+        switch(prefix) {
+        case '*': hdr = shared.mbulkhdr[ll]; break;
+        case '$': hdr = shared.bulkhdr[ll]; break;
+        case ':': hdr = shared.intreply[ll]; break;
+        case '%': hdr = shared.maphdr[ll]; break;
+        case '~': hdr = shared.sethdr[ll]; break;
+        }
+        if (hdr) {
+            addReply(c,hdr);
+            return;
+        }
+    }
+
+    if (prepareClientToWrite(c) != C_OK) return;
+
+    /* Format the number straight into the static buffer when possible,
+     * 32 bytes are enough for the prefix, any 64 bit integer and the CRLF. */
+    if (!(c->flags & CLIENT_CLOSE_AFTER_REPLY) &&
+        listLength(c->reply) == 0 && sizeof(c->buf)-c->bufpos >= 32)
+    {
+        char *p = c->buf+c->bufpos;
+
+        p[0] = prefix;
+        len = ll2string(p+1,31,ll);
+        p[len+1] = '\r';
+        p[len+2] = '\n';
+        c->bufpos += len+3;
         return;
     }
 
@@ -510,23 +637,40 @@ void addReplyLongLongWithPrefix(client *c, long long ll, char prefix) {
     len = ll2string(buf+1,sizeof(buf)-1,ll);
     buf[len+1] = '\r';
     buf[len+2] = '\n';
-    addReplyString(c,buf,len+3);
+    if (_addReplyToBuffer(c,buf,len+3) != C_OK)
+        _addReplyStringToList(c,buf,len+3);
 }
 
 void addReplyLongLong(client *c, long long ll) {
-    if (ll == 0)
-        addReply(c,shared.czero);
-    else if (ll == 1)
-        addReply(c,shared.cone);
-    else
-        addReplyLongLongWithPrefix(c,ll,':');
+    addReplyLongLongWithPrefix(c,ll,':');
 }
 
 void addReplyMultiBulkLen(client *c, long length) {
-    if (length < OBJ_SHARED_BULKHDR_LEN)
-        addReply(c,shared.mbulkhdr[length]);
+    addReplyLongLongWithPrefix(c,length,'*');
+}
+
+/* Emit the header of a map of 'length' field-value pairs. RESP2 clients
+ * get a flat array of fields and values. */
+void addReplyMapLen(client *c, long length) {
+    if (c->resp == 2)
+        addReplyLongLongWithPrefix(c,length*2,'*');
     else
+        addReplyLongLongWithPrefix(c,length,'%');
+}
+
+/* Emit the header of a set, an array of unique elements for RESP2. */
+void addReplySetLen(client *c, long length) {
+    if (c->resp == 2)
         addReplyLongLongWithPrefix(c,length,'*');
+    else
+        addReplyLongLongWithPrefix(c,length,'~');
+}
+
+/* Emit the header of an out of band push reply. Only RESP3 clients can
+ * receive push replies. */
+void addReplyPushLen(client *c, long length) {
+    serverAssert(c->resp >= 3);
+    addReplyLongLongWithPrefix(c,length,'>');
 }
 
 /* Create the length prefix of a bulk reply, example: $2234 */
@@ -536,32 +680,48 @@ void addReplyBulkLen(client *c, robj *obj) {
     if (sdsEncodedObject(obj)) {
         len = sdslen(obj->ptr);
     } else {
-        long n = (long)obj->ptr;
-
-        /* Compute how many bytes will take this integer as a radix 10 string */
-        len = 1;
-        if (n < 0) {
-            len++;
-            n = -n;
-        }
-        while((n = n/10) != 0) {
-            len++;
-        }
+        /* Bytes this integer takes as a radix 10 string. */
+        len = sdigits10((long)obj->ptr);
     }
-
-    if (len < OBJ_SHARED_BULKHDR_LEN)
-        addReply(c,shared.bulkhdr[len]);
-    else
-        addReplyLongLongWithPrefix(c,len,'$');
+    addReplyLongLongWithPrefix(c,len,'$');
 }
 
 /* Add a Redis Object as a bulk reply */
 void addReplyBulk(client *c, robj *obj) {
+    if (obj->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedString *cs = obj->ptr;
+
+        addReplyBulkChunkedString(c,cs,0,cs->len);
+        return;
+    }
     addReplyBulkLen(c,obj);
     addReply(c,obj);
     addReply(c,shared.crlf);
 }
 
+/* Add 'len' bytes of a chunked string starting at 'start' as bulk reply.
+ * The chunks fully included in the range are referenced, not copied. */
+void addReplyBulkChunkedString(client *c, chunkedString *cs, size_t start,
+                               size_t len)
+{
+    addReplyLongLongWithPrefix(c,len,'$');
+    while (len) {
+        size_t idx = start/OBJ_STRING_CHUNK_SIZE;
+        size_t off = start%OBJ_STRING_CHUNK_SIZE;
+        robj *chunk = cs->chunks[idx];
+        size_t count = sdslen(chunk->ptr)-off;
+
+        if (count > len) count = len;
+        if (off == 0 && count == sdslen(chunk->ptr))
+            addReply(c,chunk);
+        else
+            addReplyString(c,(char*)chunk->ptr+off,count);
+        start += count;
+        len -= count;
+    }
+    addReply(c,shared.crlf);
+}
+
 /* Add a C buffer as bulk reply */
 void addReplyBulkCBuffer(client *c, const void *p, size_t len) {
     addReplyLongLongWithPrefix(c,len,'$');
@@ -571,8 +731,7 @@ void addReplyBulkCBuffer(client *c, const void *p, size_t len) {
 
 /* Add sds to reply (takes ownership of sds and frees it) */
 void addReplyBulkSds(client *c, sds s)  {
-    addReplySds(c,sdscatfmt(sdsempty(),"$%u\r\n",
-        (unsigned long)sdslen(s)));
+    addReplyLongLongWithPrefix(c,sdslen(s),'$');
     addReplySds(c,s);
     addReply(c,shared.crlf);
 }
@@ -580,7 +739,7 @@ void addReplyBulkSds(client *c, sds s)  {
 /* Add a C nul term string as bulk reply */
 void addReplyBulkCString(client *c, const char *s) {
     if (s == NULL) {
-        addReply(c,shared.nullbulk);
+        addReplyNull(c);
     } else {
         addReplyBulkCBuffer(c,s,strlen(s));
     }
@@ -615,7 +774,11 @@ int clientHasPendingReplies(client *c) {
 #define MAX_ACCEPTS_PER_CALL 1000
 static void acceptCommonHandler(int fd, int flags, char *ip) {
     client *c;
-    if ((c = createClient(fd)) == NULL) {
+    int sockflags = 0;
+
+    if (flags & CLIENT_UNIX_SOCKET) sockflags |= CLIENT_SOCK_UNIX;
+
+    if ((c = createClientWithSocketFlags(fd,sockflags)) == NULL) {
         serverLog(LL_WARNING,
             "Error registering fd event for the new client: %s (fd=%d)",
             strerror(errno),fd);
@@ -683,9 +846,24 @@ static void acceptCommonHandler(int fd, int flags, char *ip) {
     c->flags |= flags;
 }
 
+/* Account a batch of 'accepted' connections accepted in 'usec'
+ * microseconds, for INFO and the latency monitor. */
+static void acceptUpdateStats(int accepted, long long usec) {
+    if (accepted == 0) return;
+    server.stat_accept_batches++;
+    server.stat_accept_usec += usec;
+    if (accepted > server.stat_accept_max_batch)
+        server.stat_accept_max_batch = accepted;
+    latencyAddSampleIfNeeded("accept",usec/1000);
+}
+
+/* Accept up to MAX_ACCEPTS_PER_CALL connections in a batch, so that
+ * connection storms are drained without returning to the event loop
+ * for every client. */
 void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
-    int cport, cfd, max = MAX_ACCEPTS_PER_CALL;
+    int cport, cfd, max = MAX_ACCEPTS_PER_CALL, accepted = 0;
     char cip[NET_IP_STR_LEN];
+    long long start = ustime();
     UNUSED(el);
     UNUSED(mask);
     UNUSED(privdata);
@@ -696,15 +874,18 @@ void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
             if (errno != EWOULDBLOCK)
                 serverLog(LL_WARNING,
                     "Accepting client connection: %s", server.neterr);
-            return;
+            break;
         }
         serverLog(LL_VERBOSE,"Accepted %s:%d", cip, cport);
         acceptCommonHandler(cfd,0,cip);
+        accepted++;
     }
+    acceptUpdateStats(accepted,ustime()-start);
 }
 
 void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
-    int cfd, max = MAX_ACCEPTS_PER_CALL;
+    int cfd, max = MAX_ACCEPTS_PER_CALL, accepted = 0;
+    long long start = ustime();
     UNUSED(el);
     UNUSED(mask);
     UNUSED(privdata);
@@ -715,11 +896,13 @@ void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
             if (errno != EWOULDBLOCK)
                 serverLog(LL_WARNING,
                     "Accepting client connection: %s", server.neterr);
-            return;
+            break;
         }
         serverLog(LL_VERBOSE,"Accepted connection to %s", server.unixsocket);
         acceptCommonHandler(cfd,CLIENT_UNIX_SOCKET,NULL);
+        accepted++;
     }
+    acceptUpdateStats(accepted,ustime()-start);
 }
 
 static void freeClientArgv(client *c) {
@@ -727,6 +910,7 @@ static void freeClientArgv(client *c) {
     for (j = 0; j < c->argc; j++)
         decrRefCount(c->argv[j]);
     c->argc = 0;
+    c->argv_len_sum = 0;
     c->cmd = NULL;
 }
 
@@ -757,6 +941,7 @@ void unlinkClient(client *c) {
         ln = listSearchKey(server.clients,c);
         serverAssert(ln != NULL);
         listDelNode(server.clients,ln);
+        dictDelete(server.clients_index,&c->id);
 
         /* Unregister async I/O handlers and close the socket. */
         aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
@@ -809,8 +994,11 @@ void freeClient(client *c) {
             replicationGetSlaveName(c));
     }
 
-    /* Free the query buffer */
-    sdsfree(c->querybuf);
+    /* Free the query buffer, unless it's the shared one we are processing. */
+    if (c->querybuf == thread_shared_qb)
+        sdsclear(thread_shared_qb);
+    else
+        sdsfree(c->querybuf);
     c->querybuf = NULL;
 
     /* Deallocate structures used to block on blocking ops. */
@@ -827,6 +1015,12 @@ void freeClient(client *c) {
     dictRelease(c->pubsub_channels);
     listRelease(c->pubsub_patterns);
 
+    /* Stop tracking keys for client side caching. */
+    if (c->flags & CLIENT_TRACKING) disableTracking(c);
+
+    /* Stop accounting the client memory for maxmemory-clients. */
+    removeClientFromMemUsageBucket(c);
+
     /* Free data structures. */
     listRelease(c->reply);
     freeClientArgv(c);
@@ -884,6 +1078,9 @@ void freeClientAsync(client *c) {
     if (c->flags & CLIENT_CLOSE_ASAP || c->flags & CLIENT_LUA) return;
     c->flags |= CLIENT_CLOSE_ASAP;
     listAddNodeTail(server.clients_to_close,c);
+    /* The memory of a client that is going away no longer counts against
+     * maxmemory-clients, otherwise evictClients() would pick it again. */
+    removeClientFromMemUsageBucket(c);
 }
 
 void freeClientsInAsyncFreeQueue(void) {
@@ -897,50 +1094,98 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
+/* Gather the static buffer and as many reply list nodes as possible (up to
+ * NET_MAX_IOV entries or NET_MAX_WRITES_PER_EVENT bytes) into an iovec array
+ * and send them to the socket with a single writev() call.
+ *
+ * The data that was written is then released: c->sentlen always refers to
+ * the first pending chunk (the static buffer if c->bufpos is non zero,
+ * otherwise the head of the reply list), so a partial write just leaves
+ * c->sentlen pointing inside the first chunk that was not fully sent.
+ *
+ * Returns the number of bytes written, or -1 on error (errno is set). */
+static ssize_t _writevToClient(int fd, client *c) {
+    struct iovec iov[NET_MAX_IOV];
+    int iovcnt = 0;
+    size_t iovbytes = 0, offset = c->sentlen, objlen;
+    ssize_t nwritten = 0, remaining;
+    listIter li;
+    listNode *ln;
+    robj *o;
+
+    if (c->bufpos > 0) {
+        iov[iovcnt].iov_base = c->buf+offset;
+        iov[iovcnt].iov_len = c->bufpos-offset;
+        iovbytes += iov[iovcnt].iov_len;
+        iovcnt++;
+        offset = 0;
+    }
+    listRewind(c->reply,&li);
+    while(iovcnt < NET_MAX_IOV && iovbytes < NET_MAX_WRITES_PER_EVENT &&
+          (ln = listNext(&li)) != NULL)
+    {
+        o = listNodeValue(ln);
+        /* A deferred multi bulk length not yet populated: stop here, the
+         * rest of the list can't be sent before it. */
+        if (o->ptr == NULL) break;
+        objlen = sdslen(o->ptr);
+        if (objlen == 0) continue;
+        iov[iovcnt].iov_base = ((char*)o->ptr)+offset;
+        iov[iovcnt].iov_len = objlen-offset;
+        iovbytes += iov[iovcnt].iov_len;
+        iovcnt++;
+        offset = 0;
+    }
+
+    if (iovcnt) {
+        nwritten = writev(fd,iov,iovcnt);
+        if (nwritten <= 0) return nwritten;
+    }
+
+    /* Release what was fully sent. Empty nodes at the head of the list are
+     * released as well, even when nothing was written. */
+    remaining = nwritten;
+    if (c->bufpos > 0) {
+        if ((size_t)remaining < c->bufpos-c->sentlen) {
+            c->sentlen += remaining;
+            return nwritten;
+        }
+        remaining -= c->bufpos-c->sentlen;
+        c->bufpos = 0;
+        c->sentlen = 0;
+    }
+    while(listLength(c->reply)) {
+        ln = listFirst(c->reply);
+        o = listNodeValue(ln);
+        if (o->ptr == NULL) break;
+        objlen = sdslen(o->ptr);
+        if ((size_t)remaining < objlen-c->sentlen) {
+            c->sentlen += remaining;
+            break;
+        }
+        remaining -= objlen-c->sentlen;
+        c->reply_bytes -= getStringObjectSdsUsedMemory(o);
+        c->sentlen = 0;
+        listDelNode(c->reply,ln);
+    }
+    return nwritten;
+}
+
 /* Write data in output buffers to client. Return C_OK if the client
- * is still valid after the call, C_ERR if it was freed. */
+ * is still valid after the call, C_ERR if it was freed.
+ *
+ * Normal clients, slaves and monitors all go through this path: the static
+ * buffer and the reply list are flushed together with writev(), so that a
+ * long list of small replies costs a single syscall instead of one write()
+ * per node. */
 int writeToClient(int fd, client *c, int handler_installed) {
     ssize_t nwritten = 0, totwritten = 0;
-    size_t objlen;
-    size_t objmem;
-    robj *o;
 
     while(clientHasPendingReplies(c)) {
-        if (c->bufpos > 0) {
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if ((int)c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
-            }
-        } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = getStringObjectSdsUsedMemory(o);
-
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->reply_bytes -= objmem;
-                continue;
-            }
-
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
+        nwritten = _writevToClient(fd,c);
+        if (nwritten <= 0) break;
+        totwritten += nwritten;
 
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objmem;
-            }
-        }
         /* Note that we avoid to send more than NET_MAX_WRITES_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -970,6 +1215,7 @@ int writeToClient(int fd, client *c, int handler_installed) {
          * that take some time to just fill the socket output buffer.
          * We just rely on data / pings received for timeout detection. */
         if (!(c->flags & CLIENT_MASTER)) c->lastinteraction = server.unixtime;
+        updateClientMemUsage(c);
     }
     if (!clientHasPendingReplies(c)) {
         c->sentlen = 0;
@@ -1042,6 +1288,14 @@ void resetClient(client *c) {
     c->multibulklen = 0;
     c->bulklen = -1;
 
+    /* The argv array is reused by the next command, unless it grew too big
+     * to be worth keeping around. */
+    if (c->argv_len > PROTO_REUSE_ARGV_MAX) {
+        zfree(c->argv);
+        c->argv = NULL;
+        c->argv_len = 0;
+    }
+
     /* We clear the ASKING flag as well if we are not inside a MULTI, and
      * if what we just executed is not the ASKING command itself. */
     if (!(c->flags & CLIENT_MULTI) && prevcmd != askingCommand)
@@ -1057,36 +1311,48 @@ void resetClient(client *c) {
     }
 }
 
+/* Return a pointer to the first occurrence of 'ch' in the unprocessed part
+ * of the query buffer (starting at c->qb_pos), or NULL if not found.
+ *
+ * memchr() is used instead of strchr() since it is bounded by the buffer
+ * length (the query buffer may contain binary data and null bytes), and in
+ * every modern libc it is vectorized, scanning many bytes per instruction. */
+static char *queryBufferFind(client *c, int ch) {
+    return memchr(c->querybuf+c->qb_pos,ch,sdslen(c->querybuf)-c->qb_pos);
+}
+
 int processInlineBuffer(client *c) {
     char *newline;
-    int argc, j;
+    int argc, j, linefeed_chars = 1;
     sds *argv, aux;
     size_t querylen;
 
     /* Search for end of line */
-    newline = strchr(c->querybuf,'\n');
+    newline = queryBufferFind(c,'\n');
 
     /* Nothing to do without a \r\n */
     if (newline == NULL) {
-        if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+        if (sdslen(c->querybuf)-c->qb_pos > PROTO_INLINE_MAX_SIZE) {
             addReplyError(c,"Protocol error: too big inline request");
-            setProtocolError(c,0);
+            setProtocolError(c);
         }
         return C_ERR;
     }
 
     /* Handle the \r\n case. */
-    if (newline && newline != c->querybuf && *(newline-1) == '\r')
+    if (newline != c->querybuf+c->qb_pos && *(newline-1) == '\r') {
         newline--;
+        linefeed_chars++;
+    }
 
     /* Split the input buffer up to the \r\n */
-    querylen = newline-(c->querybuf);
-    aux = sdsnewlen(c->querybuf,querylen);
+    querylen = newline-(c->querybuf+c->qb_pos);
+    aux = sdsnewlen(c->querybuf+c->qb_pos,querylen);
     argv = sdssplitargs(aux,&argc);
     sdsfree(aux);
     if (argv == NULL) {
         addReplyError(c,"Protocol error: unbalanced quotes in request");
-        setProtocolError(c,0);
+        setProtocolError(c);
         return C_ERR;
     }
 
@@ -1096,13 +1362,14 @@ int processInlineBuffer(client *c) {
     if (querylen == 0 && c->flags & CLIENT_SLAVE)
         c->repl_ack_time = server.unixtime;
 
-    /* Leave data after the first line of the query in the buffer */
-    sdsrange(c->querybuf,querylen+2,-1);
+    /* Move the cursor to the data after the first line of the query. */
+    c->qb_pos += querylen+linefeed_chars;
 
-    /* Setup argv array on client structure */
-    if (argc) {
-        if (c->argv) zfree(c->argv);
+    /* Setup argv array on client structure, reusing the old one if possible */
+    if (argc > c->argv_len) {
+        zfree(c->argv);
         c->argv = zmalloc(sizeof(robj*)*argc);
+        c->argv_len = argc;
     }
 
     /* Create redis objects for all arguments. */
@@ -1118,9 +1385,10 @@ int processInlineBuffer(client *c) {
     return C_OK;
 }
 
-/* Helper function. Trims query buffer to make the function that processes
- * multi bulk requests idempotent. */
-static void setProtocolError(client *c, int pos) {
+/* Helper function. Flags the client to be closed after the error reply
+ * is sent. The query buffer is left untouched: nothing more will be
+ * processed from it. */
+static void setProtocolError(client *c) {
     if (server.verbosity <= LL_VERBOSE) {
         sds client = catClientInfoString(sdsempty(),c);
         serverLog(LL_VERBOSE,
@@ -1128,12 +1396,15 @@ static void setProtocolError(client *c, int pos) {
         sdsfree(client);
     }
     c->flags |= CLIENT_CLOSE_AFTER_REPLY;
-    sdsrange(c->querybuf,pos,-1);
 }
 
+/* Parse the multi bulk request starting at c->qb_pos, advancing the cursor
+ * as arguments are consumed. The query buffer itself is only trimmed by
+ * processInputBuffer(), once all the buffered commands were processed, so
+ * that a big pipeline does not cost a memmove() per command. */
 int processMultibulkBuffer(client *c) {
     char *newline = NULL;
-    int pos = 0, ok;
+    int ok;
     long long ll;
 
     if (c->multibulklen == 0) {
@@ -1141,11 +1412,11 @@ int processMultibulkBuffer(client *c) {
         serverAssertWithInfo(c,NULL,c->argc == 0);
 
         /* Multi bulk length cannot be read without a \r\n */
-        newline = strchr(c->querybuf,'\r');
+        newline = queryBufferFind(c,'\r');
         if (newline == NULL) {
-            if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+            if (sdslen(c->querybuf)-c->qb_pos > PROTO_INLINE_MAX_SIZE) {
                 addReplyError(c,"Protocol error: too big mbulk count string");
-                setProtocolError(c,0);
+                setProtocolError(c);
             }
             return C_ERR;
         }
@@ -1156,37 +1427,39 @@ int processMultibulkBuffer(client *c) {
 
         /* We know for sure there is a whole line since newline != NULL,
          * so go ahead and find out the multi bulk length. */
-        serverAssertWithInfo(c,NULL,c->querybuf[0] == '*');
-        ok = string2ll(c->querybuf+1,newline-(c->querybuf+1),&ll);
+        serverAssertWithInfo(c,NULL,c->querybuf[c->qb_pos] == '*');
+        ok = string2ll(c->querybuf+c->qb_pos+1,
+                       newline-(c->querybuf+c->qb_pos+1),&ll);
         if (!ok || ll > 1024*1024) {
             addReplyError(c,"Protocol error: invalid multibulk length");
-            setProtocolError(c,pos);
+            setProtocolError(c);
             return C_ERR;
         }
 
-        pos = (newline-c->querybuf)+2;
-        if (ll <= 0) {
-            sdsrange(c->querybuf,pos,-1);
-            return C_OK;
-        }
+        c->qb_pos = (newline-c->querybuf)+2;
+        if (ll <= 0) return C_OK;
 
         c->multibulklen = ll;
 
-        /* Setup argv array on client structure */
-        if (c->argv) zfree(c->argv);
-        c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+        /* Setup argv array on client structure, reusing the old one if
+         * possible */
+        if (c->multibulklen > c->argv_len) {
+            zfree(c->argv);
+            c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+            c->argv_len = c->multibulklen;
+        }
     }
 
     serverAssertWithInfo(c,NULL,c->multibulklen > 0);
     while(c->multibulklen) {
         /* Read bulk length if unknown */
         if (c->bulklen == -1) {
-            newline = strchr(c->querybuf+pos,'\r');
+            newline = queryBufferFind(c,'\r');
             if (newline == NULL) {
-                if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+                if (sdslen(c->querybuf)-c->qb_pos > PROTO_INLINE_MAX_SIZE) {
                     addReplyError(c,
                         "Protocol error: too big bulk count string");
-                    setProtocolError(c,0);
+                    setProtocolError(c);
                     return C_ERR;
                 }
                 break;
@@ -1196,22 +1469,23 @@ int processMultibulkBuffer(client *c) {
             if (newline-(c->querybuf) > ((signed)sdslen(c->querybuf)-2))
                 break;
 
-            if (c->querybuf[pos] != '$') {
+            if (c->querybuf[c->qb_pos] != '$') {
                 addReplyErrorFormat(c,
                     "Protocol error: expected '$', got '%c'",
-                    c->querybuf[pos]);
-                setProtocolError(c,pos);
+                    c->querybuf[c->qb_pos]);
+                setProtocolError(c);
                 return C_ERR;
             }
 
-            ok = string2ll(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
+            ok = string2ll(c->querybuf+c->qb_pos+1,
+                           newline-(c->querybuf+c->qb_pos+1),&ll);
             if (!ok || ll < 0 || ll > 512*1024*1024) {
                 addReplyError(c,"Protocol error: invalid bulk length");
-                setProtocolError(c,pos);
+                setProtocolError(c);
                 return C_ERR;
             }
 
-            pos += newline-(c->querybuf+pos)+2;
+            c->qb_pos = (newline-c->querybuf)+2;
             if (ll >= PROTO_MBULK_BIG_ARG) {
                 size_t qblen;
 
@@ -1219,49 +1493,52 @@ int processMultibulkBuffer(client *c) {
                  * try to make it likely that it will start at c->querybuf
                  * boundary so that we can optimize object creation
                  * avoiding a large copy of data. */
-                sdsrange(c->querybuf,pos,-1);
-                pos = 0;
+                sdsrange(c->querybuf,c->qb_pos,-1);
+                c->qb_pos = 0;
                 qblen = sdslen(c->querybuf);
                 /* Hint the sds library about the amount of bytes this string is
-                 * going to contain. */
-                if (qblen < (size_t)ll+2)
+                 * going to contain. The shared query buffer is never grown:
+                 * the partial argument will be moved to a private buffer
+                 * sized for it, see resetSharedQueryBuf(). */
+                if (c->querybuf != thread_shared_qb && qblen < (size_t)ll+2)
                     c->querybuf = sdsMakeRoomFor(c->querybuf,ll+2-qblen);
             }
             c->bulklen = ll;
         }
 
         /* Read bulk argument */
-        if (sdslen(c->querybuf)-pos < (unsigned)(c->bulklen+2)) {
+        if (sdslen(c->querybuf)-c->qb_pos < (size_t)(c->bulklen+2)) {
             /* Not enough data (+2 == trailing \r\n) */
             break;
         } else {
             /* Optimization: if the buffer contains JUST our bulk element
              * instead of creating a new object by *copying* the sds we
              * just use the current sds string. */
-            if (pos == 0 &&
+            if (c->qb_pos == 0 &&
+                c->querybuf != thread_shared_qb &&
                 c->bulklen >= PROTO_MBULK_BIG_ARG &&
-                (signed) sdslen(c->querybuf) == c->bulklen+2)
+                sdslen(c->querybuf) == (size_t)(c->bulklen+2))
             {
                 c->argv[c->argc++] = createObject(OBJ_STRING,c->querybuf);
+                c->argv_len_sum += c->bulklen;
                 sdsIncrLen(c->querybuf,-2); /* remove CRLF */
                 /* Assume that if we saw a fat argument we'll see another one
                  * likely... */
                 c->querybuf = sdsnewlen(NULL,c->bulklen+2);
                 sdsclear(c->querybuf);
-                pos = 0;
             } else {
+                /* Small arguments become EMBSTR objects created straight
+                 * from the query buffer. */
                 c->argv[c->argc++] =
-                    createStringObject(c->querybuf+pos,c->bulklen);
-                pos += c->bulklen+2;
+                    createStringObject(c->querybuf+c->qb_pos,c->bulklen);
+                c->argv_len_sum += c->bulklen;
+                c->qb_pos += c->bulklen+2;
             }
             c->bulklen = -1;
             c->multibulklen--;
         }
     }
 
-    /* Trim to pos */
-    if (pos) sdsrange(c->querybuf,pos,-1);
-
     /* We're done when c->multibulk == 0 */
     if (c->multibulklen == 0) return C_OK;
 
@@ -1269,10 +1546,13 @@ int processMultibulkBuffer(client *c) {
     return C_ERR;
 }
 
-void processInputBuffer(client *c) {
+/* Process the commands accumulated in the client query buffer. Returns C_ERR
+ * if the client was freed in the process, and should not be touched anymore,
+ * otherwise C_OK is returned. */
+int processInputBuffer(client *c) {
     server.current_client = c;
     /* Keep processing while there is something in the input buffer */
-    while(sdslen(c->querybuf)) {
+    while(c->querybuf && c->qb_pos < sdslen(c->querybuf)) {
         /* Return if clients are paused. */
         if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) break;
 
@@ -1288,7 +1568,7 @@ void processInputBuffer(client *c) {
 
         /* Determine request type when unknown. */
         if (!c->reqtype) {
-            if (c->querybuf[0] == '*') {
+            if (c->querybuf[c->qb_pos] == '*') {
                 c->reqtype = PROTO_REQ_MULTIBULK;
             } else {
                 c->reqtype = PROTO_REQ_INLINE;
@@ -1311,11 +1591,44 @@ void processInputBuffer(client *c) {
             if (processCommand(c) == C_OK)
                 resetClient(c);
             /* freeMemoryIfNeeded may flush slave output buffers. This may result
-             * into a slave, that may be the active client, to be freed. */
-            if (server.current_client == NULL) break;
+             * into a slave, that may be the active client, to be freed, so
+             * we can't touch the client anymore. */
+            if (server.current_client == NULL) return C_ERR;
         }
     }
+
+    /* Trim the consumed part of the query buffer: this is the only place
+     * where the remaining data is moved at the start of the buffer. */
+    if (c->qb_pos) {
+        sdsrange(c->querybuf,c->qb_pos,-1);
+        c->qb_pos = 0;
+    }
     server.current_client = NULL;
+    return C_OK;
+}
+
+/* If the client is using the shared query buffer, give it back, moving what
+ * is left of it (a partial command) into a private buffer owned by the
+ * client. Clients without anything pending are left with a NULL querybuf. */
+static void resetSharedQueryBuf(client *c) {
+    size_t remaining;
+
+    if (c->querybuf != thread_shared_qb) return;
+    remaining = sdslen(c->querybuf);
+    if (remaining || c->reqtype) {
+        c->querybuf = sdsnewlen(thread_shared_qb,remaining);
+        /* Make room for a big argument in a single allocation, so that
+         * processMultibulkBuffer() can use the buffer as the argument
+         * itself once complete. */
+        if (c->bulklen >= PROTO_MBULK_BIG_ARG &&
+            remaining < (size_t)c->bulklen+2)
+        {
+            c->querybuf = sdsMakeRoomFor(c->querybuf,c->bulklen+2-remaining);
+        }
+    } else {
+        c->querybuf = NULL;
+    }
+    sdsclear(thread_shared_qb);
 }
 
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
@@ -1340,12 +1653,36 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         if (remaining < readlen) readlen = remaining;
     }
 
+    /* Nothing pending: read into the shared query buffer. The master keeps
+     * a private buffer, since its query buffer outlives disconnections when
+     * it gets cached for a partial resynchronization. A private buffer is
+     * also used if the shared one is not empty: this means another client
+     * is processing it, and we were re-entered by processEventsWhileBlocked()
+     * during a slow script or while loading. */
+    if (c->querybuf == NULL) {
+        if (thread_shared_qb == NULL) {
+            thread_shared_qb = sdsnewlen(NULL,PROTO_IOBUF_LEN);
+            sdsclear(thread_shared_qb);
+        }
+        if (c->flags & CLIENT_MASTER || sdslen(thread_shared_qb) != 0)
+            c->querybuf = sdsempty();
+        else
+            c->querybuf = thread_shared_qb;
+    }
+
     qblen = sdslen(c->querybuf);
     if (c->querybuf_peak < qblen) c->querybuf_peak = qblen;
-    c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
+    if (c->querybuf == thread_shared_qb) {
+        /* Growing the shared buffer may reallocate it. */
+        c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
+        thread_shared_qb = c->querybuf;
+    } else {
+        c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
+    }
     nread = read(fd, c->querybuf+qblen, readlen);
     if (nread == -1) {
         if (errno == EAGAIN) {
+            resetSharedQueryBuf(c);
             return;
         } else {
             serverLog(LL_VERBOSE, "Reading from client: %s",strerror(errno));
@@ -1372,7 +1709,10 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         freeClient(c);
         return;
     }
-    processInputBuffer(c);
+    if (processInputBuffer(c) == C_OK) {
+        resetSharedQueryBuf(c);
+        updateClientMemUsage(c);
+    }
 }
 
 void getClientsMaxBuffers(unsigned long *longest_output_list,
@@ -1387,7 +1727,8 @@ void getClientsMaxBuffers(unsigned long *longest_output_list,
         c = listNodeValue(ln);
 
         if (listLength(c->reply) > lol) lol = listLength(c->reply);
-        if (sdslen(c->querybuf) > bib) bib = sdslen(c->querybuf);
+        if (c->querybuf && sdslen(c->querybuf)-c->qb_pos > bib)
+            bib = sdslen(c->querybuf)-c->qb_pos;
     }
     *longest_output_list = lol;
     *biggest_input_buffer = bib;
@@ -1451,6 +1792,7 @@ sds catClientInfoString(sds s, client *client) {
     if (client->flags & CLIENT_CLOSE_ASAP) *p++ = 'A';
     if (client->flags & CLIENT_UNIX_SOCKET) *p++ = 'U';
     if (client->flags & CLIENT_READONLY) *p++ = 'r';
+    if (client->flags & CLIENT_NO_EVICT) *p++ = 'e';
     if (p == flags) *p++ = 'N';
     *p++ = '\0';
 
@@ -1460,7 +1802,7 @@ sds catClientInfoString(sds s, client *client) {
     if (emask & AE_WRITABLE) *p++ = 'w';
     *p = '\0';
     return sdscatfmt(s,
-        "id=%U addr=%s fd=%i name=%s age=%I idle=%I flags=%s db=%i sub=%i psub=%i multi=%i qbuf=%U qbuf-free=%U obl=%U oll=%U omem=%U events=%s cmd=%s",
+        "id=%U addr=%s fd=%i name=%s age=%I idle=%I flags=%s db=%i sub=%i psub=%i multi=%i qbuf=%U qbuf-free=%U obl=%U oll=%U omem=%U tot-mem=%U events=%s cmd=%s resp=%i",
         (unsigned long long) client->id,
         getClientPeerId(client),
         client->fd,
@@ -1472,13 +1814,17 @@ sds catClientInfoString(sds s, client *client) {
         (int) dictSize(client->pubsub_channels),
         (int) listLength(client->pubsub_patterns),
         (client->flags & CLIENT_MULTI) ? client->mstate.count : -1,
-        (unsigned long long) sdslen(client->querybuf),
-        (unsigned long long) sdsavail(client->querybuf),
+        (unsigned long long) (client->querybuf ?
+            sdslen(client->querybuf)-client->qb_pos : 0),
+        (unsigned long long) (client->querybuf ?
+            sdsavail(client->querybuf) : 0),
         (unsigned long long) client->bufpos,
         (unsigned long long) listLength(client->reply),
         (unsigned long long) getClientOutputBufferMemoryUsage(client),
+        (unsigned long long) getClientMemoryUsage(client),
         events,
-        client->lastcmd ? client->lastcmd->name : "NULL");
+        client->lastcmd ? client->lastcmd->name : "NULL",
+        client->resp);
 }
 
 sds getAllClientsInfoString(void) {
@@ -1496,6 +1842,43 @@ sds getAllClientsInfoString(void) {
     return o;
 }
 
+/* Return the client with the specified ID, or NULL if no such client is
+ * connected. */
+client *lookupClientByID(uint64_t id) {
+    return dictFetchValue(server.clients_index,&id);
+}
+
+/* Set the name of the client to 'name', or remove it if 'name' is empty.
+ * On invalid names an error is sent to the client and C_ERR is returned. */
+int clientSetNameOrReply(client *c, robj *name) {
+    int j, len = sdslen(name->ptr);
+    char *p = name->ptr;
+
+    /* Setting the client name to an empty string actually removes
+     * the current name. */
+    if (len == 0) {
+        if (c->name) decrRefCount(c->name);
+        c->name = NULL;
+        return C_OK;
+    }
+
+    /* Otherwise check if the charset is ok. We need to do this otherwise
+     * CLIENT LIST format will break. You should always be able to
+     * split by space to get the different fields. */
+    for (j = 0; j < len; j++) {
+        if (p[j] < '!' || p[j] > '~') { /* ASCII is assumed. */
+            addReplyError(c,
+                "Client names cannot contain spaces, "
+                "newlines or special characters.");
+            return C_ERR;
+        }
+    }
+    if (c->name) decrRefCount(c->name);
+    c->name = name;
+    incrRefCount(c->name);
+    return C_OK;
+}
+
 void clientCommand(client *c) {
     listNode *ln;
     listIter li;
@@ -1520,6 +1903,18 @@ void clientCommand(client *c) {
             addReply(c,shared.syntaxerr);
             return;
         }
+    } else if (!strcasecmp(c->argv[1]->ptr,"no-evict") && c->argc == 3) {
+        /* CLIENT NO-EVICT ON|OFF */
+        if (!strcasecmp(c->argv[2]->ptr,"on")) {
+            c->flags |= CLIENT_NO_EVICT;
+        } else if (!strcasecmp(c->argv[2]->ptr,"off")) {
+            c->flags &= ~CLIENT_NO_EVICT;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        updateClientMemUsage(c);
+        addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"kill")) {
         /* CLIENT KILL <ip:port>
          * CLIENT KILL <option> [value] ... <option> [value] */
@@ -1607,38 +2002,13 @@ void clientCommand(client *c) {
          * only after we queued the reply to its output buffers. */
         if (close_this_client) c->flags |= CLIENT_CLOSE_AFTER_REPLY;
     } else if (!strcasecmp(c->argv[1]->ptr,"setname") && c->argc == 3) {
-        int j, len = sdslen(c->argv[2]->ptr);
-        char *p = c->argv[2]->ptr;
-
-        /* Setting the client name to an empty string actually removes
-         * the current name. */
-        if (len == 0) {
-            if (c->name) decrRefCount(c->name);
-            c->name = NULL;
+        if (clientSetNameOrReply(c,c->argv[2]) == C_OK)
             addReply(c,shared.ok);
-            return;
-        }
-
-        /* Otherwise check if the charset is ok. We need to do this otherwise
-         * CLIENT LIST format will break. You should always be able to
-         * split by space to get the different fields. */
-        for (j = 0; j < len; j++) {
-            if (p[j] < '!' || p[j] > '~') { /* ASCII is assumed. */
-                addReplyError(c,
-                    "Client names cannot contain spaces, "
-                    "newlines or special characters.");
-                return;
-            }
-        }
-        if (c->name) decrRefCount(c->name);
-        c->name = c->argv[2];
-        incrRefCount(c->name);
-        addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"getname") && c->argc == 2) {
         if (c->name)
             addReplyBulk(c,c->name);
         else
-            addReply(c,shared.nullbulk);
+            addReply(c,shared.null[c->resp]);
     } else if (!strcasecmp(c->argv[1]->ptr,"pause") && c->argc == 3) {
         long long duration;
 
@@ -1646,8 +2016,68 @@ void clientCommand(client *c) {
                                         != C_OK) return;
         pauseClients(duration);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"id") && c->argc == 2) {
+        /* CLIENT ID */
+        addReplyLongLong(c,c->id);
+    } else if (!strcasecmp(c->argv[1]->ptr,"tracking") && c->argc >= 3) {
+        /* CLIENT TRACKING (on|off) [REDIRECT <id>] [BCAST] [PREFIX <p>] ... */
+        long long redir = 0;
+        int bcast = 0, j, numprefixes = 0;
+        robj **prefixes = NULL;
+
+        for (j = 3; j < c->argc; j++) {
+            int moreargs = (c->argc-1) - j;
+
+            if (!strcasecmp(c->argv[j]->ptr,"redirect") && moreargs) {
+                j++;
+                if (getLongLongFromObjectOrReply(c,c->argv[j],&redir,NULL) !=
+                    C_OK) goto tracking_cleanup;
+                /* We will require the client with the specified ID to exist
+                 * right now, even if it is possible that it gets disconnected
+                 * later. Still a valid sanity check. */
+                if (lookupClientByID(redir) == NULL) {
+                    addReplyError(c,"The client ID you want redirect to "
+                                    "does not exist");
+                    goto tracking_cleanup;
+                }
+            } else if (!strcasecmp(c->argv[j]->ptr,"bcast")) {
+                bcast = 1;
+            } else if (!strcasecmp(c->argv[j]->ptr,"prefix") && moreargs) {
+                j++;
+                prefixes = zrealloc(prefixes,sizeof(robj*)*(numprefixes+1));
+                prefixes[numprefixes++] = c->argv[j];
+            } else {
+                addReply(c,shared.syntaxerr);
+                goto tracking_cleanup;
+            }
+        }
+
+        if (!strcasecmp(c->argv[2]->ptr,"on")) {
+            if (numprefixes && !bcast) {
+                addReplyError(c,"PREFIX option requires BCAST mode "
+                                "to be enabled");
+                goto tracking_cleanup;
+            }
+            /* RESP2 has no way to push invalidation messages in the same
+             * connection, so a redirection is mandatory. */
+            if (redir == 0 && c->resp == 2) {
+                addReplyError(c,"Tracking requires a REDIRECT to a client "
+                                "subscribed to __redis__:invalidate");
+                goto tracking_cleanup;
+            }
+            enableTracking(c,redir,bcast,prefixes,numprefixes);
+        } else if (!strcasecmp(c->argv[2]->ptr,"off")) {
+            disableTracking(c);
+        } else {
+            addReply(c,shared.syntaxerr);
+            goto tracking_cleanup;
+        }
+        addReply(c,shared.ok);
+
+tracking_cleanup:
+        zfree(prefixes);
     } else {
-        addReplyError(c, "Syntax error, try CLIENT (LIST | KILL | GETNAME | SETNAME | PAUSE | REPLY)");
+        addReplyError(c, "Syntax error, try CLIENT (LIST | KILL | GETNAME | SETNAME | PAUSE | REPLY | ID | TRACKING | NO-EVICT)");
     }
 }
 
@@ -1695,6 +2125,7 @@ void rewriteClientCommandVector(client *c, int argc, ...) {
     zfree(c->argv);
     /* Replace argv and argc with our new versions. */
     c->argv = argv;
+    c->argv_len = argc;
     c->argc = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     serverAssertWithInfo(c,NULL,c->cmd != NULL);
@@ -1706,6 +2137,7 @@ void replaceClientCommandVector(client *c, int argc, robj **argv) {
     freeClientArgv(c);
     zfree(c->argv);
     c->argv = argv;
+    c->argv_len = argc;
     c->argc = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     serverAssertWithInfo(c,NULL,c->cmd != NULL);
@@ -1727,6 +2159,7 @@ void rewriteClientCommandArgument(client *c, int i, robj *newval) {
 
     if (i >= c->argc) {
         c->argv = zrealloc(c->argv,sizeof(robj*)*(i+1));
+        c->argv_len = i+1;
         c->argc = i+1;
         c->argv[i] = NULL;
     }
@@ -1761,6 +2194,118 @@ unsigned long getClientOutputBufferMemoryUsage(client *c) {
     return c->reply_bytes + (list_item_size*listLength(c->reply));
 }
 
+/* Return the memory used by the client: the structure itself with its
+ * static reply buffer, the query buffer, the arguments parsed so far, the
+ * reply list, and an estimate of the memory used to remember the WATCHed keys
+ * and the Pub/Sub subscriptions. */
+size_t getClientMemoryUsage(client *c) {
+    size_t mem = sizeof(client);
+
+    if (c->querybuf && c->querybuf != thread_shared_qb)
+        mem += sdsAllocSize(c->querybuf);
+    mem += c->argv_len*sizeof(robj*) + c->argv_len_sum;
+    mem += getClientOutputBufferMemoryUsage(c);
+    mem += listLength(c->watched_keys)*(sizeof(listNode)+sizeof(void*)*2);
+    mem += dictSize(c->pubsub_channels)*sizeof(dictEntry) +
+           dictSlots(c->pubsub_channels)*sizeof(dictEntry*);
+    mem += listLength(c->pubsub_patterns)*sizeof(listNode);
+    return mem;
+}
+
+/* Clients that maxmemory-clients is allowed to evict: masters, slaves,
+ * fake clients and clients flagged with CLIENT NO-EVICT are not tracked. */
+static int clientIsEvictable(client *c) {
+    if (c->fd == -1) return 0;
+    if (c->flags & (CLIENT_MASTER|CLIENT_NO_EVICT|CLIENT_LUA|
+                    CLIENT_CLOSE_ASAP)) return 0;
+    if ((c->flags & CLIENT_SLAVE) && !(c->flags & CLIENT_MONITOR)) return 0;
+    return 1;
+}
+
+static list *getMemUsageBucket(size_t mem) {
+    int log = 0, idx;
+
+    while (log < 63 && ((size_t)1<<(log+1)) <= mem) log++;
+    idx = log - CLIENT_MEM_USAGE_BUCKET_MIN_LOG;
+    if (idx < 0) idx = 0;
+    if (idx >= CLIENT_MEM_USAGE_BUCKETS) idx = CLIENT_MEM_USAGE_BUCKETS-1;
+    return server.client_mem_usage_buckets[idx];
+}
+
+void removeClientFromMemUsageBucket(client *c) {
+    if (c->mem_usage_bucket == NULL) return;
+    listDelNode(c->mem_usage_bucket,c->mem_usage_bucket_node);
+    server.clients_memory -= c->last_memory_usage;
+    c->mem_usage_bucket = NULL;
+    c->mem_usage_bucket_node = NULL;
+    c->last_memory_usage = 0;
+}
+
+/* Update the memory usage of the client and move it to the right bucket.
+ * This is O(1) and called every time the client buffers may have changed
+ * substantially: after reading a query, writing a reply or appending to the
+ * reply list, and from clientsCron(). */
+void updateClientMemUsage(client *c) {
+    size_t mem;
+    list *bucket;
+
+    if (!clientIsEvictable(c)) {
+        removeClientFromMemUsageBucket(c);
+        return;
+    }
+    mem = getClientMemoryUsage(c);
+    bucket = getMemUsageBucket(mem);
+    server.clients_memory -= c->last_memory_usage;
+    server.clients_memory += mem;
+    c->last_memory_usage = mem;
+    if (bucket != c->mem_usage_bucket) {
+        if (c->mem_usage_bucket)
+            listDelNode(c->mem_usage_bucket,c->mem_usage_bucket_node);
+        listAddNodeTail(bucket,c);
+        c->mem_usage_bucket = bucket;
+        c->mem_usage_bucket_node = listLast(bucket);
+    }
+}
+
+/* Evict clients while the memory used by clients is over the
+ * maxmemory-clients limit, starting from the bucket of the biggest ones, so
+ * that no scan of the clients list is needed. Clients in the same bucket use
+ * about the same memory (within a factor of two).
+ *
+ * The current client, and the client calling a script, can't be freed
+ * synchronously from here, so they are closed asynchronously: they leave
+ * the buckets immediately anyway. The function returns the number of
+ * evicted clients. */
+int evictClients(void) {
+    int j = CLIENT_MEM_USAGE_BUCKETS-1, evicted = 0;
+
+    if (!server.maxmemory_clients) return 0;
+    while (server.clients_memory > server.maxmemory_clients && j >= 0) {
+        list *bucket = server.client_mem_usage_buckets[j];
+        client *c;
+        sds ci;
+
+        if (listLength(bucket) == 0) {
+            j--;
+            continue;
+        }
+        c = listNodeValue(listFirst(bucket));
+        ci = catClientInfoString(sdsempty(),c);
+        serverLog(LL_NOTICE,"Evicting client: %s",ci);
+        sdsfree(ci);
+        server.stat_evictedclients++;
+        evicted++;
+        if (c == server.current_client || c == server.lua_caller ||
+            server.loading)
+        {
+            freeClientAsync(c);
+        } else {
+            freeClient(c);
+        }
+    }
+    return evicted;
+}
+
 /* Get the class of a client, used in order to enforce limits to different
  * classes of clients.
  *
@@ -1850,6 +2395,9 @@ int checkClientOutputBufferLimits(client *c) {
 void asyncCloseClientOnOutputBufferLimitReached(client *c) {
     serverAssert(c->reply_bytes < SIZE_MAX-(1024*64));
     if (c->reply_bytes == 0 || c->flags & CLIENT_CLOSE_ASAP) return;
+    /* Clients receiving data they don't read, like Pub/Sub subscribers,
+     * only get their memory usage updated here. */
+    updateClientMemUsage(c);
     if (checkClientOutputBufferLimits(c)) {
         sds client = catClientInfoString(sdsempty(),c);
 
@@ -54,6 +54,26 @@ robj *createRawStringObject(const char *ptr, size_t len) {
     return createObject(OBJ_STRING,sdsnewlen(ptr,len));
 }
 
+/* Create a string object with encoding OBJ_ENCODING_CHUNKED, used for big
+ * strings that are modified in place, see the chunkedString type. */
+robj *createChunkedStringObject(const char *ptr, size_t len) {
+    robj *o = createObject(OBJ_STRING,chunkedStringNew(ptr,len));
+    o->encoding = OBJ_ENCODING_CHUNKED;
+    return o;
+}
+
+/* Turn a chunked string object into a raw one in place. This is used when
+ * the object is about to be accessed by code that only knows about sds
+ * strings. */
+void flattenChunkedStringObject(robj *o) {
+    chunkedString *cs = o->ptr;
+
+    serverAssert(o->encoding == OBJ_ENCODING_CHUNKED);
+    o->ptr = chunkedStringToSds(cs);
+    o->encoding = OBJ_ENCODING_RAW;
+    chunkedStringFree(cs);
+}
+
 /* Create a string object with encoding OBJ_ENCODING_EMBSTR, that is
  * an object where the sds string is actually an unmodifiable string
  * allocated in the same chunk as the object itself. */
@@ -84,8 +104,8 @@ robj *createEmbeddedStringObject(const char *ptr, size_t len) {
  * used.
  *
  * The current limit of 39 is chosen so that the biggest string object
- * we allocate as EMBSTR will still fit into the 64 byte arena of jemalloc. */
-#define OBJ_ENCODING_EMBSTR_SIZE_LIMIT 44
+ * we allocate as EMBSTR will still fit into the 64 byte arena of jemalloc.
+ * OBJ_ENCODING_EMBSTR_SIZE_LIMIT is defined in server.h. */
 robj *createStringObject(const char *ptr, size_t len) {
     if (len <= OBJ_ENCODING_EMBSTR_SIZE_LIMIT)
         return createEmbeddedStringObject(ptr,len);
@@ -175,6 +195,10 @@ robj *dupStringObject(robj *o) {
         d->encoding = OBJ_ENCODING_INT;
         d->ptr = o->ptr;
         return d;
+    case OBJ_ENCODING_CHUNKED:
+        d = createObject(OBJ_STRING, chunkedStringDup(o->ptr));
+        d->encoding = OBJ_ENCODING_CHUNKED;
+        return d;
     default:
         serverPanic("Wrong encoding.");
         break;
@@ -237,6 +261,8 @@ robj *createZsetZiplistObject(void) {
 void freeStringObject(robj *o) {
     if (o->encoding == OBJ_ENCODING_RAW) {
         sdsfree(o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedStringFree(o->ptr);
     }
 }
 
@@ -281,6 +307,7 @@ void freeZsetObject(robj *o) {
 void freeHashObject(robj *o) {
     switch (o->encoding) {
     case OBJ_ENCODING_HT:
+        zfree(hashTypePendingZiplist(o));
         dictRelease((dict*) o->ptr);
         break;
     case OBJ_ENCODING_ZIPLIST:
@@ -355,6 +382,215 @@ int isObjectRepresentableAsLongLong(robj *o, long long *llval) {
     }
 }
 
+/* Return true if string objects can be shared among different keys.
+ * Note that we avoid sharing objects when maxmemory is used with an LRU
+ * policy because every object needs to have a private LRU field for the
+ * LRU algorithm to work well. */
+static int canShareStringObjects(void) {
+    return server.maxmemory == 0 ||
+           (server.maxmemory_policy != MAXMEMORY_VOLATILE_LRU &&
+            server.maxmemory_policy != MAXMEMORY_ALLKEYS_LRU);
+}
+
+/* ---------------------------------------------------------------------------
+ * Interned strings
+ *
+ * When string-intern-max-entries is not zero, short string values (up to
+ * string-intern-max-len bytes) are looked up in server.intern_table, and
+ * keys set to the same value end sharing a single object, like it happens
+ * with the small integers in shared.integers. The table holds a reference
+ * to every object it contains: entries only referenced by the table are
+ * released incrementally by internTableCron().
+ * ------------------------------------------------------------------------ */
+
+/* Return the interned version of the string object 'o', taking ownership
+ * of 'o'. If the table is full, or 'o' is too long to be an EMBSTR object,
+ * 'o' itself is returned. */
+static robj *internStringObject(robj *o) {
+    dictEntry *de;
+    robj *shared;
+
+    if (sdslen(o->ptr) > OBJ_ENCODING_EMBSTR_SIZE_LIMIT) return o;
+    de = dictFind(server.intern_table,o->ptr);
+
+    if (de) {
+        shared = dictGetVal(de);
+        server.stat_intern_hits++;
+        incrRefCount(shared);
+        decrRefCount(o);
+        return shared;
+    }
+
+    /* Not found: add it to the table as an EMBSTR object. */
+    if (dictSize(server.intern_table) >= server.string_intern_max_entries)
+        return o;
+    if (o->encoding != OBJ_ENCODING_EMBSTR) {
+        shared = createEmbeddedStringObject(o->ptr,sdslen(o->ptr));
+        decrRefCount(o);
+        o = shared;
+    }
+    dictAdd(server.intern_table,o->ptr,o);
+    incrRefCount(o);
+    return o;
+}
+
+/* Collect the table entries only referenced by the table itself. */
+static void internTableScanCallback(void *privdata, const dictEntry *de) {
+    list *unused = privdata;
+    robj *o = dictGetVal(de);
+
+    if (o->refcount == 1) listAddNodeTail(unused,o->ptr);
+}
+
+/* Called from serverCron(): scan a few buckets of the intern table releasing
+ * the values no longer used by any key, so that the slots can be used by
+ * other values. */
+#define INTERN_TABLE_SCAN_BUCKETS 100
+void internTableCron(void) {
+    static unsigned long cursor = 0;
+    list *unused;
+    listIter li;
+    listNode *ln;
+    int j;
+
+    if (dictSize(server.intern_table) == 0) return;
+    unused = listCreate();
+    for (j = 0; j < INTERN_TABLE_SCAN_BUCKETS; j++) {
+        cursor = dictScan(server.intern_table,cursor,internTableScanCallback,
+                          unused);
+        if (cursor == 0) break;
+    }
+    listRewind(unused,&li);
+    while ((ln = listNext(&li)) != NULL)
+        dictDelete(server.intern_table,listNodeValue(ln));
+    listRelease(unused);
+}
+
+/* Drop all the table references, for instance when interning is disabled.
+ * Values still used by keys stay shared among them. */
+void internTableEmpty(void) {
+    dictEmpty(server.intern_table,NULL);
+}
+
+/* ---------------------------------------------------------------------------
+ * Packed values
+ *
+ * On 64 bit systems small string values, that is integers in the 32 bit
+ * range and strings of up to 4 bytes, can be stored directly in the value
+ * slot of the db->dict entry instead of in a separated object. The packed
+ * value is a tagged pointer with the following layout:
+ *
+ *  bits  0-7: bit 0 is always set (objects are at least 8 bytes aligned),
+ *             bit 1 tells if the payload is a string, bit 2 if the string
+ *             object was RAW encoded, bits 3-5 the string length.
+ *  bits 8-31: the LRU clock of the object.
+ *  bits 32-63: the integer value, or the bytes of the string.
+ *
+ * Values are packed in the background by packValuesCron() once they are
+ * idle for pack-values-idle seconds, and are unpacked again as soon as they
+ * are looked up, so the rest of the code only ever sees normal objects.
+ * The LRU clock is retained, so OBJECT IDLETIME and the eviction of packed
+ * values keep working.
+ * ------------------------------------------------------------------------ */
+
+#define OBJ_PACKED_STRING (1<<1)
+#define OBJ_PACKED_RAW (1<<2)
+#define OBJ_PACKED_MAX_STRLEN 4
+
+/* Return the packed version of 'o', or NULL if 'o' can't be packed. */
+static void *packObject(robj *o) {
+    uint64_t v = OBJ_PACKED_TAG | ((uint64_t)o->lru << 8);
+
+    if (sizeof(void*) != 8 || o->type != OBJ_STRING || o->refcount != 1)
+        return NULL;
+    if (o->encoding == OBJ_ENCODING_INT) {
+        long value = (long)o->ptr;
+
+        if (value < INT32_MIN || value > INT32_MAX) return NULL;
+        v |= (uint64_t)(uint32_t)(int32_t)value << 32;
+    } else if (sdsEncodedObject(o)) {
+        size_t len = sdslen(o->ptr), j;
+        unsigned char *s = o->ptr;
+
+        if (len > OBJ_PACKED_MAX_STRLEN) return NULL;
+        v |= OBJ_PACKED_STRING | (len << 3);
+        if (o->encoding == OBJ_ENCODING_RAW) v |= OBJ_PACKED_RAW;
+        for (j = 0; j < len; j++) v |= (uint64_t)s[j] << (32+j*8);
+    } else {
+        return NULL;
+    }
+    return (void*)(uintptr_t)v;
+}
+
+/* Return the LRU clock stored in the packed value 'v'. */
+static unsigned int packedObjectLRU(void *v) {
+    return ((uint64_t)(uintptr_t)v >> 8) & LRU_CLOCK_MAX;
+}
+
+/* Create a new object with the same content, encoding and LRU clock of the
+ * object that was packed into 'v'. */
+robj *unpackObject(void *v) {
+    uint64_t p = (uintptr_t)v;
+    robj *o;
+
+    if (p & OBJ_PACKED_STRING) {
+        char buf[OBJ_PACKED_MAX_STRLEN];
+        size_t len = (p >> 3) & 7, j;
+
+        for (j = 0; j < len; j++) buf[j] = (p >> (32+j*8)) & 0xff;
+        if (p & OBJ_PACKED_RAW)
+            o = createRawStringObject(buf,len);
+        else
+            o = createEmbeddedStringObject(buf,len);
+    } else {
+        o = createObject(OBJ_STRING,
+                         (void*)(long)(int32_t)(uint32_t)(p >> 32));
+        o->encoding = OBJ_ENCODING_INT;
+    }
+    o->lru = packedObjectLRU(v);
+    return o;
+}
+
+/* Pack the value of the db->dict entry 'de' if it is small and was not
+ * accessed recently. */
+static void packValuesScanCallback(void *privdata, const dictEntry *de) {
+    robj *o = dictGetVal(de);
+    void *packed;
+
+    UNUSED(privdata);
+    if (objectIsPacked(o) ||
+        estimateObjectIdleTime(o)/1000 < (unsigned)server.pack_values_idle ||
+        (packed = packObject(o)) == NULL) return;
+    ((dictEntry*)de)->v.val = packed;
+    decrRefCount(o);
+    server.packed_values++;
+}
+
+/* Called by databasesCron() to pack the idle small values, scanning the
+ * databases incrementally for about PACK_VALUES_CYCLE_USEC microseconds. */
+#define PACK_VALUES_CYCLE_USEC 1000
+void packValuesCron(void) {
+    static unsigned long cursor = 0;
+    static int dbid = 0;
+    long long start = ustime();
+    int iterations = 0, dbs = 0;
+
+    if (server.pack_values_idle == 0 || sizeof(void*) != 8) return;
+    while (dbs < server.dbnum) {
+        dict *d = server.db[dbid].dict;
+
+        if (dictSize(d)) cursor = dictScan(d,cursor,packValuesScanCallback,
+                                           NULL);
+        if (dictSize(d) == 0 || cursor == 0) {
+            cursor = 0;
+            dbid = (dbid+1) % server.dbnum;
+            dbs++;
+        }
+        if ((++iterations & 15) == 0 &&
+            ustime()-start > PACK_VALUES_CYCLE_USEC) break;
+    }
+}
+
 /* Try to encode a string object in order to save space */
 robj *tryObjectEncoding(robj *o) {
     long value;
@@ -382,13 +618,8 @@ robj *tryObjectEncoding(robj *o) {
      * representable as a 32 nor 64 bit integer. */
     len = sdslen(s);
     if (len <= 20 && string2l(s,len,&value)) {
-        /* This object is encodable as a long. Try to use a shared object.
-         * Note that we avoid using shared integers when maxmemory is used
-         * because every object needs to have a private LRU field for the LRU
-         * algorithm to work well. */
-        if ((server.maxmemory == 0 ||
-             (server.maxmemory_policy != MAXMEMORY_VOLATILE_LRU &&
-              server.maxmemory_policy != MAXMEMORY_ALLKEYS_LRU)) &&
+        /* This object is encodable as a long. Try to use a shared object. */
+        if (canShareStringObjects() &&
             value >= 0 &&
             value < OBJ_SHARED_INTEGERS)
         {
@@ -403,6 +634,15 @@ robj *tryObjectEncoding(robj *o) {
         }
     }
 
+    /* Short values can be shared with other keys set to the same value. */
+    if (server.string_intern_max_entries &&
+        len <= server.string_intern_max_len &&
+        canShareStringObjects())
+    {
+        o = internStringObject(o);
+        if (o->refcount > 1) return o;
+    }
+
     /* If the string is small and is still RAW encoded,
      * try the EMBSTR encoding which is more efficient.
      * In this representation the object and the SDS string are allocated
@@ -450,6 +690,8 @@ robj *getDecodedObject(robj *o) {
         ll2string(buf,32,(long)o->ptr);
         dec = createStringObject(buf,strlen(buf));
         return dec;
+    } else if (o->type == OBJ_STRING && o->encoding == OBJ_ENCODING_CHUNKED) {
+        return createObject(OBJ_STRING,chunkedStringToSds(o->ptr));
     } else {
         serverPanic("Unknown encoding type");
     }
@@ -528,6 +770,8 @@ size_t stringObjectLen(robj *o) {
     serverAssertWithInfo(NULL,o,o->type == OBJ_STRING);
     if (sdsEncodedObject(o)) {
         return sdslen(o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        return ((chunkedString*)o->ptr)->len;
     } else {
         return sdigits10((long)o->ptr);
     }
@@ -672,6 +916,7 @@ char *strEncoding(int encoding) {
     case OBJ_ENCODING_INTSET: return "intset";
     case OBJ_ENCODING_SKIPLIST: return "skiplist";
     case OBJ_ENCODING_EMBSTR: return "embstr";
+    case OBJ_ENCODING_CHUNKED: return "chunked";
     default: return "unknown";
     }
 }
@@ -680,10 +925,12 @@ char *strEncoding(int encoding) {
  * requested, using an approximated LRU algorithm. */
 unsigned long long estimateObjectIdleTime(robj *o) {
     unsigned long long lruclock = LRU_CLOCK();
-    if (lruclock >= o->lru) {
-        return (lruclock - o->lru) * LRU_CLOCK_RESOLUTION;
+    unsigned int lru = objectIsPacked(o) ? packedObjectLRU(o) : o->lru;
+
+    if (lruclock >= lru) {
+        return (lruclock - lru) * LRU_CLOCK_RESOLUTION;
     } else {
-        return (lruclock + (LRU_CLOCK_MAX - o->lru)) *
+        return (lruclock + (LRU_CLOCK_MAX - lru)) *
                     LRU_CLOCK_RESOLUTION;
     }
 }
@@ -694,7 +941,7 @@ robj *objectCommandLookup(client *c, robj *key) {
     dictEntry *de;
 
     if ((de = dictFind(c->db->dict,key->ptr)) == NULL) return NULL;
-    return (robj*) dictGetVal(de);
+    return dbUnpackValue(c->db,de);
 }
 
 robj *objectCommandLookupOrReply(client *c, robj *key, robj *reply) {
@@ -710,15 +957,15 @@ void objectCommand(client *c) {
     robj *o;
 
     if (!strcasecmp(c->argv[1]->ptr,"refcount") && c->argc == 3) {
-        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.null[c->resp]))
                 == NULL) return;
         addReplyLongLong(c,o->refcount);
     } else if (!strcasecmp(c->argv[1]->ptr,"encoding") && c->argc == 3) {
-        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.null[c->resp]))
                 == NULL) return;
         addReplyBulkCString(c,strEncoding(o->encoding));
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
-        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.null[c->resp]))
                 == NULL) return;
         addReplyLongLong(c,estimateObjectIdleTime(o)/1000);
     } else {
@@ -726,3 +973,154 @@ void objectCommand(client *c) {
     }
 }
 
+
+/* ======================= Memory introspection ============================= */
+
+/* Return the memory used by a string object, including the object itself.
+ * Shared objects are accounted as if they were not shared, since this is
+ * the memory the value would use anyway if it was not shared. */
+static size_t stringObjectComputeSize(robj *o) {
+    size_t asize = sizeof(*o);
+
+    if (o->encoding == OBJ_ENCODING_RAW) {
+        asize += sdsAllocSize(o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_EMBSTR) {
+        asize += sizeof(struct sdshdr8)+sdslen(o->ptr)+1;
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedString *cs = o->ptr;
+        size_t j;
+
+        asize += sizeof(*cs)+sizeof(robj*)*cs->alloc;
+        for (j = 0; j < cs->numchunks; j++)
+            asize += stringObjectComputeSize(cs->chunks[j]);
+    }
+    return asize;
+}
+
+/* Return the memory used by a dict whose keys (and values, if 'vals' is
+ * true) are string objects. Only 'samples' entries are actually inspected
+ * (all of them if 'samples' is zero), and the average size of the sampled
+ * entries is used to estimate the total. */
+static size_t dictComputeSize(dict *d, int vals, size_t samples) {
+    size_t asize, elesize = 0, sampled = 0;
+    dictIterator *di;
+    dictEntry *de;
+
+    asize = sizeof(dict)+sizeof(dictEntry*)*(d->ht[0].size+d->ht[1].size);
+    di = dictGetIterator(d);
+    while((de = dictNext(di)) != NULL && (!samples || sampled < samples)) {
+        elesize += sizeof(dictEntry)+stringObjectComputeSize(dictGetKey(de));
+        if (vals) elesize += stringObjectComputeSize(dictGetVal(de));
+        sampled++;
+    }
+    dictReleaseIterator(di);
+    if (sampled) asize += (double)elesize/sampled*dictSize(d);
+    return asize;
+}
+
+/* Return the approximated amount of memory used by the value 'o', see the
+ * MEMORY USAGE command. Aggregate values are sampled as dictComputeSize()
+ * does, ziplists and intsets are always accounted exactly. */
+size_t objectComputeSize(robj *o, size_t samples) {
+    size_t asize = sizeof(*o), elesize = 0, sampled = 0;
+
+    if (o->type == OBJ_STRING) {
+        asize = stringObjectComputeSize(o);
+    } else if (o->type == OBJ_LIST && o->encoding == OBJ_ENCODING_QUICKLIST) {
+        quicklist *ql = o->ptr;
+        quicklistNode *node = ql->head;
+
+        asize += sizeof(*ql);
+        while (node && (!samples || sampled < samples)) {
+            elesize += sizeof(*node);
+            if (node->encoding == QUICKLIST_NODE_ENCODING_LZF)
+                elesize += sizeof(quicklistLZF)+
+                           ((quicklistLZF*)node->zl)->sz;
+            else
+                elesize += node->sz;
+            sampled++;
+            node = node->next;
+        }
+        if (sampled) asize += (double)elesize/sampled*ql->len;
+    } else if (o->type == OBJ_SET) {
+        if (o->encoding == OBJ_ENCODING_INTSET)
+            asize += intsetBlobLen(o->ptr);
+        else
+            asize += dictComputeSize(o->ptr,0,samples);
+    } else if (o->type == OBJ_ZSET) {
+        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
+            asize += ziplistBlobLen(o->ptr);
+        } else {
+            zset *zs = o->ptr;
+            zskiplistNode *zn = zs->zsl->header->level[0].forward;
+
+            /* Member objects are shared between the dict and the skiplist,
+             * so they are accounted by the skiplist nodes only. */
+            asize += sizeof(*zs)+sizeof(zskiplist)+sizeof(dict)+
+                     sizeof(dictEntry*)*(zs->dict->ht[0].size+
+                                         zs->dict->ht[1].size);
+            while (zn && (!samples || sampled < samples)) {
+                elesize += zmalloc_size(zn)+sizeof(dictEntry)+
+                           stringObjectComputeSize(zn->obj);
+                sampled++;
+                zn = zn->level[0].forward;
+            }
+            if (sampled) asize += (double)elesize/sampled*zs->zsl->length;
+        }
+    } else if (o->type == OBJ_HASH) {
+        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
+            asize += ziplistBlobLen(o->ptr);
+        } else {
+            asize += dictComputeSize(o->ptr,1,samples);
+            /* The pairs not yet moved by the incremental conversion. */
+            if (hashTypePendingZiplist(o))
+                asize += ziplistBlobLen(hashTypePendingZiplist(o));
+        }
+    }
+    return asize;
+}
+
+/* MEMORY USAGE <key> [SAMPLES <count>]
+ *
+ * Reply with the number of bytes used by the key and its value, including
+ * the main dictionary entry. Aggregate values are estimated sampling
+ * <count> elements (OBJ_COMPUTE_SIZE_DEF_SAMPLES by default), or all the
+ * elements if <count> is zero. */
+void memoryCommand(client *c) {
+    long long samples = OBJ_COMPUTE_SIZE_DEF_SAMPLES;
+    dictEntry *de;
+    robj *o;
+    size_t usage;
+    int j;
+
+    if (strcasecmp(c->argv[1]->ptr,"usage") || c->argc > 5) {
+        addReplyError(c,"Syntax error. Try MEMORY USAGE <key> [SAMPLES <count>]");
+        return;
+    }
+    for (j = 3; j < c->argc; j++) {
+        if (!strcasecmp(c->argv[j]->ptr,"samples") && j+1 < c->argc) {
+            if (getLongLongFromObjectOrReply(c,c->argv[++j],&samples,NULL)
+                != C_OK) return;
+            if (samples < 0) {
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    /* Expired keys are reported as missing. Chunked strings are measured
+     * as they are, without converting them. */
+    o = lookupKeyReadWithFlags(c->db,c->argv[2],
+                               LOOKUP_NOTOUCH|LOOKUP_CHUNKED);
+    if (o == NULL) {
+        addReply(c,shared.null[c->resp]);
+        return;
+    }
+    de = dictFind(c->db->dict,c->argv[2]->ptr);
+    usage = objectComputeSize(o,samples);
+    usage += sizeof(dictEntry)+sdsAllocSize(dictGetKey(de));
+    addReplyLongLong(c,usage);
+}
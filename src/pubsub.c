@@ -54,6 +54,16 @@ int clientSubscriptionsCount(client *c) {
            listLength(c->pubsub_patterns);
 }
 
+/* Emit the header of a Pub/Sub message or (un)subscription confirmation:
+ * a normal array for RESP2 clients, a push reply for RESP3 clients, so
+ * that they can tell it apart from the replies to their commands. */
+static void addReplyPubsubHeader(client *c, long len) {
+    if (c->resp == 2)
+        addReply(c,shared.mbulkhdr[len]);
+    else
+        addReplyPushLen(c,len);
+}
+
 /* Subscribe a client to a channel. Returns 1 if the operation succeeded, or
  * 0 if the client was already subscribed to that channel. */
 int pubsubSubscribeChannel(client *c, robj *channel) {
@@ -77,7 +87,7 @@ int pubsubSubscribeChannel(client *c, robj *channel) {
         listAddNodeTail(clients,c);
     }
     /* Notify the client */
-    addReply(c,shared.mbulkhdr[3]);
+    addReplyPubsubHeader(c,3);
     addReply(c,shared.subscribebulk);
     addReplyBulk(c,channel);
     addReplyLongLong(c,clientSubscriptionsCount(c));
@@ -113,7 +123,7 @@ int pubsubUnsubscribeChannel(client *c, robj *channel, int notify) {
     }
     /* Notify the client */
     if (notify) {
-        addReply(c,shared.mbulkhdr[3]);
+        addReplyPubsubHeader(c,3);
         addReply(c,shared.unsubscribebulk);
         addReplyBulk(c,channel);
         addReplyLongLong(c,dictSize(c->pubsub_channels)+
@@ -139,7 +149,7 @@ int pubsubSubscribePattern(client *c, robj *pattern) {
         listAddNodeTail(server.pubsub_patterns,pat);
     }
     /* Notify the client */
-    addReply(c,shared.mbulkhdr[3]);
+    addReplyPubsubHeader(c,3);
     addReply(c,shared.psubscribebulk);
     addReplyBulk(c,pattern);
     addReplyLongLong(c,clientSubscriptionsCount(c));
@@ -164,7 +174,7 @@ int pubsubUnsubscribePattern(client *c, robj *pattern, int notify) {
     }
     /* Notify the client */
     if (notify) {
-        addReply(c,shared.mbulkhdr[3]);
+        addReplyPubsubHeader(c,3);
         addReply(c,shared.punsubscribebulk);
         addReplyBulk(c,pattern);
         addReplyLongLong(c,dictSize(c->pubsub_channels)+
@@ -188,9 +198,9 @@ int pubsubUnsubscribeAllChannels(client *c, int notify) {
     }
     /* We were subscribed to nothing? Still reply to the client. */
     if (notify && count == 0) {
-        addReply(c,shared.mbulkhdr[3]);
+        addReplyPubsubHeader(c,3);
         addReply(c,shared.unsubscribebulk);
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
         addReplyLongLong(c,dictSize(c->pubsub_channels)+
                        listLength(c->pubsub_patterns));
     }
@@ -213,9 +223,9 @@ int pubsubUnsubscribeAllPatterns(client *c, int notify) {
     }
     if (notify && count == 0) {
         /* We were subscribed to nothing? Still reply to the client. */
-        addReply(c,shared.mbulkhdr[3]);
+        addReplyPubsubHeader(c,3);
         addReply(c,shared.punsubscribebulk);
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
         addReplyLongLong(c,dictSize(c->pubsub_channels)+
                        listLength(c->pubsub_patterns));
     }
@@ -240,7 +250,7 @@ int pubsubPublishMessage(robj *channel, robj *message) {
         while ((ln = listNext(&li)) != NULL) {
             client *c = ln->value;
 
-            addReply(c,shared.mbulkhdr[3]);
+            addReplyPubsubHeader(c,3);
             addReply(c,shared.messagebulk);
             addReplyBulk(c,channel);
             addReplyBulk(c,message);
@@ -258,7 +268,7 @@ int pubsubPublishMessage(robj *channel, robj *message) {
                                 sdslen(pat->pattern->ptr),
                                 (char*)channel->ptr,
                                 sdslen(channel->ptr),0)) {
-                addReply(pat->client,shared.mbulkhdr[4]);
+                addReplyPubsubHeader(pat->client,4);
                 addReply(pat->client,shared.pmessagebulk);
                 addReplyBulk(pat->client,pat->pattern);
                 addReplyBulk(pat->client,channel);
@@ -29,6 +29,7 @@
  */
 
 #include <string.h> /* for memcpy */
+#include <sys/time.h> /* for gettimeofday */
 #include "quicklist.h"
 #include "zmalloc.h"
 #include "ziplist.h"
@@ -58,6 +59,12 @@ static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
  * resulted in a larger size than the original data. */
 #define MIN_COMPRESS_IMPROVE 8
 
+/* Bytes of decompressed nodes every quicklist may keep in its node cache,
+ * 0 disables the cache. See quicklistSetCacheBytes(). */
+static size_t quicklist_cache_bytes = 0;
+
+static quicklistStats quicklist_stats;
+
 /* If not verbose testing, remove all debug printing. */
 #ifndef REDIS_TEST_VERBOSE
 #define D(...)
@@ -100,6 +107,8 @@ quicklist *quicklistCreate(void) {
     quicklist->count = 0;
     quicklist->compress = 0;
     quicklist->fill = -2;
+    quicklist->index = NULL;
+    quicklist->cache = NULL;
     return quicklist;
 }
 
@@ -123,6 +132,23 @@ void quicklistSetFill(quicklist *quicklist, int fill) {
     quicklist->fill = fill;
 }
 
+/* Set how many bytes of decompressed interior nodes every quicklist may keep
+ * around after reading them, 0 disables the cache. Lists already caching
+ * more than the new budget shrink the next time they use the cache. */
+void quicklistSetCacheBytes(size_t bytes) { quicklist_cache_bytes = bytes; }
+
+void quicklistGetStats(quicklistStats *stats) { *stats = quicklist_stats; }
+
+void quicklistResetStats(void) {
+    memset(&quicklist_stats, 0, sizeof(quicklist_stats));
+}
+
+static unsigned long long _quicklistUstime(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((unsigned long long)tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
 void quicklistSetOptions(quicklist *quicklist, int fill, int depth) {
     quicklistSetFill(quicklist, fill);
     quicklistSetCompressDepth(quicklist, depth);
@@ -145,6 +171,7 @@ REDIS_STATIC quicklistNode *quicklistCreateNode(void) {
     node->encoding = QUICKLIST_NODE_ENCODING_RAW;
     node->container = QUICKLIST_NODE_CONTAINER_ZIPLIST;
     node->recompress = 0;
+    node->cached = 0;
     return node;
 }
 
@@ -169,9 +196,97 @@ void quicklistRelease(quicklist *quicklist) {
         quicklist->len--;
         current = next;
     }
+    zfree(quicklist->cache);
+    if (quicklist->index) {
+        zfree(quicklist->index->anchors);
+        zfree(quicklist->index);
+    }
     zfree(quicklist);
 }
 
+/* Skip index over the nodes, see quicklistNodeIndex in quicklist.h.
+ * Lists with less than QUICKLIST_INDEX_MIN_NODES nodes are not indexed. */
+#define QUICKLIST_INDEX_STRIDE 32
+#define QUICKLIST_INDEX_MIN_NODES 128
+
+#define quicklistIndexValid(ql) ((ql)->index && (ql)->index->valid)
+
+/* Invalidate the index after a change in the middle of the list. */
+#define quicklistIndexInvalidate(ql)                                           \
+    do {                                                                       \
+        if ((ql)->index)                                                       \
+            (ql)->index->valid = 0;                                            \
+    } while (0)
+
+/* (Re)build the index, taking an anchor every QUICKLIST_INDEX_STRIDE nodes. */
+REDIS_STATIC void _quicklistIndexBuild(quicklist *quicklist) {
+    quicklistNodeIndex *qi = quicklist->index;
+    unsigned long needed = quicklist->len / QUICKLIST_INDEX_STRIDE;
+    unsigned long pos = 0, accum = 0;
+
+    if (!qi) {
+        qi = zcalloc(sizeof(*qi));
+        quicklist->index = qi;
+    }
+    if (qi->size < needed) {
+        qi->anchors = zrealloc(qi->anchors, sizeof(quicklistAnchor) * needed);
+        qi->size = needed;
+    }
+    qi->first = qi->len = 0;
+    qi->bias = 0;
+    for (quicklistNode *n = quicklist->head; n; n = n->next, pos++) {
+        if (pos && (pos % QUICKLIST_INDEX_STRIDE) == 0 && qi->len < needed) {
+            qi->anchors[qi->len].node = n;
+            qi->anchors[qi->len].offset = accum;
+            qi->len++;
+        }
+        accum += n->count;
+    }
+    qi->valid = 1;
+}
+
+/* Use the index to find the node holding the zero-based entry 'index',
+ * counting from the head. Returns the node, and the number of entries
+ * before it in '*accum'. If the walk from the nearest anchor was too long,
+ * because many nodes were added after the index was built, the index is
+ * invalidated so that the next lookup rebuilds it. */
+REDIS_STATIC quicklistNode *_quicklistIndexLookup(quicklist *quicklist,
+                                                  unsigned long long index,
+                                                  unsigned long long *accum) {
+    quicklistNodeIndex *qi;
+    quicklistNode *n = quicklist->head;
+    unsigned long walked = 0;
+
+    if (!quicklistIndexValid(quicklist)) _quicklistIndexBuild(quicklist);
+    qi = quicklist->index;
+    *accum = 0;
+
+    /* Binary search the last anchor starting at or before 'index'. */
+    if (qi->len > qi->first) {
+        unsigned long lo = qi->first, hi = qi->len;
+
+        while (lo < hi) {
+            unsigned long mid = lo + (hi - lo) / 2;
+            if (qi->anchors[mid].offset + qi->bias <= index)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo > qi->first) {
+            n = qi->anchors[lo - 1].node;
+            *accum = qi->anchors[lo - 1].offset + qi->bias;
+        }
+    }
+
+    while (n && *accum + n->count <= index) {
+        *accum += n->count;
+        n = n->next;
+        walked++;
+    }
+    if (walked > QUICKLIST_INDEX_STRIDE * 2) qi->valid = 0;
+    return n;
+}
+
 /* Compress the ziplist in 'node' and update encoding details.
  * Returns 1 if ziplist compressed successfully.
  * Returns 0 if compression failed or if ziplist too small to compress. */
@@ -185,15 +300,20 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
         return 0;
 
     quicklistLZF *lzf = zmalloc(sizeof(*lzf) + node->sz);
+    unsigned long long start = _quicklistUstime();
 
     /* Cancel if compression fails or doesn't compress small enough */
-    if (((lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed,
-                                 node->sz)) == 0) ||
-        lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
+    lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed, node->sz);
+    quicklist_stats.compress_us += _quicklistUstime() - start;
+    if (lzf->sz == 0 || lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
         /* lzf_compress aborts/rejects compression if value not compressable. */
+        quicklist_stats.compress_failed++;
         zfree(lzf);
         return 0;
     }
+    quicklist_stats.compressed++;
+    quicklist_stats.compress_in += node->sz;
+    quicklist_stats.compress_out += lzf->sz;
     lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
     zfree(node->zl);
     node->zl = (unsigned char *)lzf;
@@ -219,11 +339,14 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 
     void *decompressed = zmalloc(node->sz);
     quicklistLZF *lzf = (quicklistLZF *)node->zl;
+    unsigned long long start = _quicklistUstime();
     if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
         /* Someone requested decompress, but we can't decompress.  Not good. */
         zfree(decompressed);
         return 0;
     }
+    quicklist_stats.decompress_us += _quicklistUstime() - start;
+    quicklist_stats.decompressed++;
     zfree(lzf);
     node->zl = decompressed;
     node->encoding = QUICKLIST_NODE_ENCODING_RAW;
@@ -338,6 +461,97 @@ REDIS_STATIC void __quicklistCompress(const quicklist *quicklist,
             __quicklistCompress((_ql), (_node));                               \
     } while (0)
 
+/* Return 1 if 'node' is one of the nodes at the ends of the list that are
+ * never compressed, or if the list is too short to compress anything. */
+REDIS_STATIC int _quicklistNodeWithinDepth(const quicklist *quicklist,
+                                           const quicklistNode *node) {
+    if (!quicklistAllowsCompression(quicklist) ||
+        quicklist->len < (unsigned int)(quicklist->compress * 2))
+        return 1;
+
+    const quicklistNode *forward = quicklist->head;
+    const quicklistNode *reverse = quicklist->tail;
+    for (int depth = 0; depth < quicklist->compress; depth++) {
+        if (forward == node || reverse == node)
+            return 1;
+        forward = forward->next;
+        reverse = reverse->prev;
+    }
+    return 0;
+}
+
+/* Remove 'node' from the decompressed nodes cache of 'quicklist', without
+ * touching its encoding. */
+REDIS_STATIC void _quicklistCacheRemove(quicklist *quicklist,
+                                        quicklistNode *node) {
+    quicklistNodeCache *cache = quicklist->cache;
+
+    for (int j = 0; j < cache->len; j++) {
+        if (cache->nodes[j] != node)
+            continue;
+        cache->bytes -= cache->sz[j];
+        cache->len--;
+        memmove(cache->nodes + j, cache->nodes + j + 1,
+                sizeof(cache->nodes[0]) * (cache->len - j));
+        memmove(cache->sz + j, cache->sz + j + 1,
+                sizeof(cache->sz[0]) * (cache->len - j));
+        break;
+    }
+    node->cached = 0;
+}
+
+/* Called instead of recompressing 'node' once a reader is done with it:
+ * the node is left decompressed and becomes the most recently used entry
+ * of the cache, compressing the least recently used nodes if the cache is
+ * now over budget. Nodes are compressed only if nothing else already did
+ * it, and if they are not now within the compress depth of the list.
+ * Nodes bigger than the whole budget are just compressed again. */
+REDIS_STATIC void __quicklistCacheNode(quicklist *quicklist,
+                                       quicklistNode *node) {
+    if (node->sz > quicklist_cache_bytes) {
+        quicklistCompressNode(node);
+        return;
+    }
+
+    if (!quicklist->cache)
+        quicklist->cache = zcalloc(sizeof(*quicklist->cache));
+    quicklistNodeCache *cache = quicklist->cache;
+
+    if (node->cached)
+        _quicklistCacheRemove(quicklist, node);
+
+    while (cache->len && (cache->len == QUICKLIST_CACHE_MAX_NODES ||
+                          cache->bytes + node->sz > quicklist_cache_bytes)) {
+        quicklistNode *victim = cache->nodes[cache->len - 1];
+        _quicklistCacheRemove(quicklist, victim);
+        if (victim->encoding == QUICKLIST_NODE_ENCODING_RAW &&
+            victim->recompress &&
+            !_quicklistNodeWithinDepth(quicklist, victim)) {
+            __quicklistCompressNode(victim);
+            quicklist_stats.cache_evictions++;
+        }
+    }
+
+    memmove(cache->nodes + 1, cache->nodes,
+            sizeof(cache->nodes[0]) * cache->len);
+    memmove(cache->sz + 1, cache->sz, sizeof(cache->sz[0]) * cache->len);
+    cache->nodes[0] = node;
+    cache->sz[0] = node->sz;
+    cache->bytes += node->sz;
+    cache->len++;
+    node->cached = 1;
+}
+
+/* Recompress a node a reader is done with, like quicklistCompress(), but
+ * park it in the decompressed nodes cache when the cache is enabled. */
+#define quicklistCompressOrCache(_ql, _node)                                   \
+    do {                                                                       \
+        if ((_node)->recompress && quicklist_cache_bytes)                      \
+            __quicklistCacheNode((struct quicklist *)(_ql), (_node));          \
+        else                                                                   \
+            quicklistCompress((_ql), (_node));                                 \
+    } while (0)
+
 /* If we previously used quicklistDecompressNodeForUse(), just recompress. */
 #define quicklistRecompressOnly(_ql, _node)                                    \
     do {                                                                       \
@@ -493,6 +707,9 @@ int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
     }
     quicklist->count++;
     quicklist->head->count++;
+    /* Every anchored node has one more entry before it. */
+    if (quicklistIndexValid(quicklist))
+        quicklist->index->bias++;
     return (orig_head != quicklist->head);
 }
 
@@ -597,6 +814,8 @@ REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
 
     quicklist->count -= node->count;
 
+    if (node->cached)
+        _quicklistCacheRemove(quicklist, node);
     zfree(node->zl);
     zfree(node);
     quicklist->len--;
@@ -613,6 +832,7 @@ REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
 REDIS_STATIC int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
                                    unsigned char **p) {
     int gone = 0;
+    int at_head = (node == quicklist->head), at_tail = (node == quicklist->tail);
 
     node->zl = ziplistDelete(node->zl, p);
     node->count--;
@@ -623,6 +843,27 @@ REDIS_STATIC int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
         quicklistNodeUpdateSz(node);
     }
     quicklist->count--;
+
+    /* Keep the index valid for pops: deleting from the head shifts every
+     * anchor by one entry, and a node that becomes the head, or an anchored
+     * tail node that is deleted, is no longer anchored. Note that the
+     * anchor nodes are compared by address only, 'node' may be freed. */
+    if (quicklistIndexValid(quicklist)) {
+        quicklistNodeIndex *qi = quicklist->index;
+
+        if (at_head) {
+            qi->bias--;
+            if (qi->len > qi->first && quicklist->head &&
+                qi->anchors[qi->first].node == quicklist->head)
+                qi->first++;
+        } else if (at_tail) {
+            if (gone && qi->len > qi->first &&
+                qi->anchors[qi->len - 1].node == node)
+                qi->len--;
+        } else {
+            qi->valid = 0;
+        }
+    }
     /* If we deleted the node, the original node is no longer valid */
     return gone ? 1 : 0;
 }
@@ -836,6 +1077,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
     quicklistNode *node = entry->node;
     quicklistNode *new_node = NULL;
 
+    quicklistIndexInvalidate(quicklist);
     if (!node) {
         /* we have no reference node, so let's create only node in the list */
         D("No node given!");
@@ -973,6 +1215,7 @@ int quicklistDelRange(quicklist *quicklist, const long start,
     quicklistEntry entry;
     if (!quicklistIndex(quicklist, start, &entry))
         return 0;
+    quicklistIndexInvalidate(quicklist);
 
     D("Quicklist delete request for start %ld, count %ld, extent: %ld", start,
       count, extent);
@@ -1088,7 +1331,7 @@ quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
  * If we still have a valid current node, then re-encode current node. */
 void quicklistReleaseIterator(quicklistIter *iter) {
     if (iter->current)
-        quicklistCompress(iter->quicklist, iter->current);
+        quicklistCompressOrCache(iter->quicklist, iter->current);
 
     zfree(iter);
 }
@@ -1135,6 +1378,9 @@ int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
 
     if (!iter->zi) {
         /* If !zi, use current index. */
+        if (iter->current->cached &&
+            iter->current->encoding == QUICKLIST_NODE_ENCODING_RAW)
+            quicklist_stats.cache_hits++;
         quicklistDecompressNodeForUse(iter->current);
         iter->zi = ziplistIndex(iter->current->zl, iter->offset);
     } else {
@@ -1160,7 +1406,7 @@ int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
     } else {
         /* We ran out of ziplist entries.
          * Pick next node, update offset, then re-run retrieval. */
-        quicklistCompress(iter->quicklist, iter->current);
+        quicklistCompressOrCache(iter->quicklist, iter->current);
         if (iter->direction == AL_START_HEAD) {
             /* Forward traversal */
             D("Jumping to start of next node");
@@ -1243,31 +1489,48 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
     if (index >= quicklist->count)
         return 0;
 
-    while (likely(n)) {
-        if ((accum + n->count) > index) {
-            break;
-        } else {
-            D("Skipping over (%p) %u at accum %lld", (void *)n, n->count,
-              accum);
-            accum += n->count;
-            n = forward ? n->next : n->prev;
+    if (quicklist->len >= QUICKLIST_INDEX_MIN_NODES && index >= n->count) {
+        /* Long lists use the skip index, that works from the head, unless
+         * the entry is in the first node we would look at anyway. The index
+         * is cached state, so it's fine to update it even if the quicklist
+         * is const for the caller. */
+        unsigned long long fwd = forward ? index : quicklist->count - 1 - index;
+
+        n = _quicklistIndexLookup((struct quicklist *)quicklist, fwd, &accum);
+        if (!n)
+            return 0;
+        entry->node = n;
+        entry->offset = fwd - accum;
+        /* Reverse lookups use negative offsets, like below. */
+        if (!forward)
+            entry->offset -= n->count;
+    } else {
+        while (likely(n)) {
+            if ((accum + n->count) > index) {
+                break;
+            } else {
+                D("Skipping over (%p) %u at accum %lld", (void *)n, n->count,
+                  accum);
+                accum += n->count;
+                n = forward ? n->next : n->prev;
+            }
         }
-    }
 
-    if (!n)
-        return 0;
+        if (!n)
+            return 0;
 
-    D("Found node: %p at accum %llu, idx %llu, sub+ %llu, sub- %llu", (void *)n,
-      accum, index, index - accum, (-index) - 1 + accum);
+        D("Found node: %p at accum %llu, idx %llu, sub+ %llu, sub- %llu", (void *)n,
+          accum, index, index - accum, (-index) - 1 + accum);
 
-    entry->node = n;
-    if (forward) {
-        /* forward = normal head-to-tail offset. */
-        entry->offset = index - accum;
-    } else {
-        /* reverse = need negative offset for tail-to-head, so undo
-         * the result of the original if (index < 0) above. */
-        entry->offset = (-index) - 1 + accum;
+        entry->node = n;
+        if (forward) {
+            /* forward = normal head-to-tail offset. */
+            entry->offset = index - accum;
+        } else {
+            /* reverse = need negative offset for tail-to-head, so undo
+             * the result of the original if (index < 0) above. */
+            entry->offset = (-index) - 1 + accum;
+        }
     }
 
     quicklistDecompressNodeForUse(entry->node);
@@ -2276,6 +2539,114 @@ int quicklistTest(int argc, char *argv[]) {
             OK;
         }
 
+        TEST("index lookups on long list while pushing and popping") {
+            /* Small nodes, so that the node skip index is used, checked
+             * against a plain array holding the same values. */
+            quicklist *ql = quicklistNew(4, options[_i]);
+            static long long model[40000];
+            int mhead = 20000, mlen = 0;
+            char num[32];
+            quicklistEntry entry;
+            for (int i = 0; i < 4000; i++) {
+                model[mhead + mlen++] = i;
+                quicklistPushTail(ql, num, ll2string(num, sizeof(num), i));
+            }
+            for (int op = 0; op < 20000; op++) {
+                long long v = 100000 + op;
+                int sz = ll2string(num, sizeof(num), v);
+                int pos = rand() % mlen;
+                switch (rand() % 7) {
+                case 0:
+                    quicklistPushHead(ql, num, sz);
+                    model[--mhead] = v;
+                    mlen++;
+                    break;
+                case 1:
+                    quicklistPushTail(ql, num, sz);
+                    model[mhead + mlen++] = v;
+                    break;
+                case 2:
+                    quicklistPop(ql, QUICKLIST_HEAD, NULL, NULL, NULL);
+                    mhead++;
+                    mlen--;
+                    break;
+                case 3:
+                    quicklistPop(ql, QUICKLIST_TAIL, NULL, NULL, NULL);
+                    mlen--;
+                    break;
+                case 4:
+                    quicklistReplaceAtIndex(ql, pos, num, sz);
+                    model[mhead + pos] = v;
+                    break;
+                case 5:
+                    if (op % 10 == 0) {
+                        quicklistIndex(ql, pos, &entry);
+                        quicklistInsertAfter(ql, &entry, num, sz);
+                        memmove(model + mhead + pos + 2, model + mhead + pos + 1,
+                                sizeof(long long) * (mlen - pos - 1));
+                        model[mhead + pos + 1] = v;
+                        mlen++;
+                    }
+                    break;
+                default:
+                    break;
+                }
+                pos = rand() % mlen;
+                if (!quicklistIndex(ql, pos, &entry) ||
+                    entry.longval != model[mhead + pos])
+                    ERR("[%d] index %d: expected %lld", op, pos,
+                        model[mhead + pos]);
+                if (!quicklistIndex(ql, pos - mlen, &entry) ||
+                    entry.longval != model[mhead + pos])
+                    ERR("[%d] index %d: expected %lld", op, pos - mlen,
+                        model[mhead + pos]);
+            }
+            if (ql->count != (unsigned long)mlen)
+                ERR("Count %lu, expected %d", ql->count, mlen);
+            quicklistRelease(ql);
+        }
+
+        TEST("iterate compressed list with decompressed nodes cache") {
+            quicklist *ql = quicklistNew(16, options[_i]);
+            char buf[64];
+            for (int i = 0; i < 1000; i++) {
+                int sz = snprintf(buf, sizeof(buf), "cached-node-value-%d", i);
+                quicklistPushTail(ql, buf, sz);
+            }
+            size_t nodesz = ql->head->next->sz;
+            quicklistSetCacheBytes(nodesz * 4);
+            for (int pass = 0; pass < 3; pass++) {
+                quicklistIter *iter = quicklistGetIterator(
+                    ql, pass == 1 ? AL_START_TAIL : AL_START_HEAD);
+                quicklistEntry entry;
+                int i = 0;
+                while (quicklistNext(iter, &entry)) {
+                    int j = pass == 1 ? 999 - i : i;
+                    if (pass == 2 && j >= 900)
+                        j += 50;
+                    int sz = snprintf(buf, sizeof(buf), "cached-node-value-%d", j);
+                    if (entry.sz != (unsigned int)sz ||
+                        memcmp(entry.value, buf, sz))
+                        ERR("[%d] Element %d: %.*s", pass, j, entry.sz,
+                            entry.value);
+                    i++;
+                }
+                quicklistReleaseIterator(iter);
+                if (i != (pass == 2 ? 950 : 1000))
+                    ERR("[%d] Iterated %d elements", pass, i);
+                if (options[_i] && (!ql->cache || ql->cache->len == 0 ||
+                                    ql->cache->bytes > nodesz * 4))
+                    ERR("[%d] Cache holds %d nodes, %zu bytes", pass,
+                        ql->cache ? ql->cache->len : 0,
+                        ql->cache ? ql->cache->bytes : 0);
+                /* Drop nodes from the middle, cached ones included. */
+                if (pass == 1)
+                    quicklistDelRange(ql, 900, 50);
+            }
+            quicklistSetCacheBytes(0);
+            quicklistRelease(ql);
+        }
+
         for (int f = optimize_start; f < 16; f++) {
             TEST_DESC("lrem test at fill %d at compress %d", f, options[_i]) {
                 quicklist *ql = quicklistNew(f, options[_i]);
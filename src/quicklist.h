@@ -40,7 +40,8 @@
  * container: 2 bits, NONE=1, ZIPLIST=2.
  * recompress: 1 bit, bool, true if node is temporarry decompressed for usage.
  * attempted_compress: 1 bit, boolean, used for verifying during testing.
- * extra: 12 bits, free for future use; pads out the remainder of 32 bits */
+ * cached: 1 bit, boolean, true if node is in the decompressed nodes cache.
+ * extra: 9 bits, free for future use; pads out the remainder of 32 bits */
 typedef struct quicklistNode {
     struct quicklistNode *prev;
     struct quicklistNode *next;
@@ -51,7 +52,8 @@ typedef struct quicklistNode {
     unsigned int container : 2;  /* NONE==1 or ZIPLIST==2 */
     unsigned int recompress : 1; /* was this node previous compressed? */
     unsigned int attempted_compress : 1; /* node can't compress; too small */
-    unsigned int extra : 10; /* more bits to steal for future usage */
+    unsigned int cached : 1;     /* is node in the decompressed nodes cache? */
+    unsigned int extra : 9; /* more bits to steal for future usage */
 } quicklistNode;
 
 /* quicklistLZF is a 4+N byte struct holding 'sz' followed by 'compressed'.
@@ -64,12 +66,67 @@ typedef struct quicklistLZF {
     char compressed[];
 } quicklistLZF;
 
-/* quicklist is a 32 byte struct (on 64-bit systems) describing a quicklist.
+/* quicklistAnchor remembers the number of entries stored before 'node'.
+ * quicklistNodeIndex is a skip index over the nodes of long quicklists:
+ * every QUICKLIST_INDEX_STRIDE nodes (never the head) an anchor is taken,
+ * so that quicklistIndex() can binary search the anchors and walk at most
+ * about QUICKLIST_INDEX_STRIDE nodes, instead of half the list.
+ * 'bias' is added to every anchor offset: pushing and popping at the head
+ * just update it. Pops removing an anchored node at the head or the tail
+ * drop the anchor, any other change to the list invalidates the index,
+ * which is rebuilt by the next lookup. */
+typedef struct quicklistAnchor {
+    quicklistNode *node;
+    unsigned long offset;
+} quicklistAnchor;
+
+typedef struct quicklistNodeIndex {
+    quicklistAnchor *anchors;
+    unsigned long first;    /* first valid anchor */
+    unsigned long len;      /* anchors[first..len-1] are valid */
+    unsigned long size;     /* allocated anchors */
+    long bias;
+    int valid;
+} quicklistNodeIndex;
+
+/* quicklistNodeCache is a small LRU of interior nodes that were decompressed
+ * to be read by an iterator. Instead of compressing them again as soon as
+ * the iterator moves on, up to QUICKLIST_CACHE_MAX_NODES nodes, and no more
+ * than the configured amount of bytes, are left decompressed, so that
+ * reading the same region of a compressed list again does not decompress
+ * and recompress it every time. The least recently used node is compressed
+ * when the cache gets over budget. 'sz' is the node size accounted when
+ * the node entered the cache. */
+#define QUICKLIST_CACHE_MAX_NODES 16
+typedef struct quicklistNodeCache {
+    quicklistNode *nodes[QUICKLIST_CACHE_MAX_NODES]; /* most recent first */
+    unsigned int sz[QUICKLIST_CACHE_MAX_NODES];
+    int len;
+    size_t bytes;
+} quicklistNodeCache;
+
+/* Process wide node compression statistics, see quicklistGetStats(). */
+typedef struct quicklistStats {
+    unsigned long long compressed;      /* nodes compressed */
+    unsigned long long compress_failed; /* compressions not worth it */
+    unsigned long long compress_in;     /* bytes given to the compressor */
+    unsigned long long compress_out;    /* bytes it produced */
+    unsigned long long compress_us;     /* time spent compressing */
+    unsigned long long decompressed;    /* nodes decompressed */
+    unsigned long long decompress_us;   /* time spent decompressing */
+    unsigned long long cache_hits;      /* node found already decompressed */
+    unsigned long long cache_evictions; /* nodes compressed by the cache */
+} quicklistStats;
+
+/* quicklist is a 48 byte struct (on 64-bit systems) describing a quicklist.
  * 'count' is the number of total entries.
  * 'len' is the number of quicklist nodes.
  * 'compress' is: -1 if compression disabled, otherwise it's the number
  *                of quicklistNodes to leave uncompressed at ends of quicklist.
- * 'fill' is the user-requested (or default) fill factor. */
+ * 'fill' is the user-requested (or default) fill factor.
+ * 'index' is the skip index over the nodes, NULL until the list is long
+ *         enough for a positional lookup to build it.
+ * 'cache' is the decompressed nodes cache, NULL until first used. */
 typedef struct quicklist {
     quicklistNode *head;
     quicklistNode *tail;
@@ -77,6 +134,8 @@ typedef struct quicklist {
     unsigned int len;           /* number of quicklistNodes */
     int fill : 16;              /* fill factor for individual nodes */
     unsigned int compress : 16; /* depth of end nodes not to compress;0=off */
+    quicklistNodeIndex *index;  /* skip index over nodes, may be NULL */
+    quicklistNodeCache *cache;  /* decompressed nodes cache, may be NULL */
 } quicklist;
 
 typedef struct quicklistIter {
@@ -118,6 +177,9 @@ typedef struct quicklistEntry {
 quicklist *quicklistCreate(void);
 quicklist *quicklistNew(int fill, int compress);
 void quicklistSetCompressDepth(quicklist *quicklist, int depth);
+void quicklistSetCacheBytes(size_t bytes);
+void quicklistGetStats(quicklistStats *stats);
+void quicklistResetStats(void);
 void quicklistSetFill(quicklist *quicklist, int fill);
 void quicklistSetOptions(quicklist *quicklist, int fill, int depth);
 void quicklistRelease(quicklist *quicklist);
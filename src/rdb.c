@@ -391,12 +391,32 @@ ssize_t rdbSaveLongLongAsStringObject(rio *rdb, long long value) {
     return nwritten;
 }
 
+/* Save a chunked string as a plain uncompressed string, so that it is
+ * loaded back as a normal string. LZF would need the whole string in a
+ * single buffer, so the chunks are written as they are. */
+static ssize_t rdbSaveChunkedString(rio *rdb, chunkedString *cs) {
+    ssize_t n, nwritten = 0;
+    size_t j;
+
+    if ((n = rdbSaveLen(rdb,cs->len)) == -1) return -1;
+    nwritten += n;
+    for (j = 0; j < cs->numchunks; j++) {
+        robj *chunk = cs->chunks[j];
+
+        if (rdbWriteRaw(rdb,chunk->ptr,sdslen(chunk->ptr)) == -1) return -1;
+        nwritten += sdslen(chunk->ptr);
+    }
+    return nwritten;
+}
+
 /* Like rdbSaveStringObjectRaw() but handle encoded objects */
 int rdbSaveStringObject(rio *rdb, robj *obj) {
     /* Avoid to decode the object, then encode it again, if the
      * object is already integer encoded. */
     if (obj->encoding == OBJ_ENCODING_INT) {
         return rdbSaveLongLongAsStringObject(rdb,(long)obj->ptr);
+    } else if (obj->encoding == OBJ_ENCODING_CHUNKED) {
+        return rdbSaveChunkedString(rdb,obj->ptr);
     } else {
         serverAssertWithInfo(NULL,obj,sdsEncodedObject(obj));
         return rdbSaveRawString(rdb,obj->ptr,sdslen(obj->ptr));
@@ -662,8 +682,9 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
         } else if (o->encoding == OBJ_ENCODING_HT) {
             dictIterator *di = dictGetIterator(o->ptr);
             dictEntry *de;
+            unsigned char *zl = hashTypePendingZiplist(o), *p;
 
-            if ((n = rdbSaveLen(rdb,dictSize((dict*)o->ptr))) == -1) return -1;
+            if ((n = rdbSaveLen(rdb,hashTypeLength(o))) == -1) return -1;
             nwritten += n;
 
             while((de = dictNext(di)) != NULL) {
@@ -677,6 +698,24 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
             }
             dictReleaseIterator(di);
 
+            /* Pairs not yet moved into the dict by the incremental
+             * conversion: fields and values are just consecutive entries. */
+            p = zl ? ziplistIndex(zl,0) : NULL;
+            while (p != NULL) {
+                unsigned char *vstr;
+                unsigned int vlen;
+                long long vll;
+
+                ziplistGet(p,&vstr,&vlen,&vll);
+                if (vstr)
+                    n = rdbSaveRawString(rdb,vstr,vlen);
+                else
+                    n = rdbSaveLongLongAsStringObject(rdb,vll);
+                if (n == -1) return -1;
+                nwritten += n;
+                p = ziplistNext(zl,p);
+            }
+
         } else {
             serverPanic("Unknown hash encoding");
         }
@@ -719,6 +758,63 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
     return 1;
 }
 
+/* Save the expire times of the fields of a hash, as an opcode preceding
+ * the key it refers to (and its expire time if any):
+ *
+ * HASH_FIELD_EXPIRES <count> [<field> <unix time in milliseconds>] ...
+ *
+ * The opcode is only emitted for hashes having fields with a TTL, so that
+ * data sets not using the feature can still be loaded by other versions.
+ * Returns -1 on error, 1 on success. */
+int rdbSaveHashFieldExpires(rio *rdb, hashFieldExpires *hfe) {
+    dictIterator *di;
+    dictEntry *de;
+
+    if (rdbSaveType(rdb,RDB_OPCODE_HASH_FIELD_EXPIRES) == -1) return -1;
+    if (rdbSaveLen(rdb,dictSize(hfe->fields)) == -1) return -1;
+    di = dictGetIterator(hfe->fields);
+    while((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+
+        if (rdbSaveRawString(rdb,(unsigned char*)field,sdslen(field)) == -1 ||
+            rdbSaveMillisecondTime(rdb,dictGetSignedIntegerVal(de)) == -1)
+        {
+            dictReleaseIterator(di);
+            return -1;
+        }
+    }
+    dictReleaseIterator(di);
+    return 1;
+}
+
+/* Load the body of an HASH_FIELD_EXPIRES opcode (see
+ * rdbSaveHashFieldExpires()) into 'fields', a dict of type
+ * hashFieldTimesDictType. Returns -1 on short read or duplicated field,
+ * 0 on success. */
+int rdbLoadHashFieldExpires(rio *rdb, dict *fields) {
+    uint32_t count;
+
+    if ((count = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return -1;
+    while(count--) {
+        robj *fieldobj;
+        dictEntry *de;
+        sds field;
+        long long when;
+
+        if ((fieldobj = rdbLoadStringObject(rdb)) == NULL) return -1;
+        field = sdsdup(fieldobj->ptr);
+        decrRefCount(fieldobj);
+        if ((when = rdbLoadMillisecondTime(rdb)) == -1 ||
+            (de = dictAddRaw(fields,field)) == NULL)
+        {
+            sdsfree(field);
+            return -1;
+        }
+        dictSetSignedIntegerVal(de,when);
+    }
+    return 0;
+}
+
 /* Save an AUX field. */
 int rdbSaveAuxField(rio *rdb, void *key, size_t keylen, void *val, size_t vallen) {
     if (rdbSaveType(rdb,RDB_OPCODE_AUX) == -1) return -1;
@@ -764,13 +860,18 @@ int rdbSaveRio(rio *rdb, int *error) {
     dictIterator *di = NULL;
     dictEntry *de;
     char magic[10];
-    int j;
+    int j, rdbver = RDB_VERSION_NO_FIELD_EXPIRES;
     long long now = mstime();
     uint64_t cksum;
 
+    /* Only announce the newer format if the HASH_FIELD_EXPIRES opcode may
+     * be emitted, older versions can load the file otherwise. */
+    for (j = 0; j < server.dbnum; j++)
+        if (dictSize(server.db[j].hexpires)) rdbver = RDB_VERSION;
+
     if (server.rdb_checksum)
         rdb->update_cksum = rioGenericUpdateChecksum;
-    snprintf(magic,sizeof(magic),"REDIS%04d",RDB_VERSION);
+    snprintf(magic,sizeof(magic),"REDIS%04d",rdbver);
     if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
     if (rdbSaveInfoAuxFields(rdb) == -1) goto werr;
 
@@ -803,12 +904,23 @@ int rdbSaveRio(rio *rdb, int *error) {
         /* Iterate this DB writing every entry */
         while((de = dictNext(di)) != NULL) {
             sds keystr = dictGetKey(de);
-            robj key, *o = dictGetVal(de);
+            robj key, *o = dictGetVal(de), *unpacked = NULL;
             long long expire;
+            int retval;
+
+            if (objectIsPacked(o)) o = unpacked = unpackObject(o);
 
             initStaticStringObject(key,keystr);
             expire = getExpire(db,&key);
-            if (rdbSaveKeyValuePair(rdb,&key,o,expire,now) == -1) goto werr;
+            /* Field expire times go before the key, that is skipped by
+             * rdbSaveKeyValuePair() when already expired. */
+            if (o->type == OBJ_HASH && (expire == -1 || expire >= now)) {
+                hashFieldExpires *hfe = hashGetFieldExpires(db,&key);
+                if (hfe && rdbSaveHashFieldExpires(rdb,hfe) == -1) goto werr;
+            }
+            retval = rdbSaveKeyValuePair(rdb,&key,o,expire,now);
+            if (unpacked) decrRefCount(unpacked);
+            if (retval == -1) goto werr;
         }
         dictReleaseIterator(di);
     }
@@ -1279,6 +1391,7 @@ int rdbLoad(char *filename) {
     redisDb *db = server.db+0;
     char buf[1024];
     long long expiretime, now = mstime();
+    dict *fieldexpires = NULL; /* Field TTLs of the next hash to load. */
     FILE *fp;
     rio rdb;
 
@@ -1312,7 +1425,15 @@ int rdbLoad(char *filename) {
         if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
 
         /* Handle special types. */
-        if (type == RDB_OPCODE_EXPIRETIME) {
+        if (type == RDB_OPCODE_HASH_FIELD_EXPIRES) {
+            /* HASH_FIELD_EXPIRES: expire times of the fields of the next
+             * key to load, that is a hash. Saved before the key expire. */
+            if (!fieldexpires)
+                fieldexpires = dictCreate(&hashFieldTimesDictType,NULL);
+            if (rdbLoadHashFieldExpires(&rdb,fieldexpires) == -1)
+                goto eoferr;
+            continue; /* Read type again. */
+        } else if (type == RDB_OPCODE_EXPIRETIME) {
             /* EXPIRETIME: load an expire associated with the next key
              * to load. Note that after loading an expire we need to
              * load the actual type, and continue. */
@@ -1396,6 +1517,7 @@ int rdbLoad(char *filename) {
         if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
             decrRefCount(key);
             decrRefCount(val);
+            if (fieldexpires) dictEmpty(fieldexpires,NULL);
             continue;
         }
         /* Add the new object in the hash table */
@@ -1404,6 +1526,13 @@ int rdbLoad(char *filename) {
         /* Set the expire time if needed */
         if (expiretime != -1) setExpire(db,key,expiretime);
 
+        /* Set the fields expire times if needed. Fields already expired
+         * are reclaimed as soon as the loading is over. */
+        if (fieldexpires && dictSize(fieldexpires)) {
+            hashAddFieldExpires(db,key,val,fieldexpires);
+            dictEmpty(fieldexpires,NULL);
+        }
+
         decrRefCount(key);
     }
     /* Verify the checksum if RDB version is >= 5 */
@@ -1420,6 +1549,7 @@ int rdbLoad(char *filename) {
         }
     }
 
+    if (fieldexpires) dictRelease(fieldexpires);
     fclose(fp);
     stopLoading();
     return C_OK;
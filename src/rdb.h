@@ -38,7 +38,12 @@
 
 /* The current RDB version. When the format changes in a way that is no longer
  * backward compatible this number gets incremented. */
-#define RDB_VERSION 7
+#define RDB_VERSION 8
+
+/* Files not using any feature introduced after this version are saved with
+ * it, so that they can still be loaded by older Redis versions. Version 8
+ * is only needed when a hash has fields with a TTL. */
+#define RDB_VERSION_NO_FIELD_EXPIRES 7
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -88,7 +93,11 @@
 /* Test if a type is an object type. */
 #define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 14))
 
-/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
+/* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType).
+ * RDB_OPCODE_HASH_FIELD_EXPIRES is far from both the object types, that
+ * grow from 0, and the other opcodes, that grow down from 255, so that it
+ * does not clash with the ones allocated by other Redis versions. */
+#define RDB_OPCODE_HASH_FIELD_EXPIRES 200
 #define RDB_OPCODE_AUX        250
 #define RDB_OPCODE_RESIZEDB   251
 #define RDB_OPCODE_EXPIRETIME_MS 252
@@ -113,6 +122,8 @@ ssize_t rdbSaveObject(rio *rdb, robj *o);
 size_t rdbSavedObjectLen(robj *o);
 robj *rdbLoadObject(int type, rio *rdb);
 void backgroundSaveDoneHandler(int exitcode, int bysignal);
+int rdbSaveHashFieldExpires(rio *rdb, hashFieldExpires *hfe);
+int rdbLoadHashFieldExpires(rio *rdb, dict *fields);
 int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime, long long now);
 robj *rdbLoadStringObject(rio *rdb);
 
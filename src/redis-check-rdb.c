@@ -31,9 +31,14 @@
 #include "rdb.h"
 
 #include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 void createSharedObjects(void);
 void rdbLoadProgressCallback(rio *r, const void *buf, size_t len);
+void bytesToHuman(char *s, unsigned long long n);
 long long rdbLoadMillisecondTime(rio *rdb);
 int rdbCheckMode = 0;
 
@@ -208,7 +213,19 @@ int redis_check_rdb(char *rdbfilename) {
         if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
 
         /* Handle special types. */
-        if (type == RDB_OPCODE_EXPIRETIME) {
+        if (type == RDB_OPCODE_HASH_FIELD_EXPIRES) {
+            /* HASH_FIELD_EXPIRES: fields TTLs of the next key, a hash. */
+            uint64_t count;
+            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+            if ((count = rdbLoadLen(&rdb,NULL)) == RDB_LENERR) goto eoferr;
+            while(count--) {
+                robj *field;
+                if ((field = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
+                decrRefCount(field);
+                rdbLoadMillisecondTime(&rdb);
+            }
+            continue; /* Read type again. */
+        } else if (type == RDB_OPCODE_EXPIRETIME) {
             rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
             /* EXPIRETIME: load an expire associated with the next key
              * to load. Note that after loading an expire we need to
@@ -321,22 +338,825 @@ eoferr: /* unexpected end of file is handled here with a fatal exit */
     return 1;
 }
 
+/* ============================ RDB analysis ================================
+ *
+ * With --analyze the RDB file is not just checked: every key is loaded and
+ * accounted, in order to report the estimated memory used by the data set
+ * per type, per encoding and per key prefix, the distribution of the TTLs
+ * and the biggest keys, without the need to load the file into a server.
+ *
+ * The file is memory mapped and scanned a first time without decoding the
+ * values, just skipping them, in order to split it into ranges of similar
+ * size starting at key boundaries. Then the ranges are analyzed in parallel
+ * by child processes, that load the keys and report their statistics to the
+ * parent, that merges them. Like the server does for BGSAVE we use fork():
+ * the loading code was never meant to be used by multiple threads. */
+
+#define RDB_ANALYZE_MAX_WORKERS 64
+#define RDB_ANALYZE_DEFAULT_TOP 10
+#define RDB_ANALYZE_TOP_PREFIXES 20
+#define RDB_ANALYZE_MAX_PREFIXES 100000 /* Per worker, then "(other)". */
+
+/* TTL distribution buckets. */
+#define RDB_ANALYZE_TTL_NONE 0
+#define RDB_ANALYZE_TTL_EXPIRED 1
+#define RDB_ANALYZE_TTL_HOUR 2
+#define RDB_ANALYZE_TTL_DAY 3
+#define RDB_ANALYZE_TTL_WEEK 4
+#define RDB_ANALYZE_TTL_MONTH 5
+#define RDB_ANALYZE_TTL_MORE 6
+#define RDB_ANALYZE_TTL_BUCKETS 7
+
+char *rdb_analyze_ttl_string[] = {
+    "no expire",
+    "already expired",
+    "< 1 hour",
+    "< 1 day",
+    "< 1 week",
+    "< 30 days",
+    ">= 30 days"
+};
+
+char *rdb_analyze_type_string[] = {"string","list","set","zset","hash"};
+
+typedef struct analyzeStats {
+    unsigned long long keys;
+    unsigned long long mem;         /* Estimated memory, in bytes. */
+    unsigned long long elements;    /* Bytes for strings, else elements. */
+} analyzeStats;
+
+/* A key among the biggest of its type. */
+typedef struct analyzeKey {
+    sds key;
+    int dbid;
+    unsigned long long mem;
+    unsigned long long elements;
+    long long expire;
+} analyzeKey;
+
+/* A range of the file starting at a key boundary. */
+typedef struct analyzeRange {
+    off_t start;
+    off_t end;
+    int dbid;                       /* DB selected at 'start'. */
+    FILE *results;                  /* Statistics reported by the worker. */
+    FILE *csv;                      /* CSV rows written by the worker. */
+    pid_t pid;
+} analyzeRange;
+
+struct {
+    char *map;                      /* The memory mapped RDB file. */
+    size_t size;
+    int workers;
+    int top;                        /* Biggest keys reported per type. */
+    char separator;                 /* Key prefix separator. */
+    char *csvfile;
+    long long now;
+    analyzeStats types[OBJ_HASH+1];
+    analyzeStats encodings[OBJ_ENCODING_CHUNKED+1];
+    analyzeStats ttls[RDB_ANALYZE_TTL_BUCKETS];
+    dict *prefixes;                 /* Prefix -> analyzeStats. */
+    analyzeKey *biggest[OBJ_HASH+1];/* 'top' keys per type, biggest first. */
+} analysis;
+
+unsigned int dictSdsHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+void dictSdsDestructor(void *privdata, void *val);
+void dictVanillaFree(void *privdata, void *val);
+
+/* Prefix -> analyzeStats. */
+dictType analyzePrefixDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    dictVanillaFree,            /* val destructor */
+    NULL                        /* allow to expand */
+};
+
+/* A rio reading from the mapped file. The position is kept in the buffer
+ * target fields, but the mapped file is accessed directly, without any
+ * copy into an sds string. */
+static size_t rioMapRead(rio *r, void *buf, size_t len) {
+    if ((size_t)r->io.buffer.pos + len > analysis.size) return 0;
+    memcpy(buf,analysis.map+r->io.buffer.pos,len);
+    r->io.buffer.pos += len;
+    return 1;
+}
+
+static off_t rioMapTell(rio *r) {
+    return r->io.buffer.pos;
+}
+
+static void rioInitWithMap(rio *r, off_t pos) {
+    memset(r,0,sizeof(*r));
+    r->read = rioMapRead;
+    r->tell = rioMapTell;
+    r->io.buffer.pos = pos;
+    r->processed_bytes = pos; /* So that errors report file offsets. */
+}
+
+/* Skip 'len' bytes of the mapped file. */
+static int rioMapSkip(rio *r, size_t len) {
+    if ((size_t)r->io.buffer.pos + len > analysis.size) return 0;
+    r->io.buffer.pos += len;
+    r->processed_bytes += len;
+    return 1;
+}
+
+/* Skip a string, see rdbGenericLoadStringObject(). */
+static int rdbSkipString(rio *r) {
+    int isencoded;
+    uint32_t len, clen;
+
+    if ((len = rdbLoadLen(r,&isencoded)) == RDB_LENERR) return 0;
+    if (isencoded) {
+        switch(len) {
+        case RDB_ENC_INT8: return rioMapSkip(r,1);
+        case RDB_ENC_INT16: return rioMapSkip(r,2);
+        case RDB_ENC_INT32: return rioMapSkip(r,4);
+        case RDB_ENC_LZF:
+            if ((clen = rdbLoadLen(r,NULL)) == RDB_LENERR) return 0;
+            if (rdbLoadLen(r,NULL) == RDB_LENERR) return 0;
+            return rioMapSkip(r,clen);
+        default: return 0;
+        }
+    }
+    return rioMapSkip(r,len);
+}
+
+/* Skip a double saved by rdbSaveDoubleValue(). */
+static int rdbSkipDoubleValue(rio *r) {
+    unsigned char len;
+
+    if (rioRead(r,&len,1) == 0) return 0;
+    return len >= 253 ? 1 : rioMapSkip(r,len);
+}
+
+/* Skip an object of the specified type without loading it. */
+static int rdbSkipObject(rio *r, int type) {
+    uint32_t len, j;
+
+    switch(type) {
+    case RDB_TYPE_STRING:
+    case RDB_TYPE_HASH_ZIPMAP:
+    case RDB_TYPE_LIST_ZIPLIST:
+    case RDB_TYPE_SET_INTSET:
+    case RDB_TYPE_ZSET_ZIPLIST:
+    case RDB_TYPE_HASH_ZIPLIST:
+        return rdbSkipString(r);
+    case RDB_TYPE_LIST:
+    case RDB_TYPE_SET:
+    case RDB_TYPE_LIST_QUICKLIST:
+        if ((len = rdbLoadLen(r,NULL)) == RDB_LENERR) return 0;
+        for (j = 0; j < len; j++) if (!rdbSkipString(r)) return 0;
+        return 1;
+    case RDB_TYPE_ZSET:
+        if ((len = rdbLoadLen(r,NULL)) == RDB_LENERR) return 0;
+        for (j = 0; j < len; j++)
+            if (!rdbSkipString(r) || !rdbSkipDoubleValue(r)) return 0;
+        return 1;
+    case RDB_TYPE_HASH:
+        if ((len = rdbLoadLen(r,NULL)) == RDB_LENERR) return 0;
+        for (j = 0; j < len; j++)
+            if (!rdbSkipString(r) || !rdbSkipString(r)) return 0;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Scan the file without loading the values, splitting it into at most
+ * 'n' ranges of similar size, every one starting at the first opcode of a
+ * key (an expire time precedes the key type). Returns the number of ranges,
+ * or -1 if the file is corrupted: the caller should fall back to the normal
+ * check in order to get a detailed report. */
+static int analyzeFindRanges(analyzeRange *ranges, int n) {
+    rio r;
+    int numranges = 1, dbid = 0, type;
+    off_t recstart = -1, off;
+
+    rioInitWithMap(&r,9);
+    ranges[0].start = 9;
+    ranges[0].dbid = 0;
+    while(1) {
+        uint32_t len;
+
+        off = r.io.buffer.pos;
+        if ((type = rdbLoadType(&r)) == -1) return -1;
+        if (type == RDB_OPCODE_EXPIRETIME) {
+            if (recstart == -1) recstart = off;
+            if (!rioMapSkip(&r,4)) return -1;
+            continue;
+        } else if (type == RDB_OPCODE_EXPIRETIME_MS) {
+            if (recstart == -1) recstart = off;
+            if (!rioMapSkip(&r,8)) return -1;
+            continue;
+        } else if (type == RDB_OPCODE_HASH_FIELD_EXPIRES) {
+            if (recstart == -1) recstart = off;
+            if ((len = rdbLoadLen(&r,NULL)) == RDB_LENERR) return -1;
+            while(len--)
+                if (!rdbSkipString(&r) || !rioMapSkip(&r,8)) return -1;
+            continue;
+        } else if (type == RDB_OPCODE_EOF) {
+            ranges[numranges-1].end = off;
+            return numranges;
+        } else if (type == RDB_OPCODE_SELECTDB) {
+            if ((len = rdbLoadLen(&r,NULL)) == RDB_LENERR) return -1;
+            dbid = len;
+            continue;
+        } else if (type == RDB_OPCODE_RESIZEDB) {
+            if (rdbLoadLen(&r,NULL) == RDB_LENERR ||
+                rdbLoadLen(&r,NULL) == RDB_LENERR) return -1;
+            continue;
+        } else if (type == RDB_OPCODE_AUX) {
+            if (!rdbSkipString(&r) || !rdbSkipString(&r)) return -1;
+            continue;
+        } else if (!rdbIsObjectType(type)) {
+            return -1;
+        }
+
+        /* A key starts here: start a new range if the current one is big
+         * enough. */
+        if (recstart == -1) recstart = off;
+        if (numranges < n &&
+            (size_t)recstart >= analysis.size/n*numranges)
+        {
+            ranges[numranges-1].end = recstart;
+            ranges[numranges].start = recstart;
+            ranges[numranges].dbid = dbid;
+            numranges++;
+        }
+        recstart = -1;
+        if (!rdbSkipString(&r) || !rdbSkipObject(&r,type)) return -1;
+    }
+}
+
+/* Add 'mem' and 'elements' to the stats. */
+static void analyzeStatsAdd(analyzeStats *s, unsigned long long keys,
+                            unsigned long long mem,
+                            unsigned long long elements)
+{
+    s->keys += keys;
+    s->mem += mem;
+    s->elements += elements;
+}
+
+static void analyzeAddPrefix(sds prefix, unsigned long long keys,
+                             unsigned long long mem,
+                             unsigned long long elements)
+{
+    dictEntry *de = dictFind(analysis.prefixes,prefix);
+    analyzeStats *s;
+
+    if (de == NULL) {
+        if (dictSize(analysis.prefixes) >= RDB_ANALYZE_MAX_PREFIXES &&
+            strcmp(prefix,"(other)"))
+        {
+            sds other = sdsnew("(other)");
+            analyzeAddPrefix(other,keys,mem,elements);
+            sdsfree(other);
+            return;
+        }
+        s = zcalloc(sizeof(*s));
+        dictAdd(analysis.prefixes,sdsdup(prefix),s);
+    } else {
+        s = dictGetVal(de);
+    }
+    analyzeStatsAdd(s,keys,mem,elements);
+}
+
+/* Add the key to the biggest keys of its type if needed. The key name is
+ * copied. */
+static void analyzeAddBiggest(int type, analyzeKey *k) {
+    analyzeKey *top = analysis.biggest[type];
+    int j, last = analysis.top-1;
+
+    if (top[last].key && k->mem <= top[last].mem) return;
+    for (j = 0; j < last; j++)
+        if (top[j].key == NULL || k->mem > top[j].mem) break;
+    sdsfree(top[last].key);
+    memmove(top+j+1,top+j,sizeof(analyzeKey)*(last-j));
+    top[j] = *k;
+    top[j].key = sdsdup(k->key);
+}
+
+static int analyzeTTLBucket(long long expire) {
+    long long ttl = expire-analysis.now;
+
+    if (expire == -1) return RDB_ANALYZE_TTL_NONE;
+    if (ttl <= 0) return RDB_ANALYZE_TTL_EXPIRED;
+    if (ttl < 3600*1000LL) return RDB_ANALYZE_TTL_HOUR;
+    if (ttl < 86400*1000LL) return RDB_ANALYZE_TTL_DAY;
+    if (ttl < 7*86400*1000LL) return RDB_ANALYZE_TTL_WEEK;
+    if (ttl < 30*86400*1000LL) return RDB_ANALYZE_TTL_MONTH;
+    return RDB_ANALYZE_TTL_MORE;
+}
+
+/* Write 'len' bytes of 's' as a CSV field. */
+static void analyzeWriteCSVField(FILE *fp, char *s, size_t len) {
+    size_t j;
+
+    fputc('"',fp);
+    for (j = 0; j < len; j++) {
+        if (s[j] == '"') fputc('"',fp);
+        fputc(s[j],fp);
+    }
+    fputc('"',fp);
+}
+
+/* Account a loaded key. The estimated memory is the one MEMORY USAGE would
+ * report, plus the entry in the expires dictionary if any. */
+static void analyzeKeyValue(int dbid, robj *key, robj *val, long long expire,
+                            FILE *csv)
+{
+    analyzeKey k;
+    unsigned long long elements;
+    char *sep;
+    sds prefix;
+
+    k.key = key->ptr;
+    k.dbid = dbid;
+    k.expire = expire;
+    k.mem = objectComputeSize(val,0)+sizeof(dictEntry)+sdsAllocSize(key->ptr);
+    if (expire != -1) k.mem += sizeof(dictEntry);
+    switch(val->type) {
+    case OBJ_STRING: elements = stringObjectLen(val); break;
+    case OBJ_LIST: elements = listTypeLength(val); break;
+    case OBJ_SET: elements = setTypeSize(val); break;
+    case OBJ_ZSET: elements = zsetLength(val); break;
+    case OBJ_HASH: elements = hashTypeLength(val); break;
+    default: elements = 0; break;
+    }
+    k.elements = elements;
+
+    analyzeStatsAdd(&analysis.types[val->type],1,k.mem,elements);
+    analyzeStatsAdd(&analysis.encodings[val->encoding],1,k.mem,elements);
+    analyzeStatsAdd(&analysis.ttls[analyzeTTLBucket(expire)],1,k.mem,
+                    elements);
+    sep = memchr(k.key,analysis.separator,sdslen(k.key));
+    prefix = sep ? sdsnewlen(k.key,sep-k.key+1) : sdsnew("(no prefix)");
+    analyzeAddPrefix(prefix,1,k.mem,elements);
+    sdsfree(prefix);
+    analyzeAddBiggest(val->type,&k);
+
+    if (csv) {
+        fprintf(csv,"%d,%s,%s,",dbid,rdb_analyze_type_string[val->type],
+            strEncoding(val->encoding));
+        analyzeWriteCSVField(csv,k.key,sdslen(k.key));
+        fprintf(csv,",%llu,%llu,",k.mem,elements);
+        if (expire != -1) fprintf(csv,"%lld",expire);
+        fputc('\n',csv);
+    }
+}
+
+/* Load and account all the keys of the range. Returns 0 on success, 1 if
+ * the file is corrupted, in which case an error is reported. */
+static int analyzeRangeKeys(analyzeRange *range) {
+    rio r;
+    int type, dbid = range->dbid;
+    long long expire = -1;
+
+    rioInitWithMap(&r,range->start);
+    rdbstate.rio = &r;
+    while(r.io.buffer.pos < range->end) {
+        robj *key, *val;
+
+        rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
+        if ((type = rdbLoadType(&r)) == -1) goto eoferr;
+        if (type == RDB_OPCODE_EXPIRETIME) {
+            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+            if ((expire = rdbLoadTime(&r)) == -1) goto eoferr;
+            expire *= 1000;
+            continue;
+        } else if (type == RDB_OPCODE_EXPIRETIME_MS) {
+            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+            if ((expire = rdbLoadMillisecondTime(&r)) == -1) goto eoferr;
+            continue;
+        } else if (type == RDB_OPCODE_HASH_FIELD_EXPIRES) {
+            uint32_t count;
+
+            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+            if ((count = rdbLoadLen(&r,NULL)) == RDB_LENERR) goto eoferr;
+            while(count--)
+                if (!rdbSkipString(&r) || !rioMapSkip(&r,8)) goto eoferr;
+            continue;
+        } else if (type == RDB_OPCODE_SELECTDB) {
+            rdbstate.doing = RDB_CHECK_DOING_READ_LEN;
+            if ((dbid = rdbLoadLen(&r,NULL)) == (int)RDB_LENERR) goto eoferr;
+            continue;
+        } else if (type == RDB_OPCODE_RESIZEDB) {
+            rdbstate.doing = RDB_CHECK_DOING_READ_LEN;
+            if (rdbLoadLen(&r,NULL) == RDB_LENERR ||
+                rdbLoadLen(&r,NULL) == RDB_LENERR) goto eoferr;
+            continue;
+        } else if (type == RDB_OPCODE_AUX) {
+            rdbstate.doing = RDB_CHECK_DOING_READ_AUX;
+            if (!rdbSkipString(&r) || !rdbSkipString(&r)) goto eoferr;
+            continue;
+        } else if (!rdbIsObjectType(type)) {
+            rdbCheckError("Invalid object type: %d", type);
+            return 1;
+        }
+
+        rdbstate.key_type = type;
+        rdbstate.doing = RDB_CHECK_DOING_READ_KEY;
+        if ((key = rdbLoadStringObject(&r)) == NULL) goto eoferr;
+        rdbstate.key = key;
+        rdbstate.doing = RDB_CHECK_DOING_READ_OBJECT_VALUE;
+        if ((val = rdbLoadObject(type,&r)) == NULL) goto eoferr;
+        analyzeKeyValue(dbid,key,val,expire,range->csv);
+        rdbstate.keys++;
+        rdbstate.key = NULL;
+        rdbstate.key_type = -1;
+        decrRefCount(key);
+        decrRefCount(val);
+        expire = -1;
+    }
+    return 0;
+
+eoferr:
+    if (rdbstate.error_set) {
+        rdbCheckError(rdbstate.error);
+    } else {
+        rdbCheckError("Unexpected EOF reading RDB file");
+    }
+    return 1;
+}
+
+/* Write the statistics collected by a worker, one per line, so that the
+ * parent can merge them with analyzeReadResults(). */
+static void analyzeWriteStats(FILE *fp, char *kind, int id, analyzeStats *s) {
+    if (s->keys)
+        fprintf(fp,"%s %d %llu %llu %llu\n",kind,id,s->keys,s->mem,
+            s->elements);
+}
+
+static void analyzeWriteResults(FILE *fp) {
+    dictIterator *di;
+    dictEntry *de;
+    int j, i;
+
+    for (j = 0; j <= OBJ_HASH; j++)
+        analyzeWriteStats(fp,"type",j,&analysis.types[j]);
+    for (j = 0; j <= OBJ_ENCODING_CHUNKED; j++)
+        analyzeWriteStats(fp,"encoding",j,&analysis.encodings[j]);
+    for (j = 0; j < RDB_ANALYZE_TTL_BUCKETS; j++)
+        analyzeWriteStats(fp,"ttl",j,&analysis.ttls[j]);
+
+    di = dictGetIterator(analysis.prefixes);
+    while((de = dictNext(di)) != NULL) {
+        sds repr = sdscatrepr(sdsempty(),dictGetKey(de),
+                              sdslen(dictGetKey(de)));
+        analyzeStats *s = dictGetVal(de);
+
+        fprintf(fp,"prefix %s %llu %llu %llu\n",repr,s->keys,s->mem,
+            s->elements);
+        sdsfree(repr);
+    }
+    dictReleaseIterator(di);
+
+    for (j = 0; j <= OBJ_HASH; j++) {
+        for (i = 0; i < analysis.top; i++) {
+            analyzeKey *k = &analysis.biggest[j][i];
+            sds repr;
+
+            if (k->key == NULL) break;
+            repr = sdscatrepr(sdsempty(),k->key,sdslen(k->key));
+            fprintf(fp,"key %d %d %llu %llu %lld %s\n",j,k->dbid,k->mem,
+                k->elements,k->expire,repr);
+            sdsfree(repr);
+        }
+    }
+}
+
+/* Merge the statistics written by a worker. */
+static void analyzeReadResults(FILE *fp) {
+    char buf[1024];
+    sds line = sdsempty();
+
+    rewind(fp);
+    while(fgets(buf,sizeof(buf),fp) != NULL) {
+        sds *argv;
+        int argc;
+
+        line = sdscat(line,buf);
+        if (line[sdslen(line)-1] != '\n') continue; /* Partial line. */
+        argv = sdssplitargs(line,&argc);
+        if (argv && argc == 5 && strcmp(argv[0],"prefix")) {
+            int id = atoi(argv[1]);
+            analyzeStats *s = NULL;
+
+            if (!strcmp(argv[0],"type") && id >= 0 && id <= OBJ_HASH)
+                s = &analysis.types[id];
+            else if (!strcmp(argv[0],"encoding") && id >= 0 &&
+                     id <= OBJ_ENCODING_CHUNKED)
+                s = &analysis.encodings[id];
+            else if (!strcmp(argv[0],"ttl") && id >= 0 &&
+                     id < RDB_ANALYZE_TTL_BUCKETS)
+                s = &analysis.ttls[id];
+            if (s) analyzeStatsAdd(s,strtoull(argv[2],NULL,10),
+                strtoull(argv[3],NULL,10),strtoull(argv[4],NULL,10));
+        } else if (argv && argc == 5) {
+            analyzeAddPrefix(argv[1],strtoull(argv[2],NULL,10),
+                strtoull(argv[3],NULL,10),strtoull(argv[4],NULL,10));
+        } else if (argv && argc == 7 && !strcmp(argv[0],"key")) {
+            int type = atoi(argv[1]);
+            analyzeKey k;
+
+            if (type >= 0 && type <= OBJ_HASH) {
+                k.dbid = atoi(argv[2]);
+                k.mem = strtoull(argv[3],NULL,10);
+                k.elements = strtoull(argv[4],NULL,10);
+                k.expire = strtoll(argv[5],NULL,10);
+                k.key = argv[6];
+                analyzeAddBiggest(type,&k);
+            }
+        }
+        sdsfreesplitres(argv,argc);
+        sdsclear(line);
+    }
+    sdsfree(line);
+}
+
+/* Reset the statistics, in the parent before merging the results. */
+static void analyzeResetStats(void) {
+    int j, i;
+
+    memset(analysis.types,0,sizeof(analysis.types));
+    memset(analysis.encodings,0,sizeof(analysis.encodings));
+    memset(analysis.ttls,0,sizeof(analysis.ttls));
+    if (analysis.prefixes) dictRelease(analysis.prefixes);
+    analysis.prefixes = dictCreate(&analyzePrefixDictType,NULL);
+    for (j = 0; j <= OBJ_HASH; j++) {
+        if (analysis.biggest[j]) {
+            for (i = 0; i < analysis.top; i++)
+                sdsfree(analysis.biggest[j][i].key);
+            zfree(analysis.biggest[j]);
+        }
+        analysis.biggest[j] = zcalloc(sizeof(analyzeKey)*analysis.top);
+    }
+}
+
+static int analyzeComparePrefixes(const void *a, const void *b) {
+    analyzeStats *sa = dictGetVal(*(dictEntry**)a);
+    analyzeStats *sb = dictGetVal(*(dictEntry**)b);
+
+    if (sa->mem == sb->mem) return 0;
+    return sa->mem > sb->mem ? -1 : 1;
+}
+
+static void analyzePrintStats(char *name, analyzeStats *s,
+                              unsigned long long totmem)
+{
+    char hmem[64];
+
+    bytesToHuman(hmem,s->mem);
+    printf("  %-24s %12llu %12s %6.2f%% %14llu %12.2f\n", name, s->keys, hmem,
+        totmem ? 100*(double)s->mem/totmem : 0, s->elements,
+        s->keys ? (double)s->mem/s->keys : 0);
+}
+
+static void analyzePrintHeader(char *title) {
+    printf("\n%s\n  %-24s %12s %12s %7s %14s %12s\n", title, "", "keys",
+        "memory", "%mem", "elements", "avg memory");
+}
+
+/* Print the merged statistics. */
+static void analyzePrintReport(void) {
+    unsigned long long totkeys = 0, totmem = 0;
+    dictIterator *di;
+    dictEntry *de, **prefixes;
+    unsigned long numprefixes, j;
+    char hmem[64], name[64];
+    int i, t;
+
+    for (t = 0; t <= OBJ_HASH; t++) {
+        totkeys += analysis.types[t].keys;
+        totmem += analysis.types[t].mem;
+    }
+    bytesToHuman(hmem,totmem);
+    printf("\n--- RDB ANALYSIS ---\n");
+    printf("Keys: %llu, estimated memory: %llu bytes (%s)\n", totkeys,
+        totmem, hmem);
+    printf("(elements are bytes for strings, members for the other types)\n");
+
+    analyzePrintHeader("By type:");
+    for (t = 0; t <= OBJ_HASH; t++)
+        analyzePrintStats(rdb_analyze_type_string[t],&analysis.types[t],
+                          totmem);
+
+    analyzePrintHeader("By encoding:");
+    for (i = 0; i <= OBJ_ENCODING_CHUNKED; i++)
+        if (analysis.encodings[i].keys)
+            analyzePrintStats(strEncoding(i),&analysis.encodings[i],totmem);
+
+    snprintf(name,sizeof(name),"By key prefix (separator '%c', top %d):",
+        analysis.separator, RDB_ANALYZE_TOP_PREFIXES);
+    analyzePrintHeader(name);
+    numprefixes = dictSize(analysis.prefixes);
+    prefixes = zmalloc(sizeof(dictEntry*)*(numprefixes+1));
+    di = dictGetIterator(analysis.prefixes);
+    for (j = 0; (de = dictNext(di)) != NULL; j++) prefixes[j] = de;
+    dictReleaseIterator(di);
+    qsort(prefixes,numprefixes,sizeof(dictEntry*),analyzeComparePrefixes);
+    for (j = 0; j < numprefixes && j < RDB_ANALYZE_TOP_PREFIXES; j++) {
+        sds repr = sdscatrepr(sdsempty(),dictGetKey(prefixes[j]),
+                              sdslen(dictGetKey(prefixes[j])));
+        analyzePrintStats(repr,dictGetVal(prefixes[j]),totmem);
+        sdsfree(repr);
+    }
+    zfree(prefixes);
+
+    analyzePrintHeader("By expire:");
+    for (i = 0; i < RDB_ANALYZE_TTL_BUCKETS; i++)
+        analyzePrintStats(rdb_analyze_ttl_string[i],&analysis.ttls[i],totmem);
+
+    for (t = 0; t <= OBJ_HASH; t++) {
+        if (analysis.biggest[t][0].key == NULL) continue;
+        printf("\nBiggest %d %s keys:\n", analysis.top,
+            rdb_analyze_type_string[t]);
+        for (i = 0; i < analysis.top && analysis.biggest[t][i].key; i++) {
+            analyzeKey *k = &analysis.biggest[t][i];
+            sds repr = sdscatrepr(sdsempty(),k->key,sdslen(k->key));
+
+            bytesToHuman(hmem,k->mem);
+            printf("  %3d) db%d %s %s, %llu elements%s\n", i+1, k->dbid,
+                repr, hmem, k->elements, k->expire != -1 ? ", expires" : "");
+            sdsfree(repr);
+        }
+    }
+}
+
+/* Copy the CSV rows of every range, in order, to the CSV file. */
+static int analyzeWriteCSV(analyzeRange *ranges, int numranges) {
+    FILE *fp = fopen(analysis.csvfile,"w");
+    char buf[1024*16];
+    size_t nread;
+    int j;
+
+    if (fp == NULL) {
+        fprintf(stderr,"Can't open %s: %s\n",analysis.csvfile,
+            strerror(errno));
+        return 1;
+    }
+    fprintf(fp,"database,type,encoding,key,size_in_bytes,num_elements,"
+               "expiry\n");
+    for (j = 0; j < numranges; j++) {
+        rewind(ranges[j].csv);
+        while((nread = fread(buf,1,sizeof(buf),ranges[j].csv)) > 0)
+            fwrite(buf,1,nread,fp);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* Analyze the specified RDB file. Returns 0 on success. */
+int redis_analyze_rdb(char *rdbfilename) {
+    analyzeRange ranges[RDB_ANALYZE_MAX_WORKERS];
+    struct stat sb;
+    int fd, numranges, j, retval = 0;
+
+    if ((fd = open(rdbfilename,O_RDONLY)) == -1 || fstat(fd,&sb) == -1) {
+        fprintf(stderr,"Can't open %s: %s\n",rdbfilename,strerror(errno));
+        return 1;
+    }
+    analysis.size = sb.st_size;
+    if (analysis.size < 9 ||
+        (analysis.map = mmap(NULL,analysis.size,PROT_READ,MAP_PRIVATE,fd,0))
+            == MAP_FAILED)
+    {
+        fprintf(stderr,"Can't map %s\n",rdbfilename);
+        return 1;
+    }
+    close(fd);
+    if (memcmp(analysis.map,"REDIS",5) != 0) {
+        rdbCheckError("Wrong signature trying to load DB from file");
+        return 1;
+    }
+
+    analysis.now = mstime();
+    if ((numranges = analyzeFindRanges(ranges,analysis.workers)) == -1) {
+        rdbCheckInfo("The RDB file is corrupted, checking it...");
+        munmap(analysis.map,analysis.size);
+        redis_check_rdb(rdbfilename);
+        return 1;
+    }
+    rdbCheckInfo("Analyzing %zu bytes using %d worker(s)", analysis.size,
+        numranges);
+
+    /* Run a worker per range. Flush stdout first, otherwise the workers
+     * would output again what is still buffered. */
+    analyzeResetStats();
+    fflush(stdout);
+    for (j = 0; j < numranges; j++) {
+        ranges[j].results = tmpfile();
+        ranges[j].csv = analysis.csvfile ? tmpfile() : NULL;
+        if (ranges[j].results == NULL ||
+            (analysis.csvfile && ranges[j].csv == NULL))
+        {
+            fprintf(stderr,"Can't create temporary file: %s\n",
+                strerror(errno));
+            return 1;
+        }
+        if ((ranges[j].pid = fork()) == 0) {
+            int err = analyzeRangeKeys(&ranges[j]);
+
+            analyzeWriteResults(ranges[j].results);
+            fflush(ranges[j].results);
+            if (ranges[j].csv) fflush(ranges[j].csv);
+            fflush(stdout); /* Errors are reported with printf(). */
+            _exit(err);
+        } else if (ranges[j].pid == -1) {
+            fprintf(stderr,"Can't fork: %s\n",strerror(errno));
+            return 1;
+        }
+    }
+
+    /* Wait for the workers and merge the results. */
+    analyzeResetStats();
+    for (j = 0; j < numranges; j++) {
+        int status;
+
+        if (waitpid(ranges[j].pid,&status,0) == -1 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            printf("[info] Worker %d failed analyzing bytes %lld-%lld "
+                   "of the file\n", j, (long long)ranges[j].start,
+                   (long long)ranges[j].end);
+            retval = 1;
+        } else {
+            analyzeReadResults(ranges[j].results);
+        }
+    }
+
+    if (retval == 0) {
+        analyzePrintReport();
+        if (analysis.csvfile) retval = analyzeWriteCSV(ranges,numranges);
+    }
+    for (j = 0; j < numranges; j++) {
+        fclose(ranges[j].results);
+        if (ranges[j].csv) fclose(ranges[j].csv);
+    }
+    munmap(analysis.map,analysis.size);
+    return retval;
+}
+
 /* RDB check main: called form redis.c when Redis is executed with the
  * redis-check-rdb alias.
  *
  * The function never returns, but exits with the status code according
  * to success (RDB is sane) or error (RDB is corrupted). */
 int redis_check_rdb_main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <rdb-file-name>\n", argv[0]);
+    char *filename = NULL;
+    int analyze = 0, j, retval;
+
+    analysis.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    analysis.top = RDB_ANALYZE_DEFAULT_TOP;
+    analysis.separator = ':';
+    for (j = 1; j < argc; j++) {
+        int lastarg = j == argc-1;
+
+        if (!strcmp(argv[j],"--analyze")) {
+            analyze = 1;
+        } else if (!strcmp(argv[j],"--workers") && !lastarg) {
+            analysis.workers = atoi(argv[++j]);
+        } else if (!strcmp(argv[j],"--top") && !lastarg) {
+            analysis.top = atoi(argv[++j]);
+        } else if (!strcmp(argv[j],"--separator") && !lastarg) {
+            analysis.separator = argv[++j][0];
+        } else if (!strcmp(argv[j],"--csv") && !lastarg) {
+            analysis.csvfile = argv[++j];
+        } else if (filename == NULL && argv[j][0] != '-') {
+            filename = argv[j];
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (filename == NULL) {
+        fprintf(stderr, "Usage: %s [--analyze [--workers <n>] [--top <n>] "
+                        "[--separator <char>] [--csv <file>]] "
+                        "<rdb-file-name>\n", argv[0]);
         exit(1);
     }
+    if (analysis.workers < 1) analysis.workers = 1;
+    if (analysis.workers > RDB_ANALYZE_MAX_WORKERS)
+        analysis.workers = RDB_ANALYZE_MAX_WORKERS;
+    if (analysis.top < 1) analysis.top = 1;
+
     createSharedObjects(); /* Needed for loading. */
     server.loading_process_events_interval_bytes = 0;
     rdbCheckMode = 1;
-    rdbCheckInfo("Checking RDB file %s", argv[1]);
     rdbCheckSetupSignals();
-    int retval = redis_check_rdb(argv[1]);
+    rdbstate.key_type = -1;
+    if (analyze) {
+        rdbCheckInfo("Analyzing RDB file %s", filename);
+        exit(redis_analyze_rdb(filename));
+    }
+    rdbCheckInfo("Checking RDB file %s", filename);
+    retval = redis_check_rdb(filename);
     if (retval == 0) {
         rdbCheckInfo("\\o/ RDB looks OK! \\o/");
         rdbShowGenericInfo();
@@ -65,6 +65,7 @@
 #define REDIS_CLI_HISTFILE_DEFAULT ".rediscli_history"
 #define REDIS_CLI_RCFILE_ENV "REDISCLI_RCFILE"
 #define REDIS_CLI_RCFILE_DEFAULT ".redisclirc"
+#define REDIS_CLI_BIGKEYS_MAX_WORKERS 64 /* --bigkeys-workers max value. */
 
 /* --latency-dist palettes. */
 int spectrum_palette_color_size = 19;
@@ -107,6 +108,11 @@ static struct config {
     char *pattern;
     char *rdb_filename;
     int bigkeys;
+    int memkeys;
+    int memkeys_samples;
+    int bigkeys_workers;
+    int bigkeys_top;
+    int hotkeys;
     int stdinarg; /* get last arg from stdin. (-x option) */
     char *auth;
     int output; /* output mode, see OUTPUT_* defines */
@@ -1045,6 +1051,25 @@ static int parseOptions(int argc, char **argv) {
             config.pipe_timeout = atoi(argv[++i]);
         } else if (!strcmp(argv[i],"--bigkeys")) {
             config.bigkeys = 1;
+        } else if (!strcmp(argv[i],"--memkeys")) {
+            config.bigkeys = 1;
+            config.memkeys = 1;
+        } else if (!strcmp(argv[i],"--memkeys-samples") && !lastarg) {
+            config.memkeys_samples = atoi(argv[++i]);
+        } else if (!strcmp(argv[i],"--bigkeys-workers") && !lastarg) {
+            config.bigkeys_workers = atoi(argv[++i]);
+            if (config.bigkeys_workers < 1 ||
+                config.bigkeys_workers > REDIS_CLI_BIGKEYS_MAX_WORKERS)
+            {
+                fprintf(stderr,"--bigkeys-workers must be between 1 and %d\n",
+                    REDIS_CLI_BIGKEYS_MAX_WORKERS);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i],"--top") && !lastarg) {
+            config.bigkeys_top = atoi(argv[++i]);
+            if (config.bigkeys_top < 1) config.bigkeys_top = 1;
+        } else if (!strcmp(argv[i],"--hotkeys")) {
+            config.hotkeys = 1;
         } else if (!strcmp(argv[i],"--eval") && !lastarg) {
             config.eval = argv[++i];
         } else if (!strcmp(argv[i],"--ldb")) {
@@ -1138,6 +1163,15 @@ static void usage(void) {
 "                     no reply is received within <n> seconds.\n"
 "                     Default timeout: %d. Use 0 to wait forever.\n"
 "  --bigkeys          Sample Redis keys looking for big keys.\n"
+"  --memkeys          Like --bigkeys but sizing keys in bytes with MEMORY USAGE.\n"
+"  --memkeys-samples <n> Elements sampled by MEMORY USAGE for aggregate keys\n"
+"                     (0 means all of them). Default: the server default.\n"
+"  --bigkeys-workers <n> Connections scanning every node at the same time in\n"
+"                     --bigkeys and --memkeys modes (default: 4). With -c all\n"
+"                     the masters of the cluster are scanned.\n"
+"  --top <n>          Biggest keys to report per type (default: 5).\n"
+"  --hotkeys          Show the most accessed keys, as tracked by the server.\n"
+"                     Use -i to refresh the list every <interval> seconds.\n"
 "  --scan             List all keys using the SCAN command.\n"
 "  --pattern <pat>    Useful with --scan to specify a SCAN pattern.\n"
 "  --intrinsic-latency <sec> Run a test to measure intrinsic system latency.\n"
@@ -1949,39 +1983,111 @@ static void pipeMode(void) {
 #define TYPE_ZSET   4
 #define TYPE_NONE   5
 
-static redisReply *sendScan(unsigned long long *it) {
-    redisReply *reply = redisCommand(context, "SCAN %llu", *it);
+#define BIGKEYS_SCAN_COUNT 100     /* COUNT option of SCAN. */
+#define BIGKEYS_MIN_SLICE_KEYS 1024 /* Min keys per worker. */
+#define BIGKEYS_HIST_BUCKETS 64    /* Power of two size buckets. */
+
+/* The keyspace of every node is scanned by config.bigkeys_workers
+ * connections at the same time, every one iterating a different slice of
+ * the SCAN cursor space. The cursor is the index of the hash table bucket
+ * with reversed bits, so its low bits don't change while the iteration is
+ * inside a given slice: worker 'k' out of 'n' (a power of two) starts at the
+ * cursor having the reversed bits of 'k' as low bits, and stops as soon as
+ * the low bits change.
+ *
+ * A single SCAN call visits buckets until COUNT keys are found, so the last
+ * call of a worker may cross into the next slice, returning some of the keys
+ * that the next worker returns in its first call (which visits at least the
+ * same buckets, since it collected COUNT keys starting from the start of the
+ * slice). The keys of the first reply of every worker are remembered, and
+ * skipped if they are found again in the last reply of another worker.
+ *
+ * Commands are sent to all the workers before reading any reply, so that
+ * the round trip latency is paid once per batch for all the workers, and
+ * in cluster mode all the masters are scanned at the same time. */
+typedef struct scanWorker {
+    redisContext *ctx;
+    sds node;                   /* Node address, for error messages. */
+    unsigned long long cursor;  /* Next SCAN cursor. */
+    unsigned long long mask;    /* Low cursor bits selecting the slice. */
+    unsigned long long slice;   /* Value of the low bits for this worker. */
+    int done;                   /* True when the slice was fully scanned. */
+    redisReply *scan;           /* Last SCAN reply, or NULL. */
+    int *types;
+    unsigned long long *sizes;
+    size_t arrsize;
+} scanWorker;
+
+/* Statistics about the keys of a given type. The biggest config.bigkeys_top
+ * keys are kept sorted, biggest first. */
+typedef struct typeStats {
+    unsigned long long count;
+    unsigned long long total;
+    unsigned long long hist[BIGKEYS_HIST_BUCKETS];
+    sds *topkeys;
+    unsigned long long *topsizes;
+} typeStats;
+
+typedef struct boundaryKey {
+    sds key;
+    int worker;                 /* Worker that returned it first. */
+} boundaryKey;
+
+static scanWorker *scanWorkers = NULL;
+static int numScanWorkers = 0;
+static int numScanNodes = 0;
+static boundaryKey *boundaryKeys = NULL;
+static size_t numBoundaryKeys = 0;
+
+/* Connect to the specified node (or to config.hostsocket if 'ip' is NULL),
+ * authenticating and selecting the right DB like cliConnect() does. */
+static redisContext *bigkeysConnect(char *ip, int port) {
+    redisContext *ctx;
+    redisReply *reply;
 
-    /* Handle any error conditions */
-    if(reply == NULL) {
-        fprintf(stderr, "\nI/O error\n");
-        exit(1);
-    } else if(reply->type == REDIS_REPLY_ERROR) {
-        fprintf(stderr, "SCAN error: %s\n", reply->str);
-        exit(1);
-    } else if(reply->type != REDIS_REPLY_ARRAY) {
-        fprintf(stderr, "Non ARRAY response from SCAN!\n");
-        exit(1);
-    } else if(reply->elements != 2) {
-        fprintf(stderr, "Invalid element count from SCAN!\n");
+    if (ip == NULL)
+        ctx = redisConnectUnix(config.hostsocket);
+    else
+        ctx = redisConnect(ip,port);
+    if (ctx->err) {
+        fprintf(stderr,"Could not connect to Redis at %s:%d: %s\n",
+            ip ? ip : config.hostsocket, port, ctx->errstr);
         exit(1);
     }
+    anetKeepAlive(NULL, ctx->fd, REDIS_CLI_KEEPALIVE_INTERVAL);
 
-    /* Validate our types are correct */
-    assert(reply->element[0]->type == REDIS_REPLY_STRING);
-    assert(reply->element[1]->type == REDIS_REPLY_ARRAY);
+    if (config.auth) {
+        reply = redisCommand(ctx,"AUTH %s",config.auth);
+        if (reply) freeReplyObject(reply);
+    }
+    if (config.dbnum) {
+        reply = redisCommand(ctx,"SELECT %d",config.dbnum);
+        if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr,"Can't select DB %d\n", config.dbnum);
+            exit(1);
+        }
+        freeReplyObject(reply);
+    }
+    return ctx;
+}
 
-    /* Update iterator */
-    *it = strtoull(reply->element[0]->str, NULL, 10);
+/* Read the next reply of the worker, exiting on I/O errors. */
+static redisReply *workerGetReply(scanWorker *w) {
+    redisReply *reply;
 
+    if (redisGetReply(w->ctx,(void**)&reply) != REDIS_OK) {
+        fprintf(stderr, "\nI/O error from %s (%d: %s)\n",
+            w->node, w->ctx->err, w->ctx->errstr);
+        exit(1);
+    }
     return reply;
 }
 
-static int getDbSize(void) {
+static long long getDbSize(redisContext *ctx) {
     redisReply *reply;
-    int size;
+    long long size;
 
-    reply = redisCommand(context, "DBSIZE");
+    reply = redisCommand(ctx, "DBSIZE");
 
     if(reply == NULL || reply->type != REDIS_REPLY_INTEGER) {
         fprintf(stderr, "Couldn't determine DBSIZE!\n");
@@ -1995,6 +2101,143 @@ static int getDbSize(void) {
     return size;
 }
 
+/* Reverse the 'bits' low bits of 'v'. */
+static unsigned long long reverseBits(unsigned long long v, int bits) {
+    unsigned long long r = 0;
+    int j;
+
+    for (j = 0; j < bits; j++) {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
+
+/* Create the workers scanning the specified node, returning the number of
+ * keys in the node. Small keyspaces are scanned by less workers: the slices
+ * only work as expected when the hash table has at least as many buckets as
+ * the workers. */
+static long long bigkeysAddNode(char *ip, int port) {
+    redisContext *ctx = bigkeysConnect(ip,port);
+    long long dbsize = getDbSize(ctx);
+    int n = 1, bits = 0, k;
+
+    numScanNodes++;
+    while (n*2 <= config.bigkeys_workers &&
+           dbsize >= (long long)n*2*BIGKEYS_MIN_SLICE_KEYS)
+    {
+        n *= 2;
+        bits++;
+    }
+
+    scanWorkers = zrealloc(scanWorkers,
+                           sizeof(scanWorker)*(numScanWorkers+n));
+    for (k = 0; k < n; k++) {
+        scanWorker *w = &scanWorkers[numScanWorkers++];
+
+        memset(w,0,sizeof(*w));
+        w->ctx = k == 0 ? ctx : bigkeysConnect(ip,port);
+        w->node = ip ? sdscatprintf(sdsempty(),"%s:%d",ip,port) :
+                       sdsnew(config.hostsocket);
+        w->mask = n-1;
+        w->slice = reverseBits(k,bits);
+        w->cursor = w->slice;
+    }
+    return dbsize;
+}
+
+/* In cluster mode scan all the masters, otherwise just the node we are
+ * connected to. Returns the total number of keys. */
+static long long bigkeysAddNodes(void) {
+    redisReply *reply;
+    long long keys = 0;
+    sds *lines;
+    int count, j;
+
+    if (!config.cluster_mode || config.hostsocket)
+        return bigkeysAddNode(config.hostsocket ? NULL : config.hostip,
+                              config.hostport);
+
+    reply = redisCommand(context,"CLUSTER NODES");
+    if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+        if (reply) freeReplyObject(reply);
+        return bigkeysAddNode(config.hostip,config.hostport);
+    }
+
+    lines = sdssplitlen(reply->str,reply->len,"\n",1,&count);
+    for (j = 0; j < count; j++) {
+        sds *argv, addr;
+        int argc;
+        char *p;
+
+        argv = sdssplitlen(lines[j],sdslen(lines[j])," ",1,&argc);
+        if (argc >= 3 && strstr(argv[2],"master") &&
+            !strstr(argv[2],"fail") && !strstr(argv[2],"noaddr"))
+        {
+            addr = argv[1];
+            if ((p = strchr(addr,'@')) != NULL) *p = '\0';
+            if ((p = strrchr(addr,':')) != NULL) {
+                *p = '\0';
+                keys += bigkeysAddNode(addr[0] ? addr : config.hostip,
+                                       atoi(p+1));
+            }
+        }
+        sdsfreesplitres(argv,argc);
+    }
+    sdsfreesplitres(lines,count);
+    freeReplyObject(reply);
+    return keys;
+}
+
+/* Send the next SCAN to every active worker, then read the replies. */
+static void sendScan(void) {
+    scanWorker *w;
+    redisReply *reply;
+    int j;
+
+    for (j = 0; j < numScanWorkers; j++) {
+        w = &scanWorkers[j];
+        if (w->done) continue;
+        redisAppendCommand(w->ctx,"SCAN %llu COUNT %d",
+            w->cursor, BIGKEYS_SCAN_COUNT);
+    }
+
+    for (j = 0; j < numScanWorkers; j++) {
+        w = &scanWorkers[j];
+        if (w->done) continue;
+        reply = workerGetReply(w);
+
+        /* Handle any error conditions */
+        if(reply->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr, "SCAN error: %s\n", reply->str);
+            exit(1);
+        } else if(reply->type != REDIS_REPLY_ARRAY) {
+            fprintf(stderr, "Non ARRAY response from SCAN!\n");
+            exit(1);
+        } else if(reply->elements != 2) {
+            fprintf(stderr, "Invalid element count from SCAN!\n");
+            exit(1);
+        }
+
+        /* Validate our types are correct */
+        assert(reply->element[0]->type == REDIS_REPLY_STRING);
+        assert(reply->element[1]->type == REDIS_REPLY_ARRAY);
+
+        /* Update iterator, stopping at the end of our slice. */
+        w->cursor = strtoull(reply->element[0]->str, NULL, 10);
+        if (w->cursor == 0 || (w->cursor & w->mask) != w->slice) w->done = 1;
+        w->scan = reply;
+
+        /* Reallocate our type and size array if we need to */
+        if (reply->element[1]->elements > w->arrsize) {
+            w->arrsize = reply->element[1]->elements;
+            w->types = zrealloc(w->types, sizeof(int)*w->arrsize);
+            w->sizes = zrealloc(w->sizes,
+                                sizeof(unsigned long long)*w->arrsize);
+        }
+    }
+}
+
 static int toIntType(char *key, char *type) {
     if(!strcmp(type, "string")) {
         return TYPE_STRING;
@@ -2014,179 +2257,302 @@ static int toIntType(char *key, char *type) {
     }
 }
 
-static void getKeyTypes(redisReply *keys, int *types) {
-    redisReply *reply;
+static void getKeyTypes(void) {
+    redisReply *reply, *keys;
     unsigned int i;
+    int j;
 
     /* Pipeline TYPE commands */
-    for(i=0;i<keys->elements;i++) {
-        redisAppendCommand(context, "TYPE %s", keys->element[i]->str);
+    for (j = 0; j < numScanWorkers; j++) {
+        if (!scanWorkers[j].scan) continue;
+        keys = scanWorkers[j].scan->element[1];
+        for(i=0;i<keys->elements;i++) {
+            redisAppendCommand(scanWorkers[j].ctx, "TYPE %b",
+                keys->element[i]->str, keys->element[i]->len);
+        }
     }
 
     /* Retrieve types */
-    for(i=0;i<keys->elements;i++) {
-        if(redisGetReply(context, (void**)&reply)!=REDIS_OK) {
-            fprintf(stderr, "Error getting type for key '%s' (%d: %s)\n",
-                keys->element[i]->str, context->err, context->errstr);
-            exit(1);
-        } else if(reply->type != REDIS_REPLY_STATUS) {
-            if(reply->type == REDIS_REPLY_ERROR) {
-                fprintf(stderr, "TYPE returned an error: %s\n", reply->str);
-            } else {
-                fprintf(stderr,
-                    "Invalid reply type (%d) for TYPE on key '%s'!\n",
-                    reply->type, keys->element[i]->str);
+    for (j = 0; j < numScanWorkers; j++) {
+        scanWorker *w = &scanWorkers[j];
+
+        if (!w->scan) continue;
+        keys = w->scan->element[1];
+        for(i=0;i<keys->elements;i++) {
+            reply = workerGetReply(w);
+            if(reply->type != REDIS_REPLY_STATUS) {
+                if(reply->type == REDIS_REPLY_ERROR) {
+                    fprintf(stderr, "TYPE returned an error: %s\n",
+                        reply->str);
+                } else {
+                    fprintf(stderr,
+                        "Invalid reply type (%d) for TYPE on key '%s'!\n",
+                        reply->type, keys->element[i]->str);
+                }
+                exit(1);
             }
-            exit(1);
-        }
 
-        types[i] = toIntType(keys->element[i]->str, reply->str);
-        freeReplyObject(reply);
+            w->types[i] = toIntType(keys->element[i]->str, reply->str);
+            freeReplyObject(reply);
+        }
     }
 }
 
-static void getKeySizes(redisReply *keys, int *types,
-                        unsigned long long *sizes)
-{
-    redisReply *reply;
+/* Get the size of the keys: the number of elements, or with --memkeys the
+ * number of bytes reported by MEMORY USAGE. */
+static void getKeySizes(void) {
+    redisReply *reply, *keys;
     char *sizecmds[] = {"STRLEN","LLEN","SCARD","HLEN","ZCARD"};
     unsigned int i;
+    int j;
 
     /* Pipeline size commands */
-    for(i=0;i<keys->elements;i++) {
-        /* Skip keys that were deleted */
-        if(types[i]==TYPE_NONE)
-            continue;
+    for (j = 0; j < numScanWorkers; j++) {
+        scanWorker *w = &scanWorkers[j];
 
-        redisAppendCommand(context, "%s %s", sizecmds[types[i]],
-            keys->element[i]->str);
+        if (!w->scan) continue;
+        keys = w->scan->element[1];
+        for(i=0;i<keys->elements;i++) {
+            char *key = keys->element[i]->str;
+            size_t len = keys->element[i]->len;
+
+            /* Skip keys that were deleted */
+            if(w->types[i]==TYPE_NONE)
+                continue;
+
+            if (!config.memkeys)
+                redisAppendCommand(w->ctx, "%s %b", sizecmds[w->types[i]],
+                    key, len);
+            else if (config.memkeys_samples < 0)
+                redisAppendCommand(w->ctx, "MEMORY USAGE %b", key, len);
+            else
+                redisAppendCommand(w->ctx, "MEMORY USAGE %b SAMPLES %d",
+                    key, len, config.memkeys_samples);
+        }
     }
 
     /* Retreive sizes */
-    for(i=0;i<keys->elements;i++) {
-        /* Skip keys that dissapeared between SCAN and TYPE */
-        if(types[i] == TYPE_NONE) {
-            sizes[i] = 0;
-            continue;
+    for (j = 0; j < numScanWorkers; j++) {
+        scanWorker *w = &scanWorkers[j];
+
+        if (!w->scan) continue;
+        keys = w->scan->element[1];
+        for(i=0;i<keys->elements;i++) {
+            /* Skip keys that dissapeared between SCAN and TYPE */
+            if(w->types[i] == TYPE_NONE) {
+                w->sizes[i] = 0;
+                continue;
+            }
+
+            /* Retreive size */
+            reply = workerGetReply(w);
+            if (reply->type == REDIS_REPLY_NIL) {
+                /* Deleted between TYPE and MEMORY USAGE. */
+                w->types[i] = TYPE_NONE;
+                w->sizes[i] = 0;
+            } else if (reply->type == REDIS_REPLY_ERROR && config.memkeys) {
+                fprintf(stderr, "MEMORY USAGE error: %s\n", reply->str);
+                exit(1);
+            } else if(reply->type != REDIS_REPLY_INTEGER) {
+                /* Theoretically the key could have been removed and
+                 * added as a different type between TYPE and SIZE */
+                fprintf(stderr,
+                    "Warning:  %s on '%s' failed (may have changed type)\n",
+                     sizecmds[w->types[i]], keys->element[i]->str);
+                w->sizes[i] = 0;
+            } else {
+                w->sizes[i] = reply->integer;
+            }
+
+            freeReplyObject(reply);
         }
+    }
+}
 
-        /* Retreive size */
-        if(redisGetReply(context, (void**)&reply)!=REDIS_OK) {
-            fprintf(stderr, "Error getting size for key '%s' (%d: %s)\n",
-                keys->element[i]->str, context->err, context->errstr);
-            exit(1);
-        } else if(reply->type != REDIS_REPLY_INTEGER) {
-            /* Theoretically the key could have been removed and
-             * added as a different type between TYPE and SIZE */
-            fprintf(stderr,
-                "Warning:  %s on '%s' failed (may have changed type)\n",
-                 sizecmds[types[i]], keys->element[i]->str);
-            sizes[i] = 0;
-        } else {
-            sizes[i] = reply->integer;
+static int boundaryKeyCompare(const void *a, const void *b) {
+    return sdscmp(((boundaryKey*)a)->key,((boundaryKey*)b)->key);
+}
+
+/* Remember the keys of the first reply of every worker, see the comment
+ * at the top of this section. */
+static void rememberBoundaryKeys(void) {
+    int j;
+    unsigned int i;
+
+    for (j = 0; j < numScanWorkers; j++) {
+        redisReply *keys;
+
+        if (!scanWorkers[j].scan || scanWorkers[j].mask == 0) continue;
+        keys = scanWorkers[j].scan->element[1];
+        boundaryKeys = zrealloc(boundaryKeys,
+            sizeof(boundaryKey)*(numBoundaryKeys+keys->elements));
+        for (i = 0; i < keys->elements; i++) {
+            boundaryKey *bk = &boundaryKeys[numBoundaryKeys++];
+
+            bk->key = sdsnewlen(keys->element[i]->str,keys->element[i]->len);
+            bk->worker = j;
         }
+    }
+    qsort(boundaryKeys,numBoundaryKeys,sizeof(boundaryKey),
+          boundaryKeyCompare);
+}
 
-        freeReplyObject(reply);
+/* Return true if the key, found in the last reply of the specified
+ * worker, was already returned by the first reply of another worker. */
+static int isBoundaryDuplicate(char *key, size_t len, int worker) {
+    boundaryKey k, *found;
+
+    if (numBoundaryKeys == 0) return 0;
+    k.key = sdsnewlen(key,len);
+    found = bsearch(&k,boundaryKeys,numBoundaryKeys,sizeof(boundaryKey),
+                    boundaryKeyCompare);
+    sdsfree(k.key);
+    return found && found->worker != worker;
+}
+
+/* Account a key in the statistics of its type. Returns 1 if the key is the
+ * biggest found so far for its type. */
+static int typeStatsAddKey(typeStats *ts, char *key, size_t keylen,
+                           unsigned long long size)
+{
+    int top = config.bigkeys_top, bucket = 0, j;
+    unsigned long long s = size;
+
+    ts->count++;
+    ts->total += size;
+    while (s >>= 1) bucket++;
+    ts->hist[bucket]++;
+
+    /* Insert in the sorted top keys array if it's big enough. */
+    if (ts->topkeys[top-1] && size <= ts->topsizes[top-1]) return 0;
+    for (j = 0; j < top; j++)
+        if (ts->topkeys[j] == NULL || size > ts->topsizes[j]) break;
+    sdsfree(ts->topkeys[top-1]);
+    memmove(ts->topkeys+j+1,ts->topkeys+j,sizeof(sds)*(top-j-1));
+    memmove(ts->topsizes+j+1,ts->topsizes+j,
+            sizeof(unsigned long long)*(top-j-1));
+    ts->topkeys[j] = sdsnewlen(key,keylen);
+    ts->topsizes[j] = size;
+    return j == 0;
+}
+
+/* Print the distribution of the sizes of the keys of a given type, using
+ * power of two buckets. */
+static void typeStatsPrintHistogram(typeStats *ts, char *typename,
+                                    char *typeunit)
+{
+    unsigned long long max = 0;
+    int j, first = -1, last = -1;
+
+    for (j = 0; j < BIGKEYS_HIST_BUCKETS; j++) {
+        if (ts->hist[j] == 0) continue;
+        if (first == -1) first = j;
+        last = j;
+        if (ts->hist[j] > max) max = ts->hist[j];
+    }
+    if (first == -1) return;
+
+    printf("\n%s sizes distribution (%s):\n", typename, typeunit);
+    for (j = first; j <= last; j++) {
+        unsigned long long from = j ? 1ULL<<j : 0;
+        unsigned long long to = (j == 63) ? ULLONG_MAX : (2ULL<<j)-1;
+        int bar = (int)(40*ts->hist[j]/max);
+        char range[64];
+
+        snprintf(range,sizeof(range),"%llu-%llu",from,to);
+        printf("  %-26s %12llu (%6.2f%%) ", range, ts->hist[j],
+            100*(double)ts->hist[j]/ts->count);
+        while (bar--) putchar('#');
+        printf("\n");
     }
 }
 
 static void findBigKeys(void) {
-    unsigned long long biggest[5] = {0}, counts[5] = {0}, totalsize[5] = {0};
-    unsigned long long sampled = 0, total_keys, totlen=0, *sizes=NULL, it=0;
-    sds maxkeys[5] = {0};
+    typeStats stats[TYPE_NONE];
+    unsigned long long sampled = 0, total_keys, totlen=0, scans = 0;
     char *typename[] = {"string","list","set","hash","zset"};
     char *typeunit[] = {"bytes","items","members","fields","members"};
-    redisReply *reply, *keys;
-    unsigned int arrsize=0, i;
-    int type, *types=NULL;
+    unsigned int i;
+    int type, j, active, first = 1, top = config.bigkeys_top;
     double pct;
 
-    /* Total keys pre scanning */
-    total_keys = getDbSize();
+    /* New up the arrays to keep track of the biggest keys per type */
+    memset(stats,0,sizeof(stats));
+    for(i=0;i<TYPE_NONE; i++) {
+        stats[i].topkeys = zcalloc(sizeof(sds)*top);
+        stats[i].topsizes = zcalloc(sizeof(unsigned long long)*top);
+        if (config.memkeys) typeunit[i] = "bytes";
+    }
+
+    /* Connect the workers and grab the total keys pre scanning */
+    total_keys = bigkeysAddNodes();
 
     /* Status message */
     printf("\n# Scanning the entire keyspace to find biggest keys as well as\n");
     printf("# average sizes per key type.  You can use -i 0.1 to sleep 0.1 sec\n");
-    printf("# per 100 SCAN commands (not usually needed).\n\n");
-
-    /* New up sds strings to keep track of overall biggest per type */
-    for(i=0;i<TYPE_NONE; i++) {
-        maxkeys[i] = sdsempty();
-        if(!maxkeys[i]) {
-            fprintf(stderr, "Failed to allocate memory for largest key names!\n");
-            exit(1);
-        }
-    }
+    printf("# per 100 SCAN commands (not usually needed).\n");
+    printf("# Using %d connection(s) to %d node(s).\n\n", numScanWorkers,
+        numScanNodes);
 
     /* SCAN loop */
     do {
         /* Calculate approximate percentage completion */
-        pct = 100 * (double)sampled/total_keys;
+        pct = total_keys ? 100 * (double)sampled/total_keys : 0;
+        if (pct > 100) pct = 100;
 
-        /* Grab some keys and point to the keys array */
-        reply = sendScan(&it);
-        keys  = reply->element[1];
-
-        /* Reallocate our type and size array if we need to */
-        if(keys->elements > arrsize) {
-            types = zrealloc(types, sizeof(int)*keys->elements);
-            sizes = zrealloc(sizes, sizeof(unsigned long long)*keys->elements);
-
-            if(!types || !sizes) {
-                fprintf(stderr, "Failed to allocate storage for keys!\n");
-                exit(1);
-            }
-
-            arrsize = keys->elements;
-        }
-
-        /* Retreive types and then sizes */
-        getKeyTypes(keys, types);
-        getKeySizes(keys, types, sizes);
+        /* Grab some keys from every worker, then retreive types and
+         * then sizes */
+        sendScan();
+        getKeyTypes();
+        getKeySizes();
+        if (first) rememberBoundaryKeys();
+        first = 0;
 
         /* Now update our stats */
-        for(i=0;i<keys->elements;i++) {
-            if((type = types[i]) == TYPE_NONE)
-                continue;
+        active = 0;
+        for (j = 0; j < numScanWorkers; j++) {
+            scanWorker *w = &scanWorkers[j];
+            redisReply *keys;
+
+            if (!w->scan) continue;
+            keys = w->scan->element[1];
+            for(i=0;i<keys->elements;i++) {
+                if((type = w->types[i]) == TYPE_NONE)
+                    continue;
+                if (w->done && w->mask &&
+                    isBoundaryDuplicate(keys->element[i]->str,
+                                        keys->element[i]->len,j))
+                    continue;
 
-            totalsize[type] += sizes[i];
-            counts[type]++;
-            totlen += keys->element[i]->len;
-            sampled++;
-
-            if(biggest[type]<sizes[i]) {
-                printf(
-                   "[%05.2f%%] Biggest %-6s found so far '%s' with %llu %s\n",
-                   pct, typename[type], keys->element[i]->str, sizes[i],
-                   typeunit[type]);
-
-                /* Keep track of biggest key name for this type */
-                maxkeys[type] = sdscpy(maxkeys[type], keys->element[i]->str);
-                if(!maxkeys[type]) {
-                    fprintf(stderr, "Failed to allocate memory for key!\n");
-                    exit(1);
-                }
+                totlen += keys->element[i]->len;
+                sampled++;
 
-                /* Keep track of the biggest size for this type */
-                biggest[type] = sizes[i];
-            }
+                if (typeStatsAddKey(&stats[type],keys->element[i]->str,
+                                    keys->element[i]->len,w->sizes[i]))
+                {
+                    printf(
+                       "[%05.2f%%] Biggest %-6s found so far '%s' with %llu %s\n",
+                       pct, typename[type], keys->element[i]->str,
+                       w->sizes[i], typeunit[type]);
+                }
 
-            /* Update overall progress */
-            if(sampled % 1000000 == 0) {
-                printf("[%05.2f%%] Sampled %llu keys so far\n", pct, sampled);
+                /* Update overall progress */
+                if(sampled % 1000000 == 0) {
+                    printf("[%05.2f%%] Sampled %llu keys so far\n", pct, sampled);
+                }
             }
+            freeReplyObject(w->scan);
+            w->scan = NULL;
+            if (!w->done) active++;
+            scans++;
         }
 
         /* Sleep if we've been directed to do so */
-        if(sampled && (sampled %100) == 0 && config.interval) {
+        if(scans >= 100 && config.interval) {
             usleep(config.interval);
+            scans = 0;
         }
-
-        freeReplyObject(reply);
-    } while(it != 0);
-
-    if(types) zfree(types);
-    if(sizes) zfree(sizes);
+    } while(active);
 
     /* We're done */
     printf("\n-------- summary -------\n\n");
@@ -2197,9 +2563,9 @@ static void findBigKeys(void) {
 
     /* Output the biggest keys we found, for types we did find */
     for(i=0;i<TYPE_NONE;i++) {
-        if(sdslen(maxkeys[i])>0) {
-            printf("Biggest %6s found '%s' has %llu %s\n", typename[i], maxkeys[i],
-               biggest[i], typeunit[i]);
+        if(stats[i].topkeys[0]) {
+            printf("Biggest %6s found '%s' has %llu %s\n", typename[i],
+               stats[i].topkeys[0], stats[i].topsizes[0], typeunit[i]);
         }
     }
 
@@ -2207,14 +2573,87 @@ static void findBigKeys(void) {
 
     for(i=0;i<TYPE_NONE;i++) {
         printf("%llu %ss with %llu %s (%05.2f%% of keys, avg size %.2f)\n",
-           counts[i], typename[i], totalsize[i], typeunit[i],
-           sampled ? 100 * (double)counts[i]/sampled : 0,
-           counts[i] ? (double)totalsize[i]/counts[i] : 0);
+           stats[i].count, typename[i], stats[i].total, typeunit[i],
+           sampled ? 100 * (double)stats[i].count/sampled : 0,
+           stats[i].count ? (double)stats[i].total/stats[i].count : 0);
     }
 
-    /* Free sds strings containing max keys */
+    /* Top keys and distributions per type */
+    if (top > 1) {
+        printf("\n-------- top keys -------\n");
+        for(i=0;i<TYPE_NONE;i++) {
+            if (!stats[i].topkeys[0]) continue;
+            printf("\nBiggest %d %ss:\n", top, typename[i]);
+            for (j = 0; j < top && stats[i].topkeys[j]; j++)
+                printf("  %3d) '%s' %llu %s\n", j+1, stats[i].topkeys[j],
+                    stats[i].topsizes[j], typeunit[i]);
+        }
+    }
+
+    printf("\n-------- distribution -------\n");
+    for(i=0;i<TYPE_NONE;i++)
+        typeStatsPrintHistogram(&stats[i],typename[i],typeunit[i]);
+
+    /* Free the workers and the top keys */
+    for (j = 0; j < numScanWorkers; j++) {
+        redisFree(scanWorkers[j].ctx);
+        sdsfree(scanWorkers[j].node);
+        zfree(scanWorkers[j].types);
+        zfree(scanWorkers[j].sizes);
+    }
+    zfree(scanWorkers);
+    for (i = 0; i < numBoundaryKeys; i++) sdsfree(boundaryKeys[i].key);
+    zfree(boundaryKeys);
     for(i=0;i<TYPE_NONE;i++) {
-        sdsfree(maxkeys[i]);
+        for (j = 0; j < top; j++) sdsfree(stats[i].topkeys[j]);
+        zfree(stats[i].topkeys);
+        zfree(stats[i].topsizes);
+    }
+
+    /* Success! */
+    exit(0);
+}
+
+/*------------------------------------------------------------------------------
+ * Find hot keys
+ *--------------------------------------------------------------------------- */
+
+/* Print the most accessed keys using the HOTKEYS command, that reports the
+ * keys counted by the server in every lookup: unlike MONITOR this does not
+ * slow down the server. When -i is given the list is printed again every
+ * <interval> seconds. */
+static void findHotKeys(void) {
+    redisReply *reply;
+    unsigned int j;
+
+    while(1) {
+        reply = reconnectingRedisCommand(context,"HOTKEYS COUNT 64");
+        if (reply->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr,"HOTKEYS error: %s\n", reply->str);
+            exit(1);
+        }
+
+        printf("\n# Most accessed keys, with an estimation of the recent number\n");
+        printf("# of accesses. Keys are tracked only if hotkeys-tracking is\n");
+        printf("# enabled in the server.\n\n");
+        printf("%-5s %-4s %-6s %-12s %s\n","rank","db","slot","accesses","key");
+        for (j = 0; j < reply->elements; j++) {
+            redisReply *e = reply->element[j];
+            sds key;
+
+            if (e->type != REDIS_REPLY_ARRAY || e->elements != 4) continue;
+            key = sdscatrepr(sdsempty(),e->element[0]->str,
+                             e->element[0]->len);
+            printf("%-5u %-4lld %-6lld %-12lld %s\n", j+1,
+                e->element[1]->integer, e->element[2]->integer,
+                e->element[3]->integer, key);
+            sdsfree(key);
+        }
+        if (reply->elements == 0) printf("(no keys accessed recently)\n");
+        freeReplyObject(reply);
+
+        if (config.interval == 0) break;
+        usleep(config.interval);
     }
 
     /* Success! */
@@ -2595,6 +3034,11 @@ int main(int argc, char **argv) {
     config.pipe_mode = 0;
     config.pipe_timeout = REDIS_CLI_DEFAULT_PIPE_TIMEOUT;
     config.bigkeys = 0;
+    config.memkeys = 0;
+    config.memkeys_samples = -1;
+    config.bigkeys_workers = 4;
+    config.bigkeys_top = 5;
+    config.hotkeys = 0;
     config.stdinarg = 0;
     config.auth = NULL;
     config.eval = NULL;
@@ -2655,6 +3099,12 @@ int main(int argc, char **argv) {
         findBigKeys();
     }
 
+    /* Find hot keys */
+    if (config.hotkeys) {
+        if (cliConnect(0) == REDIS_ERR) exit(1);
+        findHotKeys();
+    }
+
     /* Stat mode */
     if (config.stat_mode) {
         if (cliConnect(0) == REDIS_ERR) exit(1);
@@ -456,65 +456,60 @@ sds sdscpy(sds s, const char *t) {
  * representation stored at 's'. */
 // 超长整型转成字符串存储，并返回字符串长度。ll=10000 => "10000\0"，-3123 => "-3123\0"
 #define SDS_LLSTR_SIZE 21  // ll to str，21个字节=ll无符号型最长19位 + 负号1位 + 结束符1位
+/* Two digits lookup table: converting two digits at a time halves the
+ * number of divisions, and writing the digits backward from the end of a
+ * scratch buffer avoids reversing the string afterwards. */
+static const char sds_digits[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Write the digits of 'v' backward, ending just before 'p', and return a
+ * pointer to the first digit. */
+static char *sdsWriteDigitsBackward(char *p, unsigned long long v) {
+    while (v >= 100) {
+        int const i = (v % 100) * 2;
+        v /= 100;
+        *--p = sds_digits[i+1];
+        *--p = sds_digits[i];
+    }
+    if (v < 10) {
+        *--p = '0' + (char)v;
+    } else {
+        int const i = (int)v * 2;
+        *--p = sds_digits[i+1];
+        *--p = sds_digits[i];
+    }
+    return p;
+}
+
 int sdsll2str(char *s, long long value) {
-    char *p, aux;  //
+    char buf[SDS_LLSTR_SIZE], *end = buf+sizeof(buf), *p;
     unsigned long long v;
     size_t l;
 
-    /* 生成翻转的字符串表达式，比如1234 => "4321\0"
-     * Generate the string representation, this method produces
-     * an reversed string.
-     **/
-    v = (value < 0) ? -value : value;
-    p = s;  // 注1：此时s和p等于同一个地址
-    do {
-        *p++ = '0'+(v%10);  // 转成ascii计算后再转成字符赋值给*p，然后指针向后移动1个
-        v /= 10;
-    } while(v);
-    if (value < 0) *p++ = '-';  // 如果是负数，追加负号
-
-    /* 在加入结束符前计算长度 Compute length and add null term. */
-    l = p-s;  // 注2：此时p=最后一个翻转后的字符地址，s=开始地址，所以长度=p-s
-    *p = '\0';
-
-    /* 翻转字符串，p--跳过结束符 Reverse the string. */
-    p--;
-    while(s < p) {
-        aux = *s;
-        *s = *p;
-        *p = aux;
-        s++;
-        p--;  // 注3：最后p=开始地址
-    }
+    /* Negate as unsigned so that LLONG_MIN does not overflow. */
+    v = (value < 0) ? 0ULL-(unsigned long long)value :
+                      (unsigned long long)value;
+    p = sdsWriteDigitsBackward(end,v);
+    if (value < 0) *--p = '-';
+    l = end-p;
+    memcpy(s,p,l);
+    s[l] = '\0';
     return l;
 }
 
 /* Identical sdsll2str(), but for unsigned long long type. */
 int sdsull2str(char *s, unsigned long long v) {
-    char *p, aux;
+    char buf[SDS_LLSTR_SIZE], *end = buf+sizeof(buf), *p;
     size_t l;
 
-    /* Generate the string representation, this method produces
-     * an reversed string. */
-    p = s;
-    do {
-        *p++ = '0'+(v%10);
-        v /= 10;
-    } while(v);
-
-    /* Compute length and add null term. */
-    l = p-s;
-    *p = '\0';
-
-    /* Reverse the string. */
-    p--;
-    while(s < p) {
-        aux = *s;
-        *s = *p;
-        *p = aux;
-        s++;
-        p--;
-    }
+    p = sdsWriteDigitsBackward(end,v);
+    l = end-p;
+    memcpy(s,p,l);
+    s[l] = '\0';
     return l;
 }
 
@@ -398,7 +398,8 @@ dictType instancesDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    dictInstancesValDestructor /* val destructor */
+    dictInstancesValDestructor, /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* Instance runid (sds) -> votes (long casted to void*)
@@ -411,7 +412,8 @@ dictType leaderVotesDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow to expand */
 };
 
 /* =========================== Initialization =============================== */
@@ -2973,7 +2975,7 @@ void sentinelCommand(client *c) {
         if (c->argc != 3) goto numargserr;
         ri = sentinelGetMasterByName(c->argv[2]->ptr);
         if (ri == NULL) {
-            addReply(c,shared.nullmultibulk);
+            addReply(c,shared.nullarray[c->resp]);
         } else {
             sentinelAddr *addr = sentinelGetCurrentMasterAddress(ri);
 
@@ -3141,7 +3143,7 @@ void sentinelCommand(client *c) {
             if (ri->info)
                 addReplyBulkCBuffer(c,ri->info,sdslen(ri->info));
             else
-                addReply(c,shared.nullbulk);
+                addReply(c,shared.null[c->resp]);
 
             dictIterator *sdi;
             dictEntry *sde;
@@ -3153,7 +3155,7 @@ void sentinelCommand(client *c) {
                 if (sri->info)
                     addReplyBulkCBuffer(c,sri->info,sdslen(sri->info));
                 else
-                    addReply(c,shared.nullbulk);
+                    addReply(c,shared.null[c->resp]);
             }
             dictReleaseIterator(sdi);
         }
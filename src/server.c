@@ -148,8 +148,9 @@ struct redisCommand redisCommandTable[] = {
     {"rpushx",rpushxCommand,3,"wmF",0,NULL,1,1,1,0,0},
     {"lpushx",lpushxCommand,3,"wmF",0,NULL,1,1,1,0,0},
     {"linsert",linsertCommand,5,"wm",0,NULL,1,1,1,0,0},
-    {"rpop",rpopCommand,2,"wF",0,NULL,1,1,1,0,0},
-    {"lpop",lpopCommand,2,"wF",0,NULL,1,1,1,0,0},
+    {"rpop",rpopCommand,-2,"wF",0,NULL,1,1,1,0,0},
+    {"lpop",lpopCommand,-2,"wF",0,NULL,1,1,1,0,0},
+    {"lmpop",lmpopCommand,-4,"w",0,lmpopGetKeys,0,0,0,0,0},
     {"brpop",brpopCommand,-3,"ws",0,NULL,1,-2,1,0,0},
     {"brpoplpush",brpoplpushCommand,4,"wms",0,NULL,1,2,1,0,0},
     {"blpop",blpopCommand,-3,"ws",0,NULL,1,-2,1,0,0},
@@ -157,6 +158,7 @@ struct redisCommand redisCommandTable[] = {
     {"lindex",lindexCommand,3,"r",0,NULL,1,1,1,0,0},
     {"lset",lsetCommand,4,"wm",0,NULL,1,1,1,0,0},
     {"lrange",lrangeCommand,4,"r",0,NULL,1,1,1,0,0},
+    {"lpos",lposCommand,-3,"r",0,NULL,1,1,1,0,0},
     {"ltrim",ltrimCommand,4,"w",0,NULL,1,1,1,0,0},
     {"lrem",lremCommand,4,"w",0,NULL,1,1,1,0,0},
     {"rpoplpush",rpoplpushCommand,3,"wm",0,NULL,1,2,1,0,0},
@@ -211,6 +213,13 @@ struct redisCommand redisCommandTable[] = {
     {"hgetall",hgetallCommand,2,"r",0,NULL,1,1,1,0,0},
     {"hexists",hexistsCommand,3,"rF",0,NULL,1,1,1,0,0},
     {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
+    {"hexpire",hexpireCommand,-6,"wF",0,NULL,1,1,1,0,0},
+    {"hpexpire",hpexpireCommand,-6,"wF",0,NULL,1,1,1,0,0},
+    {"hexpireat",hexpireatCommand,-6,"wF",0,NULL,1,1,1,0,0},
+    {"hpexpireat",hpexpireatCommand,-6,"wF",0,NULL,1,1,1,0,0},
+    {"httl",httlCommand,-5,"rF",0,NULL,1,1,1,0,0},
+    {"hpttl",hpttlCommand,-5,"rF",0,NULL,1,1,1,0,0},
+    {"hpersist",hpersistCommand,-5,"wF",0,NULL,1,1,1,0,0},
     {"incrby",incrbyCommand,3,"wmF",0,NULL,1,1,1,0,0},
     {"decrby",decrbyCommand,3,"wmF",0,NULL,1,1,1,0,0},
     {"incrbyfloat",incrbyfloatCommand,3,"wmF",0,NULL,1,1,1,0,0},
@@ -230,6 +239,7 @@ struct redisCommand redisCommandTable[] = {
     {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0},
     {"dbsize",dbsizeCommand,1,"rF",0,NULL,0,0,0,0,0},
     {"auth",authCommand,2,"sltF",0,NULL,0,0,0,0,0},
+    {"hello",helloCommand,-1,"sltF",0,NULL,0,0,0,0,0},
     {"ping",pingCommand,-1,"tF",0,NULL,0,0,0,0,0},
     {"echo",echoCommand,2,"F",0,NULL,0,0,0,0,0},
     {"save",saveCommand,1,"as",0,NULL,0,0,0,0,0},
@@ -274,6 +284,7 @@ struct redisCommand redisCommandTable[] = {
     {"readwrite",readwriteCommand,1,"F",0,NULL,0,0,0,0,0},
     {"dump",dumpCommand,2,"r",0,NULL,1,1,1,0,0},
     {"object",objectCommand,3,"r",0,NULL,2,2,2,0,0},
+    {"memory",memoryCommand,-3,"r",0,NULL,2,2,1,0,0},
     {"client",clientCommand,-2,"as",0,NULL,0,0,0,0,0},
     {"eval",evalCommand,-3,"s",0,evalGetKeys,0,0,0,0,0},
     {"evalsha",evalShaCommand,-3,"s",0,evalGetKeys,0,0,0,0,0},
@@ -300,7 +311,8 @@ struct redisCommand redisCommandTable[] = {
     {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0},
     {"post",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0},
     {"host:",securityWarningCommand,-1,"lt",0,NULL,0,0,0,0,0},
-    {"latency",latencyCommand,-2,"aslt",0,NULL,0,0,0,0,0}
+    {"latency",latencyCommand,-2,"aslt",0,NULL,0,0,0,0,0},
+    {"hotkeys",hotkeysCommand,-1,"aslt",0,NULL,0,0,0,0,0}
 };
 
 struct createZsetObject *evictionPoolAlloc(void);
@@ -547,7 +559,8 @@ dictType setDictType = {
     NULL,                      /* 无需键值复制函数， val dup */
     dictEncObjKeyCompare,      /* 键比较函数， key compare */
     dictObjectDestructor, /* 键销毁函数，key destructor */
-    NULL                       /* 无需键值销毁函数，val destructor */
+    NULL,                      /* 无需键值销毁函数，val destructor */
+    NULL                       /* allow to expand */
 };
 
 /* 指明有序集合需要的字典操作函数
@@ -558,9 +571,40 @@ dictType zsetDictType = {
     NULL,                      /* val dup */
     dictEncObjKeyCompare,      /* key compare */
     dictObjectDestructor, /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow to expand */
 };
 
+/* Db->dict values are Redis objects, or packed values. */
+void dictDbValueDestructor(void *privdata, void *val)
+{
+    DICT_NOTUSED(privdata);
+
+    if (objectIsPacked(val)) {
+        server.packed_values--;
+        return;
+    }
+    decrRefCount(val);
+}
+
+/* Return true if a keyspace table can grow, given that the new buckets array
+ * will take 'moreMem' bytes. When maxmemory is set and the new array alone
+ * would take us over the limit, we rather keep the current table as long as
+ * its elements/buckets ratio is acceptable: expanding it would only result
+ * in evicting keys (or refusing writes) to make room for empty buckets. */
+int dictExpandAllowed(size_t moreMem, double usedRatio) {
+    size_t used, overhead;
+
+    if (usedRatio > HASHTABLE_MAX_LOAD_FACTOR || server.maxmemory == 0)
+        return 1;
+    used = zmalloc_used_memory();
+    overhead = freeMemoryGetNotCountedMemory();
+    used = (used > overhead) ? used-overhead : 0;
+    if (used+moreMem <= server.maxmemory) return 1;
+    server.stat_hashtable_expands_denied++;
+    return 0;
+}
+
 /* Db->dict, keys are sds strings, vals are Redis objects. */
 dictType dbDictType = {
     dictSdsHash,                /* hash function */
@@ -568,7 +612,8 @@ dictType dbDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictObjectDestructor   /* val destructor */
+    dictDbValueDestructor,      /* val destructor */
+    dictExpandAllowed           /* allow to expand */
 };
 
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
@@ -578,7 +623,8 @@ dictType shaScriptObjectDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictObjectDestructor   /* val destructor */
+    dictObjectDestructor,  /* val destructor */
+    NULL                   /* allow to expand */
 };
 
 /* Db->expires */
@@ -588,7 +634,51 @@ dictType keyptrDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCompare,         /* key compare */
     NULL,                      /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    dictExpandAllowed          /* allow to expand */
+};
+
+/* Db->hexpires, keys are shared with db->dict like in db->expires, vals
+ * are hashFieldExpires structures. */
+void dictHashFieldExpiresDestructor(void *privdata, void *val) {
+    hashFieldExpires *hfe = val;
+
+    DICT_NOTUSED(privdata);
+    if (hfe == NULL) return; /* Moved to another key, see RENAME. */
+    dictRelease(hfe->fields);
+    zfree(hfe);
+}
+
+dictType hashFieldExpiresDictType = {
+    dictSdsHash,               /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCompare,         /* key compare */
+    NULL,                      /* key destructor */
+    dictHashFieldExpiresDestructor, /* val destructor */
+    NULL                            /* allow to expand */
+};
+
+/* hashFieldExpires->fields, field sds -> expire time stored as integer. */
+dictType hashFieldTimesDictType = {
+    dictSdsHash,               /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCompare,         /* key compare */
+    dictSdsDestructor,         /* key destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow to expand */
+};
+
+/* Intern table. The keys are the sds strings of the values. */
+dictType internTableDictType = {
+    dictSdsHash,               /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCompare,         /* key compare */
+    NULL,                      /* key destructor */
+    dictObjectDestructor,      /* val destructor */
+    NULL                       /* allow to expand */
 };
 
 /* Command table. sds string -> command struct pointer. */
@@ -598,7 +688,8 @@ dictType commandTableDictType = {
     NULL,                      /* val dup */
     dictSdsKeyCaseCompare,     /* key compare */
     dictSdsDestructor,         /* key destructor */
-    NULL                       /* val destructor */
+    NULL,                      /* val destructor */
+    NULL                       /* allow to expand */
 };
 
 /* Hash type hash table (note that small hashes are represented with ziplists) */
@@ -608,7 +699,8 @@ dictType hashDictType = {
     NULL,                       /* val dup */
     dictEncObjKeyCompare,       /* key compare */
     dictObjectDestructor,  /* key destructor */
-    dictObjectDestructor   /* val destructor */
+    dictObjectDestructor,  /* val destructor */
+    NULL                   /* allow to expand */
 };
 
 /* Keylist hash table type has unencoded redis objects as keys and
@@ -620,7 +712,8 @@ dictType keylistDictType = {
     NULL,                       /* val dup */
     dictObjKeyCompare,          /* key compare */
     dictObjectDestructor,  /* key destructor */
-    dictListDestructor          /* val destructor */
+    dictListDestructor,         /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* Cluster nodes hash table, mapping nodes addresses 1.2.3.4:6379 to
@@ -631,7 +724,8 @@ dictType clusterNodesDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* Cluster re-addition blacklist. This maps node IDs to the time
@@ -643,7 +737,8 @@ dictType clusterNodesBlackListDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* Migrate cache dict type. */
@@ -653,7 +748,8 @@ dictType migrateCacheDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 /* Replication cached script dict (server.repl_scriptcache_dict).
@@ -665,7 +761,31 @@ dictType replScriptCacheDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
     dictSdsDestructor,          /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow to expand */
+};
+
+/* Clients index, mapping client IDs to clients. Keys are pointers to the
+ * 'id' field of the client structure. */
+unsigned int dictClientIDHash(const void *key) {
+    return dictGenHashFunction(key,sizeof(uint64_t));
+}
+
+int dictClientIDKeyCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    DICT_NOTUSED(privdata);
+    return *(const uint64_t*)key1 == *(const uint64_t*)key2;
+}
+
+dictType clientsIndexDictType = {
+    dictClientIDHash,           /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictClientIDKeyCompare,     /* key compare */
+    NULL,                       /* key destructor */
+    NULL,                       /* val destructor */
+    NULL                        /* allow to expand */
 };
 
 int htNeedsResize(dict *dict) {
@@ -674,10 +794,10 @@ int htNeedsResize(dict *dict) {
     size = dictSlots(dict);
     used = dictSize(dict);
     return (size > DICT_HT_INITIAL_SIZE &&
-            (used*100/size < HASHTABLE_MIN_FILL));
+            (used*100/size < server.hashtable_min_fill));
 }
 
-/* If the percentage of used slots in the HT reaches HASHTABLE_MIN_FILL
+/* If the percentage of used slots in the HT reaches hashtable-min-fill
  * we resize the hash table to save memory */
 void tryResizeHashTables(int dbid) {
     if (htNeedsResize(server.db[dbid].dict))
@@ -688,23 +808,26 @@ void tryResizeHashTables(int dbid) {
 
 /* Our hash table implementation performs rehashing incrementally while
  * we write/read from the hash table. Still if the server is idle, the hash
- * table will use two tables for a long time. So we try to use 1 millisecond
- * of CPU time at every call of this function to perform some rehahsing.
+ * table will use two tables for a long time. So we try to use up to 'us'
+ * microseconds of CPU time at every call of this function to perform some
+ * rehashing of the keys and expires tables.
  *
- * The function returns 1 if some rehashing was performed, otherwise 0
- * is returned. */
-int incrementallyRehash(int dbid) {
+ * The function returns the microseconds used, or 0 if no rehashing was
+ * needed. */
+long long incrementallyRehash(int dbid, long long us) {
+    long long start = ustime(), elapsed = 0;
+
     /* Keys dictionary */
     if (dictIsRehashing(server.db[dbid].dict)) {
-        dictRehashMilliseconds(server.db[dbid].dict,1);
-        return 1; /* already used our millisecond for this loop... */
+        dictRehashMicroseconds(server.db[dbid].dict,us);
+        elapsed = ustime()-start+1;
     }
     /* Expires */
-    if (dictIsRehashing(server.db[dbid].expires)) {
-        dictRehashMilliseconds(server.db[dbid].expires,1);
-        return 1; /* already used our millisecond for this loop... */
+    if (elapsed < us && dictIsRehashing(server.db[dbid].expires)) {
+        dictRehashMicroseconds(server.db[dbid].expires,us-elapsed);
+        elapsed = ustime()-start+1;
     }
-    return 0;
+    return elapsed;
 }
 
 /* This function is called once a background process of some kind terminates,
@@ -743,6 +866,7 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
         dbDelete(db,keyobj);
         notifyKeyspaceEvent(NOTIFY_EXPIRED,
             "expired",keyobj,db->id);
+        trackingInvalidateKey(keyobj);
         decrRefCount(keyobj);
         server.stat_expiredkeys++;
         return 1;
@@ -828,6 +952,19 @@ void activeExpireCycle(int type) {
          * distribute the time evenly across DBs. */
         current_db++;
 
+        /* Reclaim the expired fields of hashes, sampling the hashes having
+         * fields with a TTL, with the same 25% rule used for keys below. */
+        while (dictSize(db->hexpires) &&
+               hashActiveExpireCycle(db,mstime(),
+                   ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP) >
+               ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4)
+        {
+            if (ustime()-start > timelimit) {
+                timelimit_exit = 1;
+                return;
+            }
+        }
+
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
@@ -972,9 +1109,25 @@ int clientsCronHandleTimeout(client *c, mstime_t now_ms) {
  *
  * The function always returns 0 as it never terminates the client. */
 int clientsCronResizeQueryBuffer(client *c) {
-    size_t querybuf_size = sdsAllocSize(c->querybuf);
+    size_t querybuf_size;
     time_t idletime = server.unixtime - c->lastinteraction;
 
+    /* Clients without a partial command pending read into the shared query
+     * buffer (see readQueryFromClient()), so there is nothing to resize.
+     * A private buffer that was left empty is released as well, unless it
+     * belongs to the master. */
+    if (c->querybuf && sdslen(c->querybuf) == 0 && !c->reqtype &&
+        !(c->flags & CLIENT_MASTER))
+    {
+        sdsfree(c->querybuf);
+        c->querybuf = NULL;
+    }
+    if (c->querybuf == NULL) {
+        c->querybuf_peak = 0;
+        return 0;
+    }
+    querybuf_size = sdsAllocSize(c->querybuf);
+
     /* There are two conditions to resize the query buffer:
      * 1) Query buffer is > BIG_ARG and too big for latest peak.
      * 2) Client is inactive and the buffer is bigger than 1k. */
@@ -1025,7 +1178,9 @@ void clientsCron(void) {
          * terminated. */
         if (clientsCronHandleTimeout(c,now)) continue;
         if (clientsCronResizeQueryBuffer(c)) continue;
+        updateClientMemUsage(c);
     }
+    evictClients();
 }
 
 /* This function handles 'background' operations we are required to do
@@ -1058,21 +1213,27 @@ void databasesCron(void) {
             resize_db++;
         }
 
-        /* Rehash */
+        /* Rehash, using at most active-rehashing-usec microseconds for all
+         * the databases. */
         if (server.activerehashing) {
-            for (j = 0; j < dbs_per_call; j++) {
-                int work_done = incrementallyRehash(rehash_db);
-                if (work_done) {
-                    /* If the function did some work, stop here, we'll do
-                     * more at the next cron loop. */
+            long long budget = server.active_rehashing_usec;
+
+            for (j = 0; j < dbs_per_call && budget > 0; j++) {
+                budget -= incrementallyRehash(rehash_db,budget);
+                if (budget <= 0) {
+                    /* The budget is over: stop here, we'll do more at the
+                     * next cron loop, starting from the same db. */
                     break;
                 } else {
-                    /* If this db didn't need rehash, we'll try the next one. */
+                    /* If this db is done, we'll try the next one. */
                     rehash_db++;
                     rehash_db %= server.dbnum;
                 }
             }
         }
+
+        /* Pack the small values that are idle. */
+        packValuesCron();
     }
 }
 
@@ -1110,6 +1271,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     UNUSED(id);
     UNUSED(clientData);
 
+    loopPhaseStart(LOOP_PHASE_CRON);
+
     /* Software watchdog: deliver the SIGALRM that will reach the signal
      * handler if we don't return here fast enough. */
     if (server.watchdog_period) watchdogScheduleSignal(server.watchdog_period);
@@ -1182,6 +1345,18 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     /* We need to do a few operations on clients asynchronously. */
     clientsCron();
 
+    /* Keep the client side caching tracking table within its limits. */
+    trackingLimitUsedSlots();
+
+    /* Release the interned values no longer used by any key. */
+    internTableCron();
+
+    /* Age the hot keys counters. */
+    hotkeysCron();
+
+    /* Close the metrics connections that timed out. */
+    run_with_period(1000) metricsCron();
+
     /* Handle background operations on Redis databases. */
     databasesCron();
 
@@ -1320,6 +1495,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     }
 
     server.cronloops++;
+    loopPhaseEnd(LOOP_PHASE_CRON);
     return 1000/server.hz;
 }
 
@@ -1329,6 +1505,9 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 void beforeSleep(struct aeEventLoop *eventLoop) {
     UNUSED(eventLoop);
 
+    /* Account the previous event loop iteration to the profiler. */
+    if (server.loop_profiler) loopProfilerBeforeSleep();
+
     /* Call the Redis Cluster before sleep function. Note that this function
      * may change the state of Redis Cluster (from ok to fail or vice versa),
      * so it's a good idea to call it before serving the unblocked clients
@@ -1337,8 +1516,11 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
 
     /* Run a fast expire cycle (the called function will return
      * ASAP if a fast cycle is not needed). */
-    if (server.active_expire_enabled && server.masterhost == NULL)
+    if (server.active_expire_enabled && server.masterhost == NULL) {
+        loopPhaseStart(LOOP_PHASE_EXPIRE);
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
+        loopPhaseEnd(LOOP_PHASE_EXPIRE);
+    }
 
     /* Send all the slaves an ACK request if at least one client blocked
      * during the previous event loop iteration. */
@@ -1364,11 +1546,30 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     if (listLength(server.unblocked_clients))
         processUnblockedClients();
 
+    /* Evict clients over maxmemory-clients before writing them replies. */
+    evictClients();
+
     /* Write the AOF buffer on disk */
+    loopPhaseStart(LOOP_PHASE_AOF);
     flushAppendOnlyFile(0);
+    loopPhaseEnd(LOOP_PHASE_AOF);
 
     /* Handle writes with pending output buffers. */
+    loopPhaseStart(LOOP_PHASE_WRITES);
     handleClientsWithPendingWrites();
+    loopPhaseEnd(LOOP_PHASE_WRITES);
+
+    loopPhaseEnd(LOOP_PHASE_BEFORE_SLEEP);
+    loopPhaseStart(LOOP_PHASE_POLL);
+}
+
+/* This function gets called every time Redis returns from waiting for
+ * events, in the main event loop. */
+void afterSleep(struct aeEventLoop *eventLoop) {
+    UNUSED(eventLoop);
+
+    loopPhaseEnd(LOOP_PHASE_POLL);
+    loopPhaseStart(LOOP_PHASE_EVENTS);
 }
 
 /* =========================== Server initialization ======================== */
@@ -1384,8 +1585,16 @@ void createSharedObjects(void) {
     shared.czero = createObject(OBJ_STRING,sdsnew(":0\r\n"));
     shared.cone = createObject(OBJ_STRING,sdsnew(":1\r\n"));
     shared.cnegone = createObject(OBJ_STRING,sdsnew(":-1\r\n"));
-    shared.nullbulk = createObject(OBJ_STRING,sdsnew("$-1\r\n"));
-    shared.nullmultibulk = createObject(OBJ_STRING,sdsnew("*-1\r\n"));
+    /* Null replies are indexed by the RESP version of the client. RESP3
+     * has a single null type for both bulks and aggregates. */
+    shared.null[2] = createObject(OBJ_STRING,sdsnew("$-1\r\n"));
+    shared.nullarray[2] = createObject(OBJ_STRING,sdsnew("*-1\r\n"));
+    shared.null[3] = createObject(OBJ_STRING,sdsnew("_\r\n"));
+    shared.nullarray[3] = createObject(OBJ_STRING,sdsnew("_\r\n"));
+    shared.emptymap[2] = createObject(OBJ_STRING,sdsnew("*0\r\n"));
+    shared.emptymap[3] = createObject(OBJ_STRING,sdsnew("%0\r\n"));
+    shared.emptyset[2] = createObject(OBJ_STRING,sdsnew("*0\r\n"));
+    shared.emptyset[3] = createObject(OBJ_STRING,sdsnew("~0\r\n"));
     shared.emptymultibulk = createObject(OBJ_STRING,sdsnew("*0\r\n"));
     shared.pong = createObject(OBJ_STRING,sdsnew("+PONG\r\n"));
     shared.queued = createObject(OBJ_STRING,sdsnew("+QUEUED\r\n"));
@@ -1455,6 +1664,12 @@ void createSharedObjects(void) {
             sdscatprintf(sdsempty(),"*%d\r\n",j));
         shared.bulkhdr[j] = createObject(OBJ_STRING,
             sdscatprintf(sdsempty(),"$%d\r\n",j));
+        shared.maphdr[j] = createObject(OBJ_STRING,
+            sdscatprintf(sdsempty(),"%%%d\r\n",j));
+        shared.sethdr[j] = createObject(OBJ_STRING,
+            sdscatprintf(sdsempty(),"~%d\r\n",j));
+        shared.intreply[j] = createObject(OBJ_STRING,
+            sdscatprintf(sdsempty(),":%d\r\n",j));
     }
     /* The following two shared objects, minstring and maxstrings, are not
      * actually used for their value but as a special object meaning
@@ -1475,6 +1690,7 @@ void initServerConfig(void) {
     server.runid[CONFIG_RUN_ID_SIZE] = '\0';
     server.arch_bits = (sizeof(long) == 8) ? 64 : 32;
     server.port = CONFIG_DEFAULT_SERVER_PORT;
+    server.metrics_port = CONFIG_DEFAULT_METRICS_PORT;
     server.tcp_backlog = CONFIG_DEFAULT_TCP_BACKLOG;
     server.bindaddr_count = 0;
     server.unixsocket = NULL;
@@ -1486,8 +1702,11 @@ void initServerConfig(void) {
     server.verbosity = CONFIG_DEFAULT_VERBOSITY;
     server.maxidletime = CONFIG_DEFAULT_CLIENT_TIMEOUT;
     server.tcpkeepalive = CONFIG_DEFAULT_TCP_KEEPALIVE;
+    server.busy_poll_usec = CONFIG_DEFAULT_BUSY_POLL_USEC;
     server.active_expire_enabled = 1;
     server.client_max_querybuf_len = PROTO_MAX_QUERYBUF_LEN;
+    server.tracking_table_max_keys = CONFIG_DEFAULT_TRACKING_TABLE_MAX_KEYS;
+    server.hotkeys_tracking = CONFIG_DEFAULT_HOTKEYS_TRACKING;
     server.saveparams = NULL;
     server.loading = 0;
     server.logfile = zstrdup(CONFIG_DEFAULT_LOGFILE);
@@ -1522,16 +1741,25 @@ void initServerConfig(void) {
     server.rdb_checksum = CONFIG_DEFAULT_RDB_CHECKSUM;
     server.stop_writes_on_bgsave_err = CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = CONFIG_DEFAULT_ACTIVE_REHASHING;
+    server.active_rehashing_usec = CONFIG_DEFAULT_ACTIVE_REHASHING_USEC;
+    server.hashtable_min_fill = HASHTABLE_MIN_FILL;
     server.notify_keyspace_events = 0;
     server.maxclients = CONFIG_DEFAULT_MAX_CLIENTS;
     server.bpop_blocked_clients = 0;
     server.maxmemory = CONFIG_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = CONFIG_DEFAULT_MAXMEMORY_POLICY;
     server.maxmemory_samples = CONFIG_DEFAULT_MAXMEMORY_SAMPLES;
+    server.maxmemory_clients = CONFIG_DEFAULT_MAXMEMORY_CLIENTS;
     server.hash_max_ziplist_entries = OBJ_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
     server.list_compress_depth = OBJ_LIST_COMPRESS_DEPTH;
+    server.list_compress_cache_bytes = OBJ_LIST_COMPRESS_CACHE_BYTES;
+    server.string_chunk_threshold = OBJ_STRING_CHUNK_THRESHOLD;
+    server.string_intern_max_entries = OBJ_STRING_INTERN_MAX_ENTRIES;
+    server.string_intern_max_len = OBJ_STRING_INTERN_MAX_LEN;
+    server.pack_values_idle = OBJ_PACK_VALUES_IDLE;
+    server.intern_table = dictCreate(&internTableDictType,NULL);
     server.set_max_intset_entries = OBJ_SET_MAX_INTSET_ENTRIES;
     server.zset_max_ziplist_entries = OBJ_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = OBJ_ZSET_MAX_ZIPLIST_VALUE;
@@ -1620,6 +1848,10 @@ void initServerConfig(void) {
     /* Latency monitor */
     server.latency_monitor_threshold = CONFIG_DEFAULT_LATENCY_MONITOR_THRESHOLD;
 
+    /* Event loop profiler */
+    server.loop_profiler = CONFIG_DEFAULT_LOOP_PROFILER;
+    server.loop_trace_threshold = CONFIG_DEFAULT_LOOP_TRACE_THRESHOLD;
+
     /* Debugging */
     server.assert_failed = "<no assertion failed>";
     server.assert_file = "<no file>";
@@ -1858,13 +2090,23 @@ void resetServerStats(void) {
     server.stat_numcommands = 0;
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
+    server.stat_expired_hash_fields = 0;
+    server.stat_hash_conversions = 0;
+    server.stat_intern_hits = 0;
+    server.stat_hashtable_expands_denied = 0;
     server.stat_evictedkeys = 0;
+    server.stat_evictedclients = 0;
+    server.stat_metrics_scrapes = 0;
     server.stat_keyspace_misses = 0;
     server.stat_keyspace_hits = 0;
     server.stat_fork_time = 0;
     server.stat_fork_rate = 0;
     server.stat_rejected_conn = 0;
     server.stat_sync_full = 0;
+    server.stat_tracking_evicted_slots = 0;
+    server.stat_accept_batches = 0;
+    server.stat_accept_usec = 0;
+    server.stat_accept_max_batch = 0;
     server.stat_sync_partial_ok = 0;
     server.stat_sync_partial_err = 0;
     for (j = 0; j < STATS_METRIC_COUNT; j++) {
@@ -1896,7 +2138,11 @@ void initServer(void) {
     server.pid = getpid();
     server.current_client = NULL;
     server.clients = listCreate();
+    server.clients_index = dictCreate(&clientsIndexDictType,NULL);
     server.clients_to_close = listCreate();
+    for (j = 0; j < CLIENT_MEM_USAGE_BUCKETS; j++)
+        server.client_mem_usage_buckets[j] = listCreate();
+    server.clients_memory = 0;
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.clients_pending_write = listCreate();
@@ -1941,6 +2187,7 @@ void initServer(void) {
     for (j = 0; j < server.dbnum; j++) {
         server.db[j].dict = dictCreate(&dbDictType,NULL);
         server.db[j].expires = dictCreate(&keyptrDictType,NULL);
+        server.db[j].hexpires = dictCreate(&hashFieldExpiresDictType,NULL);
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&setDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
@@ -1948,6 +2195,7 @@ void initServer(void) {
         server.db[j].id = j;
         server.db[j].avg_ttl = 0;
     }
+    server.packed_values = 0;
     server.pubsub_channels = dictCreate(&keylistDictType,NULL);
     server.pubsub_patterns = listCreate();
     listSetFreeMethod(server.pubsub_patterns,freePubsubPattern);
@@ -2018,6 +2266,7 @@ void initServer(void) {
     }
 
     if (server.cluster_enabled) clusterInit();
+    metricsInit();
     replicationScriptCacheInit();
     scriptingInit(1);
     slowlogInit();
@@ -2364,6 +2613,18 @@ void call(client *c, int flags) {
         }
         redisOpArrayFree(&server.also_propagate);
     }
+    /* If the client has keys tracking enabled for client side caching,
+     * make sure to remember the keys it fetched. Commands called by scripts
+     * are remembered on behalf of the client running the script. */
+    if (c->cmd->flags & CMD_READONLY) {
+        client *caller = (c->flags & CLIENT_LUA && server.lua_caller) ?
+                         server.lua_caller : c;
+        if (caller->flags & CLIENT_TRACKING &&
+            !(caller->flags & CLIENT_TRACKING_BCAST))
+        {
+            trackingRememberKeys(caller,c);
+        }
+    }
     server.stat_numcommands++;
 }
 
@@ -2403,7 +2664,8 @@ int processCommand(client *c) {
     }
 
     /* Check if the user is authenticated */
-    if (server.requirepass && !c->authenticated && c->cmd->proc != authCommand)
+    if (server.requirepass && !c->authenticated &&
+        c->cmd->proc != authCommand && c->cmd->proc != helloCommand)
     {
         flagTransaction(c);
         addReply(c,shared.noautherr);
@@ -2436,6 +2698,14 @@ int processCommand(client *c) {
         }
     }
 
+    /* Evict the biggest clients if they use more than maxmemory-clients,
+     * before evicting keys for maxmemory. The current client may be evicted
+     * as well, in that case its command is not executed. */
+    if (server.maxmemory_clients) {
+        evictClients();
+        if (c->flags & CLIENT_CLOSE_ASAP) return C_ERR;
+    }
+
     /* Handle the maxmemory directive.
      *
      * First we try to free some memory if possible (if there are volatile
@@ -2500,8 +2770,10 @@ int processCommand(client *c) {
         return C_OK;
     }
 
-    /* Only allow SUBSCRIBE and UNSUBSCRIBE in the context of Pub/Sub */
-    if (c->flags & CLIENT_PUBSUB &&
+    /* Only allow SUBSCRIBE and UNSUBSCRIBE in the context of Pub/Sub.
+     * RESP3 clients get Pub/Sub messages as push replies, so they can
+     * keep using the connection for normal commands. */
+    if (c->flags & CLIENT_PUBSUB && c->resp == 2 &&
         c->cmd->proc != pingCommand &&
         c->cmd->proc != subscribeCommand &&
         c->cmd->proc != unsubscribeCommand &&
@@ -2572,6 +2844,7 @@ void closeListeningSockets(int unlink_unix_socket) {
     if (server.sofd != -1) close(server.sofd);
     if (server.cluster_enabled)
         for (j = 0; j < server.cfd_count; j++) close(server.cfd[j]);
+    for (j = 0; j < server.metrics_fd_count; j++) close(server.metrics_fd[j]);
     if (unlink_unix_socket && server.unixsocket) {
         serverLog(LL_NOTICE,"Removing the unix socket file.");
         unlink(server.unixsocket); /* don't care if this fails */
@@ -2704,6 +2977,101 @@ void authCommand(client *c) {
     }
 }
 
+/* HELLO [<protover> [AUTH <username> <password>] [SETNAME <name>]]
+ *
+ * Switch the connection to the specified protocol version, authenticating
+ * and naming the client at the same time if requested, and reply with a
+ * map describing the server. The only user is "default", since the only
+ * access control is the requirepass password. */
+void helloCommand(client *c) {
+    long long ver = 0;
+    int j, authenticated;
+
+    if (c->argc >= 2) {
+        if (getLongLongFromObjectOrReply(c,c->argv[1],&ver,
+            "Protocol version is not an integer or out of range") != C_OK)
+            return;
+        if (ver < 2 || ver > 3) {
+            addReplySds(c,sdsnew("-NOPROTO unsupported protocol version\r\n"));
+            return;
+        }
+    }
+
+    /* Check the options before changing the client state, so that errors
+     * leave the connection untouched. */
+    authenticated = c->authenticated || !server.requirepass;
+    for (j = 2; j < c->argc; j++) {
+        int moreargs = (c->argc-1) - j;
+        char *opt = c->argv[j]->ptr;
+
+        if (!strcasecmp(opt,"AUTH") && moreargs >= 2) {
+            if (!server.requirepass) {
+                addReplyError(c,"Client sent AUTH, but no password is set");
+                return;
+            }
+            if (strcmp(c->argv[j+1]->ptr,"default") ||
+                time_independent_strcmp(c->argv[j+2]->ptr,server.requirepass))
+            {
+                addReplySds(c,sdsnew(
+                    "-WRONGPASS invalid username-password pair\r\n"));
+                return;
+            }
+            authenticated = 1;
+            j += 2;
+        } else if (!strcasecmp(opt,"SETNAME") && moreargs) {
+            j++;
+        } else {
+            addReplyErrorFormat(c,"Syntax error in HELLO option '%s'",opt);
+            return;
+        }
+    }
+
+    if (!authenticated) {
+        addReplySds(c,sdsnew("-NOAUTH HELLO must be called with the client "
+            "already authenticated, otherwise the HELLO AUTH <user> <pass> "
+            "option can be used to authenticate the client and select the "
+            "RESP protocol version at the same time\r\n"));
+        return;
+    }
+
+    /* Apply the options. SETNAME is the only one that can still fail. */
+    for (j = 2; j < c->argc; j++) {
+        if (!strcasecmp(c->argv[j]->ptr,"AUTH")) {
+            j += 2;
+        } else if (!strcasecmp(c->argv[j]->ptr,"SETNAME")) {
+            if (clientSetNameOrReply(c,c->argv[j+1]) == C_ERR) return;
+            j++;
+        }
+    }
+    c->authenticated = 1;
+    if (ver) c->resp = ver;
+
+    addReplyMapLen(c,7);
+
+    addReplyBulkCString(c,"server");
+    addReplyBulkCString(c,"redis");
+
+    addReplyBulkCString(c,"version");
+    addReplyBulkCString(c,REDIS_VERSION);
+
+    addReplyBulkCString(c,"proto");
+    addReplyLongLong(c,c->resp);
+
+    addReplyBulkCString(c,"id");
+    addReplyLongLong(c,c->id);
+
+    addReplyBulkCString(c,"mode");
+    if (server.sentinel_mode) addReplyBulkCString(c,"sentinel");
+    else if (server.cluster_enabled) addReplyBulkCString(c,"cluster");
+    else addReplyBulkCString(c,"standalone");
+
+    addReplyBulkCString(c,"role");
+    addReplyBulkCString(c,server.masterhost ? "slave" : "master");
+
+    addReplyBulkCString(c,"modules");
+    addReplyMultiBulkLen(c,0);
+}
+
 /* The PING command. It works in a different way if the client is in
  * in Pub/Sub mode. */
 void pingCommand(client *c) {
@@ -2714,7 +3082,7 @@ void pingCommand(client *c) {
         return;
     }
 
-    if (c->flags & CLIENT_PUBSUB) {
+    if (c->flags & CLIENT_PUBSUB && c->resp == 2) {
         addReply(c,shared.mbulkhdr[2]);
         addReplyBulkCBuffer(c,"pong",4);
         if (c->argc == 1)
@@ -2756,7 +3124,7 @@ int addReplyCommandFlag(client *c, struct redisCommand *cmd, int f, char *reply)
 /* Output the representation of a Redis command. Used by the COMMAND command. */
 void addReplyCommand(client *c, struct redisCommand *cmd) {
     if (!cmd) {
-        addReply(c, shared.nullbulk);
+        addReply(c, shared.null[c->resp]);
     } else {
         /* We are adding: command name, arg count, flags, first, last, offset */
         addReplyMultiBulkLen(c, 6);
@@ -2864,6 +3232,57 @@ void bytesToHuman(char *s, unsigned long long n) {
     }
 }
 
+/* Break down the used memory by subsystem. The figures are computed from
+ * the data structures when INFO is called, so that the allocation path
+ * does not pay anything for them. Whatever is not attributed to clients,
+ * the replication backlog or the AOF buffers is reported as dataset. */
+typedef struct memoryBreakdown {
+    size_t clients_normal;  /* Normal, Pub/Sub and master clients. */
+    size_t clients_slaves;  /* Slaves and their output buffers. */
+    size_t repl_backlog;
+    size_t aof_buffer;      /* AOF buffer and AOF rewrite buffer. */
+    size_t dataset;
+} memoryBreakdown;
+
+static void getMemoryBreakdown(memoryBreakdown *mb, size_t used) {
+    listIter li;
+    listNode *ln;
+    size_t overhead;
+
+    memset(mb,0,sizeof(*mb));
+    listRewind(server.clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+
+        if (getClientType(c) == CLIENT_TYPE_SLAVE)
+            mb->clients_slaves += getClientMemoryUsage(c);
+        else
+            mb->clients_normal += getClientMemoryUsage(c);
+    }
+    if (server.repl_backlog) mb->repl_backlog = server.repl_backlog_size;
+    mb->aof_buffer = sdsalloc(server.aof_buf)+aofRewriteBufferSize();
+    overhead = mb->clients_normal+mb->clients_slaves+mb->repl_backlog+
+               mb->aof_buffer;
+    mb->dataset = used > overhead ? used-overhead : 0;
+}
+
+/* Append to 'info' the size of the buckets array of 'd', its load factor,
+ * and if it is rehashing the size of the new array and the fraction of the
+ * buckets already moved to it. Field names are prefixed by 'prefix'. */
+static sds genHashtableInfoString(sds info, char *prefix, dict *d) {
+    unsigned long size = d->ht[0].size;
+    unsigned long target = dictIsRehashing(d) ? d->ht[1].size : 0;
+    double progress = dictIsRehashing(d) ? (double)d->rehashidx/size : 1;
+
+    return sdscatprintf(info,
+        "%sbuckets=%lu,%sload_factor=%.2f,"
+        "%srehash_target=%lu,%srehash_progress=%.2f",
+        prefix, size,
+        prefix, size ? (double)dictSize(d)/(size+target) : 0,
+        prefix, target,
+        prefix, progress);
+}
+
 /* Create the string returned by the INFO command. This is decoupled
  * by the INFO command itself as we need to report the same information
  * on memory corruption problems. */
@@ -2954,10 +3373,12 @@ sds genRedisInfoString(char *section) {
             "connected_clients:%lu\r\n"
             "client_longest_output_list:%lu\r\n"
             "client_biggest_input_buf:%lu\r\n"
-            "blocked_clients:%d\r\n",
+            "blocked_clients:%d\r\n"
+            "tracking_clients:%lu\r\n",
             listLength(server.clients)-listLength(server.slaves),
             lol, bib,
-            server.bpop_blocked_clients);
+            server.bpop_blocked_clients,
+            trackingGetClientsCount());
     }
 
     /* Memory */
@@ -2970,6 +3391,7 @@ sds genRedisInfoString(char *section) {
         char maxmemory_hmem[64];
         size_t zmalloc_used = zmalloc_used_memory();
         size_t total_system_mem = server.system_memory_size;
+        memoryBreakdown mb;
         const char *evict_policy = evictPolicyToString();
         long long memory_lua = (long long)lua_gc(server.lua,LUA_GCCOUNT,0)*1024;
 
@@ -2986,6 +3408,7 @@ sds genRedisInfoString(char *section) {
         bytesToHuman(used_memory_lua_hmem,memory_lua);
         bytesToHuman(used_memory_rss_hmem,server.resident_set_size);
         bytesToHuman(maxmemory_hmem,server.maxmemory);
+        getMemoryBreakdown(&mb,zmalloc_used);
 
         if (sections++) info = sdscat(info,"\r\n");
         info = sdscatprintf(info,
@@ -3000,9 +3423,17 @@ sds genRedisInfoString(char *section) {
             "total_system_memory_human:%s\r\n"
             "used_memory_lua:%lld\r\n"
             "used_memory_lua_human:%s\r\n"
+            "used_memory_dataset:%zu\r\n"
+            "used_memory_clients_normal:%zu\r\n"
+            "used_memory_clients_slaves:%zu\r\n"
+            "used_memory_repl_backlog:%zu\r\n"
+            "used_memory_aof_buffer:%zu\r\n"
             "maxmemory:%lld\r\n"
             "maxmemory_human:%s\r\n"
             "maxmemory_policy:%s\r\n"
+            "maxmemory_clients:%llu\r\n"
+            "mem_clients:%zu\r\n"
+            "packed_values:%lld\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
             "mem_allocator:%s\r\n",
             zmalloc_used,
@@ -3015,9 +3446,17 @@ sds genRedisInfoString(char *section) {
             total_system_hmem,
             memory_lua,
             used_memory_lua_hmem,
+            mb.dataset,
+            mb.clients_normal,
+            mb.clients_slaves,
+            mb.repl_backlog,
+            mb.aof_buffer,
             server.maxmemory,
             maxmemory_hmem,
             evict_policy,
+            server.maxmemory_clients,
+            server.clients_memory,
+            server.packed_values,
             zmalloc_get_fragmentation_ratio(server.resident_set_size),
             ZMALLOC_LIB
             );
@@ -3126,13 +3565,25 @@ sds genRedisInfoString(char *section) {
             "sync_partial_ok:%lld\r\n"
             "sync_partial_err:%lld\r\n"
             "expired_keys:%lld\r\n"
+            "expired_hash_fields:%lld\r\n"
             "evicted_keys:%lld\r\n"
+            "evicted_clients:%lld\r\n"
             "keyspace_hits:%lld\r\n"
             "keyspace_misses:%lld\r\n"
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
             "latest_fork_usec:%lld\r\n"
-            "migrate_cached_sockets:%ld\r\n",
+            "migrate_cached_sockets:%ld\r\n"
+            "tracking_used_slots:%lu\r\n"
+            "tracking_evicted_slots:%lld\r\n"
+            "tracked_hotkeys:%lu\r\n"
+            "accept_batches:%lld\r\n"
+            "accept_max_batch:%lld\r\n"
+            "accept_usec_per_conn:%.2f\r\n"
+            "hash_conversions:%lld\r\n"
+            "interned_values:%lu\r\n"
+            "intern_hits:%lld\r\n"
+            "hashtable_expands_denied:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),  // 按执行数量统计流量
@@ -3145,13 +3596,26 @@ sds genRedisInfoString(char *section) {
             server.stat_sync_partial_ok,
             server.stat_sync_partial_err,
             server.stat_expiredkeys,
+            server.stat_expired_hash_fields,
             server.stat_evictedkeys,
+            server.stat_evictedclients,
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
             dictSize(server.pubsub_channels),
             listLength(server.pubsub_patterns),
             server.stat_fork_time,
-            dictSize(server.migrate_cached_sockets));
+            dictSize(server.migrate_cached_sockets),
+            trackingGetUsedSlots(),
+            server.stat_tracking_evicted_slots,
+            hotkeysGetTrackedCount(),
+            server.stat_accept_batches,
+            server.stat_accept_max_batch,
+            server.stat_numconnections ? (double)server.stat_accept_usec /
+                                         server.stat_numconnections : 0,
+            server.stat_hash_conversions,
+            dictSize(server.intern_table),
+            server.stat_intern_hits,
+            server.stat_hashtable_expands_denied);
     }
 
     /* Replication */
@@ -3307,6 +3771,13 @@ sds genRedisInfoString(char *section) {
         }
     }
 
+    /* Event loop phases */
+    if (allsections || !strcasecmp(section,"loopstats")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Loopstats\r\n");
+        info = genLoopstatsInfoString(info);
+    }
+
     /* Cluster */
     if (allsections || defsections || !strcasecmp(section,"cluster")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -3316,6 +3787,22 @@ sds genRedisInfoString(char *section) {
         server.cluster_enabled);
     }
 
+    /* Hash tables */
+    if (allsections || defsections || !strcasecmp(section,"hashtables")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Hashtables\r\n");
+        for (j = 0; j < server.dbnum; j++) {
+            dict *keys = server.db[j].dict, *expires = server.db[j].expires;
+
+            if (dictSlots(keys) == 0 && dictSlots(expires) == 0) continue;
+            info = sdscatprintf(info,"db%d:",j);
+            info = genHashtableInfoString(info,"",keys);
+            info = sdscatlen(info,",",1);
+            info = genHashtableInfoString(info,"expires_",expires);
+            info = sdscatlen(info,"\r\n",2);
+        }
+    }
+
     /* Key space */
     if (allsections || defsections || !strcasecmp(section,"keyspace")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -3482,19 +3969,12 @@ void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEn
     if (samples != _samples) zfree(samples);
 }
 
-int freeMemoryIfNeeded(void) {
-    size_t mem_used, mem_tofree, mem_freed;
+/* Return the memory used by the slaves output buffers and the AOF buffers,
+ * that is not counted against maxmemory. */
+size_t freeMemoryGetNotCountedMemory(void) {
+    size_t overhead = 0;
     int slaves = listLength(server.slaves);
-    mstime_t latency, eviction_latency;
 
-    /* When clients are paused the dataset should be static not just from the
-     * POV of clients not being able to write, but also from the POV of
-     * expires and evictions of keys not being performed. */
-    if (clientsArePaused()) return C_OK;
-
-    /* Remove the size of slaves output buffers and AOF buffer from the
-     * count of used memory. */
-    mem_used = zmalloc_used_memory();
     if (slaves) {
         listIter li;
         listNode *ln;
@@ -3502,17 +3982,30 @@ int freeMemoryIfNeeded(void) {
         listRewind(server.slaves,&li);
         while((ln = listNext(&li))) {
             client *slave = listNodeValue(ln);
-            unsigned long obuf_bytes = getClientOutputBufferMemoryUsage(slave);
-            if (obuf_bytes > mem_used)
-                mem_used = 0;
-            else
-                mem_used -= obuf_bytes;
+            overhead += getClientOutputBufferMemoryUsage(slave);
         }
     }
     if (server.aof_state != AOF_OFF) {
-        mem_used -= sdslen(server.aof_buf);
-        mem_used -= aofRewriteBufferSize();
+        overhead += sdslen(server.aof_buf)+aofRewriteBufferSize();
     }
+    return overhead;
+}
+
+int freeMemoryIfNeeded(void) {
+    size_t mem_used, mem_tofree, mem_freed, overhead;
+    int slaves = listLength(server.slaves);
+    mstime_t latency, eviction_latency;
+
+    /* When clients are paused the dataset should be static not just from the
+     * POV of clients not being able to write, but also from the POV of
+     * expires and evictions of keys not being performed. */
+    if (clientsArePaused()) return C_OK;
+
+    /* Remove the size of slaves output buffers and AOF buffer from the
+     * count of used memory. */
+    mem_used = zmalloc_used_memory();
+    overhead = freeMemoryGetNotCountedMemory();
+    mem_used = (mem_used > overhead) ? mem_used-overhead : 0;
 
     /* Check if we are over the memory limit. */
     if (mem_used <= server.maxmemory) return C_OK;
@@ -3631,6 +4124,7 @@ int freeMemoryIfNeeded(void) {
                 server.stat_evictedkeys++;
                 notifyKeyspaceEvent(NOTIFY_EVICTED, "evicted",
                     keyobj, db->id);
+                trackingInvalidateKey(keyobj);
                 decrRefCount(keyobj);
                 keys_freed++;
 
@@ -4153,6 +4647,7 @@ int main(int argc, char **argv) {
 
     /* 8、启动事件轮询，监听客户端请求命令 */
     aeSetBeforeSleepProc(server.el,beforeSleep);
+    aeSetAfterSleepProc(server.el,afterSleep);
     aeMain(server.el);  // 进入事件监听
     aeDeleteEventLoop(server.el);
 
@@ -79,15 +79,21 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_MIN_HZ            1
 #define CONFIG_MAX_HZ            500  // 最大500次中断每秒
 #define CONFIG_DEFAULT_SERVER_PORT        6379    /* TCP port */
+#define CONFIG_DEFAULT_METRICS_PORT       0       /* HTTP metrics port, 0 = off */
 #define CONFIG_DEFAULT_TCP_BACKLOG       511     /* TCP listen backlog */
 #define CONFIG_DEFAULT_CLIENT_TIMEOUT       0       /* default client timeout: infinite */
 #define CONFIG_DEFAULT_DBNUM     16  // 默认库的数量
 #define CONFIG_MAX_LINE    1024  // 最大连接数
 #define CRON_DBS_PER_CALL 16
 #define NET_MAX_WRITES_PER_EVENT (1024*64)
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define NET_MAX_IOV IOV_MAX  /* Max iovecs for a single writev() call. */
+#else
+#define NET_MAX_IOV 1024
+#endif
 #define PROTO_SHARED_SELECT_CMDS 10
 #define OBJ_SHARED_INTEGERS 10000
-#define OBJ_SHARED_BULKHDR_LEN 32
+#define OBJ_SHARED_BULKHDR_LEN 1024 /* Precomputed "*<n>\r\n" and co. headers. */
 #define LOG_MAX_LEN    1024 /* Default maximum length of syslog messages */
 #define AOF_REWRITE_PERC  100
 #define AOF_REWRITE_MIN_SIZE (64*1024*1024)
@@ -111,6 +117,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_DAEMONIZE 0
 #define CONFIG_DEFAULT_UNIX_SOCKET_PERM 0
 #define CONFIG_DEFAULT_TCP_KEEPALIVE 300
+#define CONFIG_DEFAULT_BUSY_POLL_USEC 0
 #define CONFIG_DEFAULT_PROTECTED_MODE 1
 #define CONFIG_DEFAULT_LOGFILE ""
 #define CONFIG_DEFAULT_SYSLOG_ENABLED 0
@@ -127,6 +134,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_REPL_DISABLE_TCP_NODELAY 0
 #define CONFIG_DEFAULT_MAXMEMORY 0
 #define CONFIG_DEFAULT_MAXMEMORY_SAMPLES 5
+#define CONFIG_DEFAULT_MAXMEMORY_CLIENTS 0
 #define CONFIG_DEFAULT_AOF_FILENAME "appendonly.aof"
 #define CONFIG_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define CONFIG_DEFAULT_AOF_LOAD_TRUNCATED 1
@@ -134,11 +142,15 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
 #define CONFIG_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define CONFIG_DEFAULT_MIN_SLAVES_MAX_LAG 10
+#define CONFIG_DEFAULT_TRACKING_TABLE_MAX_KEYS 1000000
+#define CONFIG_DEFAULT_HOTKEYS_TRACKING 1
 #define NET_IP_STR_LEN 46 /* INET6_ADDRSTRLEN is 46, but we need to be sure */
 #define NET_PEER_ID_LEN (NET_IP_STR_LEN+32) /* Must be enough for ip:port */
 #define CONFIG_BINDADDR_MAX 16
 #define CONFIG_MIN_RESERVED_FDS 32
 #define CONFIG_DEFAULT_LATENCY_MONITOR_THRESHOLD 0
+#define CONFIG_DEFAULT_LOOP_PROFILER 0
+#define CONFIG_DEFAULT_LOOP_TRACE_THRESHOLD 100
 
 #define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Loopkups per loop. */
 #define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000 /* Microseconds */
@@ -159,6 +171,15 @@ typedef long long mstime_t; /* millisecond time type. */
 #define PROTO_REPLY_CHUNK_BYTES (16*1024) /* 输出缓冲区大小 16k output buffer */
 #define PROTO_INLINE_MAX_SIZE   (1024*64) /* 单行最大长度 Max size of inline reads */
 #define PROTO_MBULK_BIG_ARG     (1024*32)
+#define PROTO_REUSE_ARGV_MAX    64 /* Bigger argv arrays are freed after the command. */
+#define PROTO_REPLY_NOCOPY_BYTES (16*1024) /* Bigger values are referenced, never copied, by the reply list. */
+
+/* Clients accounted for maxmemory-clients are kept in buckets by memory
+ * usage, one bucket per power of two: clients using less than 64k share the
+ * first bucket, and all the clients using 4GB or more share the last one. */
+#define CLIENT_MEM_USAGE_BUCKET_MIN_LOG 15
+#define CLIENT_MEM_USAGE_BUCKET_MAX_LOG 32
+#define CLIENT_MEM_USAGE_BUCKETS (1+CLIENT_MEM_USAGE_BUCKET_MAX_LOG-CLIENT_MEM_USAGE_BUCKET_MIN_LOG)
 #define LONG_STR_SIZE      21          /* long转string类型需要的最大字节数（21位=最长19位无符号整型 + 1位负号 + 1位结束符） Bytes needed for long -> str + '\0' */
 #define AOF_AUTOSYNC_BYTES (1024*1024*32) /* aof持久化每次同步的最大数据量32MB fdatasync every 32MB */
 
@@ -170,6 +191,10 @@ typedef long long mstime_t; /* millisecond time type. */
 
 /* 哈希表最小填充量，即当已使用比例低于此值就可以考虑rehash缩容到能包含所有键值对的最小值，最小为4 Hash table parameters */
 #define HASHTABLE_MIN_FILL        10      /* Minimal hash table fill 10% */
+#define HASHTABLE_MAX_MIN_FILL    25      /* Max value of hashtable-min-fill */
+/* 超过此负载因子时，即使超出maxmemory也要扩容 Always expand over this ratio */
+#define HASHTABLE_MAX_LOAD_FACTOR 1.618
+#define CONFIG_DEFAULT_ACTIVE_REHASHING_USEC 1000
 
 /* 命令执行类型标记Command flags. Please check the command table defined in the redis.c file
  * for more information about the meaning of every flag. */
@@ -210,6 +235,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define OBJ_ENCODING_SKIPLIST 7  /* 以跳跃表存储 Encoded as skiplist */
 #define OBJ_ENCODING_EMBSTR 8  /* 嵌入编码（小串）Embedded sds string encoding */
 #define OBJ_ENCODING_QUICKLIST 9 /* 快速链表编码 Encoded as linked list of ziplists */
+#define OBJ_ENCODING_CHUNKED 10 /* 分块存储（超大串）Big string stored as chunks */
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -274,6 +300,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CLIENT_REPLY_SKIP (1<<24)  /* Don't send just this reply. */
 #define CLIENT_LUA_DEBUG (1<<25)  /* Run EVAL in debug mode. */
 #define CLIENT_LUA_DEBUG_SYNC (1<<26)  /* EVAL debugging without fork() */
+#define CLIENT_TRACKING (1<<27)    /* Client enabled keys tracking in order to
+                                      perform client side caching. */
+#define CLIENT_TRACKING_BCAST (1<<28) /* Tracking in broadcasting mode. */
+#define CLIENT_NO_EVICT (1<<29)    /* Never evicted by maxmemory-clients. */
 
 /* Client block type (btype field in client structure)
  * if CLIENT_BLOCKED flag is set. */
@@ -375,6 +405,14 @@ typedef long long mstime_t; /* millisecond time type. */
 /* List defaults */
 #define OBJ_LIST_MAX_ZIPLIST_SIZE -2
 #define OBJ_LIST_COMPRESS_DEPTH 0
+#define OBJ_LIST_COMPRESS_CACHE_BYTES 0
+
+/* String defaults */
+#define OBJ_STRING_CHUNK_THRESHOLD (1024*1024)
+#define OBJ_STRING_INTERN_MAX_ENTRIES 0
+#define OBJ_STRING_INTERN_MAX_LEN 32
+#define OBJ_ENCODING_EMBSTR_SIZE_LIMIT 44 /* Interned values are EMBSTR. */
+#define OBJ_PACK_VALUES_IDLE 10 /* Seconds. */
 
 /* HyperLogLog defines */
 #define CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES 3000
@@ -472,6 +510,27 @@ typedef struct redisObject {
     void *ptr;  // 64位 指向值的指针
 } robj;  // 16个字节
 
+/* Big string values modified by APPEND, SETRANGE or the bit commands are
+ * stored as an array of chunks (OBJ_ENCODING_CHUNKED), so that growing the
+ * string or changing part of it never reallocates and copies it all.
+ * Every chunk is a raw string object of OBJ_STRING_CHUNK_SIZE bytes but the
+ * last one, that may be shorter, so the chunk holding a given offset is
+ * found with a division. Chunks are refcounted: a reply can reference them
+ * without copying, and they are unshared before being modified. */
+#define OBJ_STRING_CHUNK_SIZE (64*1024-16) /* Fits a 64k allocation. */
+typedef struct chunkedString {
+    size_t len;         /* Total length of the string. */
+    size_t numchunks;   /* Number of used chunks. */
+    size_t alloc;       /* Number of allocated chunk pointers. */
+    robj **chunks;
+} chunkedString;
+
+/* Small string values that are idle for some time are packed into the value
+ * slot of their db->dict entry as tagged pointers, and unpacked on lookup.
+ * See the "Packed values" section of object.c for the details. */
+#define OBJ_PACKED_TAG 1
+#define objectIsPacked(o) ((uintptr_t)(o) & OBJ_PACKED_TAG)
+
 /* Macro used to obtain the current LRU clock.
  * If the current resolution is lower than the frequency we refresh the
  * LRU clock (as it should be in production servers) we return the
@@ -520,8 +579,20 @@ typedef struct redisDb {
     struct evictionPoolEntry *eviction_pool;    /* 待踢出的所有keys，Eviction pool of keys */
     int id;                     /* 数据库id，Database ID */
     long long avg_ttl;          /* 平均生存周期，只为统计用，Average TTL, just for stats */
+    dict *hexpires;             /* Hashes with volatile fields -> field TTLs */
 } redisDb;
 
+/* Expire times of the fields of a hash. Every hash having at least a field
+ * with a TTL has an entry in db->hexpires, whose key is the sds of the main
+ * dictionary like in db->expires. Expired fields are removed lazily when the
+ * hash is looked up, and actively by activeExpireCycle() sampling
+ * db->hexpires. 'min_expire' is a lower bound of the expire times, so that
+ * looking up a hash with nothing to expire does not scan the fields. */
+typedef struct hashFieldExpires {
+    dict *fields;           /* field sds -> unix time in milliseconds */
+    long long min_expire;   /* no field expires before this time */
+} hashFieldExpires;
+
 /* 事务中单个命令的结构体
  * Client MULTI/EXEC state */
 typedef struct multiCmd {
@@ -583,12 +654,17 @@ typedef struct client {
     redisDb *db;            /* 客户端选中的库指针 Pointer to currently SELECTed DB. */
     int dictid;             /* 客户端选中的库id ID of the currently SELECTed DB. */
     robj *name;             /* 客户端连接名称 As set by CLIENT SETNAME. */
-    sds querybuf;           /* Buffer we use to accumulate client queries. */
+    sds querybuf;           /* Buffer we use to accumulate client queries,
+                               NULL when no partial command is pending. */
+    size_t qb_pos;          /* Parsing cursor in querybuf, trimmed once per read. */
     size_t querybuf_peak;   /* Recent (100ms or more) peak of querybuf size. */
     int argc;               /* 客户端命令参数个数 Num of arguments of current command. */
     robj **argv;            /* 客户端命令的指针，可用来取命令参数 Arguments of current command. */
+    int argv_len;           /* Size of the argv array, reused across commands. */
+    size_t argv_len_sum;    /* Bytes of the arguments parsed so far. */
     struct redisCommand *cmd, *lastcmd;  /* 最后一条执行的命令 Last command executed. */
     int reqtype;            /* 请求类型 Request protocol type: PROTO_REQ_* */
+    int resp;               /* RESP protocol version used for replies: 2 or 3. */
     int multibulklen;       /* Number of multi bulk arguments left to read. */
     long bulklen;           /* Length of bulk argument in multi bulk request. */
     list *reply;            /* List of reply objects to send to the client. */
@@ -624,6 +700,12 @@ typedef struct client {
     dict *pubsub_channels;  /* channels a client is interested in (SUBSCRIBE) */
     list *pubsub_patterns;  /* patterns a client is interested in (SUBSCRIBE) */
     sds peerid;             /* Cached peer ID. */
+    uint64_t client_tracking_redirection; /* Client ID invalidation messages
+                                             are sent to, see tracking.c. */
+    list *client_tracking_prefixes; /* Prefixes registered in BCAST mode. */
+    size_t last_memory_usage; /* Memory accounted in server.clients_memory. */
+    list *mem_usage_bucket; /* maxmemory-clients bucket, NULL if untracked. */
+    listNode *mem_usage_bucket_node; /* Our node inside mem_usage_bucket. */
 
     /* Response buffer */
     int bufpos;
@@ -638,7 +720,7 @@ struct saveparam {
 /* 声明所有客户端可共享的对象 */
 struct sharedObjectsStruct {
     robj *crlf, *ok, *err, *emptybulk, *czero, *cone, *cnegone, *pong, *space,
-    *colon, *nullbulk, *nullmultibulk, *queued,
+    *colon, *queued, *null[4], *nullarray[4], *emptymap[4], *emptyset[4],
     *emptymultibulk, *wrongtypeerr, *nokeyerr, *syntaxerr, *sameobjecterr,
     *outofrangeerr, *noscripterr, *loadingerr, *slowscripterr, *bgsaveerr,
     *masterdownerr, *roslaveerr, *execaborterr, *noautherr, *noreplicaserr,
@@ -648,7 +730,10 @@ struct sharedObjectsStruct {
     *select[PROTO_SHARED_SELECT_CMDS],
     *integers[OBJ_SHARED_INTEGERS],
     *mbulkhdr[OBJ_SHARED_BULKHDR_LEN], /* "*<value>\r\n" */
-    *bulkhdr[OBJ_SHARED_BULKHDR_LEN];  /* "$<value>\r\n" */
+    *bulkhdr[OBJ_SHARED_BULKHDR_LEN],  /* "$<value>\r\n" */
+    *maphdr[OBJ_SHARED_BULKHDR_LEN],   /* "%<value>\r\n" */
+    *sethdr[OBJ_SHARED_BULKHDR_LEN],   /* "~<value>\r\n" */
+    *intreply[OBJ_SHARED_BULKHDR_LEN]; /* ":<value>\r\n" */
 };
 
 /* 跳跃表结点的结构体 ZSETs use a specialized version of Skiplists */
@@ -736,6 +821,8 @@ struct redisServer {
     unsigned lruclock:LRU_BITS; /* Clock for LRU eviction */
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    long long active_rehashing_usec; /* Rehash time budget per cron call */
+    int hashtable_min_fill;     /* Shrink tables filled less than that % */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
     int arch_bits;              /* 32 or 64 depending on sizeof(long) */
@@ -754,8 +841,16 @@ struct redisServer {
     int sofd;                   /* Unix socket file descriptor */
     int cfd[CONFIG_BINDADDR_MAX];/* Cluster bus listening socket */
     int cfd_count;              /* Used slots in cfd[] */
+    int metrics_port;           /* HTTP metrics port, 0 = disabled */
+    int metrics_fd[CONFIG_BINDADDR_MAX]; /* Metrics listening sockets */
+    int metrics_fd_count;       /* Used slots in metrics_fd[] */
+    list *metrics_clients;      /* Metrics HTTP connections */
     list *clients;              /* List of active clients */
+    dict *clients_index;        /* Active clients dictionary by client ID. */
     list *clients_to_close;     /* Clients to close asynchronously */
+    list *client_mem_usage_buckets[CLIENT_MEM_USAGE_BUCKETS]; /* Evictable
+                                   clients by memory usage. */
+    size_t clients_memory;      /* Memory used by the evictable clients. */
     list *clients_pending_write; /* There is to write or install handler. */
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     client *current_client; /* Current client, only used on crash report */
@@ -780,6 +875,10 @@ struct redisServer {
     long long stat_numcommands;     /* Number of processed commands */
     long long stat_numconnections;  /* Number of connections received */
     long long stat_expiredkeys;     /* Number of expired keys */
+    long long stat_expired_hash_fields; /* Number of expired hash fields */
+    long long stat_hash_conversions; /* Hashes converted ziplist -> dict */
+    long long stat_intern_hits;     /* Values shared via the intern table */
+    long long stat_hashtable_expands_denied; /* Expands skipped, maxmemory */
     long long stat_evictedkeys;     /* Number of evicted keys (maxmemory) */
     long long stat_keyspace_hits;   /* Number of successful lookups of keys */
     long long stat_keyspace_misses; /* Number of failed lookups of keys */
@@ -788,6 +887,13 @@ struct redisServer {
     double stat_fork_rate;          /* Fork rate in GB/sec. */
     long long stat_rejected_conn;   /* Clients rejected because of maxclients */
     long long stat_sync_full;       /* Number of full resyncs with slaves. */
+    long long stat_tracking_evicted_slots; /* Tracking table slots evicted. */
+    long long stat_accept_batches;  /* Number of accept handler calls that
+                                       accepted at least a connection. */
+    long long stat_accept_usec;     /* Time spent accepting connections. */
+    long long stat_accept_max_batch; /* Max connections accepted at once. */
+    long long stat_evictedclients;  /* Clients evicted (maxmemory-clients) */
+    long long stat_metrics_scrapes; /* Metrics HTTP requests served. */
     long long stat_sync_partial_ok; /* Number of accepted PSYNC requests. */
     long long stat_sync_partial_err;/* Number of unaccepted PSYNC requests. */
     list *slowlog;                  /* SLOWLOG list of commands */
@@ -810,6 +916,7 @@ struct redisServer {
     int verbosity;                  /* Loglevel in redis.conf */
     int maxidletime;                /* Client timeout in seconds */
     int tcpkeepalive;               /* Set SO_KEEPALIVE if non-zero. */
+    int busy_poll_usec;             /* Set SO_BUSY_POLL if non-zero. */
     int active_expire_enabled;      /* Can be disabled for testing purposes. */
     size_t client_max_querybuf_len; /* Limit for client query buffer length */
     int dbnum;                      /* Total number of configured DBs */
@@ -817,6 +924,8 @@ struct redisServer {
     int supervised_mode;            /* See SUPERVISED_* */
     int daemonize;                  /* True if running as a daemon */
     clientBufferLimitsConfig client_obuf_limits[CLIENT_TYPE_OBUF_COUNT];
+    unsigned long tracking_table_max_keys; /* Max slots in tracking table. */
+    int hotkeys_tracking;           /* Count accesses to find hot keys. */
     /* AOF persistence */
     int aof_state;                  /* AOF_(ON|OFF|WAIT_REWRITE) */
     int aof_fsync;                  /* Kind of fsync() policy */
@@ -934,6 +1043,7 @@ struct redisServer {
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key eviction */
     int maxmemory_samples;          /* Pricision of random sampling */
+    unsigned long long maxmemory_clients; /* Max memory used by clients. */
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
     list *unblocked_clients; /* list of clients to unblock before next loop */
@@ -954,6 +1064,14 @@ struct redisServer {
     /* List parameters */
     int list_max_ziplist_size;
     int list_compress_depth;
+    size_t list_compress_cache_bytes; /* Decompressed nodes kept per list. */
+    /* String parameters */
+    size_t string_chunk_threshold; /* Chunk strings bigger than that. */
+    unsigned long string_intern_max_entries; /* Intern table size, 0 = off. */
+    size_t string_intern_max_len;   /* Only intern values up to that len. */
+    dict *intern_table;             /* Interned values, sds -> robj. */
+    int pack_values_idle;           /* Pack small values idle that long. */
+    long long packed_values;        /* Number of packed db->dict values. */
     /* time cache */
     time_t unixtime;        /* Unix time sampled every cron cycle. */
     long long mstime;       /* Like 'unixtime' but with milliseconds resolution. */
@@ -992,6 +1110,11 @@ struct redisServer {
     /* Latency monitor */
     long long latency_monitor_threshold;
     dict *latency_events;
+    /* Event loop profiler */
+    int loop_profiler;              /* Profile the event loop phases. */
+    long long loop_trace_threshold; /* Keep the trace of slower iterations,
+                                       in milliseconds. 0 = off. */
+    struct loopProfiler loop;       /* Event loop profiler state. */
     /* Assert & bug reporting */
     char *assert_failed;
     char *assert_file;
@@ -1083,6 +1206,13 @@ typedef struct {
 #define OBJ_HASH_KEY 1
 #define OBJ_HASH_VALUE 2
 
+/* A ziplist encoded hash that grows too big is converted to a hash table
+ * incrementally: the pairs not yet moved into the dict are kept in a ziplist
+ * referenced by the dict private data, that hashDictType does not use.
+ * Returns NULL when the conversion is complete. */
+#define hashTypePendingZiplist(o) \
+    ((unsigned char*)((dict*)(o)->ptr)->privdata)
+
 /*-----------------------------------------------------------------------------
  * 一些外部可公用的数据结构，包括server全局配置、可共享变量、集合类型的字典结构、有序集合类型的字典结构、集群配置、数据库的字典结构、哈希类型的字典结构等。
  * Extern declarations
@@ -1098,7 +1228,11 @@ extern dictType dbDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
+extern dictType hashFieldExpiresDictType;
+extern dictType internTableDictType;
+extern dictType hashFieldTimesDictType;
 extern dictType replScriptCacheDictType;
+extern dictType clientsIndexDictType;
 
 /*-----------------------------------------------------------------------------
  * Functions prototypes
@@ -1122,13 +1256,17 @@ void resetClient(client *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
 void *addDeferredMultiBulkLength(client *c);
 void setDeferredMultiBulkLength(client *c, void *node, long length);
-void processInputBuffer(client *c);
+void setDeferredMapLen(client *c, void *node, long length);
+void setDeferredSetLen(client *c, void *node, long length);
+int processInputBuffer(client *c);
+client *lookupClientByID(uint64_t id);
 void acceptHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask);
 void addReplyBulk(client *c, robj *obj);
 void addReplyBulkCString(client *c, const char *s);
+void addReplyBulkChunkedString(client *c, chunkedString *cs, size_t start, size_t len);
 void addReplyBulkCBuffer(client *c, const void *p, size_t len);
 void addReplyBulkLongLong(client *c, long long ll);
 void addReply(client *c, robj *obj);
@@ -1140,8 +1278,15 @@ void addReplyDouble(client *c, double d);
 void addReplyHumanLongDouble(client *c, long double d);
 void addReplyLongLong(client *c, long long ll);
 void addReplyMultiBulkLen(client *c, long length);
+void addReplyMapLen(client *c, long length);
+void addReplySetLen(client *c, long length);
+void addReplyPushLen(client *c, long length);
+void addReplyNull(client *c);
+void addReplyBool(client *c, int b);
+void addReplyBigNum(client *c, const char *num, size_t len);
 void copyClientOutputBuffer(client *dst, client *src);
 void *dupClientReplyValue(void *o);
+void freeClientReplyValue(void *o);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 char *getClientPeerId(client *client);
@@ -1151,6 +1296,10 @@ void rewriteClientCommandVector(client *c, int argc, ...);
 void rewriteClientCommandArgument(client *c, int i, robj *newval);
 void replaceClientCommandVector(client *c, int argc, robj **argv);
 unsigned long getClientOutputBufferMemoryUsage(client *c);
+size_t getClientMemoryUsage(client *c);
+void updateClientMemUsage(client *c);
+void removeClientFromMemUsageBucket(client *c);
+int evictClients(void);
 void freeClientsInAsyncFreeQueue(void);
 void asyncCloseClientOnOutputBufferLimitReached(client *c);
 int getClientType(client *c);
@@ -1177,6 +1326,16 @@ void addReplyErrorFormat(client *c, const char *fmt, ...);
 void addReplyStatusFormat(client *c, const char *fmt, ...);
 #endif
 
+/* String data type */
+chunkedString *chunkedStringNew(const char *ptr, size_t len);
+chunkedString *chunkedStringDup(chunkedString *cs);
+void chunkedStringFree(chunkedString *cs);
+void chunkedStringWrite(chunkedString *cs, size_t offset, const void *p, size_t len);
+size_t chunkedStringRead(chunkedString *cs, size_t offset, void *dst, size_t len);
+sds chunkedStringToSds(chunkedString *cs);
+void chunkedStringGrowZero(chunkedString *cs, size_t len);
+int stringNeedsChunking(size_t len);
+
 /* List data type */
 void listTypeTryConversion(robj *subject, robj *value);
 void listTypePush(robj *subject, robj *value, int where);
@@ -1225,8 +1384,14 @@ robj *createEmbeddedStringObject(const char *ptr, size_t len);
 robj *dupStringObject(robj *o);
 int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
+void internTableCron(void);
+void internTableEmpty(void);
+robj *unpackObject(void *v);
+void packValuesCron(void);
 robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
+robj *createChunkedStringObject(const char *ptr, size_t len);
+void flattenChunkedStringObject(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value, int humanfriendly);
 robj *createQuicklistObject(void);
@@ -1248,6 +1413,8 @@ int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
 unsigned long long estimateObjectIdleTime(robj *o);
+#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
+size_t objectComputeSize(robj *o, size_t samples);
 #define sdsEncodedObject(objptr) (objptr->encoding == OBJ_ENCODING_RAW || objptr->encoding == OBJ_ENCODING_EMBSTR)
 
 /* 同步操作指定描述符的一些操作，同步写入、同步读取、同步读取一行等
@@ -1365,6 +1532,7 @@ void serverLogFromHandler(int level, const char *msg);
 void usage(void);
 void updateDictResizePolicy(void);
 int htNeedsResize(dict *dict);
+size_t freeMemoryGetNotCountedMemory(void);
 void populateCommandTable(void);
 void resetCommandTableStats(void);
 void adjustOpenFilesLimit(void);
@@ -1395,6 +1563,7 @@ void setTypeConvert(robj *subject, int enc);
 
 /* Hash data type */
 void hashTypeConvert(robj *o, int enc);
+void hashTypeConvertFinish(robj *o);
 void hashTypeTryConversion(robj *subject, robj **argv, int start, int end);
 void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2);
 robj *hashTypeGetObject(robj *o, robj *key);
@@ -1412,6 +1581,13 @@ void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst);
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what);
 robj *hashTypeLookupWriteOrCreate(client *c, robj *key);
+hashFieldExpires *hashGetFieldExpires(redisDb *db, robj *key);
+int hashRemoveFieldExpire(redisDb *db, robj *key, sds field);
+void hashAddFieldExpire(redisDb *db, robj *key, sds field, long long when);
+void hashAddFieldExpires(redisDb *db, robj *key, robj *o, dict *fields);
+void hashMoveFieldExpires(redisDb *src, robj *srckey, redisDb *dst, robj *dstkey);
+int hashExpireFieldsIfNeeded(redisDb *db, robj *key);
+int hashActiveExpireCycle(redisDb *db, long long now, int samples);
 
 /* Pub / Sub */
 int pubsubUnsubscribeAllChannels(client *c, int notify);
@@ -1420,6 +1596,32 @@ void freePubsubPattern(void *p);
 int listMatchPubsubPattern(void *a, void *b);
 int pubsubPublishMessage(robj *channel, robj *message);
 
+/* Client side caching (tracking mode) */
+void enableTracking(client *c, uint64_t redirect_to, int bcast, robj **prefixes, int numprefixes);
+void disableTracking(client *c);
+void trackingRememberKeys(client *tc, client *c);
+void trackingInvalidateKey(robj *keyobj);
+void trackingInvalidateKeysOnFlush(int dbid);
+void trackingLimitUsedSlots(void);
+unsigned long trackingGetUsedSlots(void);
+unsigned long trackingGetClientsCount(void);
+
+/* Hot keys detection */
+void hotkeysTrack(redisDb *db, robj *key);
+void hotkeysFlushDb(int dbid);
+void hotkeysReset(void);
+void hotkeysCron(void);
+unsigned long hotkeysGetTrackedCount(void);
+
+/* Event loop profiler */
+void loopTraceReply(client *c, int live);
+sds genLoopstatsInfoString(sds info);
+
+/* Metrics exporter */
+void metricsInit(void);
+void metricsCron(void);
+sds metricsGenerate(void);
+
 /* Keyspace events notification */
 void notifyKeyspaceEvent(int type, char *event, robj *key, int dbid);
 int keyspaceEventsStringToFlags(char *classes);
@@ -1445,8 +1647,11 @@ robj *lookupKeyWrite(redisDb *db, robj *key);
 robj *lookupKeyReadOrReply(client *c, robj *key, robj *reply);
 robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply);
 robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags);
+robj *lookupKeyWriteWithFlags(redisDb *db, robj *key, int flags);
 #define LOOKUP_NONE 0
 #define LOOKUP_NOTOUCH (1<<0)
+#define LOOKUP_CHUNKED (1<<1) /* The caller handles chunked strings. */
+robj *dbUnpackValue(redisDb *db, dictEntry *de);
 void dbAdd(redisDb *db, robj *key, robj *val);
 void dbOverwrite(redisDb *db, robj *key, robj *val);
 void setKey(redisDb *db, robj *key, robj *val);
@@ -1454,6 +1659,7 @@ int dbExists(redisDb *db, robj *key);
 robj *dbRandomKey(redisDb *db);
 int dbDelete(redisDb *db, robj *key);
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
+robj *dbChunkStringValue(redisDb *db, robj *key, robj *o);
 long long emptyDb(void(callback)(void*));
 int selectDb(client *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
@@ -1470,6 +1676,7 @@ int *getKeysFromCommand(struct redisCommand *cmd, robj **argv, int argc, int *nu
 void getKeysFreeResult(int *result);
 int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys);
 int *evalGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
+int *lmpopGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *sortGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *migrateGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *georadiusGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
@@ -1555,6 +1762,8 @@ void rpushxCommand(client *c);
 void linsertCommand(client *c);
 void lpopCommand(client *c);
 void rpopCommand(client *c);
+void lmpopCommand(client *c);
+void lposCommand(client *c);
 void llenCommand(client *c);
 void lindexCommand(client *c);
 void lrangeCommand(client *c);
@@ -1640,6 +1849,13 @@ void hvalsCommand(client *c);
 void hgetallCommand(client *c);
 void hexistsCommand(client *c);
 void hscanCommand(client *c);
+void hexpireCommand(client *c);
+void hpexpireCommand(client *c);
+void hexpireatCommand(client *c);
+void hpexpireatCommand(client *c);
+void httlCommand(client *c);
+void hpttlCommand(client *c);
+void hpersistCommand(client *c);
 void configCommand(client *c);
 void hincrbyCommand(client *c);
 void hincrbyfloatCommand(client *c);
@@ -1659,7 +1875,10 @@ void readonlyCommand(client *c);
 void readwriteCommand(client *c);
 void dumpCommand(client *c);
 void objectCommand(client *c);
+void memoryCommand(client *c);
 void clientCommand(client *c);
+int clientSetNameOrReply(client *c, robj *name);
+void helloCommand(client *c);
 void evalCommand(client *c);
 void evalShaCommand(client *c);
 void scriptCommand(client *c);
@@ -1685,6 +1904,7 @@ void pfcountCommand(client *c);
 void pfmergeCommand(client *c);
 void pfdebugCommand(client *c);
 void latencyCommand(client *c);
+void hotkeysCommand(client *c);
 void securityWarningCommand(client *c);
 
 #if defined(__GNUC__)
@@ -34,6 +34,135 @@
 #include "server.h"
 #include <math.h>
 
+/*-----------------------------------------------------------------------------
+ * Incremental ziplist -> hash table conversion
+ *----------------------------------------------------------------------------*/
+
+/* Number of field/value pairs moved from the pending ziplist into the dict
+ * at every access to a hash that is being converted. */
+#define HASH_CONVERT_STEP 16
+
+static robj *hashTypeZiplistEntryObject(unsigned char *p) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    robj *o;
+    int ret;
+
+    ret = ziplistGet(p, &vstr, &vlen, &vll);
+    serverAssert(ret);
+    if (vstr) {
+        o = createStringObject((char*)vstr, vlen);
+    } else {
+        o = createStringObjectFromLongLong(vll);
+    }
+    return tryObjectEncoding(o);
+}
+
+/* Add to the dict of 'o' the pair whose field is at 'fptr' in the pending
+ * ziplist 'zl'. */
+static void hashTypeConvertPair(robj *o, unsigned char *zl,
+                                unsigned char *fptr)
+{
+    unsigned char *vptr = ziplistNext(zl, fptr);
+    robj *field, *value;
+    int ret;
+
+    serverAssert(vptr != NULL);
+    field = hashTypeZiplistEntryObject(fptr);
+    value = hashTypeZiplistEntryObject(vptr);
+    ret = dictAdd(o->ptr, field, value);
+    if (ret != DICT_OK) {
+        serverLogHexDump(LL_WARNING,"ziplist with dup elements dump",
+            zl,ziplistBlobLen(zl));
+        serverAssert(ret == DICT_OK);
+    }
+}
+
+/* Store the pending ziplist back into the dict after it was modified,
+ * releasing it once empty: at this point the conversion is complete. */
+static void hashTypeSetPendingZiplist(robj *o, unsigned char *zl) {
+    if (zl && ziplistLen(zl) == 0) {
+        zfree(zl);
+        zl = NULL;
+    }
+    ((dict*)o->ptr)->privdata = zl;
+}
+
+/* Move up to 'pairs' field/value pairs from the tail of the pending ziplist
+ * into the dict. Deleting from the tail does not require to move the rest
+ * of the ziplist around. */
+static void hashTypeConvertStep(robj *o, unsigned long pairs) {
+    unsigned char *zl = hashTypePendingZiplist(o), *fptr;
+    unsigned long len = ziplistLen(zl)/2, j;
+    long long latency;
+
+    if (pairs > len) pairs = len;
+    if (pairs == 0) {
+        hashTypeSetPendingZiplist(o,zl);
+        return;
+    }
+
+    latencyStartMonitor(latency);
+    fptr = ziplistIndex(zl, -(long)(pairs*2));
+    for (j = 0; j < pairs; j++) {
+        hashTypeConvertPair(o, zl, fptr);
+        fptr = ziplistNext(zl, ziplistNext(zl, fptr));
+    }
+    zl = ziplistDeleteRange(zl, -(long)(pairs*2), pairs*2);
+    hashTypeSetPendingZiplist(o,zl);
+    latencyEndMonitor(latency);
+    latencyAddSampleIfNeeded("hash-convert",latency);
+}
+
+/* Called at every access to a hash that uses a dict. If the hash is still
+ * being converted, 'field' (when not NULL) is moved into the dict, so that
+ * the caller can just look it up there, together with a few more pairs,
+ * like dict.c does with incremental rehashing. */
+static void hashTypeConvertAccess(robj *o, robj *field) {
+    unsigned char *zl = hashTypePendingZiplist(o), *fptr;
+
+    if (zl == NULL) return;
+    if (field) {
+        field = getDecodedObject(field);
+        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+        decrRefCount(field);
+        if (fptr != NULL) {
+            hashTypeConvertPair(o, zl, fptr);
+            zl = ziplistDelete(zl, &fptr);
+            zl = ziplistDelete(zl, &fptr);
+            hashTypeSetPendingZiplist(o,zl);
+            if (hashTypePendingZiplist(o) == NULL) return;
+        }
+    }
+    hashTypeConvertStep(o,HASH_CONVERT_STEP);
+}
+
+/* Start converting a ziplist encoded hash to a hash table. The object
+ * switches to the new encoding at once, but the pairs are moved a few at a
+ * time by the following accesses, so that hashes configured with a large
+ * hash-max-ziplist-entries don't stall the server while converting. */
+static void hashTypeConvertZiplistIncrementally(robj *o) {
+    unsigned char *zl = o->ptr;
+    dict *d;
+
+    serverAssert(o->encoding == OBJ_ENCODING_ZIPLIST);
+    d = dictCreate(&hashDictType, zl);
+    dictExpand(d, ziplistLen(zl)/2);
+    o->encoding = OBJ_ENCODING_HT;
+    o->ptr = d;
+    server.stat_hash_conversions++;
+    hashTypeConvertStep(o,HASH_CONVERT_STEP);
+}
+
+/* Complete the conversion of 'o', if any, for the code that needs to access
+ * the dict directly, like SCAN. */
+void hashTypeConvertFinish(robj *o) {
+    if (o->encoding == OBJ_ENCODING_HT && hashTypePendingZiplist(o))
+        hashTypeConvertStep(o,ULONG_MAX);
+}
+
 /*-----------------------------------------------------------------------------
  * Hash type API
  *----------------------------------------------------------------------------*/
@@ -50,7 +179,7 @@ void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
         if (sdsEncodedObject(argv[i]) &&
             sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
         {
-            hashTypeConvert(o, OBJ_ENCODING_HT);
+            hashTypeConvertZiplistIncrementally(o);
             break;
         }
     }
@@ -107,6 +236,7 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
 
     serverAssert(o->encoding == OBJ_ENCODING_HT);
 
+    hashTypeConvertAccess(o, field);
     de = dictFind(o->ptr, field);
     if (de == NULL) return -1;
     *value = dictGetVal(de);
@@ -231,8 +361,9 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 
         /* Check if the ziplist needs to be converted to a hash table */
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-            hashTypeConvert(o, OBJ_ENCODING_HT);
+            hashTypeConvertZiplistIncrementally(o);
     } else if (o->encoding == OBJ_ENCODING_HT) {
+        hashTypeConvertAccess(o, field);
         if (dictReplace(o->ptr, field, value)) { /* Insert */
             incrRefCount(field);
         } else { /* Update */
@@ -270,6 +401,7 @@ int hashTypeDelete(robj *o, robj *field) {
         decrRefCount(field);
 
     } else if (o->encoding == OBJ_ENCODING_HT) {
+        hashTypeConvertAccess(o, field);
         if (dictDelete((dict*)o->ptr, field) == C_OK) {
             deleted = 1;
 
@@ -291,7 +423,10 @@ unsigned long hashTypeLength(robj *o) {
     if (o->encoding == OBJ_ENCODING_ZIPLIST) {
         length = ziplistLen(o->ptr) / 2;
     } else if (o->encoding == OBJ_ENCODING_HT) {
+        unsigned char *zl = hashTypePendingZiplist(o);
+
         length = dictSize((dict*)o->ptr);
+        if (zl) length += ziplistLen(zl) / 2;
     } else {
         serverPanic("Unknown hash encoding");
     }
@@ -331,7 +466,10 @@ int hashTypeNext(hashTypeIterator *hi) {
         unsigned char *zl;
         unsigned char *fptr, *vptr;
 
-        zl = hi->subject->ptr;
+        /* The subject may be a hash table still being converted, in which
+         * case we are iterating the pairs not yet moved into the dict. */
+        zl = hi->subject->encoding == OBJ_ENCODING_ZIPLIST ?
+             hi->subject->ptr : hashTypePendingZiplist(hi->subject);
         fptr = hi->fptr;
         vptr = hi->vptr;
 
@@ -354,7 +492,16 @@ int hashTypeNext(hashTypeIterator *hi) {
         hi->fptr = fptr;
         hi->vptr = vptr;
     } else if (hi->encoding == OBJ_ENCODING_HT) {
-        if ((hi->de = dictNext(hi->di)) == NULL) return C_ERR;
+        if ((hi->de = dictNext(hi->di)) == NULL) {
+            if (hashTypePendingZiplist(hi->subject) == NULL) return C_ERR;
+            /* Continue with the pairs not yet moved into the dict. */
+            dictReleaseIterator(hi->di);
+            hi->di = NULL;
+            hi->encoding = OBJ_ENCODING_ZIPLIST;
+            hi->fptr = NULL;
+            hi->vptr = NULL;
+            return hashTypeNext(hi);
+        }
     } else {
         serverPanic("Unknown hash encoding");
     }
@@ -613,7 +760,7 @@ static void addHashFieldToReply(client *c, robj *o, robj *field) {
     int ret;
 
     if (o == NULL) {
-        addReply(c, shared.nullbulk);
+        addReply(c, shared.null[c->resp]);
         return;
     }
 
@@ -624,7 +771,7 @@ static void addHashFieldToReply(client *c, robj *o, robj *field) {
 
         ret = hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll);
         if (ret < 0) {
-            addReply(c, shared.nullbulk);
+            addReply(c, shared.null[c->resp]);
         } else {
             if (vstr) {
                 addReplyBulkCBuffer(c, vstr, vlen);
@@ -638,7 +785,7 @@ static void addHashFieldToReply(client *c, robj *o, robj *field) {
 
         ret = hashTypeGetFromHashTable(o, field, &value);
         if (ret < 0) {
-            addReply(c, shared.nullbulk);
+            addReply(c, shared.null[c->resp]);
         } else {
             addReplyBulk(c, value);
         }
@@ -651,7 +798,7 @@ static void addHashFieldToReply(client *c, robj *o, robj *field) {
 void hgetCommand(client *c) {
     robj *o;
 
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk)) == NULL ||
+    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.null[c->resp])) == NULL ||
         checkType(c,o,OBJ_HASH)) return;
 
     addHashFieldToReply(c, o, c->argv[2]);
@@ -684,6 +831,8 @@ void hdelCommand(client *c) {
 
     for (j = 2; j < c->argc; j++) {
         if (hashTypeDelete(o,c->argv[j])) {
+            if (dictSize(c->db->hexpires))
+                hashRemoveFieldExpire(c->db,c->argv[1],c->argv[j]->ptr);
             deleted++;
             if (hashTypeLength(o) == 0) {
                 dbDelete(c->db,c->argv[1]);
@@ -749,15 +898,21 @@ void genericHgetallCommand(client *c, int flags) {
     hashTypeIterator *hi;
     int multiplier = 0;
     int length, count = 0;
+    /* HGETALL replies with a map, HKEYS and HVALS with an array. */
+    robj *emptyreply = ((flags & OBJ_HASH_KEY) && (flags & OBJ_HASH_VALUE)) ?
+                       shared.emptymap[c->resp] : shared.emptymultibulk;
 
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptymultibulk)) == NULL
+    if ((o = lookupKeyReadOrReply(c,c->argv[1],emptyreply)) == NULL
         || checkType(c,o,OBJ_HASH)) return;
 
     if (flags & OBJ_HASH_KEY) multiplier++;
     if (flags & OBJ_HASH_VALUE) multiplier++;
 
     length = hashTypeLength(o) * multiplier;
-    addReplyMultiBulkLen(c, length);
+    if (multiplier == 2)
+        addReplyMapLen(c, length/2);
+    else
+        addReplyMultiBulkLen(c, length);
 
     hi = hashTypeInitIterator(o);
     while (hashTypeNext(hi) != C_ERR) {
@@ -804,3 +959,439 @@ void hscanCommand(client *c) {
         checkType(c,o,OBJ_HASH)) return;
     scanGenericCommand(c,o,cursor);
 }
+
+/*-----------------------------------------------------------------------------
+ * Hash fields expiration
+ *----------------------------------------------------------------------------*/
+
+/* Return the expire times of the fields of the hash at 'key', or NULL if no
+ * field of the hash has a TTL. */
+hashFieldExpires *hashGetFieldExpires(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    if (dictSize(db->hexpires) == 0 ||
+       (de = dictFind(db->hexpires,key->ptr)) == NULL) return NULL;
+    return dictGetVal(de);
+}
+
+/* Return the expire time of 'field' in the hash at 'key', or -1 if the field
+ * has no TTL. */
+static long long hashGetFieldExpire(redisDb *db, robj *key, sds field) {
+    hashFieldExpires *hfe = hashGetFieldExpires(db,key);
+    dictEntry *de;
+
+    if (hfe == NULL || (de = dictFind(hfe->fields,field)) == NULL) return -1;
+    return dictGetSignedIntegerVal(de);
+}
+
+/* Set the expire time of 'field' in the hash at 'key'. The key must exist. */
+void hashAddFieldExpire(redisDb *db, robj *key, sds field, long long when) {
+    hashFieldExpires *hfe = hashGetFieldExpires(db,key);
+    dictEntry *de;
+
+    if (hfe == NULL) {
+        /* Reuse the sds from the main dict in the hexpires dict */
+        dictEntry *kde = dictFind(db->dict,key->ptr);
+        serverAssertWithInfo(NULL,key,kde != NULL);
+        hfe = zmalloc(sizeof(*hfe));
+        hfe->fields = dictCreate(&hashFieldTimesDictType,NULL);
+        hfe->min_expire = LLONG_MAX;
+        dictAdd(db->hexpires,dictGetKey(kde),hfe);
+    }
+    if ((de = dictFind(hfe->fields,field)) == NULL)
+        de = dictAddRaw(hfe->fields,sdsdup(field));
+    dictSetSignedIntegerVal(de,when);
+    if (when < hfe->min_expire) hfe->min_expire = when;
+}
+
+/* Set the expire times of the fields of the hash 'o' just added at 'key',
+ * as loaded from an RDB file or a DUMP payload into 'fields', a dict of
+ * type hashFieldTimesDictType. Fields missing from the hash are ignored,
+ * the ones already expired are reclaimed by the usual expire mechanisms. */
+void hashAddFieldExpires(redisDb *db, robj *key, robj *o, dict *fields) {
+    dictIterator *di;
+    dictEntry *de;
+
+    if (o->type != OBJ_HASH) return;
+    di = dictGetIterator(fields);
+    while((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+        robj *fieldobj = createStringObject(field,sdslen(field));
+
+        if (hashTypeExists(o,fieldobj))
+            hashAddFieldExpire(db,key,field,dictGetSignedIntegerVal(de));
+        decrRefCount(fieldobj);
+    }
+    dictReleaseIterator(di);
+}
+
+/* Remove the TTL of 'field' in the hash at 'key'. Returns 1 if the field had
+ * a TTL, 0 otherwise. */
+int hashRemoveFieldExpire(redisDb *db, robj *key, sds field) {
+    hashFieldExpires *hfe = hashGetFieldExpires(db,key);
+
+    if (hfe == NULL || dictDelete(hfe->fields,field) != DICT_OK) return 0;
+    if (dictSize(hfe->fields) == 0) dictDelete(db->hexpires,key->ptr);
+    return 1;
+}
+
+/* Move the field expire times of the hash at 'srckey' in 'src' to the hash
+ * now stored at 'dstkey' in 'dst', as RENAME and MOVE do. */
+void hashMoveFieldExpires(redisDb *src, robj *srckey, redisDb *dst,
+                          robj *dstkey)
+{
+    dictEntry *de, *kde;
+    hashFieldExpires *hfe;
+
+    if (dictSize(src->hexpires) == 0 ||
+       (de = dictFind(src->hexpires,srckey->ptr)) == NULL) return;
+    hfe = dictGetVal(de);
+    /* Detach the fields from the source entry before deleting it. */
+    dictSetVal(src->hexpires,de,NULL);
+    dictDelete(src->hexpires,srckey->ptr);
+
+    kde = dictFind(dst->dict,dstkey->ptr);
+    serverAssertWithInfo(NULL,dstkey,kde != NULL);
+    dictAdd(dst->hexpires,dictGetKey(kde),hfe);
+}
+
+/* Propagate the expiration of a hash field as an HDEL, like expired keys
+ * are propagated as DEL by propagateExpire(). */
+static void propagateHashFieldExpire(redisDb *db, robj *key, robj *field) {
+    struct redisCommand *hdel = lookupCommandByCString("hdel");
+    robj *argv[3];
+
+    argv[0] = createStringObject("HDEL",4);
+    argv[1] = key;
+    argv[2] = field;
+
+    if (server.aof_state != AOF_OFF)
+        feedAppendOnlyFile(hdel,db->id,argv,3);
+    replicationFeedSlaves(server.slaves,db->id,argv,3);
+
+    decrRefCount(argv[0]);
+}
+
+/* Delete the fields of the hash at 'key' expired at time 'now', propagating
+ * the deletions, and deleting the key as well if no field is left.
+ * Returns the number of expired fields. */
+static int hashExpireFields(redisDb *db, robj *key, hashFieldExpires *hfe,
+                            long long now)
+{
+    dictEntry *kde = dictFind(db->dict,key->ptr), *de;
+    robj *o;
+    long long min_expire = LLONG_MAX;
+    int expired = 0;
+
+    serverAssertWithInfo(NULL,key,kde != NULL);
+    o = dictGetVal(kde);
+
+    dictIterator *di = dictGetSafeIterator(hfe->fields);
+    while((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+        long long when = dictGetSignedIntegerVal(de);
+
+        if (when > now) {
+            if (when < min_expire) min_expire = when;
+            continue;
+        }
+        robj *fieldobj = createStringObject(field,sdslen(field));
+        hashTypeDelete(o,fieldobj);
+        propagateHashFieldExpire(db,key,fieldobj);
+        decrRefCount(fieldobj);
+        dictDelete(hfe->fields,field);
+        expired++;
+    }
+    dictReleaseIterator(di);
+    hfe->min_expire = min_expire;
+    if (expired == 0) return 0;
+
+    server.stat_expired_hash_fields += expired;
+    notifyKeyspaceEvent(NOTIFY_HASH,"hexpired",key,db->id);
+    trackingInvalidateKey(key);
+    if (hashTypeLength(o) == 0) {
+        dbDelete(db,key);
+        notifyKeyspaceEvent(NOTIFY_GENERIC,"del",key,db->id);
+    } else if (dictSize(hfe->fields) == 0) {
+        dictDelete(db->hexpires,key->ptr);
+    }
+    return expired;
+}
+
+/* Called when looking up 'key': if it is a hash with fields already
+ * expired, remove them. Like expireIfNeeded(), nothing is removed while
+ * loading, and slaves wait for the master to send the HDELs, so that their
+ * data set stays consistent with the master one.
+ * Returns the number of expired fields. */
+int hashExpireFieldsIfNeeded(redisDb *db, robj *key) {
+    hashFieldExpires *hfe = hashGetFieldExpires(db,key);
+    long long now;
+
+    if (hfe == NULL || server.loading || server.masterhost != NULL) return 0;
+
+    /* Time is blocked to when a Lua script started, see expireIfNeeded(). */
+    now = server.lua_caller ? server.lua_time_start : mstime();
+    if (now < hfe->min_expire) return 0;
+    return hashExpireFields(db,key,hfe,now);
+}
+
+/* Called by activeExpireCycle(): sample up to 'samples' hashes among the
+ * ones having fields with a TTL, expiring the fields already due.
+ * Returns the number of sampled hashes that had expired fields. */
+int hashActiveExpireCycle(redisDb *db, long long now, int samples) {
+    int found = 0;
+
+    while (samples-- && dictSize(db->hexpires)) {
+        dictEntry *de = dictGetRandomKey(db->hexpires);
+        hashFieldExpires *hfe = dictGetVal(de);
+
+        if (now < hfe->min_expire) continue;
+        /* The key sds may be released while expiring, take a copy. */
+        sds keystr = dictGetKey(de);
+        robj *keyobj = createStringObject(keystr,sdslen(keystr));
+        if (hashExpireFields(db,keyobj,hfe,now)) found++;
+        decrRefCount(keyobj);
+    }
+    return found;
+}
+
+/* Parse the "FIELDS numfields field [field ...]" trailing part of the hash
+ * fields expiration commands, starting at argv[j]. On success the index of
+ * the first field is returned, otherwise an error is sent to the client and
+ * -1 is returned. */
+static int hashParseFieldsOrReply(client *c, int j) {
+    long long numfields;
+
+    if (j >= c->argc || strcasecmp(c->argv[j]->ptr,"fields")) {
+        addReplyError(c,"Mandatory argument FIELDS is missing or not at "
+                        "the right position");
+        return -1;
+    }
+    if (j+1 >= c->argc ||
+        getLongLongFromObjectOrReply(c,c->argv[j+1],&numfields,NULL) != C_OK)
+    {
+        if (j+1 >= c->argc) addReply(c,shared.syntaxerr);
+        return -1;
+    }
+    if (numfields <= 0 || numfields != c->argc-j-2) {
+        addReplyError(c,"The numfields parameter must match the number of "
+                        "arguments");
+        return -1;
+    }
+    return j+2;
+}
+
+#define HFE_NX (1<<0)
+#define HFE_XX (1<<1)
+#define HFE_GT (1<<2)
+#define HFE_LT (1<<3)
+
+/* This is the generic command implementation for HEXPIRE, HPEXPIRE,
+ * HEXPIREAT and HPEXPIREAT, following the same conventions of
+ * expireGenericCommand() for 'basetime' and 'unit':
+ *
+ * H[P]EXPIRE[AT] key time [NX|XX|GT|LT] FIELDS numfields field [field ...]
+ *
+ * The reply is an array with, for every field, -2 if the field (or the key)
+ * does not exist, 0 if the NX/XX/GT/LT condition was not met, 1 if the
+ * expire time was set, 2 if the field was deleted since the time is already
+ * in the past. The command is propagated as an HPEXPIREAT of the fields
+ * actually updated, and an HDEL of the deleted ones. */
+void hexpireGenericCommand(client *c, long long basetime, int unit) {
+    robj *key = c->argv[1], *o;
+    long long when;
+    int flags = 0, first, j;
+
+    if (getLongLongFromObjectOrReply(c,c->argv[2],&when,NULL) != C_OK)
+        return;
+    if (when < 0 || (unit == UNIT_SECONDS && when > LLONG_MAX/1000) ||
+        (unit == UNIT_SECONDS ? when*1000 : when) > LLONG_MAX-basetime)
+    {
+        addReplyError(c,"invalid expire time");
+        return;
+    }
+    if (unit == UNIT_SECONDS) when *= 1000;
+    when += basetime;
+
+    j = 3;
+    if (j < c->argc && strcasecmp(c->argv[j]->ptr,"fields")) {
+        char *opt = c->argv[j]->ptr;
+        if (!strcasecmp(opt,"nx")) flags = HFE_NX;
+        else if (!strcasecmp(opt,"xx")) flags = HFE_XX;
+        else if (!strcasecmp(opt,"gt")) flags = HFE_GT;
+        else if (!strcasecmp(opt,"lt")) flags = HFE_LT;
+        else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        j++;
+    }
+    if ((first = hashParseFieldsOrReply(c,j)) == -1) return;
+
+    o = lookupKeyWrite(c->db,key);
+    if (o != NULL && checkType(c,o,OBJ_HASH)) return;
+
+    addReplyMultiBulkLen(c,c->argc-first);
+    if (o == NULL) {
+        for (j = first; j < c->argc; j++) addReplyLongLong(c,-2);
+        return;
+    }
+
+    /* Like EXPIRE, a time in the past deletes the fields, unless we are
+     * loading or a slave: the master will send the HDEL. */
+    int delete = when <= mstime() && !server.loading && !server.masterhost;
+    robj **setv = zmalloc(sizeof(robj*)*(c->argc-first+5));
+    robj **delv = zmalloc(sizeof(robj*)*(c->argc-first+2));
+    int setc = 0, delc = 0, keyremoved = 0;
+
+    for (j = first; j < c->argc; j++) {
+        robj *field = c->argv[j];
+        long long current;
+
+        if (keyremoved || !hashTypeExists(o,field)) {
+            addReplyLongLong(c,-2);
+            continue;
+        }
+        current = hashGetFieldExpire(c->db,key,field->ptr);
+        if (((flags & HFE_NX) && current != -1) ||
+            ((flags & HFE_XX) && current == -1) ||
+            ((flags & HFE_GT) && (current == -1 || when <= current)) ||
+            ((flags & HFE_LT) && current != -1 && when >= current))
+        {
+            addReplyLongLong(c,0);
+            continue;
+        }
+        if (delete) {
+            hashRemoveFieldExpire(c->db,key,field->ptr);
+            hashTypeDelete(o,field);
+            delv[2+delc++] = field;
+            addReplyLongLong(c,2);
+            if (hashTypeLength(o) == 0) {
+                dbDelete(c->db,key);
+                keyremoved = 1;
+            }
+        } else {
+            hashAddFieldExpire(c->db,key,field->ptr,when);
+            setv[5+setc++] = field;
+            addReplyLongLong(c,1);
+        }
+    }
+
+    preventCommandPropagation(c);
+    if (setc) {
+        setv[0] = createStringObject("HPEXPIREAT",10);
+        setv[1] = key;
+        setv[2] = createStringObjectFromLongLong(when);
+        setv[3] = createStringObject("FIELDS",6);
+        setv[4] = createStringObjectFromLongLong(setc);
+        alsoPropagate(lookupCommandByCString("hpexpireat"),c->db->id,
+                      setv,setc+5,PROPAGATE_AOF|PROPAGATE_REPL);
+        decrRefCount(setv[0]);
+        decrRefCount(setv[2]);
+        decrRefCount(setv[3]);
+        decrRefCount(setv[4]);
+        notifyKeyspaceEvent(NOTIFY_HASH,"hexpire",key,c->db->id);
+    }
+    if (delc) {
+        delv[0] = createStringObject("HDEL",4);
+        delv[1] = key;
+        alsoPropagate(lookupCommandByCString("hdel"),c->db->id,
+                      delv,delc+2,PROPAGATE_AOF|PROPAGATE_REPL);
+        decrRefCount(delv[0]);
+        notifyKeyspaceEvent(NOTIFY_HASH,"hdel",key,c->db->id);
+        if (keyremoved)
+            notifyKeyspaceEvent(NOTIFY_GENERIC,"del",key,c->db->id);
+    }
+    if (setc || delc) {
+        signalModifiedKey(c->db,key);
+        server.dirty += setc+delc;
+    }
+    zfree(setv);
+    zfree(delv);
+}
+
+void hexpireCommand(client *c) {
+    hexpireGenericCommand(c,mstime(),UNIT_SECONDS);
+}
+
+void hpexpireCommand(client *c) {
+    hexpireGenericCommand(c,mstime(),UNIT_MILLISECONDS);
+}
+
+void hexpireatCommand(client *c) {
+    hexpireGenericCommand(c,0,UNIT_SECONDS);
+}
+
+void hpexpireatCommand(client *c) {
+    hexpireGenericCommand(c,0,UNIT_MILLISECONDS);
+}
+
+/* HTTL/HPTTL key FIELDS numfields field [field ...]
+ *
+ * Reply with the remaining time to live of every field, -1 if the field has
+ * no TTL, or -2 if the field (or the key) does not exist. */
+void httlGenericCommand(client *c, int output_ms) {
+    robj *o;
+    int first, j;
+
+    if ((first = hashParseFieldsOrReply(c,2)) == -1) return;
+    o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_NOTOUCH);
+    if (o != NULL && checkType(c,o,OBJ_HASH)) return;
+
+    addReplyMultiBulkLen(c,c->argc-first);
+    for (j = first; j < c->argc; j++) {
+        long long expire, ttl;
+
+        if (o == NULL || !hashTypeExists(o,c->argv[j])) {
+            addReplyLongLong(c,-2);
+            continue;
+        }
+        expire = hashGetFieldExpire(c->db,c->argv[1],c->argv[j]->ptr);
+        if (expire == -1) {
+            addReplyLongLong(c,-1);
+            continue;
+        }
+        ttl = expire-mstime();
+        if (ttl < 0) ttl = 0;
+        addReplyLongLong(c,output_ms ? ttl : ((ttl+500)/1000));
+    }
+}
+
+void httlCommand(client *c) {
+    httlGenericCommand(c,0);
+}
+
+void hpttlCommand(client *c) {
+    httlGenericCommand(c,1);
+}
+
+/* HPERSIST key FIELDS numfields field [field ...]
+ *
+ * Remove the TTL of the fields, replying for every field with 1 if the TTL
+ * was removed, -1 if the field has no TTL, -2 if the field (or the key)
+ * does not exist. */
+void hpersistCommand(client *c) {
+    robj *o;
+    int first, j, persisted = 0;
+
+    if ((first = hashParseFieldsOrReply(c,2)) == -1) return;
+    o = lookupKeyWrite(c->db,c->argv[1]);
+    if (o != NULL && checkType(c,o,OBJ_HASH)) return;
+
+    addReplyMultiBulkLen(c,c->argc-first);
+    for (j = first; j < c->argc; j++) {
+        if (o == NULL || !hashTypeExists(o,c->argv[j])) {
+            addReplyLongLong(c,-2);
+        } else if (hashRemoveFieldExpire(c->db,c->argv[1],c->argv[j]->ptr)) {
+            addReplyLongLong(c,1);
+            persisted++;
+        } else {
+            addReplyLongLong(c,-1);
+        }
+    }
+    if (persisted) {
+        signalModifiedKey(c->db,c->argv[1]);
+        notifyKeyspaceEvent(NOTIFY_HASH,"hpersist",c->argv[1],c->db->id);
+        server.dirty += persisted;
+    }
+}
@@ -307,7 +307,7 @@ void llenCommand(client *c) {
 }
 
 void lindexCommand(client *c) {
-    robj *o = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk);
+    robj *o = lookupKeyReadOrReply(c,c->argv[1],shared.null[c->resp]);
     if (o == NULL || checkType(c,o,OBJ_LIST)) return;
     long index;
     robj *value = NULL;
@@ -326,7 +326,7 @@ void lindexCommand(client *c) {
             addReplyBulk(c,value);
             decrRefCount(value);
         } else {
-            addReply(c,shared.nullbulk);
+            addReply(c,shared.null[c->resp]);
         }
     } else {
         serverPanic("Unknown list encoding");
@@ -359,13 +359,99 @@ void lsetCommand(client *c) {
     }
 }
 
+/* Reply with up to 'count' elements popped from the head or the tail of the
+ * list 'o', in the order a sequence of single pops would return them.
+ *
+ * The entries are emitted straight from the ziplist of every node, without
+ * creating an object per element, and the popped range is then released with
+ * a single quicklistDelRange() call, that drops the fully covered nodes as a
+ * whole instead of deleting one entry at a time.
+ *
+ * The function returns the number of elements actually popped. */
+static long listPopRangeAndReply(client *c, robj *o, long count, int where) {
+    long llen = listTypeLength(o);
+    long rangelen = (count > llen) ? llen : count;
+    listTypeEntry entry;
+    listTypeIterator *li;
+    long j;
+
+    addReplyMultiBulkLen(c,rangelen);
+    if (rangelen == 0) return 0;
+
+    if (o->encoding == OBJ_ENCODING_QUICKLIST) {
+        /* Head pops walk towards the tail starting at index 0, tail pops
+         * walk towards the head starting at the last element. */
+        li = listTypeInitIterator(o,(where == LIST_HEAD) ? 0 : -1,
+                                  (where == LIST_HEAD) ? LIST_TAIL : LIST_HEAD);
+        for (j = 0; j < rangelen; j++) {
+            serverAssert(listTypeNext(li,&entry));
+            if (entry.entry.value) {
+                addReplyBulkCBuffer(c,entry.entry.value,entry.entry.sz);
+            } else {
+                addReplyBulkLongLong(c,entry.entry.longval);
+            }
+        }
+        listTypeReleaseIterator(li);
+        quicklistDelRange(o->ptr,(where == LIST_HEAD) ? 0 : -rangelen,
+                          rangelen);
+    } else {
+        serverPanic("Unknown list encoding");
+    }
+    return rangelen;
+}
+
+/* Pop up to 'count' elements from the list stored at 'key' (already looked
+ * up as 'o'), replying with them and taking care of notifications, key
+ * deletion and dirty counter. Returns the number of popped elements. */
+static long listPopCountAndReply(client *c, robj *key, robj *o, long count,
+                                 int where)
+{
+    char *event = (where == LIST_HEAD) ? "lpop" : "rpop";
+    long popped = listPopRangeAndReply(c,o,count,where);
+
+    if (popped == 0) return 0;
+    notifyKeyspaceEvent(NOTIFY_LIST,event,key,c->db->id);
+    if (listTypeLength(o) == 0) {
+        notifyKeyspaceEvent(NOTIFY_GENERIC,"del",key,c->db->id);
+        dbDelete(c->db,key);
+    }
+    signalModifiedKey(c->db,key);
+    server.dirty += popped;
+    return popped;
+}
+
+/* LPOP/RPOP key [count] */
 void popGenericCommand(client *c, int where) {
-    robj *o = lookupKeyWriteOrReply(c,c->argv[1],shared.nullbulk);
+    long count = 0;
+    robj *o;
+
+    if (c->argc > 3) {
+        addReplyErrorFormat(c,"wrong number of arguments for '%s' command",
+                            c->cmd->name);
+        return;
+    } else if (c->argc == 3) {
+        if (getLongFromObjectOrReply(c,c->argv[2],&count,NULL) != C_OK)
+            return;
+        if (count < 0) {
+            addReplyError(c,"value is out of range, must be positive");
+            return;
+        }
+
+        /* Without the count argument the reply is a single bulk, with it
+         * the reply is always an array, or a null array if the key does
+         * not exist. */
+        o = lookupKeyWriteOrReply(c,c->argv[1],shared.nullarray[c->resp]);
+        if (o == NULL || checkType(c,o,OBJ_LIST)) return;
+        listPopCountAndReply(c,c->argv[1],o,count,where);
+        return;
+    }
+
+    o = lookupKeyWriteOrReply(c,c->argv[1],shared.null[c->resp]);
     if (o == NULL || checkType(c,o,OBJ_LIST)) return;
 
     robj *value = listTypePop(o,where);
     if (value == NULL) {
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
     } else {
         char *event = (where == LIST_HEAD) ? "lpop" : "rpop";
 
@@ -390,6 +476,72 @@ void rpopCommand(client *c) {
     popGenericCommand(c,LIST_TAIL);
 }
 
+/* LMPOP numkeys key [key ...] LEFT|RIGHT [COUNT count]
+ *
+ * Pop up to 'count' elements (one by default) from the first non empty list
+ * among the given keys. The reply is a two elements array with the name of
+ * the key and the array of popped elements, or a null array if all the lists
+ * are empty. */
+void lmpopCommand(client *c) {
+    long numkeys, count = 1;
+    int where, j;
+
+    if (getLongFromObjectOrReply(c,c->argv[1],&numkeys,NULL) != C_OK) return;
+    if (numkeys <= 0 || numkeys > c->argc-3) {
+        addReplyError(c,"numkeys should be greater than 0 and no more than "
+                        "the number of keys given");
+        return;
+    }
+
+    j = 2+numkeys;
+    if (!strcasecmp(c->argv[j]->ptr,"left")) {
+        where = LIST_HEAD;
+    } else if (!strcasecmp(c->argv[j]->ptr,"right")) {
+        where = LIST_TAIL;
+    } else {
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+    j++;
+    if (j < c->argc) {
+        if (j+2 != c->argc || strcasecmp(c->argv[j]->ptr,"count")) {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+        if (getLongFromObjectOrReply(c,c->argv[j+1],&count,NULL) != C_OK)
+            return;
+        if (count <= 0) {
+            addReplyError(c,"count should be greater than 0");
+            return;
+        }
+    }
+
+    for (j = 2; j < 2+numkeys; j++) {
+        robj *key = c->argv[j];
+        robj *o = lookupKeyWrite(c->db,key);
+
+        if (o == NULL) continue;
+        if (checkType(c,o,OBJ_LIST)) return;
+        if (listTypeLength(o) == 0) continue;
+
+        incrRefCount(key);
+        addReplyMultiBulkLen(c,2);
+        addReplyBulk(c,key);
+        count = listPopCountAndReply(c,key,o,count,where);
+
+        /* Replicate the command as a plain LPOP/RPOP with the number of
+         * elements actually popped, that is deterministic and does not
+         * require slaves and the AOF to scan the key list again. */
+        robj *countobj = createStringObjectFromLongLong(count);
+        rewriteClientCommandVector(c,3,
+            (where == LIST_HEAD) ? shared.lpop : shared.rpop,key,countobj);
+        decrRefCount(countobj);
+        decrRefCount(key);
+        return;
+    }
+    addReply(c,shared.nullarray[c->resp]);
+}
+
 void lrangeCommand(client *c) {
     robj *o;
     long start, end, llen, rangelen;
@@ -526,6 +678,114 @@ void lremCommand(client *c) {
     addReplyLongLong(c,removed);
 }
 
+/* LPOS key element [RANK rank] [COUNT num-matches] [MAXLEN len]
+ *
+ * Return the index of the first element matching 'element'. RANK selects
+ * which match to start from (negative values scan from the tail), COUNT
+ * returns up to the specified number of matches as an array (zero means all
+ * the matches), and MAXLEN limits the number of compared elements. */
+void lposCommand(client *c) {
+    robj *o, *ele;
+    ele = c->argv[2];
+    int direction = LIST_TAIL;
+    long rank = 1, count = -1, maxlen = 0; /* Count -1: option not given. */
+
+    /* Parse the optional arguments. */
+    for (int j = 3; j < c->argc; j++) {
+        char *opt = c->argv[j]->ptr;
+        int moreargs = (c->argc-1)-j;
+
+        if (!strcasecmp(opt,"RANK") && moreargs) {
+            j++;
+            if (getLongFromObjectOrReply(c,c->argv[j],&rank,NULL) != C_OK)
+                return;
+            if (rank == 0 || rank == LONG_MIN) {
+                addReplyError(c,"RANK can't be zero: use 1 to start from "
+                                "the first match, 2 from the second ... "
+                                "or use negative to start from the end of "
+                                "the list");
+                return;
+            }
+        } else if (!strcasecmp(opt,"COUNT") && moreargs) {
+            j++;
+            if (getLongFromObjectOrReply(c,c->argv[j],&count,NULL) != C_OK)
+                return;
+            if (count < 0) {
+                addReplyError(c,"COUNT can't be negative");
+                return;
+            }
+        } else if (!strcasecmp(opt,"MAXLEN") && moreargs) {
+            j++;
+            if (getLongFromObjectOrReply(c,c->argv[j],&maxlen,NULL) != C_OK)
+                return;
+            if (maxlen < 0) {
+                addReplyError(c,"MAXLEN can't be negative");
+                return;
+            }
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    /* A negative rank means start from the tail. */
+    if (rank < 0) {
+        rank = -rank;
+        direction = LIST_HEAD;
+    }
+
+    /* We return NULL or an empty array if there is no such key (or
+     * if we find no matches, depending on the presence of the COUNT option. */
+    if ((o = lookupKeyRead(c->db,c->argv[1])) == NULL) {
+        if (count != -1)
+            addReply(c,shared.emptymultibulk);
+        else
+            addReply(c,shared.null[c->resp]);
+        return;
+    }
+    if (checkType(c,o,OBJ_LIST)) return;
+
+    /* If we got the COUNT option, prepare to emit an array. */
+    void *arraylenptr = NULL;
+    if (count != -1) arraylenptr = addDeferredMultiBulkLength(c);
+
+    /* Seek the element. */
+    listTypeIterator *li;
+    li = listTypeInitIterator(o,direction == LIST_HEAD ? -1 : 0,direction);
+    listTypeEntry entry;
+    long llen = listTypeLength(o);
+    long index = 0, matches = 0, matchindex = -1, arraylen = 0;
+    while (listTypeNext(li,&entry) && (maxlen == 0 || index < maxlen)) {
+        if (listTypeEqual(&entry,ele)) {
+            matches++;
+            matchindex = (direction == LIST_TAIL) ? index : llen - index - 1;
+            if (matches >= rank) {
+                if (arraylenptr) {
+                    arraylen++;
+                    addReplyLongLong(c,matchindex);
+                    if (count && matches-rank+1 >= count) break;
+                } else {
+                    break;
+                }
+            }
+        }
+        index++;
+        matchindex = -1; /* Remember if we exit the loop without a match. */
+    }
+    listTypeReleaseIterator(li);
+
+    /* Reply to the client. Note that arraylenptr is not NULL only if
+     * the COUNT option was selected. */
+    if (arraylenptr != NULL) {
+        setDeferredMultiBulkLength(c,arraylenptr,arraylen);
+    } else {
+        if (matchindex != -1)
+            addReplyLongLong(c,matchindex);
+        else
+            addReply(c,shared.null[c->resp]);
+    }
+}
+
 /* This is the semantic of this command:
  *  RPOPLPUSH srclist dstlist:
  *    IF LLEN(srclist) > 0
@@ -559,13 +819,13 @@ void rpoplpushHandlePush(client *c, robj *dstkey, robj *dstobj, robj *value) {
 
 void rpoplpushCommand(client *c) {
     robj *sobj, *value;
-    if ((sobj = lookupKeyWriteOrReply(c,c->argv[1],shared.nullbulk)) == NULL ||
+    if ((sobj = lookupKeyWriteOrReply(c,c->argv[1],shared.null[c->resp])) == NULL ||
         checkType(c,sobj,OBJ_LIST)) return;
 
     if (listTypeLength(sobj) == 0) {
         /* This may only happen after loading very old RDB files. Recent
          * versions of Redis delete keys of empty lists. */
-        addReply(c,shared.nullbulk);
+        addReply(c,shared.null[c->resp]);
     } else {
         robj *dobj = lookupKeyWrite(c->db,c->argv[2]);
         robj *touchedkey = c->argv[1];
@@ -920,7 +1180,7 @@ void blockingPopGenericCommand(client *c, int where) {
     /* If we are inside a MULTI/EXEC and the list is empty the only thing
      * we can do is treating it as a timeout (even with timeout 0). */
     if (c->flags & CLIENT_MULTI) {
-        addReply(c,shared.nullmultibulk);
+        addReply(c,shared.nullarray[c->resp]);
         return;
     }
 
@@ -948,7 +1208,7 @@ void brpoplpushCommand(client *c) {
         if (c->flags & CLIENT_MULTI) {
             /* Blocking against an empty list in a multi state
              * returns immediately. */
-            addReply(c, shared.nullbulk);
+            addReply(c, shared.null[c->resp]);
         } else {
             /* The list is empty and the client blocks. */
             blockForKeys(c, c->argv + 1, 1, timeout, c->argv[2]);
@@ -43,6 +43,166 @@
 #include "server.h"
 #include <math.h> /* isnan(), isinf() */
 
+/*-----------------------------------------------------------------------------
+ * Chunked strings API
+ *----------------------------------------------------------------------------*/
+
+/* Make room for at least 'count' chunk pointers. */
+static void chunkedStringReserve(chunkedString *cs, size_t count) {
+    if (count <= cs->alloc) return;
+    cs->alloc = cs->alloc ? cs->alloc*2 : 4;
+    if (cs->alloc < count) cs->alloc = count;
+    cs->chunks = zrealloc(cs->chunks,sizeof(robj*)*cs->alloc);
+}
+
+/* Create a new chunk holding 'len' zero bytes. The chunk is always allocated
+ * with its final size, so that appending to it never reallocates. */
+static robj *chunkedStringNewChunk(size_t len) {
+    sds s = sdsnewlen(NULL,OBJ_STRING_CHUNK_SIZE);
+
+    sdssetlen(s,len);
+    s[len] = '\0';
+    return createObject(OBJ_STRING,s);
+}
+
+/* Return the chunk at 'idx' ready to be modified, that is, duplicated if it
+ * is referenced elsewhere, for instance by a client reply. */
+static robj *chunkedStringUnshareChunk(chunkedString *cs, size_t idx) {
+    robj *chunk = cs->chunks[idx];
+
+    if (chunk->refcount != 1) {
+        robj *copy = chunkedStringNewChunk(sdslen(chunk->ptr));
+
+        memcpy(copy->ptr,chunk->ptr,sdslen(chunk->ptr));
+        decrRefCount(chunk);
+        cs->chunks[idx] = chunk = copy;
+    }
+    return chunk;
+}
+
+/* Grow the string to 'len' bytes, padding with zeroes. */
+void chunkedStringGrowZero(chunkedString *cs, size_t len) {
+    size_t numchunks = (len+OBJ_STRING_CHUNK_SIZE-1)/OBJ_STRING_CHUNK_SIZE;
+
+    if (len <= cs->len) return;
+    chunkedStringReserve(cs,numchunks);
+
+    /* Fill the last chunk, then add new ones. */
+    if (cs->numchunks) {
+        robj *last = chunkedStringUnshareChunk(cs,cs->numchunks-1);
+        size_t used = sdslen(last->ptr);
+        size_t fill = OBJ_STRING_CHUNK_SIZE-used;
+
+        if (fill > len-cs->len) fill = len-cs->len;
+        memset((char*)last->ptr+used,0,fill);
+        sdsIncrLen(last->ptr,fill);
+        cs->len += fill;
+    }
+    while (cs->len < len) {
+        size_t chunklen = len-cs->len;
+
+        if (chunklen > OBJ_STRING_CHUNK_SIZE) chunklen = OBJ_STRING_CHUNK_SIZE;
+        cs->chunks[cs->numchunks++] = chunkedStringNewChunk(chunklen);
+        cs->len += chunklen;
+    }
+}
+
+/* Create a chunked string with a copy of 'len' bytes at 'ptr'. */
+chunkedString *chunkedStringNew(const char *ptr, size_t len) {
+    chunkedString *cs = zmalloc(sizeof(*cs));
+
+    cs->len = 0;
+    cs->numchunks = 0;
+    cs->alloc = 0;
+    cs->chunks = NULL;
+    if (len) chunkedStringWrite(cs,0,ptr,len);
+    return cs;
+}
+
+/* Duplicate a chunked string. The chunks are shared and will be copied only
+ * when one of the two strings modifies them. */
+chunkedString *chunkedStringDup(chunkedString *cs) {
+    chunkedString *dup = chunkedStringNew(NULL,0);
+    size_t j;
+
+    chunkedStringReserve(dup,cs->numchunks);
+    for (j = 0; j < cs->numchunks; j++) {
+        dup->chunks[j] = cs->chunks[j];
+        incrRefCount(cs->chunks[j]);
+    }
+    dup->numchunks = cs->numchunks;
+    dup->len = cs->len;
+    return dup;
+}
+
+void chunkedStringFree(chunkedString *cs) {
+    size_t j;
+
+    for (j = 0; j < cs->numchunks; j++) decrRefCount(cs->chunks[j]);
+    zfree(cs->chunks);
+    zfree(cs);
+}
+
+/* Copy 'len' bytes from 'p' at 'offset', growing the string and padding it
+ * with zeroes if needed, like SETRANGE does. Only the chunks in the written
+ * range are touched. */
+void chunkedStringWrite(chunkedString *cs, size_t offset, const void *p,
+                        size_t len)
+{
+    const char *src = p;
+
+    chunkedStringGrowZero(cs,offset+len);
+    while (len) {
+        size_t idx = offset/OBJ_STRING_CHUNK_SIZE;
+        size_t off = offset%OBJ_STRING_CHUNK_SIZE;
+        size_t count = OBJ_STRING_CHUNK_SIZE-off;
+        robj *chunk = chunkedStringUnshareChunk(cs,idx);
+
+        if (count > len) count = len;
+        memcpy((char*)chunk->ptr+off,src,count);
+        src += count;
+        offset += count;
+        len -= count;
+    }
+}
+
+/* Copy up to 'len' bytes starting at 'offset' into 'dst'. Returns the number
+ * of bytes copied, that is less than 'len' when the string is shorter. */
+size_t chunkedStringRead(chunkedString *cs, size_t offset, void *dst,
+                         size_t len)
+{
+    char *p = dst;
+    size_t copied = 0;
+
+    if (offset >= cs->len) return 0;
+    if (len > cs->len-offset) len = cs->len-offset;
+    while (copied < len) {
+        size_t idx = offset/OBJ_STRING_CHUNK_SIZE;
+        size_t off = offset%OBJ_STRING_CHUNK_SIZE;
+        size_t count = OBJ_STRING_CHUNK_SIZE-off;
+
+        if (count > len-copied) count = len-copied;
+        memcpy(p+copied,(char*)cs->chunks[idx]->ptr+off,count);
+        copied += count;
+        offset += count;
+    }
+    return copied;
+}
+
+/* Return the whole string as a single sds. */
+sds chunkedStringToSds(chunkedString *cs) {
+    sds s = sdsnewlen(NULL,cs->len);
+
+    chunkedStringRead(cs,0,s,cs->len);
+    return s;
+}
+
+/* Return true if a string of 'len' bytes should use the chunked encoding. */
+int stringNeedsChunking(size_t len) {
+    return server.string_chunk_threshold &&
+           len > server.string_chunk_threshold;
+}
+
 /*-----------------------------------------------------------------------------
  * String Commands
  *----------------------------------------------------------------------------*/
@@ -90,10 +250,12 @@ void setGenericCommand(client *c, int flags, robj *key, robj *val, robj *expire,
         if (unit == UNIT_SECONDS) milliseconds *= 1000;
     }
 
-    if ((flags & OBJ_SET_NX && lookupKeyWrite(c->db,key) != NULL) ||
-        (flags & OBJ_SET_XX && lookupKeyWrite(c->db,key) == NULL))
+    if ((flags & OBJ_SET_NX &&
+         lookupKeyWriteWithFlags(c->db,key,LOOKUP_CHUNKED) != NULL) ||
+        (flags & OBJ_SET_XX &&
+         lookupKeyWriteWithFlags(c->db,key,LOOKUP_CHUNKED) == NULL))
     {
-        addReply(c, abort_reply ? abort_reply : shared.nullbulk);
+        addReply(c, abort_reply ? abort_reply : shared.null[c->resp]);
         return;
     }
     setKey(c->db,key,val);
@@ -170,8 +332,10 @@ void psetexCommand(client *c) {
 int getGenericCommand(client *c) {
     robj *o;
 
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk)) == NULL)
+    if ((o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED)) == NULL) {
+        addReply(c,shared.null[c->resp]);
         return C_OK;
+    }
 
     if (o->type != OBJ_STRING) {
         addReply(c,shared.wrongtypeerr);
@@ -207,7 +371,7 @@ void setrangeCommand(client *c) {
         return;
     }
 
-    o = lookupKeyWrite(c->db,c->argv[1]);
+    o = lookupKeyWriteWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED);
     if (o == NULL) {
         /* Return 0 when setting nothing on a non-existing string */
         if (sdslen(value) == 0) {
@@ -219,7 +383,10 @@ void setrangeCommand(client *c) {
         if (checkStringLength(c,offset+sdslen(value)) != C_OK)
             return;
 
-        o = createObject(OBJ_STRING,sdsnewlen(NULL, offset+sdslen(value)));
+        if (stringNeedsChunking(offset+sdslen(value)))
+            o = createChunkedStringObject(NULL,0);
+        else
+            o = createObject(OBJ_STRING,sdsnewlen(NULL,offset+sdslen(value)));
         dbAdd(c->db,c->argv[1],o);
     } else {
         size_t olen;
@@ -239,19 +406,29 @@ void setrangeCommand(client *c) {
         if (checkStringLength(c,offset+sdslen(value)) != C_OK)
             return;
 
-        /* Create a copy when the object is shared or encoded. */
-        o = dbUnshareStringValue(c->db,c->argv[1],o);
+        /* Create a copy when the object is shared or encoded. Strings
+         * growing past the chunking threshold switch to chunks. */
+        if (o->encoding == OBJ_ENCODING_CHUNKED ||
+            (offset+sdslen(value) > olen &&
+             stringNeedsChunking(offset+sdslen(value))))
+            o = dbChunkStringValue(c->db,c->argv[1],o);
+        else
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
     }
 
     if (sdslen(value) > 0) {
-        o->ptr = sdsgrowzero(o->ptr,offset+sdslen(value));
-        memcpy((char*)o->ptr+offset,value,sdslen(value));
+        if (o->encoding == OBJ_ENCODING_CHUNKED) {
+            chunkedStringWrite(o->ptr,offset,value,sdslen(value));
+        } else {
+            o->ptr = sdsgrowzero(o->ptr,offset+sdslen(value));
+            memcpy((char*)o->ptr+offset,value,sdslen(value));
+        }
         signalModifiedKey(c->db,c->argv[1]);
         notifyKeyspaceEvent(NOTIFY_STRING,
             "setrange",c->argv[1],c->db->id);
         server.dirty++;
     }
-    addReplyLongLong(c,sdslen(o->ptr));
+    addReplyLongLong(c,stringObjectLen(o));
 }
 
 void getrangeCommand(client *c) {
@@ -264,12 +441,18 @@ void getrangeCommand(client *c) {
         return;
     if (getLongLongFromObjectOrReply(c,c->argv[3],&end,NULL) != C_OK)
         return;
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptybulk)) == NULL ||
-        checkType(c,o,OBJ_STRING)) return;
+    if ((o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED)) == NULL) {
+        addReply(c,shared.emptybulk);
+        return;
+    }
+    if (checkType(c,o,OBJ_STRING)) return;
 
     if (o->encoding == OBJ_ENCODING_INT) {
         str = llbuf;
         strlen = ll2string(llbuf,sizeof(llbuf),(long)o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        str = NULL;
+        strlen = ((chunkedString*)o->ptr)->len;
     } else {
         str = o->ptr;
         strlen = sdslen(str);
@@ -290,6 +473,8 @@ void getrangeCommand(client *c) {
      * nothing can be returned is: start > end. */
     if (start > end || strlen == 0) {
         addReply(c,shared.emptybulk);
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        addReplyBulkChunkedString(c,o->ptr,start,end-start+1);
     } else {
         addReplyBulkCBuffer(c,(char*)str+start,end-start+1);
     }
@@ -302,10 +487,10 @@ void mgetCommand(client *c) {
     for (j = 1; j < c->argc; j++) {
         robj *o = lookupKeyRead(c->db,c->argv[j]);
         if (o == NULL) {
-            addReply(c,shared.nullbulk);
+            addReply(c,shared.null[c->resp]);
         } else {
             if (o->type != OBJ_STRING) {
-                addReply(c,shared.nullbulk);
+                addReply(c,shared.null[c->resp]);
             } else {
                 addReplyBulk(c,o);
             }
@@ -324,7 +509,7 @@ void msetGenericCommand(client *c, int nx) {
      * set nothing at all if at least one already key exists. */
     if (nx) {
         for (j = 1; j < c->argc; j += 2) {
-            if (lookupKeyWrite(c->db,c->argv[j]) != NULL) {
+            if (lookupKeyWriteWithFlags(c->db,c->argv[j],LOOKUP_CHUNKED)) {
                 busykeys++;
             }
         }
@@ -449,7 +634,7 @@ void appendCommand(client *c) {
     size_t totlen;
     robj *o, *append;
 
-    o = lookupKeyWrite(c->db,c->argv[1]);
+    o = lookupKeyWriteWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED);
     if (o == NULL) {
         /* Create the key */
         c->argv[2] = tryObjectEncoding(c->argv[2]);
@@ -467,10 +652,20 @@ void appendCommand(client *c) {
         if (checkStringLength(c,totlen) != C_OK)
             return;
 
-        /* Append the value */
-        o = dbUnshareStringValue(c->db,c->argv[1],o);
-        o->ptr = sdscatlen(o->ptr,append->ptr,sdslen(append->ptr));
-        totlen = sdslen(o->ptr);
+        /* Append the value. Strings growing past the chunking threshold
+         * switch to chunks, so that they are no longer reallocated and
+         * copied as a whole on every append. */
+        if (o->encoding == OBJ_ENCODING_CHUNKED ||
+            stringNeedsChunking(totlen))
+        {
+            o = dbChunkStringValue(c->db,c->argv[1],o);
+            chunkedStringWrite(o->ptr,stringObjectLen(o),append->ptr,
+                               sdslen(append->ptr));
+        } else {
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
+            o->ptr = sdscatlen(o->ptr,append->ptr,sdslen(append->ptr));
+        }
+        totlen = stringObjectLen(o);
     }
     signalModifiedKey(c->db,c->argv[1]);
     notifyKeyspaceEvent(NOTIFY_STRING,"append",c->argv[1],c->db->id);
@@ -480,7 +675,10 @@ void appendCommand(client *c) {
 
 void strlenCommand(client *c) {
     robj *o;
-    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
-        checkType(c,o,OBJ_STRING)) return;
+    if ((o = lookupKeyReadWithFlags(c->db,c->argv[1],LOOKUP_CHUNKED)) == NULL) {
+        addReply(c,shared.czero);
+        return;
+    }
+    if (checkType(c,o,OBJ_STRING)) return;
     addReplyLongLong(c,stringObjectLen(o));
 }
@@ -1417,7 +1417,7 @@ void zaddGenericCommand(client *c, int flags) {
         if (processed)
             addReplyDouble(c, score);
         else
-            addReply(c, shared.nullbulk);
+            addReply(c, shared.null[c->resp]);
     } else { /* ZADD. */
         addReplyLongLong(c, ch ? added + updated : added);
     }
@@ -2887,12 +2887,12 @@ void zscoreCommand(client *c) {
     robj *zobj;
     double score;
 
-    if ((zobj = lookupKeyReadOrReply(c, key, shared.nullbulk)) == NULL ||
+    if ((zobj = lookupKeyReadOrReply(c, key, shared.null[c->resp])) == NULL ||
         checkType(c, zobj, OBJ_ZSET))
         return;
 
     if (zsetScore(zobj, c->argv[2], &score) == C_ERR) {
-        addReply(c, shared.nullbulk);
+        addReply(c, shared.null[c->resp]);
     } else {
         addReplyDouble(c, score);
     }
@@ -2905,7 +2905,7 @@ void zrankGenericCommand(client *c, int reverse) {
     unsigned long llen;
     unsigned long rank;
 
-    if ((zobj = lookupKeyReadOrReply(c, key, shared.nullbulk)) == NULL ||
+    if ((zobj = lookupKeyReadOrReply(c, key, shared.null[c->resp])) == NULL ||
         checkType(c, zobj, OBJ_ZSET))
         return;
     llen = zsetLength(zobj);
@@ -2935,7 +2935,7 @@ void zrankGenericCommand(client *c, int reverse) {
             else
                 addReplyLongLong(c, rank - 1);
         } else {
-            addReply(c, shared.nullbulk);
+            addReply(c, shared.null[c->resp]);
         }
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
@@ -2954,7 +2954,7 @@ void zrankGenericCommand(client *c, int reverse) {
             else
                 addReplyLongLong(c, rank - 1);
         } else {
-            addReply(c, shared.nullbulk);
+            addReply(c, shared.null[c->resp]);
         }
     } else {
         serverPanic("Unknown sorted set encoding");
@@ -0,0 +1,334 @@
+/* tracking.c - Client side caching: keys tracking and invalidation
+ *
+ * Copyright (c) 2026, Redis contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "server.h"
+
+/* The tracking table is made of slots: every key name is hashed into one
+ * of TRACKING_TABLE_SIZE slots, and for every slot we remember the IDs of the
+ * clients that read keys hashing to it. Only slots actually used are stored
+ * (the table is a dictionary mapping the slot number to an intset of client
+ * IDs), so the memory used is proportional to the number of keys tracked,
+ * and is capped by the tracking-table-max-keys option.
+ *
+ * When a key is modified, the clients in the slot are sent an invalidation
+ * message with the key name, and the slot is cleared: clients will be
+ * tracked again for this slot once they fetch one of its keys again. Since
+ * different keys may hash to the same slot, clients may receive invalidation
+ * messages for keys they never read: this is harmless.
+ *
+ * Clients in broadcasting mode (BCAST) are not tracked per key at all:
+ * they register a set of prefixes instead, and receive invalidation messages
+ * for every key modified that matches one of them. The empty prefix
+ * matches every key.
+ *
+ * RESP3 clients receive invalidation messages as push replies in the same
+ * connection. Since RESP2 has no way to send out of band data in the middle
+ * of a normal request-response stream, RESP2 clients redirect invalidation
+ * messages to another connection (CLIENT TRACKING on REDIRECT <id>), that
+ * should be subscribed to the __redis__:invalidate channel: messages have
+ * the same format of Pub/Sub messages for this channel. A null message means
+ * that the client should flush its whole cache. */
+
+#define TRACKING_TABLE_BITS 24
+#define TRACKING_TABLE_SIZE (1<<TRACKING_TABLE_BITS)
+#define TRACKING_TABLE_MASK (TRACKING_TABLE_SIZE-1)
+#define TRACKING_CHANNEL_NAME "__redis__:invalidate"
+
+dict *TrackingTable = NULL;        /* Slot -> intset of client IDs. */
+dict *PrefixTable = NULL;          /* Prefix -> intset of client IDs (BCAST). */
+unsigned long TrackingClients = 0; /* Number of clients with tracking on. */
+
+unsigned int dictSdsHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+void dictSdsDestructor(void *privdata, void *val);
+void dictVanillaFree(void *privdata, void *val);
+
+/* The tracking table is keyed by slot number, stored in the key pointer.
+ * Slots are already the output of a hash function, so they are used as
+ * their own hash. */
+unsigned int dictTrackingSlotHash(const void *key) {
+    return (unsigned int)(uintptr_t)key;
+}
+
+/* Tracking table type: slot -> intset of client IDs. */
+dictType trackingTableDictType = {
+    dictTrackingSlotHash,       /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    NULL,                       /* key destructor */
+    dictVanillaFree,            /* val destructor */
+    NULL                        /* allow to expand */
+};
+
+/* Prefix table type: sds prefix -> intset of client IDs. */
+dictType trackingPrefixDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    dictVanillaFree,            /* val destructor */
+    NULL                        /* allow to expand */
+};
+
+/* Return the slot of the tracking table the key name hashes to. */
+static uintptr_t trackingKeySlot(sds key) {
+    return dictGenHashFunction(key,sdslen(key)) & TRACKING_TABLE_MASK;
+}
+
+/* Add the client ID to the intset stored as value of 'de'. */
+static void trackingAddClientID(dict *d, dictEntry *de, uint64_t id) {
+    intset *ids = dictGetVal(de);
+    dictSetVal(d,de,intsetAdd(ids,(int64_t)id,NULL));
+}
+
+/* Remove all the tracking state of the client, and turn tracking off.
+ * Note that the client ID is not removed from the tracking table slots:
+ * this would require remembering all the slots of every client. Stale IDs
+ * are just skipped (and dropped) when the slot is invalidated. */
+void disableTracking(client *c) {
+    if (!(c->flags & CLIENT_TRACKING)) return;
+    if (c->client_tracking_prefixes) {
+        listIter li;
+        listNode *ln;
+
+        listRewind(c->client_tracking_prefixes,&li);
+        while((ln = listNext(&li)) != NULL) {
+            sds prefix = listNodeValue(ln);
+            dictEntry *de = dictFind(PrefixTable,prefix);
+
+            if (de == NULL) continue;
+            dictSetVal(PrefixTable,de,
+                intsetRemove(dictGetVal(de),(int64_t)c->id,NULL));
+            if (intsetLen(dictGetVal(de)) == 0) dictDelete(PrefixTable,prefix);
+        }
+        listRelease(c->client_tracking_prefixes);
+        c->client_tracking_prefixes = NULL;
+    }
+    c->flags &= ~(CLIENT_TRACKING|CLIENT_TRACKING_BCAST);
+    c->client_tracking_redirection = 0;
+    TrackingClients--;
+}
+
+/* Enable tracking for the client, sending invalidation messages to the
+ * client with the specified ID. When 'bcast' is true the client is
+ * registered for all the prefixes in 'prefixes' (or for every key if
+ * 'numprefixes' is zero), instead of being tracked key by key. */
+void enableTracking(client *c, uint64_t redirect_to, int bcast,
+                    robj **prefixes, int numprefixes)
+{
+    int j;
+
+    disableTracking(c);
+    if (TrackingTable == NULL) {
+        TrackingTable = dictCreate(&trackingTableDictType,NULL);
+        PrefixTable = dictCreate(&trackingPrefixDictType,NULL);
+    }
+    c->flags |= CLIENT_TRACKING;
+    c->client_tracking_redirection = redirect_to;
+    TrackingClients++;
+    if (!bcast) return;
+
+    c->flags |= CLIENT_TRACKING_BCAST;
+    c->client_tracking_prefixes = listCreate();
+    listSetFreeMethod(c->client_tracking_prefixes,
+        (void (*)(void*))sdsfree);
+    for (j = 0; j < (numprefixes ? numprefixes : 1); j++) {
+        sds prefix = numprefixes ? sdsdup(prefixes[j]->ptr) : sdsempty();
+        dictEntry *de = dictFind(PrefixTable,prefix);
+
+        if (de == NULL) {
+            de = dictAddRaw(PrefixTable,sdsdup(prefix));
+            dictSetVal(PrefixTable,de,intsetNew());
+        }
+        trackingAddClientID(PrefixTable,de,c->id);
+        listAddNodeTail(c->client_tracking_prefixes,prefix);
+    }
+}
+
+/* Called after a read only command was executed by the client 'c' on behalf
+ * of the tracking client 'tc' (they are the same client unless the command
+ * was called from a Lua script): remember that 'tc' fetched the keys
+ * of the command, so that it will be notified when they are modified. */
+void trackingRememberKeys(client *tc, client *c) {
+    int numkeys, *keys, j;
+
+    keys = getKeysFromCommand(c->cmd,c->argv,c->argc,&numkeys);
+    if (keys == NULL) return;
+    for (j = 0; j < numkeys; j++) {
+        uintptr_t slot = trackingKeySlot(c->argv[keys[j]]->ptr);
+        dictEntry *de = dictFind(TrackingTable,(void*)slot);
+
+        if (de == NULL) {
+            de = dictAddRaw(TrackingTable,(void*)slot);
+            dictSetVal(TrackingTable,de,intsetNew());
+        }
+        trackingAddClientID(TrackingTable,de,tc->id);
+    }
+    getKeysFreeResult(keys);
+}
+
+/* Send the invalidation message for 'key' to the tracking client 'c', or
+ * to the client it is redirecting to. A NULL key means the client should
+ * flush its whole cache. RESP3 targets get an "invalidate" push reply with
+ * the array of keys. RESP2 targets get a Pub/Sub message, so nothing is sent
+ * if they are not in Pub/Sub mode (or if the target is gone). */
+static void sendTrackingMessage(client *c, sds key) {
+    client *target = c;
+
+    if (c->client_tracking_redirection) {
+        target = lookupClientByID(c->client_tracking_redirection);
+        if (target == NULL) return;
+    }
+
+    if (target->resp > 2) {
+        addReplyPushLen(target,2);
+        addReplyBulkCBuffer(target,"invalidate",10);
+        if (key) {
+            addReplyMultiBulkLen(target,1);
+            addReplyBulkCBuffer(target,key,sdslen(key));
+        } else {
+            addReplyNull(target);
+        }
+        return;
+    }
+    if (!(target->flags & CLIENT_PUBSUB)) return;
+
+    addReply(target,shared.mbulkhdr[3]);
+    addReply(target,shared.messagebulk);
+    addReplyBulkCString(target,TRACKING_CHANNEL_NAME);
+    if (key)
+        addReplyBulkCBuffer(target,key,sdslen(key));
+    else
+        addReplyNull(target);
+}
+
+/* Send the invalidation message for 'key' to every client in the set of
+ * IDs. Clients no longer in the expected tracking mode are skipped. */
+static void sendTrackingMessageToIDs(intset *ids, sds key, int bcast) {
+    uint32_t j;
+    int64_t id;
+
+    for (j = 0; j < intsetLen(ids); j++) {
+        client *c;
+
+        intsetGet(ids,j,&id);
+        c = lookupClientByID((uint64_t)id);
+        if (c == NULL || !(c->flags & CLIENT_TRACKING)) continue;
+        if (!!(c->flags & CLIENT_TRACKING_BCAST) != bcast) continue;
+        sendTrackingMessage(c,key);
+    }
+}
+
+/* Called by signalModifiedKey() every time a key is modified: clients that
+ * fetched keys hashing to the same slot, and broadcasting clients with a
+ * matching prefix, are sent an invalidation message. */
+void trackingInvalidateKey(robj *keyobj) {
+    sds key;
+    dictEntry *de;
+
+    if (TrackingTable == NULL) return;
+    key = keyobj->ptr;
+
+    if (dictSize(TrackingTable)) {
+        uintptr_t slot = trackingKeySlot(key);
+
+        de = dictFind(TrackingTable,(void*)slot);
+        if (de) {
+            /* Unlink the slot before sending: the table may not be
+             * touched while delivering messages. */
+            intset *ids = dictGetVal(de);
+            dictSetVal(TrackingTable,de,NULL);
+            dictDelete(TrackingTable,(void*)slot);
+            sendTrackingMessageToIDs(ids,key,0);
+            zfree(ids);
+        }
+    }
+
+    if (dictSize(PrefixTable)) {
+        dictIterator *di = dictGetIterator(PrefixTable);
+
+        while((de = dictNext(di)) != NULL) {
+            sds prefix = dictGetKey(de);
+
+            if (sdslen(prefix) > sdslen(key) ||
+                memcmp(prefix,key,sdslen(prefix)) != 0) continue;
+            sendTrackingMessageToIDs(dictGetVal(de),key,1);
+        }
+        dictReleaseIterator(di);
+    }
+}
+
+/* Called by signalFlushedDb(): every tracking client is told to flush its
+ * whole cache. The tracking table is cleared as well, since all the keys
+ * it refers to are gone (or most of them, when flushing a single DB). */
+void trackingInvalidateKeysOnFlush(int dbid) {
+    listIter li;
+    listNode *ln;
+    UNUSED(dbid);
+
+    if (TrackingClients == 0) return;
+    listRewind(server.clients,&li);
+    while((ln = listNext(&li)) != NULL) {
+        client *c = listNodeValue(ln);
+        if (c->flags & CLIENT_TRACKING) sendTrackingMessage(c,NULL);
+    }
+    dictEmpty(TrackingTable,NULL);
+}
+
+/* Called from serverCron(): if the tracking table has more slots than
+ * allowed by tracking-table-max-keys, random slots are evicted. Since we
+ * don't know the keys hashing to an evicted slot, its clients are told to
+ * flush their whole cache. */
+void trackingLimitUsedSlots(void) {
+    if (TrackingTable == NULL) return;
+    while(dictSize(TrackingTable) > server.tracking_table_max_keys) {
+        dictEntry *de = dictGetRandomKey(TrackingTable);
+        void *slot = dictGetKey(de);
+        intset *ids = dictGetVal(de);
+
+        dictSetVal(TrackingTable,de,NULL);
+        dictDelete(TrackingTable,slot);
+        sendTrackingMessageToIDs(ids,NULL,0);
+        zfree(ids);
+        server.stat_tracking_evicted_slots++;
+    }
+}
+
+/* Return the number of slots of the tracking table currently used. */
+unsigned long trackingGetUsedSlots(void) {
+    return TrackingTable ? dictSize(TrackingTable) : 0;
+}
+
+/* Return the number of clients with tracking enabled. */
+unsigned long trackingGetClientsCount(void) {
+    return TrackingClients;
+}
@@ -68,9 +68,66 @@ void zlibc_free(void *ptr) {
 #endif
 
 #if defined(__ATOMIC_RELAXED)
-#define update_zmalloc_stat_add(__n) __atomic_add_fetch(&used_memory, (__n), __ATOMIC_RELAXED)
-#define update_zmalloc_stat_sub(__n) __atomic_sub_fetch(&used_memory, (__n), __ATOMIC_RELAXED)
-#elif defined(HAVE_ATOMIC)
+/* Used memory is accounted per thread: every thread owns a slot of the
+ * used_memory_thread array, each one in its own cache line, so the main
+ * thread and the background threads freeing memory never write the same
+ * cache line. A thread updates its own slot with a plain relaxed load and
+ * store, without any locked instruction, and zmalloc_used_memory() sums the
+ * slots at read time. Note that a slot can go negative when a thread frees
+ * memory allocated by another one.
+ *
+ * Threads exceeding ZMALLOC_MAX_THREADS share the last slot, that is then
+ * updated with atomic operations. */
+#define ZMALLOC_MAX_THREADS 16
+#define ZMALLOC_CACHE_LINE 64
+
+typedef struct zmallocThreadStat {
+    long long used;
+    char padding[ZMALLOC_CACHE_LINE-sizeof(long long)];
+} zmallocThreadStat;
+
+static zmallocThreadStat used_memory_thread[ZMALLOC_MAX_THREADS]
+    __attribute__((aligned(ZMALLOC_CACHE_LINE)));
+static int used_memory_slots = 0; /* Number of slots assigned so far. */
+static __thread int used_memory_slot = -1;
+
+static int zmalloc_thread_slot(void) {
+    if (used_memory_slot == -1) {
+        int slot = __atomic_fetch_add(&used_memory_slots,1,__ATOMIC_RELAXED);
+        used_memory_slot = (slot < ZMALLOC_MAX_THREADS) ?
+                           slot : ZMALLOC_MAX_THREADS-1;
+    }
+    return used_memory_slot;
+}
+
+static void update_zmalloc_stat_delta(long long delta) {
+    int slot = zmalloc_thread_slot();
+    long long *used = &used_memory_thread[slot].used;
+
+    if (slot == ZMALLOC_MAX_THREADS-1) {
+        __atomic_add_fetch(used,delta,__ATOMIC_RELAXED);
+    } else {
+        long long old = __atomic_load_n(used,__ATOMIC_RELAXED);
+        __atomic_store_n(used,old+delta,__ATOMIC_RELAXED);
+    }
+}
+
+#define update_zmalloc_stat_alloc(__n) do { \
+    size_t _n = (__n); \
+    if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
+    update_zmalloc_stat_delta((long long)_n); \
+} while(0)
+
+#define update_zmalloc_stat_free(__n) do { \
+    size_t _n = (__n); \
+    if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
+    update_zmalloc_stat_delta(-(long long)_n); \
+} while(0)
+
+#else
+/* Without atomic builtins there is a single counter, protected by a mutex
+ * once zmalloc_enable_thread_safeness() was called. */
+#if defined(HAVE_ATOMIC)
 #define update_zmalloc_stat_add(__n) __sync_add_and_fetch(&used_memory, (__n))
 #define update_zmalloc_stat_sub(__n) __sync_sub_and_fetch(&used_memory, (__n))
 #else
@@ -111,6 +168,7 @@ void zlibc_free(void *ptr) {
 static size_t used_memory = 0;
 static int zmalloc_thread_safe = 0;
 pthread_mutex_t used_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 static void zmalloc_default_oom(size_t size) {
     fprintf(stderr, "zmalloc: Out of memory trying to allocate %zu bytes\n",
@@ -218,11 +276,27 @@ char *zstrdup(const char *s) {
     return p;
 }
 
+#if defined(__ATOMIC_RELAXED)
+size_t zmalloc_used_memory(void) {
+    int j, slots = __atomic_load_n(&used_memory_slots,__ATOMIC_RELAXED);
+    long long um = 0;
+
+    if (slots > ZMALLOC_MAX_THREADS) slots = ZMALLOC_MAX_THREADS;
+    for (j = 0; j < slots; j++)
+        um += __atomic_load_n(&used_memory_thread[j].used,__ATOMIC_RELAXED);
+    /* The slots are read while other threads may update them: the sum
+     * could be transiently inconsistent, never report a negative value. */
+    return um > 0 ? (size_t)um : 0;
+}
+
+/* Per thread accounting is always thread safe, nothing to enable. */
+void zmalloc_enable_thread_safeness(void) {}
+#else
 size_t zmalloc_used_memory(void) {
     size_t um;
 
     if (zmalloc_thread_safe) {
-#if defined(__ATOMIC_RELAXED) || defined(HAVE_ATOMIC)
+#if defined(HAVE_ATOMIC)
         um = update_zmalloc_stat_add(0);
 #else
         pthread_mutex_lock(&used_memory_mutex);
@@ -240,6 +314,7 @@ size_t zmalloc_used_memory(void) {
 void zmalloc_enable_thread_safeness(void) {
     zmalloc_thread_safe = 1;
 }
+#endif
 
 void zmalloc_set_oom_handler(void (*oom_handler)(size_t)) {
     zmalloc_oom_handler = oom_handler;
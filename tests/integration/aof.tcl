@@ -251,6 +251,29 @@ tags {"aof"} {
         }
     }
 
+    ## Test that commands replying with a null are replayed correctly
+    create_aof {
+        append_to_aof [formatCommand spop noset]
+        append_to_aof [formatCommand eval {redis.call('set',KEYS[1],'bar'); return nil} 1 foo]
+        append_to_aof [formatCommand rpush list foo]
+    }
+
+    start_server_aof [list dir $server_path aof-load-truncated no] {
+        test "AOF+null replies: Server should have been started" {
+            assert_equal 1 [is_alive $srv]
+        }
+
+        test "AOF+null replies: Keyspace should contain the values" {
+            set client [redis [dict get $srv host] [dict get $srv port]]
+            wait_for_condition 50 100 {
+                [catch {$client ping} e] == 0
+            } else {
+                fail "Loading DB is taking too much time."
+            }
+            list [$client get foo] [$client lrange list 0 -1]
+        } {bar foo}
+    }
+
     start_server {overrides {appendonly {yes} appendfilename {appendonly.aof}}} {
         test {Redis should not try to convert DEL into EXPIREAT for EXPIRE -1} {
             r set x 10
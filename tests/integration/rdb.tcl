@@ -96,3 +96,63 @@ start_server_and_kill_it [list "dir" $server_path] {
         }
     }
 }
+
+set server_path [tmpdir "server.rdb-analyze-test"]
+
+start_server [list overrides [list "dir" $server_path]] {
+    test {redis-check-rdb --analyze accounts every key of the data set} {
+        r debug populate 1000 string
+        for {set j 0} {$j < 200} {incr j} {
+            r rpush list:$j a b c
+            r hmset hash:$j field1 value1 field2 value2
+            r setex volatile:$j 1000 value
+        }
+        r hmset hfe:1 a 1 b 2 c 3
+        r hexpire hfe:1 1000 FIELDS 2 a b
+        r save
+        set dbsize [r dbsize]
+
+        set rdb [file join $server_path dump.rdb]
+        set csv [file join $server_path analyze.csv]
+        set output [exec src/redis-check-rdb --analyze --workers 4 \
+                        --csv $csv $rdb]
+        assert_match {*using 4 worker(s)*} $output
+        assert {[regexp {Keys: (\d+),} $output -> keys]}
+        assert_equal $dbsize $keys
+
+        set fp [open $csv]
+        set rows [split [string trim [read $fp]] "\n"]
+        close $fp
+        assert_match {database,type,*} [lindex $rows 0]
+        set rows [lrange $rows 1 end]
+        assert_equal $dbsize [llength $rows]
+        set names {}
+        foreach row $rows {lappend names [lindex [split $row ,] 3]}
+        assert_equal $dbsize [llength [lsort -unique $names]]
+        assert_equal 200 [llength [lsearch -all $rows {*,"volatile:*}]]
+        assert_equal 1 [llength [lsearch -all $rows {*,"hfe:1",*}]]
+    }
+}
+
+set server_path [tmpdir "server.rdb-analyze-corrupt-test"]
+
+start_server [list overrides [list "dir" $server_path]] {
+    test {redis-check-rdb --analyze reports worker errors when piped} {
+        r set lzfkey [string repeat abcd 200]
+        r save
+        set rdb [file join $server_path dump.rdb]
+
+        # Corrupt the first LZF control byte, that is after the encoding
+        # byte, the compressed length and the original length.
+        set fp [open $rdb r+]
+        fconfigure $fp -translation binary
+        set pos [string first lzfkey [read $fp]]
+        seek $fp [expr {$pos+[string length lzfkey]+4}]
+        puts -nonewline $fp "\xff"
+        close $fp
+
+        catch {exec src/redis-check-rdb --analyze --workers 1 $rdb} output
+        assert_match {*RDB ERROR DETECTED*Invalid LZF*} $output
+        assert_match {*Worker 0 failed*} $output
+    }
+}
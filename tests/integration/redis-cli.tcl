@@ -205,4 +205,16 @@ start_server {tags {"cli"}} {
         assert_equal "OK" [run_cli_with_input_file $tmpfile set key]
         assert_equal "from file" [r get key]
     }
+
+    test_nontty_cli "--memkeys with several workers reports every key once" {
+        r flushdb
+        r debug populate 5000
+        r rpush biglist {*}[lrepeat 1000 foobar]
+        set out [run_cli --memkeys --bigkeys-workers 4 --top 2]
+        assert_match {*Using 4 connection(s) to 1 node(s)*} $out
+        assert_match {*Sampled 5001 keys in the keyspace!*} $out
+        assert_match {*Biggest   list found 'biglist' has * bytes*} $out
+        assert_match {*5000 strings with * bytes*} $out
+        assert_match {*string sizes distribution (bytes):*} $out
+    }
 }
@@ -179,9 +179,12 @@ proc ::redis::redis_bulk_read {fd} {
     return $buf
 }
 
-proc ::redis::redis_multi_bulk_read {id fd} {
+# Read an aggregate reply. Maps (RESP3) are returned as a flat list of
+# fields and values, like RESP2 does.
+proc ::redis::redis_multi_bulk_read {id fd {multiplier 1}} {
     set count [redis_read_line $fd]
     if {$count == -1} return {}
+    set count [expr {$count*$multiplier}]
     set l {}
     set err {}
     for {set i 0} {$i < $count} {incr i} {
@@ -202,11 +205,18 @@ proc ::redis::redis_read_line fd {
 proc ::redis::redis_read_reply {id fd} {
     set type [read $fd 1]
     switch -exact -- $type {
+        ( -
+        , -
         : -
         + {redis_read_line $fd}
         - {return -code error [redis_read_line $fd]}
         $ {redis_bulk_read $fd}
+        > -
+        ~ -
         * {redis_multi_bulk_read $id $fd}
+        % {redis_multi_bulk_read $id $fd 2}
+        _ {redis_read_line $fd; return {}}
+        # {expr {[redis_read_line $fd] eq {t}}}
         default {
             if {$type eq {}} {
                 set ::redis::fd($id) {}
@@ -49,6 +49,18 @@ start_server {tags {"dump"}} {
         set e
     } {*syntax*}
 
+    test {DUMP / RESTORE preserve the TTLs of hash fields} {
+        r del foo
+        r hmset foo a 1 b 2
+        r hexpire foo 100 FIELDS 1 a
+        set encoded [r dump foo]
+        r del foo
+        r restore foo 0 $encoded
+        set ttl [lindex [r httl foo FIELDS 1 a] 0]
+        assert {$ttl >= 90 && $ttl <= 100}
+        list [r httl foo FIELDS 1 b] [r hmget foo a b]
+    } {-1 {1 2}}
+
     test {DUMP of non existing key returns nil} {
         r dump nonexisting_key
     } {}
@@ -199,6 +211,25 @@ start_server {tags {"dump"}} {
         }
     }
 
+    test {MIGRATE preserves the TTLs of hash fields} {
+        set first [srv 0 client]
+        r del key
+        r hmset key a 1 b 2
+        r hexpire key 100 FIELDS 1 a
+        start_server {tags {"repl"}} {
+            set second [srv 0 client]
+            set second_host [srv 0 host]
+            set second_port [srv 0 port]
+
+            set ret [r -1 migrate $second_host $second_port key 9 10000]
+            assert {$ret eq {OK}}
+            assert {[$first exists key] == 0}
+            set ttl [lindex [$second httl key FIELDS 1 a] 0]
+            assert {$ttl >= 90 && $ttl <= 100}
+            assert {[$second httl key FIELDS 1 b] == -1}
+        }
+    }
+
     test {MIGRATE timeout actually works} {
         set first [srv 0 client]
         r set key "Some Value"
@@ -1,7 +1,71 @@
 start_server {tags {"introspection"}} {
     test {CLIENT LIST} {
         r client list
-    } {*addr=*:* fd=* age=* idle=* flags=N db=9 sub=0 psub=0 multi=-1 qbuf=0 qbuf-free=* obl=0 oll=0 omem=0 events=r cmd=client*}
+    } {*addr=*:* fd=* age=* idle=* flags=N db=9 sub=0 psub=0 multi=-1 qbuf=0 qbuf-free=* obl=0 oll=0 omem=0 tot-mem=* events=r cmd=client*}
+
+    test {Idle clients don't hold a query buffer} {
+        set rd [redis_deferring_client]
+        $rd client setname idleclient
+        $rd read
+        set res [r client list]
+        $rd close
+        set res
+    } {*name=idleclient * qbuf=0 qbuf-free=0 *}
+
+    test {INFO reports accepted connection batches} {
+        r config resetstat
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        foreach c $clients {$c ping; $c read; $c close}
+        assert {[s accept_batches] >= 1 && [s accept_batches] <= 10}
+        assert {[s accept_max_batch] >= 1}
+        assert {[s accept_usec_per_conn] >= 0}
+    }
+
+    test {INFO memory breaks down used memory by subsystem} {
+        r flushall
+        set before [s used_memory]
+        r debug populate 10000 infotest
+        set used [s used_memory]
+        assert {[s used_memory_dataset] > 500000}
+        assert {[s used_memory_clients_normal] > 0}
+        assert {[s used_memory_dataset] + [s used_memory_clients_normal] +
+                [s used_memory_clients_slaves] + [s used_memory_repl_backlog] +
+                [s used_memory_aof_buffer] <= $used}
+        r flushall
+        # All the memory of the keys is accounted back when freed.
+        assert {[s used_memory] < $before + 100000}
+    }
+
+    test {MEMORY USAGE reports the memory used by keys} {
+        r del small big hash
+        r set small foo
+        r set big [string repeat x 10000]
+        for {set j 0} {$j < 1000} {incr j} {r hset hash field:$j value:$j}
+        set small [r memory usage small]
+        set big [r memory usage big]
+        assert {$small > 40 && $small < 100}
+        assert {$big > 10000 && $big < 11000}
+        set sampled [r memory usage hash]
+        set exact [r memory usage hash samples 0]
+        assert {$exact > 40000 && $exact < 120000}
+        assert {abs($sampled-$exact) < $exact*0.2}
+        assert_equal {} [r memory usage nokey]
+        assert_error {*syntax*} {r memory usage small samples -1}
+        assert_error {*MEMORY USAGE*} {r memory foo small}
+    }
+
+    test {MEMORY USAGE reports expired keys as missing} {
+        r debug set-active-expire 0
+        r del foo
+        r set foo bar px 1
+        after 10
+        set usage [r memory usage foo]
+        r debug set-active-expire 1
+        set usage
+    } {}
 
     test {MONITOR can log executed commands} {
         set rd [redis_deferring_client]
@@ -56,4 +120,70 @@ start_server {tags {"introspection"}} {
             fail "Client still listed in CLIENT LIST after SETNAME."
         }
     }
+
+    test {HOTKEYS reports the most accessed keys per db and slot} {
+        r hotkeys reset
+        r select 9
+        for {set j 0} {$j < 200} {incr j} {
+            r get hot:a
+            r get cold:$j
+            if {$j % 2} {r get hot:b}
+        }
+        r select 10
+        for {set j 0} {$j < 50} {incr j} {r get hot:c}
+        r select 9
+        set top [r hotkeys count 2]
+        assert_equal {hot:a hot:b} [list [lindex $top 0 0] [lindex $top 1 0]]
+        assert_equal {9 1244} [lrange [lindex $top 0] 1 2]
+        assert {[lindex $top 0 3] > [lindex $top 1 3]}
+        assert_equal {hot:c} [lindex [r hotkeys db 10] 0 0]
+        assert_equal {hot:b} [lindex [r hotkeys slot 13503] 0 0]
+        assert_error {*range*} {r hotkeys slot 16384}
+    }
+
+    test {HOTKEYS forgets the keys of flushed databases} {
+        r flushdb
+        assert_equal {} [r hotkeys db 9]
+        assert_equal {hot:c} [lindex [r hotkeys] 0 0]
+        r hotkeys reset
+        assert_equal {} [r hotkeys]
+    }
+}
+
+set metrics_port [find_available_port [expr {$::port+7}]]
+start_server [list overrides [list metrics-port $metrics_port]] {
+    proc metrics_request {port request} {
+        set fd [socket 127.0.0.1 $port]
+        fconfigure $fd -translation binary
+        puts -nonewline $fd $request
+        flush $fd
+        set reply [read $fd]
+        close $fd
+        return $reply
+    }
+
+    test {Metrics are served over HTTP in the OpenMetrics format} {
+        r set foo bar
+        r get foo
+        set reply [metrics_request $metrics_port \
+            "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n"]
+        assert_match "HTTP/1.1 200 OK\r\n*openmetrics-text*\r\n\r\n*" $reply
+        assert_match "*\nredis_db_keys{db=\"9\"} 1\n*" $reply
+        assert_match "*\nredis_commands_total{cmd=\"get\"} 1\n*" $reply
+        assert_match "*\n# TYPE redis_keyspace_hits counter\n*" $reply
+        assert_match "*\nredis_keyspace_hits_total 1\n*" $reply
+        assert_match "*\n# EOF\n" $reply
+    }
+
+    test {Metrics endpoint replies with errors to other requests} {
+        assert_match "HTTP/1.1 404 *" \
+            [metrics_request $metrics_port "GET /foo HTTP/1.1\r\n\r\n"]
+        assert_match "HTTP/1.1 405 *" \
+            [metrics_request $metrics_port "POST /metrics HTTP/1.1\r\n\r\n"]
+        set reply [metrics_request $metrics_port "HEAD /metrics HTTP/1.0\r\n\r\n"]
+        assert_match "HTTP/1.1 200 OK\r\n*" $reply
+        assert_match "*\r\n\r\n" $reply
+        assert_match "*redis_metrics_scrapes_total 3\n*" \
+            [metrics_request $metrics_port "GET / HTTP/1.0\r\n\r\n"]
+    }
 }
@@ -48,3 +48,44 @@ start_server {tags {"latency-monitor"}} {
         assert {[r latency latest] eq {}}
     }
 }
+
+start_server {tags {"latency-monitor"}} {
+    r config set loop-profiler yes
+    r config set loop-trace-threshold 50
+
+    test {LATENCY LOOP reports the event loop phases} {
+        r debug sleep 0.1
+        r ping
+        set phases {}
+        foreach phase [r latency loop] {
+            lassign $phase name calls usec max hist
+            dict set phases $name $max
+            assert {$calls > 0 && $usec >= $max}
+            assert {[llength $hist] > 0 && [llength $hist] % 2 == 0}
+        }
+        foreach name {iteration before-sleep poll events cron} {
+            assert {[dict exists $phases $name]}
+        }
+        assert {[dict get $phases events] >= 100000}
+        assert {[dict get $phases iteration] >= 100000}
+        assert_match {*loopstat_events:calls=*} [r info loopstats]
+    }
+
+    test {DEBUG LOOPTRACE shows the trace of the latest slow iteration} {
+        set slow {}
+        foreach entry [r debug looptrace] {
+            lassign $entry start name duration
+            if {$name eq {iteration}} {set slow $entry}
+        }
+        assert {[lindex $slow 2] >= 100000}
+        assert {[dict get [lrange $slow 3 end] events] >= 100000}
+        assert_match {*loop_slow_iterations:[1-9]*} [r info loopstats]
+        assert {[llength [r debug looptrace live]] > 0}
+    }
+
+    test {LATENCY LOOP RESET resets the event loop statistics} {
+        r latency loop reset
+        assert {[r debug looptrace] eq {}}
+        assert_match {*loop_slow_iterations:0*} [r info loopstats]
+    }
+}
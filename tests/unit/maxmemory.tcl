@@ -142,3 +142,66 @@ start_server {tags {"maxmemory"}} {
         }
     }
 }
+
+start_server {tags {"maxmemory"}} {
+    test "maxmemory-clients evicts clients with a big query buffer" {
+        r config set maxmemory-clients 500000
+        set rd [redis_deferring_client]
+        $rd write "*2\r\n\$4\r\nECHO\r\n\$1000000\r\n"
+        $rd write [string repeat x 1000]
+        $rd flush
+        wait_for_condition 50 100 {
+            [s evicted_clients] == 1 && [s connected_clients] == 1
+        } else {
+            fail "Client with a big query buffer was not evicted"
+        }
+        catch {$rd close}
+        assert {[s mem_clients] < 500000}
+        r ping
+    } {PONG}
+
+    test "maxmemory-clients evicts clients with a big output buffer" {
+        r config set maxmemory-clients 0
+        r set bigval [string repeat x 100000]
+        set rd [redis_deferring_client]
+        # Don't read the replies, so that they accumulate in the output
+        # buffer once the socket buffers are full.
+        for {set j 0} {$j < 500} {incr j} {
+            $rd get bigval
+        }
+        $rd flush
+        wait_for_condition 50 100 {
+            [s mem_clients] > 5000000
+        } else {
+            fail "Output buffer memory not accounted"
+        }
+        r config set maxmemory-clients 3000000
+        wait_for_condition 50 100 {
+            [s evicted_clients] == 2 && [s connected_clients] == 1
+        } else {
+            fail "Client with a big output buffer was not evicted"
+        }
+        catch {$rd close}
+        r ping
+    } {PONG}
+
+    test "CLIENT NO-EVICT protects clients from maxmemory-clients" {
+        r config set maxmemory-clients 500000
+        set rd [redis_deferring_client]
+        $rd client no-evict on
+        assert_equal OK [$rd read]
+        $rd write "*2\r\n\$4\r\nECHO\r\n\$1000000\r\n"
+        $rd write [string repeat x 1000]
+        $rd flush
+        after 500
+        assert_equal 2 [s connected_clients]
+        assert_equal 2 [s evicted_clients]
+        assert_match {*flags=e*} [r client list]
+        $rd write [string repeat x 999000]
+        $rd write "\r\n"
+        $rd flush
+        assert_equal 1000000 [string length [$rd read]]
+        $rd close
+        r config set maxmemory-clients 0
+    } {OK}
+}
@@ -244,3 +244,39 @@ start_server {tags {"other"}} {
         r save
     } {OK}
 }
+
+start_server {tags {"other"}} {
+    test {Hash tables are shrunk according to hashtable-min-fill} {
+        r flushall
+        r debug populate 1000
+        assert_match {*db9:buckets=1024,*} [r info hashtables]
+        for {set j 0} {$j < 850} {incr j} {r del key:$j}
+        # 150 keys in 1024 buckets is over the default 10% fill.
+        after 500
+        assert_match {*db9:buckets=1024,*} [r info hashtables]
+        r config set hashtable-min-fill 20
+        wait_for_condition 50 100 {
+            [string match {*db9:buckets=256,*rehash_target=0,*} \
+                [r info hashtables]]
+        } else {
+            fail "Hash table not shrunk"
+        }
+        assert_equal 150 [r dbsize]
+        r config set hashtable-min-fill 10
+    }
+
+    test {Hash tables are not expanded when this would breach maxmemory} {
+        r flushall
+        r debug populate 1024
+        assert_match {*db9:buckets=1024,*} [r info hashtables]
+        set denied [s hashtable_expands_denied]
+        r config set maxmemory [expr {[s used_memory]+4096}]
+        r set foo bar
+        assert_match {*db9:buckets=1024,*} [r info hashtables]
+        assert {[s hashtable_expands_denied] > $denied}
+        r config set maxmemory 0
+        r set bar foo
+        assert_match {*db9:buckets=1024,*rehash_target=4096,*} \
+            [r info hashtables]
+    }
+}
@@ -68,6 +68,149 @@ start_server {tags {"protocol"}} {
         assert_error "*unbalanced*" {r read}
     }
 
+    test "Pipelined inline commands terminated by a bare newline" {
+        reconnect
+        r write "SET inlinekey 12\nINCR inlinekey\r\nGET inlinekey\n"
+        r flush
+        list [r read] [r read] [r read]
+    } {OK 13 13}
+
+    test "Pipelined replies spanning the static buffer and the reply list" {
+        reconnect
+        r del biglist
+        r rpush biglist [string repeat x 20000]
+        for {set j 0} {$j < 500} {incr j} {
+            r write "*2\r\n\$4\r\nECHO\r\n\$[string length $j]\r\n$j\r\n"
+            r write "*4\r\n\$6\r\nLRANGE\r\n\$7\r\nbiglist\r\n\$1\r\n0\r\n\$2\r\n-1\r\n"
+        }
+        r flush
+        set err {}
+        for {set j 0} {$j < 500} {incr j} {
+            if {[r read] ne $j} {set err "bad ECHO reply $j"; break}
+            if {[string length [lindex [r read] 0]] != 20000} {
+                set err "bad LRANGE reply $j"; break
+            }
+        }
+        set err
+    } {}
+
+    test "Deferred length replies spanning several reply blocks" {
+        reconnect
+        r flushdb
+        for {set j 0} {$j < 5000} {incr j} {
+            r write "*3\r\n\$3\r\nSET\r\n\$[string length key:$j]\r\nkey:$j\r\n\$1\r\nx\r\n"
+        }
+        r flush
+        for {set j 0} {$j < 5000} {incr j} {r read}
+        # Pipeline a small reply first, so that the deferred length of KEYS
+        # is created after a partially filled reply block.
+        r write "*2\r\n\$4\r\nECHO\r\n\$5\r\nhello\r\n"
+        r write "*2\r\n\$4\r\nKEYS\r\n\$5\r\nkey:*\r\n"
+        r write "*2\r\n\$4\r\nKEYS\r\n\$5\r\nkey:*\r\n"
+        r flush
+        list [r read] [llength [r read]] [llength [r read]]
+    } {hello 5000 5000}
+
+    test "Integer and length replies around the shared header tables" {
+        reconnect
+        r del mylist mystr myint
+        set res {}
+        foreach n {1023 1024 1025} {
+            r del mylist
+            r rpush mylist {*}[lrepeat $n x]
+            lappend res [llength [r lrange mylist 0 -1]]
+            r set mystr [string repeat x $n]
+            lappend res [string length [r get mystr]]
+        }
+        foreach n {1023 1024 -1 -1024 9223372036854775807 -9223372036854775808} {
+            r set myint $n
+            lappend res [r incrby myint 0]
+        }
+        set res
+    } {1023 1023 1024 1024 1025 1025 1023 1024 -1 -1024 9223372036854775807 -9223372036854775808}
+
+    test "HELLO switches the protocol version" {
+        set reply [r hello 3]
+        assert_equal 3 [dict get $reply proto]
+        assert_equal redis [dict get $reply server]
+        assert_match {*resp=3*} [r client list]
+        set reply [r hello 2]
+        dict get $reply proto
+    } {2}
+
+    test "HELLO rejects unsupported protocol versions" {
+        catch {r hello 4} e
+        set e
+    } {NOPROTO*}
+
+    test "HELLO can set the client name" {
+        r hello 2 setname helloclient
+        r client getname
+    } {helloclient}
+
+    foreach resp {2 3} {
+        test "RESP$resp typed replies" {
+            r hello $resp
+            set res {}
+            foreach type {string integer double bignum null array set map true false} {
+                lappend res [r debug protocol $type]
+            }
+            r hello 2
+            set res
+        } {{Hello World} 12345 3.1415926535900001 1234567999999999999999999999999999999 {} {0 1 2} {0 1 2} {0 0 1 1 2 0} 1 0}
+    }
+
+    test "RESP3 replies use the map, set, double and null types" {
+        r del myhash myset myzset
+        r hset myhash f v
+        r sadd myset a
+        r zadd myzset 1.5 a
+        set s [socket [srv 0 host] [srv 0 port]]
+        fconfigure $s -translation binary
+        puts -nonewline $s "HELLO 3\r\nSELECT 9\r\nPING\r\n"
+        flush $s
+        while {[gets $s] ne "+PONG\r"} {}
+        puts -nonewline $s "HGETALL myhash\r\nHGETALL nokey\r\n"
+        puts -nonewline $s "SMEMBERS myset\r\nSMEMBERS nokey\r\n"
+        puts -nonewline $s "ZSCORE myzset a\r\nGET nokey\r\n"
+        flush $s
+        set expected "%1\r\n\$1\r\nf\r\n\$1\r\nv\r\n%0\r\n"
+        append expected "~1\r\n\$1\r\na\r\n~0\r\n,1.5\r\n_\r\n"
+        set reply [read $s [string length $expected]]
+        close $s
+        assert_equal $expected $reply
+    }
+
+    test "RESP3 clients can run commands while subscribed" {
+        set rd [redis_deferring_client]
+        $rd hello 3
+        $rd read
+        $rd subscribe chan
+        assert_equal {subscribe chan 1} [$rd read]
+        $rd set subkey 100
+        assert_equal OK [$rd read]
+        r publish chan hello
+        $rd get subkey
+        set res [list [$rd read] [$rd read]]
+        $rd close
+        set res
+    } {{message chan hello} 100}
+
+    test "RESP3 tracking clients get invalidations in the same connection" {
+        set rd [redis_deferring_client]
+        $rd hello 3
+        $rd read
+        $rd client tracking on
+        $rd read
+        $rd get trackedkey
+        $rd read
+        r set trackedkey 1
+        $rd ping
+        set res [list [$rd read] [$rd read]]
+        $rd close
+        set res
+    } {{invalidate trackedkey} PONG}
+
     set c 0
     foreach seq [list "\x00" "*\x00" "$\x00"] {
         incr c
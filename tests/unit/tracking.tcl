@@ -0,0 +1,114 @@
+start_server {tags {"tracking"}} {
+    # Create a deferred client we'll use to redirect invalidation
+    # messages to.
+    set rd1 [redis_deferring_client]
+    $rd1 client id
+    set redir [$rd1 read]
+    $rd1 subscribe __redis__:invalidate
+    $rd1 read ; # Consume the SUBSCRIBE reply.
+
+    test {Clients are able to enable tracking and redirect it} {
+        r CLIENT TRACKING on REDIRECT $redir
+    } {*OK}
+
+    test {Tracking requires a redirection in RESP2} {
+        catch {r CLIENT TRACKING on} e
+        set e
+    } {*REDIRECT*}
+
+    test {The other connection is able to get invalidations} {
+        r SET a 1
+        r GET a
+        r INCR a
+        r INCR b ; # This key should not be notified, since it wasn't fetched.
+        set keys [lindex [$rd1 read] 2]
+        assert {[llength $keys] == 1}
+        assert {[lindex $keys 0] eq {a}}
+    }
+
+    test {The client is now able to disable tracking} {
+        # Make sure to add a few more keys in the tracking list
+        # so that we can check for leaks, as a side effect.
+        r MGET a b c d e f g
+        r CLIENT TRACKING off
+    }
+
+    test {Clients can enable the BCAST mode with the empty prefix} {
+        r CLIENT TRACKING on BCAST REDIRECT $redir
+    } {*OK*}
+
+    test {The connection gets invalidation messages about all the keys} {
+        r MSET a 1 b 2 c 3
+        set keys [lsort [list [lindex [$rd1 read] 2] \
+                              [lindex [$rd1 read] 2] \
+                              [lindex [$rd1 read] 2]]]
+        assert {$keys eq {a b c}}
+    }
+
+    test {Clients can enable the BCAST mode with prefixes} {
+        r CLIENT TRACKING off
+        r CLIENT TRACKING on BCAST REDIRECT $redir PREFIX a: PREFIX b:
+        r MULTI
+        r INCR a:1
+        r INCR a:2
+        r INCR b:1
+        r INCR b:2
+        r EXEC
+        # Because of the internals, we know we are going to receive
+        # two separated notifications for the two different prefixes.
+        set keys [lsort [list [lindex [$rd1 read] 2] \
+                              [lindex [$rd1 read] 2] \
+                              [lindex [$rd1 read] 2] \
+                              [lindex [$rd1 read] 2]]]
+        assert {$keys eq {a:1 a:2 b:1 b:2}}
+    }
+
+    test {Enabling BCAST mode again replaces the prefixes} {
+        r CLIENT TRACKING on BCAST REDIRECT $redir PREFIX c:
+        r INCR c:1234
+        set keys [lsort [lindex [$rd1 read] 2]]
+        assert {$keys eq {c:1234}}
+    }
+
+    test {PREFIX requires the BCAST mode} {
+        r CLIENT TRACKING off
+        catch {r CLIENT TRACKING on REDIRECT $redir PREFIX a:} e
+        set e
+    } {*BCAST*}
+
+    test {Tracked keys are invalidated when they expire} {
+        r CLIENT TRACKING on REDIRECT $redir
+        r SET exp 1 PX 100
+        r GET exp
+        after 200
+        r GET exp
+        lindex [$rd1 read] 2
+    } {exp}
+
+    test {FLUSHALL sends a null invalidation message} {
+        r SET a 1
+        r GET a
+        r FLUSHALL
+        lindex [$rd1 read] 2
+    } {}
+
+    test {Tracking gets notification on tracking table key eviction} {
+        r CONFIG SET tracking-table-max-keys 1
+        r MSET key1 a key2 b
+        r MGET key1 key2
+        wait_for_condition 50 100 {
+            [s tracking_used_slots] <= 1
+        } else {
+            fail "Tracking table not trimmed"
+        }
+        r CONFIG SET tracking-table-max-keys 1000000
+        assert {[s tracking_evicted_slots] >= 1}
+        lindex [$rd1 read] 2
+    } {}
+
+    test {INFO reports the tracking clients} {
+        s tracking_clients
+    } {1}
+
+    $rd1 close
+}
@@ -515,4 +515,202 @@ start_server {tags {"hash"}} {
             assert {[r object encoding myhash] eq {hashtable}}
         }
     }
+
+    test {Hash ziplist -> hashtable conversion is incremental} {
+        r config set hash-max-ziplist-entries 1000
+        r del myhash
+        set args {}
+        for {set i 0} {$i < 1001} {incr i} {
+            lappend args field:$i value:$i
+        }
+        set conversions [s hash_conversions]
+        r hmset myhash {*}$args
+        assert_encoding hashtable myhash
+        assert_equal [expr {$conversions+1}] [s hash_conversions]
+        assert_equal 1001 [r hlen myhash]
+
+        # Access the fields while most of them are still to be moved.
+        assert_equal value:0 [r hget myhash field:0]
+        assert_equal 1 [r hexists myhash field:1]
+        assert_equal 0 [r hset myhash field:2 newvalue]
+        assert_equal 1 [r hdel myhash field:3]
+        assert_equal 1000 [r hlen myhash]
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal 2000 [llength [r hgetall myhash]]
+        assert_equal newvalue [r hget myhash field:2]
+        assert_equal {} [r hget myhash field:3]
+        for {set i 4} {$i < 1001} {incr i} {
+            assert_equal value:$i [r hget myhash field:$i]
+        }
+        assert_equal 1000 [r hlen myhash]
+    }
+
+    test {HSCAN of a hash being converted returns all the fields} {
+        r del myhash
+        set args {}
+        for {set i 0} {$i < 1001} {incr i} {
+            lappend args field:$i value:$i
+        }
+        r hmset myhash {*}$args
+        set fields {}
+        set cursor 0
+        while 1 {
+            set res [r hscan myhash $cursor]
+            set cursor [lindex $res 0]
+            foreach {f v} [lindex $res 1] {lappend fields $f}
+            if {$cursor == 0} break
+        }
+        r config set hash-max-ziplist-entries 512
+        llength [lsort -unique $fields]
+    } {1001}
+
+    test {HEXPIRE / HTTL / HPERSIST basics} {
+        r del myhash
+        r hmset myhash a 1 b 2 c 3
+        assert_equal {1 1} [r hexpire myhash 100 FIELDS 2 a b]
+        assert_equal {-2} [r hexpire myhash 100 FIELDS 1 nofield]
+        set ttl [r httl myhash FIELDS 3 a c nofield]
+        assert {[lindex $ttl 0] >= 90 && [lindex $ttl 0] <= 100}
+        assert_equal {-1 -2} [lrange $ttl 1 2]
+        set ttl [lindex [r hpttl myhash FIELDS 1 b] 0]
+        assert {$ttl >= 90000 && $ttl <= 100000}
+        assert_equal {1 -1 -2} [r hpersist myhash FIELDS 3 a c nofield]
+        assert_equal {-1} [r httl myhash FIELDS 1 a]
+        assert_equal {-2 -2} [r httl nokey FIELDS 2 a b]
+    }
+
+    test {HEXPIRE argument errors} {
+        r del myhash
+        r hset myhash a 1
+        assert_error {*numfields*} {r hexpire myhash 100 FIELDS 2 a}
+        assert_error {*FIELDS*} {r hexpire myhash 100 NX 1 a}
+        assert_error {*syntax*} {r hexpire myhash 100 FOO FIELDS 1 a}
+        assert_error {*not an integer*} {r hexpire myhash abc FIELDS 1 a}
+        r set foo bar
+        assert_error {WRONGTYPE*} {r hexpire foo 100 FIELDS 1 a}
+    }
+
+    test {HEXPIRE NX / XX / GT / LT options} {
+        r del myhash
+        r hmset myhash a 1 b 2
+        assert_equal {0} [r hexpire myhash 100 XX FIELDS 1 a]
+        assert_equal {1} [r hexpire myhash 100 NX FIELDS 1 a]
+        assert_equal {0} [r hexpire myhash 200 NX FIELDS 1 a]
+        assert_equal {0} [r hexpire myhash 50 GT FIELDS 1 a]
+        assert_equal {1} [r hexpire myhash 200 GT FIELDS 1 a]
+        assert_equal {1} [r hexpire myhash 150 LT FIELDS 1 a]
+        assert_equal {0} [r hexpire myhash 150 GT FIELDS 1 b]
+        assert_equal {1} [r hexpire myhash 150 LT FIELDS 1 b]
+        set ttl [lindex [r httl myhash FIELDS 1 a] 0]
+        assert {$ttl >= 140 && $ttl <= 150}
+    }
+
+    test {HEXPIRE with a time in the past deletes the field} {
+        r del myhash
+        r hmset myhash a 1 b 2
+        assert_equal {2} [r hexpireat myhash 1 FIELDS 1 a]
+        assert_equal {b} [r hkeys myhash]
+        assert_equal {2} [r hpexpire myhash 0 FIELDS 1 b]
+        r exists myhash
+    } {0}
+
+    test {Hash fields are expired lazily on access} {
+        r debug set-active-expire 0
+        r del myhash
+        r hmset myhash a 1 b 2
+        r hpexpire myhash 50 FIELDS 1 a
+        after 100
+        assert_equal {b} [r hkeys myhash]
+        r hpexpire myhash 50 FIELDS 1 b
+        after 100
+        r debug set-active-expire 1
+        r exists myhash
+    } {0}
+
+    test {Hash fields are expired by the active expire cycle} {
+        r del myhash
+        r hmset myhash a 1 b 2 c 3
+        r hpexpire myhash 50 FIELDS 2 a b
+        set expired [s expired_hash_fields]
+        wait_for_condition 50 100 {
+            [s expired_hash_fields] == $expired + 2
+        } else {
+            fail "Hash fields not expired by the active expire cycle"
+        }
+        r hkeys myhash
+    } {c}
+
+    test {Hash fields TTLs are removed by HDEL and by overwriting the key} {
+        r del myhash
+        r hmset myhash a 1 b 2
+        r hexpire myhash 100 FIELDS 2 a b
+        r hdel myhash a
+        r hset myhash a 1
+        assert_equal {-1} [r httl myhash FIELDS 1 a]
+        r set myhash foo
+        r del myhash
+        r hmset myhash a 1 b 2
+        r httl myhash FIELDS 2 a b
+    } {-1 -1}
+
+    test {Hash fields TTLs survive RENAME, MOVE and DEBUG RELOAD} {
+        r del myhash newhash
+        r hmset myhash a 1 b 2
+        r hexpire myhash 100 FIELDS 1 a
+        r rename myhash newhash
+        set ttl [lindex [r httl newhash FIELDS 1 a] 0]
+        assert {$ttl >= 90 && $ttl <= 100}
+        r debug reload
+        set ttl [lindex [r httl newhash FIELDS 1 a] 0]
+        assert {$ttl >= 90 && $ttl <= 100}
+        assert_equal {-1} [r httl newhash FIELDS 1 b]
+        r select 10
+        r del newhash
+        r select 9
+        r move newhash 10
+        r select 10
+        set ttl [r httl newhash FIELDS 1 a]
+        r del newhash
+        r select 9
+        assert {[lindex $ttl 0] >= 90 && [lindex $ttl 0] <= 100}
+    }
+
+    test {RDB version is only bumped when hash fields have a TTL} {
+        proc rdb_signature {} {
+            set dir [lindex [r config get dir] 1]
+            set fp [open [file join $dir [lindex [r config get dbfilename] 1]]]
+            fconfigure $fp -translation binary
+            set signature [read $fp 9]
+            close $fp
+            return $signature
+        }
+        r flushall
+        r hmset myhash a 1 b 2
+        r save
+        set before [rdb_signature]
+        r hexpire myhash 100 FIELDS 1 a
+        r save
+        list $before [rdb_signature]
+    } {REDIS0007 REDIS0008}
+
+    test {HEXPIRE is propagated as HPEXPIREAT and HDEL} {
+        r del myhash
+        r hmset myhash a 1 b 2
+        set repl [attach_to_replication_stream]
+        r hexpire myhash 100 FIELDS 1 a
+        r hexpire myhash 0 FIELDS 1 b
+        r hpexpire myhash 1 FIELDS 1 a
+        after 50
+        r hkeys myhash
+        assert_replication_stream $repl {
+            {select *}
+            {hpexpireat myhash * FIELDS 1 a}
+            {hdel myhash b}
+            {hpexpireat myhash * FIELDS 1 a}
+            {hdel myhash a}
+        }
+        close_replication_stream $repl
+    }
 }
@@ -66,6 +66,104 @@ start_server {
         r lpop non-existing-list
     } {}
 
+    test {R/LPOP with the optional count argument} {
+        r del mylist
+        r rpush mylist a b c d e f g
+        assert_equal {a b} [r lpop mylist 2]
+        assert_equal {g f e} [r rpop mylist 3]
+        assert_equal {} [r lpop mylist 0]
+        assert_equal {c d} [r lpop mylist 10]
+        assert_equal 0 [r exists mylist]
+        assert_error "*out of range*" {r lpop mylist -1}
+        assert_error "*wrong number*" {r lpop mylist 1 2}
+    }
+
+    test {R/LPOP with count draining several quicklist nodes} {
+        r del mylist
+        r config set list-max-ziplist-size 4
+        for {set i 0} {$i < 100} {incr i} { r rpush mylist $i }
+        set head [r lpop mylist 30]
+        set tail [r rpop mylist 30]
+        r config set list-max-ziplist-size -2
+        assert_equal 0 [lindex $head 0]
+        assert_equal 29 [lindex $head end]
+        assert_equal 99 [lindex $tail 0]
+        assert_equal 70 [lindex $tail end]
+        assert_equal 40 [r llen mylist]
+        assert_equal 30 [r lindex mylist 0]
+        assert_equal 69 [r lindex mylist -1]
+    }
+
+    test {R/LPOP with count against non existing key} {
+        r del mylist
+        assert_equal {} [r lpop mylist 3]
+        assert_equal {} [r rpop mylist 3]
+    }
+
+    test {LMPOP pops from the first non empty list} {
+        r del l1 l2 l3
+        r rpush l2 a b c
+        r rpush l3 x
+        assert_equal {l2 a} [r lmpop 3 l1 l2 l3 left]
+        assert_equal {l2 {c b}} [r lmpop 3 l1 l2 l3 right count 5]
+        assert_equal {l3 x} [r lmpop 3 l1 l2 l3 left count 2]
+        assert_equal {} [r lmpop 3 l1 l2 l3 left]
+    }
+
+    test {LMPOP errors} {
+        r del l1
+        assert_error "*numkeys*" {r lmpop 0 l1 left}
+        assert_error "*numkeys*" {r lmpop 3 l1 left}
+        assert_error "*syntax*" {r lmpop 1 l1 middle}
+        assert_error "*syntax*" {r lmpop 1 l1 left count}
+        assert_error "*count*" {r lmpop 1 l1 left count 0}
+        r set l1 foo
+        assert_error WRONGTYPE* {r lmpop 1 l1 left}
+    }
+
+    test {LMPOP is propagated as LPOP/RPOP with the popped count} {
+        r del l1
+        r rpush l1 a b c
+        set repl [attach_to_replication_stream]
+        r lmpop 1 l1 right count 10
+        assert_replication_stream $repl {
+            {select *}
+            {rpop l1 3}
+        }
+        close_replication_stream $repl
+    }
+
+    test {LPOS basic usage} {
+        r del mylist
+        r rpush mylist a b c 1 2 3 c c
+        assert_equal 2 [r lpos mylist c]
+        assert_equal 3 [r lpos mylist 1]
+        assert_equal {} [r lpos mylist x]
+        assert_equal {} [r lpos nokey c]
+        assert_equal {} [r lpos nokey c count 0]
+    }
+
+    test {LPOS RANK, COUNT and MAXLEN options} {
+        assert_equal 6 [r lpos mylist c rank 2]
+        assert_equal 7 [r lpos mylist c rank -1]
+        assert_equal 6 [r lpos mylist c rank -2]
+        assert_equal {} [r lpos mylist c rank 4]
+        assert_equal {2 6 7} [r lpos mylist c count 0]
+        assert_equal {2 6} [r lpos mylist c count 2]
+        assert_equal {6 7} [r lpos mylist c rank 2 count 0]
+        assert_equal {7 6 2} [r lpos mylist c rank -1 count 0]
+        assert_equal {2} [r lpos mylist c count 0 maxlen 6]
+        assert_equal {} [r lpos mylist c maxlen 2]
+        assert_equal {7} [r lpos mylist c rank -1 count 0 maxlen 1]
+    }
+
+    test {LPOS errors} {
+        assert_error "*RANK can't be zero*" {r lpos mylist c rank 0}
+        assert_error "*COUNT can't be negative*" {r lpos mylist c count -1}
+        assert_error "*MAXLEN can't be negative*" {r lpos mylist c maxlen -1}
+        assert_error "*syntax*" {r lpos mylist c foo}
+    }
+
     test {Variadic RPUSH/LPUSH} {
         r del mylist
         assert_equal 4 [r lpush mylist a b c d]
@@ -574,6 +672,78 @@ start_server {
         }
     }
 
+    test {LINDEX and LSET on a long list while pushing and popping} {
+        # Enough small nodes for positional lookups to use the node index.
+        r del mylist
+        set model {}
+        for {set i 0} {$i < 2000} {incr i} {
+            r rpush mylist $i
+            lappend model $i
+        }
+        for {set j 0} {$j < 1000} {incr j} {
+            set v v$j
+            switch [randomInt 6] {
+                0 {r lpush mylist $v; set model [linsert $model 0 $v]}
+                1 {r rpush mylist $v; lappend model $v}
+                2 {r lpop mylist; set model [lrange $model 1 end]}
+                3 {r rpop mylist; set model [lrange $model 0 end-1]}
+                4 {
+                    set pos [randomInt [llength $model]]
+                    r lset mylist $pos $v
+                    lset model $pos $v
+                }
+                5 {
+                    set pos [randomInt [llength $model]]
+                    set pivot [lindex $model $pos]
+                    if {[lsearch -exact $model $pivot] == $pos} {
+                        r linsert mylist after $pivot $v
+                        set model [linsert $model [expr {$pos+1}] $v]
+                    }
+                }
+            }
+            set pos [randomInt [llength $model]]
+            assert_equal [lindex $model $pos] [r lindex mylist $pos]
+            assert_equal [lindex $model end-$pos] [r lindex mylist [expr {-$pos-1}]]
+        }
+        assert_equal $model [r lrange mylist 0 -1]
+    }
+
+    test {Reading a compressed list with the decompressed nodes cache} {
+        r del mylist
+        r config set list-max-ziplist-size 16
+        r config set list-compress-depth 1
+        for {set i 0} {$i < 500} {incr i} {
+            r rpush mylist "compressible-list-element-$i"
+        }
+        set all [r lrange mylist 0 -1]
+        r config set list-compress-cache-bytes 4kb
+        r debug list-compress-stats reset
+        for {set j 0} {$j < 3} {incr j} {
+            assert_equal [lrange $all 100 200] [r lrange mylist 100 200]
+        }
+        set stats [r debug list-compress-stats]
+        assert_match {*cache_hits:[1-9]*} $stats
+        assert_match {*ql_cached_nodes:[1-9]*} [r debug object mylist]
+        regexp {ql_compress_ratio:([0-9.]+)} [r debug object mylist] - ratio
+        assert {$ratio > 1}
+
+        # Sequential scans larger than the budget must keep it.
+        assert_equal $all [r lrange mylist 0 -1]
+        assert_equal [lrange $all 450 499] [r lrange mylist -50 -1]
+
+        # Changing the cached nodes and reloading keeps the right content.
+        r lrem mylist 0 compressible-list-element-150
+        r linsert mylist before compressible-list-element-160 new
+        set all [lreplace $all 150 150]
+        set all [linsert $all 159 new]
+        assert_equal $all [r lrange mylist 0 -1]
+        r debug reload
+        assert_equal $all [r lrange mylist 0 -1]
+        r config set list-compress-cache-bytes 0
+        r config set list-compress-depth 0
+        r config set list-max-ziplist-size -2
+    }
+
     test {LLEN against non-list value error} {
         r del mylist
         r set mylist foobar
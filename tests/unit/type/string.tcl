@@ -419,4 +419,157 @@ start_server {tags {"string"}} {
         r set foo bar
         r getrange foo 0 4294967297
     } {bar}
+
+    test {Big values are replied correctly while modified in a pipeline} {
+        set big [string repeat abcd 100000]
+        r set bigval $big
+        r write "*2\r\n\$3\r\nGET\r\n\$6\r\nbigval\r\n"
+        r write "*3\r\n\$6\r\nAPPEND\r\n\$6\r\nbigval\r\n\$1\r\nx\r\n"
+        r write "*2\r\n\$3\r\nGET\r\n\$6\r\nbigval\r\n"
+        r flush
+        assert_equal $big [r read]
+        assert_equal 400001 [r read]
+        assert_equal ${big}x [r read]
+    }
+
+    test {APPEND past string-chunk-threshold switches to chunked encoding} {
+        r config set string-chunk-threshold 100000
+        r del big
+        set chunk [string repeat abcdefghij 10000]
+        for {set j 0} {$j < 5} {incr j} {r append big $chunk}
+        assert_encoding chunked big
+        assert_equal 500000 [r strlen big]
+        assert_equal [string repeat $chunk 5] [r get big]
+        # Ranges across the 64KB chunk boundaries.
+        assert_equal [string range [string repeat $chunk 5] 65500 131100] \
+            [r getrange big 65500 131100]
+        assert_equal [string range $chunk end-9 end] [r getrange big -10 -1]
+    }
+
+    test {SETRANGE and SETBIT on chunked strings} {
+        r config set string-chunk-threshold 100000
+        r del big
+        assert_equal 200003 [r setrange big 200000 xyz]
+        assert_encoding chunked big
+        assert_equal "\x00\x00xyz" [r getrange big 199998 200002]
+        r setrange big 65530 0123456789
+        assert_equal 0123456789 [r getrange big 65530 65539]
+        assert_equal 0 [r setbit big 1600000 1]
+        assert_equal 1 [r getbit big 1600000]
+        assert_equal 200003 [r strlen big]
+        r bitfield big set u16 [expr {65520*8-4}] 4660
+        assert_equal 4660 [r bitfield big get u16 [expr {65520*8-4}]]
+        assert_encoding chunked big
+    }
+
+    test {Chunked strings survive DEBUG RELOAD and are flattened on demand} {
+        r config set string-chunk-threshold 100000
+        r del big
+        r setrange big 150000 hello
+        r append big world
+        set digest [r debug digest]
+        set value [r get big]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal $value [r get big]
+        # The value is loaded back as a plain string, and is chunked again
+        # as soon as it grows.
+        assert_encoding raw big
+        r append big !
+        assert_encoding chunked big
+        # Commands not aware of the chunked encoding flatten the string.
+        assert_equal 46 [r bitcount big]
+        assert_encoding raw big
+        assert_equal $value! [r get big]
+        r config set string-chunk-threshold 1mb
+    }
+
+    test {Short values are interned when string-intern-max-entries is set} {
+        r config set string-intern-max-entries 2
+        r flushdb
+        set hits [s intern_hits]
+        r set a active
+        r set b active
+        r set c pending
+        assert_equal 3 [r object refcount a]
+        assert_equal 2 [r object refcount c]
+        assert_equal [expr {$hits+1}] [s intern_hits]
+        # The table is full: other values are not interned.
+        r set d done
+        assert_equal 1 [r object refcount d]
+        # Values no longer used are released from the table.
+        r del a b c
+        wait_for_condition 50 100 {
+            [s interned_values] == 0
+        } else {
+            fail "Unused interned values not released"
+        }
+        r config set string-intern-max-entries 0
+    }
+
+    test {Values longer than the EMBSTR limit are never interned} {
+        assert_error {*} {r config set string-intern-max-len 1000}
+        r config set string-intern-max-entries 100
+        r config set string-intern-max-len 44
+        set value [string repeat x 300]
+        r set k $value
+        r set k2 $value
+        assert_equal 300 [r strlen k]
+        assert_equal $value [r get k]
+        assert_encoding raw k
+        assert_equal 1 [r object refcount k]
+        set value [string repeat y 44]
+        r set k $value
+        r set k2 $value
+        assert_equal $value [r get k2]
+        assert_equal 3 [r object refcount k]
+        r config set string-intern-max-len 32
+        r config set string-intern-max-entries 0
+    }
+
+    test {Idle small values are packed and unpacked on access} {
+        r config set pack-values-idle 1
+        r flushall
+        r set int 12345
+        r set neg -7
+        r set str abc
+        r set long "not small"
+        r setrange raw 0 xy
+        wait_for_condition 50 100 {
+            [s packed_values] == 4
+        } else {
+            fail "Small values not packed"
+        }
+        assert_match {* packed:1*} [r debug object int]
+        assert {![string match {* packed:1*} [r debug object long]]}
+        # Packing retains the LRU clock.
+        assert {[r object idletime str] >= 1}
+        r config set pack-values-idle 0
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r flushall
+        r config set pack-values-idle 1
+        r set int 12345
+        r set neg -7
+        r set str abc
+        r set long "not small"
+        r setrange raw 0 xy
+        wait_for_condition 50 100 {
+            [s packed_values] == 4
+        } else {
+            fail "Small values not packed"
+        }
+        assert_equal $digest [r debug digest]
+        # Stop packing, so that the values unpacked by OBJECT (that doesn't
+        # alter the access time) are not packed again.
+        r config set pack-values-idle 0
+        assert_equal 12346 [r incr int]
+        assert_encoding int neg
+        assert_equal -7 [r get neg]
+        assert_equal abc [r get str]
+        assert_equal raw [r object encoding raw]
+        assert_equal 0 [s packed_values]
+        r config set pack-values-idle 10
+    }
 }